@@ -0,0 +1,88 @@
+#include "slinky/base/arena.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+
+namespace slinky {
+
+namespace {
+
+// Avoid making many tiny blocks when the arena starts out empty.
+constexpr std::size_t min_block_size = 4096;
+
+}  // namespace
+
+arena::~arena() { release_blocks(0); }
+
+void arena::add_block(std::size_t size) {
+  char* begin = static_cast<char*>(malloc(size));
+  assert(begin);
+  ++system_allocations_;
+  blocks_.push_back({begin, size, 0});
+}
+
+void arena::release_blocks(std::size_t begin) {
+  for (std::size_t i = begin; i < blocks_.size(); ++i) {
+    assert(blocks_[i].used == 0);
+    ::free(blocks_[i].begin);
+  }
+  blocks_.resize(std::min(begin, blocks_.size()));
+}
+
+void* arena::allocate_slow(std::size_t size) {
+  // The current block is full, move to the next block, making a new one if the next block is too small.
+  std::size_t next = blocks_.empty() ? 0 : current_ + 1;
+  if (next >= blocks_.size() || blocks_[next].size < size) {
+    std::size_t new_size = std::max({size, capacity(), min_block_size});
+    release_blocks(next);
+    add_block(new_size);
+  }
+  current_ = next;
+  block& b = blocks_[current_];
+  assert(b.used == 0);
+  b.used = size;
+  live_ += size;
+  high_water_ = std::max(high_water_, live_);
+  return b.begin;
+}
+
+void arena::free(void* allocation) {
+  assert(current_ < blocks_.size());
+  block& b = blocks_[current_];
+  char* p = static_cast<char*>(allocation);
+  assert(b.begin <= p && p < b.begin + b.used);
+  std::size_t offset = p - b.begin;
+  live_ -= b.used - offset;
+  b.used = offset;
+  while (current_ > 0 && blocks_[current_].used == 0) {
+    --current_;
+  }
+
+  if (live_ == 0 && blocks_.size() > 1) {
+    // Merge the blocks, so next time we don't need to move between blocks.
+    release_blocks(0);
+    add_block(high_water_);
+    current_ = 0;
+  }
+}
+
+void arena::reserve(std::size_t size) {
+  size = (size + alignment - 1) & ~(alignment - 1);
+  if (live_ != 0 || size <= capacity()) return;
+
+  release_blocks(0);
+  add_block(size);
+  current_ = 0;
+}
+
+std::size_t arena::capacity() const {
+  std::size_t result = 0;
+  for (const block& b : blocks_) {
+    result += b.size;
+  }
+  return result;
+}
+
+}  // namespace slinky
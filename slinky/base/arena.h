@@ -0,0 +1,78 @@
+#ifndef SLINKY_BASE_ARENA_H
+#define SLINKY_BASE_ARENA_H
+
+#include <cstddef>
+#include <vector>
+
+namespace slinky {
+
+// A stack allocator: allocations must be freed in the reverse order they were allocated. Memory is obtained from the
+// system allocator in blocks, which are kept when the allocations in them are freed. When the arena becomes empty, the
+// blocks are merged into one block big enough for the high-water mark seen so far, so repeating the same sequence of
+// allocations calls the system allocator only the first time. This is not thread safe.
+class arena {
+  struct block {
+    char* begin;
+    std::size_t size;
+    std::size_t used;
+  };
+  // Blocks after `current_` are empty.
+  std::vector<block> blocks_;
+  std::size_t current_ = 0;
+
+  // The number of bytes currently allocated, and the most that have been allocated at once.
+  std::size_t live_ = 0;
+  std::size_t high_water_ = 0;
+
+  // The number of calls made to the system allocator.
+  std::size_t system_allocations_ = 0;
+
+  void add_block(std::size_t size);
+  void release_blocks(std::size_t begin);
+  void* allocate_slow(std::size_t size);
+
+public:
+  // All allocations are aligned to this, and use a multiple of this many bytes.
+  static constexpr std::size_t alignment = alignof(std::max_align_t);
+
+  arena() = default;
+  ~arena();
+
+  arena(const arena&) = delete;
+  arena& operator=(const arena&) = delete;
+
+  void* allocate(std::size_t size) {
+    size = (size + alignment - 1) & ~(alignment - 1);
+    if (current_ < blocks_.size()) {
+      block& b = blocks_[current_];
+      if (size <= b.size - b.used) {
+        void* result = b.begin + b.used;
+        b.used += size;
+        live_ += size;
+        high_water_ = live_ > high_water_ ? live_ : high_water_;
+        return result;
+      }
+    }
+    return allocate_slow(size);
+  }
+
+  // `allocation` must be the most recent allocation that has not been freed.
+  void free(void* allocation);
+
+  // Make sure the arena can satisfy `size` bytes of allocations without calling the system allocator. This can only
+  // take effect when the arena is empty.
+  void reserve(std::size_t size);
+
+  std::size_t live() const { return live_; }
+  // The most bytes allocated at once over the lifetime of the arena. This is never reset, so the merged block is big
+  // enough for any sequence of allocations seen so far.
+  std::size_t high_water() const { return high_water_; }
+  std::size_t system_allocations() const { return system_allocations_; }
+
+  // The total size of the blocks owned by the arena.
+  std::size_t capacity() const;
+};
+
+}  // namespace slinky
+
+#endif  // SLINKY_BASE_ARENA_H
@@ -1,65 +1,191 @@
 #include "slinky/base/chrome_trace.h"
 
+#include <algorithm>
 #include <atomic>
+#include <charconv>
 #include <chrono>
 #include <cstdint>
+#include <cstdio>
+#include <ctime>
 #include <fstream>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 namespace slinky {
 
 namespace {
 
+std::int64_t clock_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
 // Unfortunately, std::clock returns the CPU time for the whole process, not the current thread.
-std::clock_t clock_per_thread_us() {
+std::int64_t clock_per_thread_ns() {
 #ifdef _MSC_VER
   // CLOCK_THREAD_CPUTIME_ID not defined under MSVC
   return 0;
 #else
   timespec t;
   clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
-  return t.tv_sec * 1000000 + t.tv_nsec / 1000;
+  return static_cast<std::int64_t>(t.tv_sec) * 1000000000 + t.tv_nsec;
 #endif
 }
 
 const char* message_format =
-    "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"pid\":0,\"tid\":%d,\"ts\":%ld,\"tts\":%ld}";
+    "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"pid\":0,\"tid\":%d,\"ts\":%lld,\"tts\":%lld}";
 
 }  // namespace
 
-chrome_trace::chrome_trace(std::ostream& os) : os_(os) {
+struct chrome_trace::event {
+  const char* name;
+  std::int64_t ts;
+  std::int64_t cpu_ts;
+  char type;
+};
+
+struct chrome_trace::thread_buffer {
+  int tid;
+  std::unique_ptr<event[]> events;
+  // Only the thread that owns this buffer writes `size`. Other threads may read it to flush the events written so far.
+  std::atomic<std::size_t> size = 0;
+  // Guards `flushed`, and resetting `size` to 0.
+  std::mutex mtx;
+  // The events before this index have already been written to the stream.
+  std::size_t flushed = 0;
+  // Copies of the names of the events. Only the thread that owns this buffer uses this map.
+  std::unordered_map<std::string_view, std::unique_ptr<char[]>> names;
+
+  const char* intern(const char* name);
+};
+
+// Returns this thread's copy of `name`. The copies are never moved or removed, so other threads can read the names of
+// the events written so far while this thread adds names.
+const char* chrome_trace::thread_buffer::intern(const char* name) {
+  std::string_view key(name);
+  auto i = names.find(key);
+  if (i != names.end()) return i->second.get();
+
+  std::unique_ptr<char[]> copy(new char[key.size() + 1]);
+  std::copy_n(name, key.size() + 1, copy.get());
+  const char* result = copy.get();
+  names.emplace(std::string_view(result, key.size()), std::move(copy));
+  return result;
+}
+
+chrome_trace::chrome_trace(std::ostream& os, std::size_t capacity)
+    : os_(os), capacity_(std::max<std::size_t>(capacity, 1)) {
   char buffer[1024];
-  int size = snprintf(buffer, sizeof(buffer), message_format, "[", "chrome_trace", "slinky", 'B', 0, 0, 0);
+  int size = snprintf(buffer, sizeof(buffer), message_format, "[", "chrome_trace", "slinky", 'B', 0, 0ll, 0ll);
   os_.write(buffer, size);
-  size = snprintf(buffer, sizeof(buffer), message_format, ",\n", "chrome_trace", "slinky", 'E', 0, 0, 0);
+  size = snprintf(buffer, sizeof(buffer), message_format, ",\n", "chrome_trace", "slinky", 'E', 0, 0ll, 0ll);
   os_.write(buffer, size);
-  t0_ = std::chrono::high_resolution_clock::now();
-  cpu_t0_ = clock_per_thread_us();
+  t0_ = clock_ns();
+  cpu_t0_ = clock_per_thread_ns();
+}
+chrome_trace::~chrome_trace() {
+  flush();
+  os_ << "]\n";
 }
-chrome_trace::~chrome_trace() { os_ << "]\n"; }
 
-void chrome_trace::write_event(const char* name, const char* cat, char type) {
-  auto t = std::chrono::high_resolution_clock::now();
-  std::clock_t cpu_t = clock_per_thread_us();
-  auto ts = std::chrono::duration_cast<std::chrono::microseconds>(t - t0_).count();
-  std::clock_t cpu_ts = cpu_t - cpu_t0_;
+chrome_trace::thread_buffer& chrome_trace::buffer() {
+  if (thread_buffer* b = cached_buffer_.get()) return *b;
 
   // std::thread ids are super long, use our own integer id instead.
   static std::atomic<int> next_thread_id = 0;
   thread_local int tid = next_thread_id++;
 
-  char buffer[1024];
-  // It would be an error to put a comma here as the first item in the output, but we put a dummy {} object at the
-  // beginning of the array.
-  int size = snprintf(buffer, sizeof(buffer), message_format, ",\n", name, cat, type, tid, ts, cpu_ts);
+  // This thread has not written events to this trace before (or it has written events to other traces since then).
+  std::unique_lock l(mtx_);
+  thread_buffer* b = nullptr;
+  for (const std::unique_ptr<thread_buffer>& i : buffers_) {
+    if (i->tid == tid) {
+      b = i.get();
+      break;
+    }
+  }
+  if (!b) {
+    buffers_.push_back(std::make_unique<thread_buffer>());
+    b = buffers_.back().get();
+    b->tid = tid;
+    b->events = std::make_unique<event[]>(capacity_);
+  }
+  cached_buffer_.set(b);
+  return *b;
+}
+
+void chrome_trace::write_events(thread_buffer& b, std::size_t begin, std::size_t end) {
+  if (begin == end) return;
+
+  // This is equivalent to snprintf with `message_format`, but much faster.
+  auto append_int = [](std::string& s, std::int64_t value) {
+    char buffer[32];
+    s.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+  };
+  std::string text;
+  text.reserve((end - begin) * 128);
+  for (std::size_t i = begin; i < end; ++i) {
+    const event& e = b.events[i];
+    // It would be an error to put a comma here as the first item in the output, but we put a dummy {} object at the
+    // beginning of the array.
+    text += ",\n{\"name\":\"";
+    text += e.name;
+    text += "\",\"cat\":\"slinky\",\"ph\":\"";
+    text += e.type;
+    text += "\",\"pid\":0,\"tid\":";
+    append_int(text, b.tid);
+    text += ",\"ts\":";
+    append_int(text, e.ts / 1000);
+    text += ",\"tts\":";
+    append_int(text, e.cpu_ts / 1000);
+    text += '}';
+  }
 
-  // Flush our buffer.
   std::unique_lock l(mtx_);
-  os_.write(buffer, size);
+  os_.write(text.data(), text.size());
 }
 
-void chrome_trace::begin(const char* name) { write_event(name, "slinky", 'B'); }
-void chrome_trace::end(const char* name) { write_event(name, "slinky", 'E'); }
+const char* chrome_trace::write_event(const char* name, char type) {
+  const std::int64_t ts = clock_ns() - t0_;
+  const std::int64_t cpu_ts = clock_per_thread_ns() - cpu_t0_;
+
+  thread_buffer& b = buffer();
+  name = b.intern(name);
+  std::size_t size = b.size.load(std::memory_order_relaxed);
+  if (size == capacity_) {
+    // Our buffer is full, write it out and start over.
+    std::unique_lock l(b.mtx);
+    write_events(b, b.flushed, size);
+    b.flushed = 0;
+    b.size.store(0, std::memory_order_relaxed);
+    size = 0;
+  }
+  b.events[size] = {name, ts, cpu_ts, type};
+  b.size.store(size + 1, std::memory_order_release);
+  return name;
+}
+
+const char* chrome_trace::begin(const char* name) { return write_event(name, 'B'); }
+void chrome_trace::end(const char* name) { write_event(name, 'E'); }
+
+void chrome_trace::flush() {
+  std::vector<thread_buffer*> buffers;
+  {
+    std::unique_lock l(mtx_);
+    for (const std::unique_ptr<thread_buffer>& i : buffers_) {
+      buffers.push_back(i.get());
+    }
+  }
+  for (thread_buffer* b : buffers) {
+    std::unique_lock l(b->mtx);
+    const std::size_t size = b->size.load(std::memory_order_acquire);
+    write_events(*b, b->flushed, size);
+    b->flushed = size;
+  }
+}
 
 chrome_trace* chrome_trace::global() {
   static const char* path = getenv("SLINKY_TRACE");
@@ -1,31 +1,59 @@
 #ifndef SLINKY_BASE_CHROME_TRACE_H
 #define SLINKY_BASE_CHROME_TRACE_H
 
-#include <chrono>
-#include <ctime>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <vector>
+
+#include "slinky/base/thread_cache.h"
 
 namespace slinky {
 
 // A minimal wrapper for generating chrome trace files:
 // https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+//
+// Each thread records its events in its own buffer, without synchronizing with other threads. The events are formatted
+// and written to the stream when a thread's buffer is full, when `flush` is called, or when the trace is destroyed.
+// Each thread keeps a copy of each distinct event name it uses, so the names only need to be valid during the call to
+// `begin` or `end`.
 class chrome_trace {
+public:
+  struct thread_buffer;
+
+private:
+  struct event;
+
   std::ostream& os_;
+  // Guards `os_` and `buffers_`.
   std::mutex mtx_;
-  using timestamp = std::chrono::high_resolution_clock::time_point;
-  timestamp t0_;
-  std::clock_t cpu_t0_;
+  std::vector<std::unique_ptr<thread_buffer>> buffers_;
+  std::size_t capacity_;
+  thread_cache<thread_buffer> cached_buffer_;
+  std::int64_t t0_;
+  std::int64_t cpu_t0_;
 
-  void write_event(const char* name, const char* cat, char type);
+  thread_buffer& buffer();
+  void write_events(thread_buffer& b, std::size_t begin, std::size_t end);
+  const char* write_event(const char* name, char type);
 
 public:
-  chrome_trace(std::ostream& os);
+  // Each thread buffers up to `capacity` events before writing them to `os`.
+  chrome_trace(std::ostream& os, std::size_t capacity = 4096);
   ~chrome_trace();
 
-  void begin(const char* name);
+  chrome_trace(const chrome_trace&) = delete;
+  chrome_trace& operator=(const chrome_trace&) = delete;
+
+  // Returns the trace's copy of `name`, which remains valid until the trace is destroyed.
+  const char* begin(const char* name);
   void end(const char* name);
 
+  // Write the events buffered by all threads so far to the stream.
+  void flush();
+
   // Return the global instance of tracing, or nullptr if none. Trace files will be written to the path in the
   // `SLINKY_TRACE` environment variable.
   static chrome_trace* global();
@@ -37,9 +65,9 @@ class scoped_trace {
   const char* name;
 
 public:
-  scoped_trace(chrome_trace* trace, const char* name) : trace(trace), name(name) {
+  scoped_trace(chrome_trace* trace, const char* name) : trace(trace), name(nullptr) {
     if (trace) {
-      trace->begin(name);
+      this->name = trace->begin(name);
     }
   }
   scoped_trace(const char* name) : scoped_trace(chrome_trace::global(), name) {}
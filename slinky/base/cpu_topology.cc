@@ -0,0 +1,160 @@
+#include "slinky/base/cpu_topology.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace slinky {
+
+std::vector<int> parse_cpu_list(const std::string& list) {
+  std::vector<int> result;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    // Strip whitespace (sysfs files end with a newline).
+    range.erase(std::remove_if(range.begin(), range.end(), [](char c) { return std::isspace(c); }), range.end());
+    if (range.empty()) continue;
+    std::size_t dash = range.find('-');
+    int min = std::stoi(range.substr(0, dash));
+    int max = dash == std::string::npos ? min : std::stoi(range.substr(dash + 1));
+    for (int i = min; i <= max; ++i) {
+      result.push_back(i);
+    }
+  }
+  std::sort(result.begin(), result.end());
+  result.erase(std::unique(result.begin(), result.end()), result.end());
+  return result;
+}
+
+namespace {
+
+bool read_file(const std::string& path, std::string& result) {
+  std::ifstream f(path);
+  if (!f) return false;
+  std::getline(f, result);
+  return true;
+}
+
+}  // namespace
+
+cpu_topology cpu_topology::read(const std::string& sysfs) {
+  cpu_topology result;
+  std::string list;
+  if (read_file(sysfs + "/node/online", list)) {
+    for (int node : parse_cpu_list(list)) {
+      std::string cpus;
+      if (!read_file(sysfs + "/node/node" + std::to_string(node) + "/cpulist", cpus)) continue;
+      std::vector<int> node_cpus = parse_cpu_list(cpus);
+      // Nodes without CPUs (e.g. memory-only nodes) are not useful to us.
+      if (!node_cpus.empty()) result.nodes.push_back(std::move(node_cpus));
+    }
+  }
+  if (result.nodes.empty() && read_file(sysfs + "/cpu/online", list)) {
+    std::vector<int> cpus = parse_cpu_list(list);
+    if (!cpus.empty()) result.nodes.push_back(std::move(cpus));
+  }
+  if (result.nodes.empty()) {
+    result.nodes.emplace_back();
+    for (int i = 0; i < static_cast<int>(std::max(1u, std::thread::hardware_concurrency())); ++i) {
+      result.nodes.back().push_back(i);
+    }
+  }
+  return result;
+}
+
+std::size_t cpu_topology::cpu_count() const {
+  std::size_t result = 0;
+  for (const std::vector<int>& i : nodes) {
+    result += i.size();
+  }
+  return result;
+}
+
+int cpu_topology::node_of(int cpu) const {
+  for (std::size_t i = 0; i < nodes.size(); ++i) {
+    if (std::binary_search(nodes[i].begin(), nodes[i].end(), cpu)) return i;
+  }
+  return -1;
+}
+
+bool pin_current_thread(int cpu) { return set_current_thread_affinity({cpu}); }
+
+std::vector<int> current_thread_affinity() {
+  std::vector<int> result;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) != 0) return result;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &set)) result.push_back(cpu);
+  }
+#endif
+  return result;
+}
+
+bool set_current_thread_affinity(const std::vector<int>& cpus) {
+#ifdef __linux__
+  if (cpus.empty()) return false;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return false;
+    CPU_SET(cpu, &set);
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
+
+namespace {
+
+thread_local int this_numa_node = -1;
+
+}  // namespace
+
+int current_numa_node() { return this_numa_node; }
+void set_current_numa_node(int node) { this_numa_node = node; }
+
+void first_touch(void* base, std::size_t size, int node) {
+  if (size == 0) return;
+#ifdef __linux__
+  const std::uintptr_t page_size = sysconf(_SC_PAGESIZE);
+#else
+  const std::uintptr_t page_size = 4096;
+#endif
+  const std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(base);
+  const std::uintptr_t end = begin + size;
+#if defined(__linux__) && defined(SYS_mbind)
+  if (node >= 0 && node < 64) {
+    // Only set the policy of the pages entirely within the allocation, so we don't move memory we don't own.
+    const std::uintptr_t pages_begin = (begin + page_size - 1) & ~(page_size - 1);
+    const std::uintptr_t pages_end = end & ~(page_size - 1);
+    if (pages_begin < pages_end) {
+      constexpr int mpol_preferred = 1;
+      unsigned long nodemask = 1ul << node;
+      // This fails if the kernel does not support NUMA, in which case first-touch below is all we can do.
+      syscall(SYS_mbind, pages_begin, pages_end - pages_begin, mpol_preferred, &nodemask, sizeof(nodemask) * 8, 0);
+    }
+  }
+#endif
+  // Write one byte of each page, so the pages are faulted in by the calling thread.
+  for (std::uintptr_t i = begin; i < end; i = (i + page_size) & ~(page_size - 1)) {
+    *reinterpret_cast<volatile char*>(i) = 0;
+  }
+}
+
+}  // namespace slinky
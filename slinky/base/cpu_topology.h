@@ -0,0 +1,49 @@
+#ifndef SLINKY_BASE_CPU_TOPOLOGY_H
+#define SLINKY_BASE_CPU_TOPOLOGY_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace slinky {
+
+// Parse a Linux CPU or node list, such as "0-3,8-11", into a sorted list of indices.
+std::vector<int> parse_cpu_list(const std::string& list);
+
+// Describes which CPUs belong to which NUMA node.
+struct cpu_topology {
+  // The CPUs in each NUMA node.
+  std::vector<std::vector<int>> nodes;
+
+  // Read the topology from sysfs. If the NUMA layout is not available, all online CPUs are put in one node. If the
+  // online CPUs are not available either, this returns one node with `std::thread::hardware_concurrency()` CPUs.
+  static cpu_topology read(const std::string& sysfs = "/sys/devices/system");
+
+  std::size_t node_count() const { return nodes.size(); }
+  std::size_t cpu_count() const;
+
+  // Returns the node `cpu` belongs to, or -1 if it is not in this topology.
+  int node_of(int cpu) const;
+};
+
+// Restrict the calling thread to run on `cpu`. Returns false if this is not supported, or failed.
+bool pin_current_thread(int cpu);
+
+// The CPUs the calling thread may run on, or an empty list if this is not supported.
+std::vector<int> current_thread_affinity();
+// Restrict the calling thread to run on `cpus`. Returns false if this is not supported, or failed.
+bool set_current_thread_affinity(const std::vector<int>& cpus);
+
+// The NUMA node of the calling thread. This is only known for threads that have been pinned to a node with
+// `set_current_numa_node`, otherwise this returns -1.
+int current_numa_node();
+void set_current_numa_node(int node);
+
+// Place the pages of [base, base + size) on the NUMA node `node` (if non-negative), and touch them from the calling
+// thread. The memory should not yet have been written to. Placement is a best effort: if the OS does not support it,
+// pages still follow the usual first-touch policy, placing them on the node of the calling thread.
+void first_touch(void* base, std::size_t size, int node = current_numa_node());
+
+}  // namespace slinky
+
+#endif  // SLINKY_BASE_CPU_TOPOLOGY_H
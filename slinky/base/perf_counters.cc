@@ -0,0 +1,117 @@
+#include "slinky/base/perf_counters.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace slinky {
+
+const char* to_string(perf_event e) {
+  switch (e) {
+  case perf_event::cycles: return "cycles";
+  case perf_event::instructions: return "instructions";
+  case perf_event::l1d_misses: return "l1d_misses";
+  case perf_event::llc_misses: return "llc_misses";
+  case perf_event::task_clock_ns: return "task_clock_ns";
+  case perf_event::page_faults: return "page_faults";
+  default: return "<invalid perf_event>";
+  }
+}
+
+perf_counters::perf_counters() {
+  fds_.fill(-1);
+  if (!open(perf_event::cycles)) open(perf_event::task_clock_ns);
+  open(perf_event::instructions);
+  open(perf_event::l1d_misses);
+  if (!open(perf_event::llc_misses)) open(perf_event::page_faults);
+}
+
+perf_counters::~perf_counters() {
+#ifdef __linux__
+  for (int fd : fds_) {
+    if (fd >= 0) close(fd);
+  }
+#endif
+}
+
+bool perf_counters::open(perf_event e) {
+#ifdef __linux__
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  switch (e) {
+  case perf_event::cycles:
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    break;
+  case perf_event::instructions:
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    break;
+  case perf_event::l1d_misses:
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config =
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    break;
+  case perf_event::llc_misses:
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    break;
+  case perf_event::task_clock_ns:
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.config = PERF_COUNT_SW_TASK_CLOCK;
+    break;
+  case perf_event::page_faults:
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+    break;
+  default: return false;
+  }
+  // Reading the group leader reads all of the counters at once.
+  attr.read_format = PERF_FORMAT_GROUP;
+  // Counting kernel events usually requires privileges we don't have.
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  int fd = syscall(SYS_perf_event_open, &attr, /*pid=*/0, /*cpu=*/-1, group_fd_, /*flags=*/0);
+  if (fd < 0) return false;
+  if (group_fd_ < 0) group_fd_ = fd;
+  fds_[static_cast<std::size_t>(e)] = fd;
+  order_[size_++] = e;
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::uint32_t perf_counters::counted() const {
+  std::uint32_t result = 0;
+  for (std::size_t i = 0; i < size_; ++i) {
+    result |= 1u << static_cast<std::size_t>(order_[i]);
+  }
+  return result;
+}
+
+perf_counters::values perf_counters::read() const {
+  values result;
+  result.fill(0);
+#ifdef __linux__
+  if (group_fd_ < 0) return result;
+
+  // The format of reading a group is the number of counters, followed by the value of each counter.
+  std::array<std::uint64_t, event_count + 1> buffer;
+  if (::read(group_fd_, buffer.data(), sizeof(buffer)) < static_cast<ssize_t>(sizeof(std::uint64_t))) return result;
+  for (std::size_t i = 0; i < buffer[0] && i < size_; ++i) {
+    result[static_cast<std::size_t>(order_[i])] = buffer[i + 1];
+  }
+#endif
+  return result;
+}
+
+}  // namespace slinky
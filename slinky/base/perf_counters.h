@@ -0,0 +1,60 @@
+#ifndef SLINKY_BASE_PERF_COUNTERS_H
+#define SLINKY_BASE_PERF_COUNTERS_H
+
+#include <array>
+#include <cstdint>
+
+namespace slinky {
+
+// The events counted by `perf_counters`.
+enum class perf_event {
+  cycles = 0,
+  instructions,
+  l1d_misses,
+  llc_misses,
+  // Software events, counted instead of `cycles` and `llc_misses` respectively when those are not available.
+  task_clock_ns,
+  page_faults,
+
+  count,
+};
+
+const char* to_string(perf_event e);
+
+// Counts events in the calling thread, using `perf_event_open` on Linux. When hardware counters are not available
+// (e.g. in virtual machines), software events are counted instead where possible. On other platforms, or when
+// `perf_event_open` is not permitted, no events are counted.
+class perf_counters {
+public:
+  static constexpr std::size_t event_count = static_cast<std::size_t>(perf_event::count);
+  using values = std::array<std::uint64_t, event_count>;
+
+private:
+  // The file descriptor of the group of counters, or -1 if there are none.
+  int group_fd_ = -1;
+  std::array<int, event_count> fds_;
+  // The events counted, in the order they were added to the group.
+  std::array<perf_event, event_count> order_;
+  std::size_t size_ = 0;
+
+  bool open(perf_event e);
+
+public:
+  // Opens the counters for the calling thread. The counters only count events of the thread that constructed them.
+  perf_counters();
+  ~perf_counters();
+
+  perf_counters(const perf_counters&) = delete;
+  perf_counters& operator=(const perf_counters&) = delete;
+
+  bool counts(perf_event e) const { return fds_[static_cast<std::size_t>(e)] >= 0; }
+  // A bit mask of the events that are counted, where bit `i` indicates `perf_event(i)` is counted.
+  std::uint32_t counted() const;
+
+  // Returns the current values of the counters. Events that are not counted are 0.
+  values read() const;
+};
+
+}  // namespace slinky
+
+#endif  // SLINKY_BASE_PERF_COUNTERS_H
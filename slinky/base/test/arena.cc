@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "slinky/base/arena.h"
+
+namespace slinky {
+
+namespace {
+
+bool is_aligned(void* p) { return reinterpret_cast<std::uintptr_t>(p) % arena::alignment == 0; }
+
+std::size_t round_up(std::size_t size) { return (size + arena::alignment - 1) / arena::alignment * arena::alignment; }
+
+}  // namespace
+
+TEST(arena, stack) {
+  arena a;
+  void* x = a.allocate(10);
+  void* y = a.allocate(100);
+  ASSERT_TRUE(is_aligned(x));
+  ASSERT_TRUE(is_aligned(y));
+  ASSERT_NE(x, y);
+  memset(x, 1, 10);
+  memset(y, 2, 100);
+  ASSERT_EQ(a.system_allocations(), 1);
+
+  a.free(y);
+  // The memory of y should be reused.
+  void* z = a.allocate(50);
+  ASSERT_EQ(z, y);
+  a.free(z);
+  a.free(x);
+  ASSERT_EQ(a.live(), 0);
+  ASSERT_EQ(a.high_water(), round_up(10) + round_up(100));
+}
+
+TEST(arena, grow) {
+  arena a;
+  std::vector<void*> allocations;
+  for (int i = 0; i < 20; ++i) {
+    allocations.push_back(a.allocate(1000 * (i + 1)));
+    memset(allocations.back(), i, 1000 * (i + 1));
+  }
+  ASSERT_GT(a.system_allocations(), 1);
+  for (int i = 19; i >= 0; --i) {
+    a.free(allocations[i]);
+  }
+  ASSERT_EQ(a.live(), 0);
+  ASSERT_GE(a.capacity(), a.high_water());
+
+  // Now that the arena has grown to the high-water mark, repeating the same allocations should not need more memory.
+  std::size_t system_allocations = a.system_allocations();
+  for (int repeat = 0; repeat < 3; ++repeat) {
+    allocations.clear();
+    for (int i = 0; i < 20; ++i) {
+      allocations.push_back(a.allocate(1000 * (i + 1)));
+    }
+    for (int i = 19; i >= 0; --i) {
+      a.free(allocations[i]);
+    }
+  }
+  ASSERT_EQ(a.system_allocations(), system_allocations);
+}
+
+TEST(arena, reserve) {
+  arena a;
+  a.reserve(1000);
+  ASSERT_EQ(a.system_allocations(), 1);
+  void* x = a.allocate(400);
+  void* y = a.allocate(400);
+  // We can't reserve while there are live allocations.
+  a.reserve(2000);
+  a.free(y);
+  a.free(x);
+  ASSERT_EQ(a.system_allocations(), 1);
+  a.reserve(2000);
+  ASSERT_EQ(a.system_allocations(), 2);
+  ASSERT_GE(a.capacity(), 2000);
+  // Reserving less than we have does nothing.
+  a.reserve(10);
+  ASSERT_EQ(a.system_allocations(), 2);
+}
+
+}  // namespace slinky
@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "slinky/base/chrome_trace.h"
+
+namespace slinky {
+
+namespace {
+
+struct event {
+  std::string name;
+  char type;
+  int tid;
+  long long ts;
+};
+
+std::vector<event> parse_events(const std::string& trace) {
+  std::regex event_regex(
+      R"re(\{"name":"([^"]*)","cat":"slinky","ph":"(.)","pid":0,"tid":(\d+),"ts":(-?\d+),"tts":(-?\d+)\})re");
+  std::vector<event> result;
+  for (auto i = std::sregex_iterator(trace.begin(), trace.end(), event_regex); i != std::sregex_iterator(); ++i) {
+    const std::smatch& m = *i;
+    result.push_back({m[1], m[2].str()[0], std::stoi(m[3]), std::stoll(m[4])});
+  }
+  return result;
+}
+
+void write_events(chrome_trace& trace, int n) {
+  for (int i = 0; i < n; ++i) {
+    scoped_trace outer(&trace, "outer");
+    scoped_trace inner(&trace, "inner");
+  }
+}
+
+}  // namespace
+
+TEST(chrome_trace, threads) {
+  const int thread_count = 4;
+  const int n = 1000;
+
+  std::stringstream os;
+  {
+    // Use a small buffer so we write the events while the threads are still running.
+    chrome_trace trace(os, 16);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < thread_count; ++i) {
+      threads.emplace_back([&]() { write_events(trace, n); });
+    }
+    for (std::thread& i : threads) {
+      i.join();
+    }
+  }
+
+  const std::string str = os.str();
+  ASSERT_EQ(str.front(), '[');
+  ASSERT_EQ(str.substr(str.size() - 2), "]\n");
+
+  std::vector<event> events = parse_events(str);
+  // The first two events are the dummy events.
+  ASSERT_EQ(events.size(), thread_count * n * 4 + 2);
+
+  // The events of each thread should be properly nested and in order.
+  std::map<int, std::vector<event>> stacks;
+  std::map<int, long long> last_ts;
+  for (std::size_t i = 2; i < events.size(); ++i) {
+    const event& e = events[i];
+    std::vector<event>& stack = stacks[e.tid];
+    if (e.type == 'B') {
+      stack.push_back(e);
+    } else {
+      ASSERT_EQ(e.type, 'E');
+      ASSERT_FALSE(stack.empty());
+      ASSERT_EQ(stack.back().name, e.name);
+      stack.pop_back();
+    }
+    ASSERT_GE(e.ts, last_ts[e.tid]);
+    last_ts[e.tid] = e.ts;
+  }
+  ASSERT_EQ(stacks.size(), thread_count);
+  for (const auto& i : stacks) {
+    ASSERT_TRUE(i.second.empty());
+  }
+}
+
+TEST(chrome_trace, flush) {
+  std::stringstream os;
+  chrome_trace trace(os);
+  write_events(trace, 10);
+  ASSERT_EQ(parse_events(os.str()).size(), 2);
+
+  trace.flush();
+  ASSERT_EQ(parse_events(os.str()).size(), 42);
+
+  // Flushing again should not write the same events again.
+  trace.flush();
+  ASSERT_EQ(parse_events(os.str()).size(), 42);
+
+  write_events(trace, 10);
+  trace.flush();
+  ASSERT_EQ(parse_events(os.str()).size(), 82);
+}
+
+TEST(chrome_trace, multiple_traces) {
+  std::stringstream os1, os2;
+  {
+    chrome_trace trace1(os1, 4);
+    chrome_trace trace2(os2, 4);
+    for (int i = 0; i < 10; ++i) {
+      trace1.begin("trace1");
+      trace2.begin("trace2");
+      trace1.end("trace1");
+      trace2.end("trace2");
+    }
+  }
+  for (const event& e : parse_events(os1.str())) {
+    ASSERT_NE(e.name, "trace2");
+  }
+  for (const event& e : parse_events(os2.str())) {
+    ASSERT_NE(e.name, "trace1");
+  }
+  ASSERT_EQ(parse_events(os1.str()).size(), 22);
+  ASSERT_EQ(parse_events(os2.str()).size(), 22);
+}
+
+TEST(chrome_trace, temporary_names) {
+  std::stringstream os;
+  {
+    chrome_trace trace(os);
+    for (int i = 0; i < 3; ++i) {
+      std::string name = "event" + std::to_string(i);
+      scoped_trace scope(&trace, name.c_str());
+      // Overwrite the name before the end of the scope, the trace should have its own copy.
+      name.assign(name.size(), 'x');
+    }
+  }
+  std::vector<std::string> names;
+  for (const event& e : parse_events(os.str())) {
+    if (e.name != "chrome_trace") names.push_back(e.name);
+  }
+  ASSERT_EQ(names, std::vector<std::string>({"event0", "event0", "event1", "event1", "event2", "event2"}));
+}
+
+}  // namespace slinky
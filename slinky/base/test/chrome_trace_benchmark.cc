@@ -0,0 +1,35 @@
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <ostream>
+
+#include "slinky/base/chrome_trace.h"
+
+namespace slinky {
+
+// Measures the cost of a pair of `begin` and `end` events, including writing them to a stream that discards them. If
+// the argument is 0, the events are buffered until the benchmark is complete, so this measures the cost of recording
+// the events only.
+void BM_trace_begin_end(benchmark::State& state) {
+  static std::unique_ptr<std::ostream> os;
+  static std::unique_ptr<chrome_trace> trace;
+  if (state.thread_index() == 0) {
+    const bool flush = state.range(0) != 0;
+    os = std::make_unique<std::ostream>(nullptr);
+    trace = flush ? std::make_unique<chrome_trace>(*os) : std::make_unique<chrome_trace>(*os, state.max_iterations * 2);
+  }
+
+  for (auto _ : state) {
+    trace->begin("event");
+    trace->end("event");
+  }
+
+  if (state.thread_index() == 0) {
+    trace = nullptr;
+    os = nullptr;
+  }
+}
+
+BENCHMARK(BM_trace_begin_end)->ArgName("flush")->Arg(0)->Arg(1)->ThreadRange(1, 4)->UseRealTime();
+
+}  // namespace slinky
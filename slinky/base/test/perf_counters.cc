@@ -0,0 +1,44 @@
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "slinky/base/perf_counters.h"
+
+namespace slinky {
+
+TEST(perf_counters, read) {
+  perf_counters counters;
+  for (std::size_t i = 0; i < perf_counters::event_count; ++i) {
+    perf_event e = static_cast<perf_event>(i);
+    ASSERT_EQ(counters.counts(e), (counters.counted() & (1u << i)) != 0) << to_string(e);
+  }
+  // The fallbacks are only used when the hardware events are not available.
+  ASSERT_FALSE(counters.counts(perf_event::cycles) && counters.counts(perf_event::task_clock_ns));
+  ASSERT_FALSE(counters.counts(perf_event::llc_misses) && counters.counts(perf_event::page_faults));
+
+  perf_counters::values before = counters.read();
+  // Touch some new memory.
+  std::vector<std::uint8_t> data(1 << 24);
+  for (std::size_t i = 0; i < data.size(); i += 64) {
+    data[i] = i;
+  }
+  perf_counters::values after = counters.read();
+
+  for (std::size_t i = 0; i < perf_counters::event_count; ++i) {
+    perf_event e = static_cast<perf_event>(i);
+    if (counters.counts(e)) {
+      ASSERT_GE(after[i], before[i]) << to_string(e);
+    } else {
+      ASSERT_EQ(after[i], 0) << to_string(e);
+    }
+  }
+  for (perf_event e : {perf_event::cycles, perf_event::instructions, perf_event::task_clock_ns}) {
+    if (counters.counts(e)) {
+      ASSERT_GT(after[static_cast<std::size_t>(e)], before[static_cast<std::size_t>(e)]) << to_string(e);
+    }
+  }
+}
+
+}  // namespace slinky
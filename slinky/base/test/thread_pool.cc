@@ -2,21 +2,27 @@
 
 #include <algorithm>
 #include <cassert>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <mutex>
 #include <thread>
 
+#include "slinky/base/cpu_topology.h"
 #include "slinky/base/thread_pool_impl.h"
+#include "slinky/base/thread_pool_ws.h"
 
 namespace slinky {
 
 int sum_arithmetic_sequence(int n) { return n * (n - 1) / 2; }
 
-bool test_task_impl_done(int shard_count, int n) {
+bool test_task_impl_done(int shard_count, int n, int grain = 1, int workers_per_shard = 0) {
   std::vector<int> ran(n);
 
-  auto p = thread_pool_impl::task_impl::make(shard_count, n, [&](int i) { ran[i]++; });
+  auto p = thread_pool_impl::task_impl::make(
+      shard_count, n, [&](int i) { ran[i]++; }, std::numeric_limits<int>::max(), 1, grain, workers_per_shard);
   p->work();
-  return std::all_of(ran.begin(), ran.end(), [](int i) { return i == 1; });
+  return p->done() && std::all_of(ran.begin(), ran.end(), [](int i) { return i == 1; });
 }
 
 TEST(task_impl, done) {
@@ -27,8 +33,26 @@ TEST(task_impl, done) {
   }
 }
 
-TEST(parallel_for, sum) {
-  thread_pool_impl t;
+TEST(task_impl, done_chunked) {
+  for (int n = 0; n < 100; ++n) {
+    for (int shard_count = 1; shard_count < 4; ++shard_count) {
+      for (int grain : {1, 3, 16}) {
+        for (int workers_per_shard : {0, 1, 4}) {
+          ASSERT_TRUE(test_task_impl_done(shard_count, n, grain, workers_per_shard));
+        }
+      }
+    }
+  }
+}
+
+template <typename T>
+class parallel_for : public testing::Test {};
+
+using thread_pool_types = testing::Types<thread_pool_impl, thread_pool_ws>;
+TYPED_TEST_SUITE(parallel_for, thread_pool_types);
+
+TYPED_TEST(parallel_for, sum) {
+  TypeParam t;
   for (int n = 0; n < 100; ++n) {
     std::atomic<int> count = 0;
     std::atomic<int> sum = 0;
@@ -41,8 +65,17 @@ TEST(parallel_for, sum) {
   }
 }
 
-TEST(parallel_for, sum_nested) {
-  thread_pool_impl t;
+TYPED_TEST(parallel_for, grain) {
+  TypeParam t;
+  for (int grain : {1, 4, 1000}) {
+    std::vector<std::atomic<int>> ran(1000);
+    t.parallel_for(ran.size(), [&](int i) { ran[i]++; }, std::numeric_limits<int>::max(), grain);
+    ASSERT_TRUE(std::all_of(ran.begin(), ran.end(), [](const std::atomic<int>& i) { return i == 1; }));
+  }
+}
+
+TYPED_TEST(parallel_for, sum_nested) {
+  TypeParam t;
   std::atomic<int> count = 0;
   std::atomic<int> sum = 0;
   t.parallel_for(10, [&](int i) {
@@ -103,4 +136,204 @@ TEST(thread_count, delayed_workers) {
   ASSERT_EQ(t.thread_count(), 2);
 }
 
+TEST(thread_pool_ws, atomic_call) {
+  thread_pool_ws t;
+  int sum = 0;
+  t.parallel_for(1000, [&](int i) { t.atomic_call([&]() { sum += i; }); });
+  ASSERT_EQ(sum, sum_arithmetic_sequence(1000));
+}
+
+TEST(thread_pool_ws, barriers) {
+  thread_pool_ws t;
+  bool barrier0 = false;
+  bool barrier1 = false;
+  bool barrier2 = false;
+
+  std::thread th([&]() {
+    t.atomic_call([&]() { barrier0 = true; });
+    t.wait_for([&]() -> bool { return barrier1; });
+    t.atomic_call([&]() { barrier2 = true; });
+  });
+  t.wait_for([&]() -> bool { return barrier0; });
+  t.atomic_call([&]() { barrier1 = true; });
+  t.wait_for([&]() -> bool { return barrier2; });
+
+  th.join();
+}
+
+TEST(thread_pool_ws, deque) {
+  thread_pool_ws::deque q;
+  std::vector<ref_count<thread_pool_impl::task_impl>> tasks;
+  for (int i = 0; i < 100; ++i) {
+    tasks.push_back(thread_pool_impl::task_impl::make(1, 1, [](std::size_t) {}));
+    q.push(tasks.back());
+  }
+  // The owner takes from the back, thieves steal from the front.
+  ASSERT_EQ(&*q.take(), &*tasks[99]);
+  ASSERT_EQ(&*q.steal(), &*tasks[0]);
+  ASSERT_EQ(&*q.steal(), &*tasks[1]);
+  for (int i = 98; i >= 2; --i) {
+    ASSERT_EQ(&*q.take(), &*tasks[i]);
+  }
+  ASSERT_TRUE(q.empty());
+  ASSERT_EQ(q.take(), nullptr);
+  ASSERT_EQ(q.steal(), nullptr);
+  for (const auto& i : tasks) {
+    ASSERT_EQ(i->ref_count(), 1);
+  }
+}
+
+TEST(thread_pool_ws, steal_concurrent) {
+  thread_pool_ws::deque q;
+  const int n = 10000;
+  std::atomic<int> found = 0;
+  std::atomic<bool> stop = false;
+  std::vector<std::thread> thieves;
+  for (int i = 0; i < 3; ++i) {
+    thieves.emplace_back([&]() {
+      while (!stop) {
+        if (q.steal()) ++found;
+      }
+    });
+  }
+  for (int i = 0; i < n; ++i) {
+    q.push(thread_pool_impl::task_impl::make(1, 1, [](std::size_t) {}));
+    if (i % 3 == 0 && q.take()) ++found;
+  }
+  while (q.take()) {
+    ++found;
+  }
+  stop = true;
+  for (std::thread& i : thieves) {
+    i.join();
+  }
+  while (q.steal()) {
+    ++found;
+  }
+  ASSERT_EQ(found, n);
+}
+
+TEST(cpu_topology, parse_cpu_list) {
+  ASSERT_EQ(parse_cpu_list(""), std::vector<int>());
+  ASSERT_EQ(parse_cpu_list("3\n"), std::vector<int>({3}));
+  ASSERT_EQ(parse_cpu_list("0-3,8-9,5"), std::vector<int>({0, 1, 2, 3, 5, 8, 9}));
+}
+
+TEST(cpu_topology, read) {
+  const std::filesystem::path sysfs = std::filesystem::path(testing::TempDir()) / "slinky_sysfs";
+  std::filesystem::remove_all(sysfs);
+  auto write = [&](const std::string& file, const std::string& contents) {
+    std::filesystem::create_directories((sysfs / file).parent_path());
+    std::ofstream(sysfs / file) << contents << "\n";
+  };
+
+  // No topology information.
+  ASSERT_GE(cpu_topology::read(sysfs.string()).cpu_count(), 1);
+
+  write("cpu/online", "0-5");
+  cpu_topology t = cpu_topology::read(sysfs.string());
+  ASSERT_EQ(t.nodes, std::vector<std::vector<int>>({{0, 1, 2, 3, 4, 5}}));
+
+  // Node 1 has no CPUs, and should be ignored.
+  write("node/online", "0-2");
+  write("node/node0/cpulist", "0-1,4");
+  write("node/node1/cpulist", "");
+  write("node/node2/cpulist", "2-3,5");
+  t = cpu_topology::read(sysfs.string());
+  ASSERT_EQ(t.nodes, std::vector<std::vector<int>>({{0, 1, 4}, {2, 3, 5}}));
+  ASSERT_EQ(t.cpu_count(), 6);
+  ASSERT_EQ(t.node_of(4), 0);
+  ASSERT_EQ(t.node_of(5), 1);
+  ASSERT_EQ(t.node_of(6), -1);
+
+  std::filesystem::remove_all(sysfs);
+}
+
+TEST(cpu_topology, first_touch) {
+  std::vector<char> memory(100000, 1);
+  first_touch(memory.data() + 3, memory.size() - 5, 0);
+  ASSERT_EQ(memory[2], 1);
+  ASSERT_EQ(memory[3], 0);
+  ASSERT_EQ(memory.back(), 1);
+  // One byte of each page should have been touched, and pages are at least 4KB.
+  ASSERT_LE(std::count(memory.begin(), memory.end(), 0), memory.size() / 4096 + 2);
+}
+
+TEST(task_impl, numa_shards) {
+  const int n = 100;
+  for (int node = 0; node < 2; ++node) {
+    std::vector<int> order;
+    auto p = thread_pool_impl::task_impl::make(4, n, [&](int i) { order.push_back(i); }, 1, /*node_count=*/2);
+    set_current_numa_node(node);
+    p->work();
+    set_current_numa_node(-1);
+    ASSERT_EQ(order.size(), n);
+    // The first half of the loop should be run before the second half on node 0, and vice versa.
+    ASSERT_EQ(order.front(), node * n / 2);
+    ASSERT_EQ(order[n / 2], (1 - node) * n / 2);
+  }
+}
+
+TEST(thread_pool_impl, topology) {
+  // Make a fake topology with two nodes, using the CPUs we have.
+  const cpu_topology cpus = cpu_topology::read();
+  cpu_topology topology;
+  topology.nodes.resize(2);
+  for (int i = 0; i < 4; ++i) {
+    topology.nodes[i / 2].push_back(cpus.nodes[0][i % cpus.nodes[0].size()]);
+  }
+
+  std::mutex mutex;
+  std::vector<int> nodes;
+  std::atomic<int> started = 0;
+  auto init = [&]() {
+    std::unique_lock l(mutex);
+    nodes.push_back(current_numa_node());
+    ++started;
+  };
+  thread_pool_impl t(topology, init);
+  ASSERT_EQ(t.thread_count(), 3);
+  // The calling thread is not pinned by default.
+  ASSERT_EQ(current_numa_node(), -1);
+
+  for (int n = 0; n < 100; ++n) {
+    std::atomic<int> count = 0;
+    std::atomic<int> sum = 0;
+    t.parallel_for(n, [&](int i) {
+      count++;
+      sum += i;
+    });
+    ASSERT_EQ(count, n);
+    ASSERT_EQ(sum, sum_arithmetic_sequence(n));
+  }
+
+  while (started < 3) {
+    std::this_thread::yield();
+  }
+  std::unique_lock l(mutex);
+  std::sort(nodes.begin(), nodes.end());
+  ASSERT_EQ(nodes, std::vector<int>({0, 1, 1}));
+}
+
+TEST(thread_pool_impl, pin_caller) {
+  // Use CPUs we are allowed to run on, so pinning succeeds.
+  const std::vector<int> affinity = current_thread_affinity();
+  cpu_topology topology;
+  topology.nodes.resize(2);
+  topology.nodes[0].push_back(affinity.empty() ? 0 : affinity.back());
+  topology.nodes[1].push_back(affinity.empty() ? 0 : affinity.front());
+
+  {
+    thread_pool_impl t(topology, nullptr, /*pin_caller=*/true);
+    // The calling thread gets the first CPU.
+    ASSERT_EQ(current_numa_node(), 0);
+    if (!affinity.empty()) {
+      ASSERT_EQ(current_thread_affinity(), std::vector<int>({affinity.back()}));
+    }
+  }
+  // Destroying the thread pool restores the calling thread's affinity and node.
+  ASSERT_EQ(current_numa_node(), -1);
+  ASSERT_EQ(current_thread_affinity(), affinity);
+}
+
 }  // namespace slinky
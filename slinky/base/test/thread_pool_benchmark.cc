@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "slinky/base/thread_pool_impl.h"
+#include "slinky/base/thread_pool_ws.h"
 
 namespace slinky {
 
@@ -12,9 +13,10 @@ struct unshared {
   alignas(cache_line_size) std::atomic<int> value;
 };
 
+template <typename ThreadPool>
 void BM_parallel_for_overhead(benchmark::State& state) {
   const int workers = state.range(0);
-  thread_pool_impl t(workers - 1);
+  ThreadPool t(workers - 1);
 
   std::vector<unshared> values(workers);
   while (state.KeepRunningBatch(workers)) {
@@ -22,11 +24,13 @@ void BM_parallel_for_overhead(benchmark::State& state) {
   }
 }
 
-BENCHMARK(BM_parallel_for_overhead)->RangeMultiplier(2)->Range(1, 32);
+BENCHMARK(BM_parallel_for_overhead<thread_pool_impl>)->RangeMultiplier(2)->Range(1, 128);
+BENCHMARK(BM_parallel_for_overhead<thread_pool_ws>)->RangeMultiplier(2)->Range(1, 128);
 
+template <typename ThreadPool>
 void BM_parallel_for(benchmark::State& state) {
   const int workers = state.range(0);
-  thread_pool_impl t(workers - 1);
+  ThreadPool t(workers - 1);
 
   const std::size_t n = 1000000;
 
@@ -36,11 +40,13 @@ void BM_parallel_for(benchmark::State& state) {
   }
 }
 
-BENCHMARK(BM_parallel_for)->RangeMultiplier(2)->Range(1, 32);
+BENCHMARK(BM_parallel_for<thread_pool_impl>)->RangeMultiplier(2)->Range(1, 128);
+BENCHMARK(BM_parallel_for<thread_pool_ws>)->RangeMultiplier(2)->Range(1, 128);
 
+template <typename ThreadPool>
 void BM_parallel_for_nested(benchmark::State& state) {
   const int workers = state.range(0);
-  thread_pool_impl t(workers - 1);
+  ThreadPool t(workers - 1);
 
   const std::size_t n = 1000;
 
@@ -52,6 +58,33 @@ void BM_parallel_for_nested(benchmark::State& state) {
   }
 }
 
-BENCHMARK(BM_parallel_for_nested)->RangeMultiplier(2)->Range(1, 32);
+BENCHMARK(BM_parallel_for_nested<thread_pool_impl>)->RangeMultiplier(2)->Range(1, 128);
+BENCHMARK(BM_parallel_for_nested<thread_pool_ws>)->RangeMultiplier(2)->Range(1, 128);
+
+// Many small tasks enqueued concurrently, similar to the tasks produced by `parallelize_tasks`.
+template <typename ThreadPool>
+void BM_enqueue_tasks(benchmark::State& state) {
+  const int workers = state.range(0);
+  ThreadPool t(workers - 1);
+
+  const std::size_t n = 64;
+
+  std::vector<unshared> values(workers);
+  while (state.KeepRunningBatch(n * n)) {
+    t.parallel_for(n, [&](std::size_t i) {
+      std::vector<ref_count<thread_pool::task>> tasks;
+      tasks.reserve(n);
+      for (std::size_t j = 0; j < n; ++j) {
+        tasks.push_back(t.enqueue([&values, i, workers]() { values[i % workers].value++; }));
+      }
+      for (auto& task : tasks) {
+        t.wait_for(&*task);
+      }
+    });
+  }
+}
+
+BENCHMARK(BM_enqueue_tasks<thread_pool_impl>)->RangeMultiplier(2)->Range(1, 128);
+BENCHMARK(BM_enqueue_tasks<thread_pool_ws>)->RangeMultiplier(2)->Range(1, 128);
 
 }  // namespace slinky
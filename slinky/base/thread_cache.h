@@ -0,0 +1,39 @@
+#ifndef SLINKY_BASE_THREAD_CACHE_H
+#define SLINKY_BASE_THREAD_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+
+namespace slinky {
+
+// Remembers the `T` the current thread used most recently, and the owner of the cache it belongs to. This allows an
+// object that keeps some state per thread to find the calling thread's state without a lock, as long as the thread
+// keeps using the same object. Owners are identified by a unique id rather than their address, which may be reused by
+// a new owner after the old one is destroyed.
+template <typename T>
+class thread_cache {
+  struct entry {
+    std::size_t owner = 0;
+    T* value = nullptr;
+  };
+
+  static inline std::atomic<std::size_t> next_id = 1;
+  static inline thread_local entry current;
+
+  std::size_t id_;
+
+public:
+  thread_cache() : id_(next_id++) {}
+
+  thread_cache(const thread_cache&) = delete;
+  thread_cache& operator=(const thread_cache&) = delete;
+
+  // Returns the value most recently set by the calling thread for this cache, or nullptr if the thread has set a value
+  // for another cache of the same type since then.
+  T* get() const { return current.owner == id_ ? current.value : nullptr; }
+  void set(T* value) { current = {id_, value}; }
+};
+
+}  // namespace slinky
+
+#endif  // SLINKY_BASE_THREAD_CACHE_H
@@ -35,9 +35,10 @@ public:
 
   // Enqueues a loop task over `n` work items `[0, n)`. The tasks queued in this thread pool are instances of `task`
   // plus a task body `t` that executes each iteration. Tasks are complete when all work items are done. Each thread
-  // calling `t` uses its own instance of `t`.
+  // calling `t` uses its own instance of `t`. `grain` is a hint of the minimum number of consecutive work items a
+  // thread should run at a time, which can reduce the overhead of loops with many cheap work items.
   virtual ref_count<task> enqueue(
-      std::size_t n, task_body t, int max_workers = std::numeric_limits<int>::max()) = 0;
+      std::size_t n, task_body t, int max_workers = std::numeric_limits<int>::max(), std::size_t grain = 1) = 0;
   // Run the task on the current thread, and prevents tasks enqueued by `enqueue` from running recursively.
   // Does not return until the task is complete. The task object must have been created by the `enqueue` function of
   // this thread pool.
@@ -55,7 +56,8 @@ public:
     return enqueue(1, [t = std::move(t)](std::size_t) { t(); });
   }
 
-  void parallel_for(std::size_t n, task_body body, int max_workers = std::numeric_limits<int>::max());
+  void parallel_for(
+      std::size_t n, task_body body, int max_workers = std::numeric_limits<int>::max(), std::size_t grain = 1);
 };
 
 }  // namespace slinky
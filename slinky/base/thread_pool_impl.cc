@@ -10,8 +10,12 @@
 
 namespace slinky {
 
-thread_pool_impl::task_impl::task_impl(std::size_t shard_count, std::size_t n, task_body body, int max_workers)
-    : body_(std::move(body)), shard_count_(shard_count), max_workers_(max_workers), todo_(n) {
+thread_pool_impl::task_impl::task_impl(
+    std::size_t shard_count, std::size_t n, task_body body, int max_workers, std::size_t node_count, std::size_t grain,
+    std::size_t workers_per_shard)
+    : body_(std::move(body)), shard_count_(shard_count), node_count_(std::max<std::size_t>(1, node_count)),
+      grain_(std::max<std::size_t>(1, grain)), workers_per_shard_(workers_per_shard), max_workers_(max_workers),
+      todo_(n) {
   std::size_t begin = 0;
   // Divide the work evenly among the shards we have.
   for (std::size_t i = 0; i < shard_count_; ++i) {
@@ -29,11 +33,20 @@ struct cache_line {
 };
 
 slinky::ref_count<thread_pool_impl::task_impl> thread_pool_impl::task_impl::make(
-    std::size_t shard_count, std::size_t n, task_body body, int max_workers) {
+    std::size_t shard_count, std::size_t n, task_body body, int max_workers, std::size_t node_count, std::size_t grain,
+    std::size_t workers_per_shard) {
   static_assert(sizeof(cache_line) == cache_line_size);
   static_assert(sizeof(shard) == cache_line_size, "");
   cache_line* memory = new cache_line[sizeof(task_impl) / cache_line_size + (shard_count - 1)];
-  return new (memory) task_impl(shard_count, n, std::move(body), max_workers);
+  return new (memory) task_impl(
+      shard_count, n, std::move(body), max_workers, node_count, grain, workers_per_shard);
+}
+
+std::size_t thread_pool_impl::task_impl::guided_workers_per_shard(
+    int thread_count, int max_workers, std::size_t shard_count) {
+  // The thread waiting for the loop also works on it.
+  const std::size_t workers = std::max(1, std::min(max_workers, thread_count + 1));
+  return (workers + shard_count - 1) / shard_count;
 }
 
 void thread_pool_impl::task_impl::destroy() {
@@ -41,16 +54,26 @@ void thread_pool_impl::task_impl::destroy() {
   delete[] reinterpret_cast<cache_line*>(this);
 }
 
-std::size_t thread_pool_impl::task_impl::shard::work(task_body& body) {
+std::size_t thread_pool_impl::task_impl::shard::work(task_body& body, std::size_t grain, std::size_t workers) {
   std::size_t done = 0;
   while (true) {
-    std::size_t i = this->i++;
-    if (i >= end) {
+    std::size_t chunk = grain;
+    if (workers > 0) {
+      const std::size_t next = i.load(std::memory_order_relaxed);
+      if (next >= end) break;
+      // Take a fraction of the remaining work, so there is some left for other workers to balance the load.
+      chunk = std::max(chunk, (end - next) / (2 * workers));
+    }
+    const std::size_t begin = i.fetch_add(chunk);
+    if (begin >= end) {
       // There are no more iterations to run.
       break;
     }
-    body(i);
-    ++done;
+    const std::size_t chunk_end = std::min(end, begin + chunk);
+    for (std::size_t j = begin; j < chunk_end; ++j) {
+      body(j);
+    }
+    done += chunk_end - begin;
   }
   return done;
 }
@@ -58,14 +81,32 @@ std::size_t thread_pool_impl::task_impl::shard::work(task_body& body) {
 bool thread_pool_impl::task_impl::work(std::size_t worker) {
   task_body body = body_;
   std::size_t done = 0;
+  // Find the range of shards belonging to the node of this thread.
+  std::size_t begin = 0;
+  std::size_t end = shard_count_;
+  const int node = current_numa_node();
+  if (node_count_ > 1 && node >= 0 && static_cast<std::size_t>(node) < node_count_) {
+    begin = (node * shard_count_) / node_count_;
+    end = ((node + 1) * shard_count_) / node_count_;
+    if (begin == end) {
+      begin = 0;
+      end = shard_count_;
+    }
+  }
   // The first iteration of this loop runs the work allocated to this worker. Subsequent iterations of this loop are
-  // stealing work from other workers.
-  const std::size_t i0 = worker % shard_count_;
-  for (std::size_t i = i0; i < shard_count_; ++i) {
-    done += shards_[i].work(body);
+  // stealing work from other workers, first from workers on the same node.
+  const std::size_t i0 = begin + worker % (end - begin);
+  for (std::size_t i = i0; i < end; ++i) {
+    done += shards_[i].work(body, grain_, workers_per_shard_);
+  }
+  for (std::size_t i = begin; i < i0; ++i) {
+    done += shards_[i].work(body, grain_, workers_per_shard_);
   }
-  for (std::size_t i = 0; i < i0; ++i) {
-    done += shards_[i].work(body);
+  for (std::size_t i = end; i < shard_count_; ++i) {
+    done += shards_[i].work(body, grain_, workers_per_shard_);
+  }
+  for (std::size_t i = 0; i < begin; ++i) {
+    done += shards_[i].work(body, grain_, workers_per_shard_);
   }
   return done > 0 && (todo_ -= done) == 0;
 }
@@ -99,12 +140,45 @@ thread_pool_impl::thread_pool_impl(int workers, function_ref<void()> init) : sto
   }
 }
 
+thread_pool_impl::thread_pool_impl(const cpu_topology& topology, function_ref<void()> init, bool pin_caller)
+    : stop_(false), node_count_(topology.node_count()) {
+  expect_workers(std::max<int>(0, topology.cpu_count() - 1));
+  for (std::size_t node = 0; node < topology.nodes.size(); ++node) {
+    for (std::size_t i = 0; i < topology.nodes[node].size(); ++i) {
+      const int cpu = topology.nodes[node][i];
+      if (node == 0 && i == 0) {
+        // Leave this CPU for the thread using the thread pool.
+        if (pin_caller) {
+          pinned_caller_ = std::this_thread::get_id();
+          caller_affinity_ = current_thread_affinity();
+          caller_numa_node_ = current_numa_node();
+          pin_current_thread(cpu);
+          set_current_numa_node(node);
+        }
+        continue;
+      }
+      threads_.push_back(std::thread([this, init, node, cpu]() {
+        // Pinning may fail (e.g. if the CPU is not in our affinity mask), but we still know which node we should be
+        // working on.
+        pin_current_thread(cpu);
+        set_current_numa_node(node);
+        if (init) init();
+        run_worker([this]() -> bool { return stop_; });
+      }));
+    }
+  }
+}
+
 thread_pool_impl::~thread_pool_impl() {
   atomic_call([this]() { stop_ = true; });
   cv_worker_.notify_all();
   for (std::thread& i : threads_) {
     i.join();
   }
+  if (pinned_caller_ == std::this_thread::get_id()) {
+    if (!caller_affinity_.empty()) set_current_thread_affinity(caller_affinity_);
+    set_current_numa_node(caller_numa_node_);
+  }
 }
 
 void thread_pool_impl::run_worker(predicate_ref condition) {
@@ -214,7 +288,8 @@ void thread_pool_impl::atomic_call(function_ref<void()> t) {
   cv_helper_.notify_all();
 }
 
-ref_count<thread_pool::task> thread_pool_impl::enqueue(std::size_t n, task_body t, int max_workers) {
+ref_count<thread_pool::task> thread_pool_impl::enqueue(
+    std::size_t n, task_body t, int max_workers, std::size_t grain) {
   assert(n > 0);
   constexpr int max_shards = 8;
 
@@ -224,8 +299,16 @@ ref_count<thread_pool::task> thread_pool_impl::enqueue(std::size_t n, task_body
 
   // Don't try to run more workers than there are work items.
   max_workers = std::min<std::size_t>(n, max_workers);
-  const std::size_t shard_count = ordered ? 1 : std::min(max_shards, max_workers);
-  auto loop = task_impl::make(shard_count, n, std::move(t), max_workers);
+  std::size_t shard_count = ordered ? 1 : std::min(max_shards, max_workers);
+  if (!ordered && node_count_ > 1) {
+    // Give each node the same number of shards, so each node works on a contiguous range of the loop.
+    shard_count = std::min(n, (shard_count + node_count_ - 1) / node_count_ * node_count_);
+  }
+  // Ordered loops must start iterations one at a time, in order.
+  const std::size_t workers_per_shard =
+      ordered ? 0 : task_impl::guided_workers_per_shard(thread_count(), max_workers, shard_count);
+  auto loop = task_impl::make(
+      shard_count, n, std::move(t), max_workers, node_count_, ordered ? 1 : grain, workers_per_shard);
   std::unique_lock l(mutex_);
   task_queue_.push_back(loop);
   if (max_workers == 1) {
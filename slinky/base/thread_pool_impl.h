@@ -11,6 +11,7 @@
 #include <thread>
 #include <vector>
 
+#include "slinky/base/cpu_topology.h"
 #include "slinky/base/function_ref.h"
 #include "slinky/base/ref_count.h"
 #include "slinky/base/thread_pool.h"
@@ -25,10 +26,20 @@ public:
   // This is a helper class for implementing a work stealing scheduler for a parallel for loop. It divides the work
   // among `shards`, which can be executed independently by separate threads. When the task is complete, the
   // thread will try to steal work from other shards.
+  //
+  // Workers claim blocks of iterations from a shard with one atomic operation. Blocks are at least `grain` iterations.
+  // If `workers_per_shard` is non-zero, the blocks are a fraction of the remaining work in the shard (guided
+  // scheduling), so they get smaller as the work drains, balancing the load near the end of the loop.
+  //
+  // The shards can be divided among `node_count` NUMA nodes, where each node gets a contiguous range of shards. Threads
+  // with a `current_numa_node` start working on (and steal from) the shards of their node first.
   class task_impl final : public task {
   private:
     task_body body_;
     std::size_t shard_count_;
+    std::size_t node_count_;
+    std::size_t grain_;
+    std::size_t workers_per_shard_;
     // How many workers can start working on this loop. Decremented as workers begin working.
     std::atomic<int> max_workers_;
 
@@ -41,21 +52,26 @@ public:
       // One past the last iteration to run in this shard.
       std::size_t end;
 
-      // Execute the body on each work item in this shard.
-      std::size_t work(task_body& body);
+      // Execute the body on each work item in this shard, claiming blocks of work items as described above.
+      std::size_t work(task_body& body, std::size_t grain, std::size_t workers);
     };
     // This memory follows the task_impl object.
     shard shards_[1];
 
     // Set up a parallel for loop over `n` items.
-    task_impl(std::size_t shard_count, std::size_t n, task_body body, int max_workers);
+    task_impl(std::size_t shard_count, std::size_t n, task_body body, int max_workers, std::size_t node_count,
+        std::size_t grain, std::size_t workers_per_shard);
 
   public:
-    static slinky::ref_count<task_impl> make(
-        std::size_t shard_count, std::size_t n, task_body body, int max_workers = std::numeric_limits<int>::max());
+    static slinky::ref_count<task_impl> make(std::size_t shard_count, std::size_t n, task_body body,
+        int max_workers = std::numeric_limits<int>::max(), std::size_t node_count = 1, std::size_t grain = 1,
+        std::size_t workers_per_shard = 0);
 
     void destroy() override;
 
+    // The number of workers we expect to work on each shard of a loop, used to compute guided block sizes.
+    static std::size_t guided_workers_per_shard(int thread_count, int max_workers, std::size_t shard_count);
+
     // Return a unique worker ID for this loop. Negative worker IDs are invalid, indicating no more workers should work
     // on this loop.
     int allocate_worker() { return --max_workers_; }
@@ -76,6 +92,12 @@ private:
   std::atomic<int> worker_count_{0};
   std::vector<std::thread> threads_;
   std::atomic<bool> stop_;
+  // How many NUMA nodes the workers of this thread pool are pinned to.
+  std::size_t node_count_ = 1;
+  // If the constructor pinned the calling thread, that thread, and its previous affinity and NUMA node.
+  std::thread::id pinned_caller_;
+  std::vector<int> caller_affinity_;
+  int caller_numa_node_ = -1;
 
   std::deque<ref_count<task_impl>> task_queue_;
   std::mutex mutex_;
@@ -97,6 +119,12 @@ public:
   // Pass workers = 0 to have a thread pool with no worker threads and
   // use `run_worker` to enter a thread into the thread pool.
   thread_pool_impl(int workers = 3, function_ref<void()> init = nullptr);
+  // Make a thread pool with a worker thread pinned to each CPU of `topology`, except the first CPU, which is left for
+  // the thread using the thread pool. Loops are divided so that contiguous ranges of iterations run on the same node.
+  // If `pin_caller` is true, the calling thread is pinned to that first CPU and its node, so it should be the thread
+  // that will use the thread pool. Its previous affinity and node are restored when the thread pool is destroyed, if
+  // that happens on the same thread.
+  explicit thread_pool_impl(const cpu_topology& topology, function_ref<void()> init = nullptr, bool pin_caller = false);
   ~thread_pool_impl() override;
 
   // Enters the calling thread into the thread pool as a worker. Does not return until `condition` returns true.
@@ -111,7 +139,8 @@ public:
 
   int thread_count() const override { return std::max<int>(expected_thread_count_, worker_count_); }
 
-  ref_count<task> enqueue(std::size_t n, task_body t, int max_workers = std::numeric_limits<int>::max()) override;
+  ref_count<task> enqueue(
+      std::size_t n, task_body t, int max_workers = std::numeric_limits<int>::max(), std::size_t grain = 1) override;
   using thread_pool::enqueue;
   void wait_for(task* t) override;
   void wait_for(predicate_ref condition) override { wait_for(condition, cv_helper_); }
@@ -0,0 +1,371 @@
+#include "slinky/base/thread_pool_ws.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace slinky {
+
+thread_pool_ws::deque::deque() {
+  rings_.push_back(std::make_unique<ring>(64));
+  ring_.store(rings_.back().get(), std::memory_order_relaxed);
+}
+
+thread_pool_ws::deque::~deque() {
+  while (take()) {
+  }
+}
+
+void thread_pool_ws::deque::push(ref_count<task_impl> t) {
+  const std::int64_t b = bottom_.load(std::memory_order_relaxed);
+  const std::int64_t top = top_.load(std::memory_order_acquire);
+  ring* r = ring_.load(std::memory_order_relaxed);
+  if (b - top > r->capacity - 1) {
+    // The ring is full, make a bigger one.
+    auto bigger = std::make_unique<ring>(r->capacity * 2);
+    for (std::int64_t i = top; i < b; ++i) {
+      bigger->put(i, r->get(i));
+    }
+    r = bigger.get();
+    ring_.store(r, std::memory_order_release);
+    rings_.push_back(std::move(bigger));
+  }
+  r->put(b, t.take());
+  std::atomic_thread_fence(std::memory_order_release);
+  bottom_.store(b + 1, std::memory_order_relaxed);
+}
+
+ref_count<thread_pool_impl::task_impl> thread_pool_ws::deque::take() {
+  const std::int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+  ring* r = ring_.load(std::memory_order_relaxed);
+  bottom_.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  std::int64_t top = top_.load(std::memory_order_relaxed);
+  task_impl* result = nullptr;
+  if (top <= b) {
+    result = r->get(b);
+    if (top == b) {
+      // This is the last task in the deque, we might be racing with a thief for it.
+      if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        result = nullptr;
+      }
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+  } else {
+    bottom_.store(b + 1, std::memory_order_relaxed);
+  }
+  return ref_count<task_impl>::assume(result);
+}
+
+ref_count<thread_pool_impl::task_impl> thread_pool_ws::deque::steal() {
+  std::int64_t top = top_.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  const std::int64_t b = bottom_.load(std::memory_order_acquire);
+  if (top >= b) return nullptr;
+
+  ring* r = ring_.load(std::memory_order_acquire);
+  task_impl* result = r->get(top);
+  if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+    // Another thread took this task.
+    return nullptr;
+  }
+  return ref_count<task_impl>::assume(result);
+}
+
+thread_pool_ws::queue::queue() : cells_(new cell[capacity]) {
+  static_assert((capacity & (capacity - 1)) == 0);
+  for (std::size_t i = 0; i < capacity; ++i) {
+    cells_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+thread_pool_ws::queue::~queue() {
+  while (pop()) {
+  }
+}
+
+bool thread_pool_ws::queue::push(ref_count<task_impl>& t) {
+  std::size_t pos = push_.load(std::memory_order_relaxed);
+  cell* c;
+  while (true) {
+    c = &cells_[pos & (capacity - 1)];
+    const std::size_t seq = c->sequence.load(std::memory_order_acquire);
+    const std::intptr_t diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+    if (diff == 0) {
+      if (push_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (diff < 0) {
+      // The queue is full.
+      return false;
+    } else {
+      pos = push_.load(std::memory_order_relaxed);
+    }
+  }
+  c->task = t.take();
+  c->sequence.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+ref_count<thread_pool_impl::task_impl> thread_pool_ws::queue::pop() {
+  std::size_t pos = pop_.load(std::memory_order_relaxed);
+  cell* c;
+  while (true) {
+    c = &cells_[pos & (capacity - 1)];
+    const std::size_t seq = c->sequence.load(std::memory_order_acquire);
+    const std::intptr_t diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+    if (diff == 0) {
+      if (pop_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (diff < 0) {
+      // The queue is empty.
+      return nullptr;
+    } else {
+      pos = pop_.load(std::memory_order_relaxed);
+    }
+  }
+  task_impl* result = c->task;
+  c->sequence.store(pos + capacity, std::memory_order_release);
+  return ref_count<task_impl>::assume(result);
+}
+
+namespace {
+
+// The thread pool and worker index of the calling thread, if it is a worker thread of a `thread_pool_ws`.
+struct worker_id {
+  const thread_pool_ws* pool = nullptr;
+  int index = -1;
+};
+thread_local worker_id this_worker;
+
+thread_local std::vector<const thread_pool::task*> task_stack;
+
+bool work_on_task(thread_pool_impl::task_impl* t, int worker) {
+  assert(std::find(task_stack.begin(), task_stack.end(), t) == task_stack.end());
+  task_stack.push_back(t);
+  bool completed = t->work(worker);
+  task_stack.pop_back();
+  return completed;
+}
+
+bool work_on_task(thread_pool_impl::task_impl* t) {
+  task_stack.push_back(t);
+  bool completed = t->work();
+  task_stack.pop_back();
+  return completed;
+}
+
+// A cheap random number generator for choosing workers to steal from.
+std::uint32_t random_u32() {
+  thread_local std::uint32_t state =
+      static_cast<std::uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id())) | 1;
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+}  // namespace
+
+thread_pool_ws::thread_pool_ws(int workers, function_ref<void()> init) {
+  for (int i = 0; i < workers; ++i) {
+    workers_.push_back(std::make_unique<worker>());
+  }
+  for (int i = 0; i < workers; ++i) {
+    threads_.push_back(std::thread([this, init, i]() {
+      if (init) init();
+      run_worker(i);
+    }));
+  }
+}
+
+thread_pool_ws::~thread_pool_ws() {
+  atomic_call([this]() { stop_ = true; });
+  for (std::thread& i : threads_) {
+    i.join();
+  }
+}
+
+int thread_pool_ws::worker_index() const { return this_worker.pool == this ? this_worker.index : -1; }
+
+void thread_pool_ws::run_worker(int w) {
+  this_worker = {this, w};
+  wait_for([this]() -> bool { return stop_; });
+  this_worker = {};
+}
+
+void thread_pool_ws::push(int w, ref_count<task_impl> t) {
+  if (w >= 0) {
+    workers_[w]->tasks.push(std::move(t));
+  } else if (!injected_.push(t)) {
+    std::unique_lock l(overflow_mutex_);
+    overflow_.push_back(std::move(t));
+    ++overflow_size_;
+  }
+}
+
+ref_count<thread_pool_impl::task_impl> thread_pool_ws::try_steal(int w) {
+  const std::size_t n = workers_.size();
+  if (n == 0) return nullptr;
+  const std::size_t start = random_u32() % n;
+  for (std::size_t i = 0; i < n; ++i) {
+    const std::size_t victim = (start + i) % n;
+    if (static_cast<int>(victim) == w) continue;
+    if (auto t = workers_[victim]->tasks.steal()) return t;
+  }
+  return nullptr;
+}
+
+ref_count<thread_pool_impl::task_impl> thread_pool_ws::find_task(int w, int& worker) {
+  // Tasks we found that are already running on this thread. We put these back when we're done looking.
+  std::vector<ref_count<task_impl>> deferred;
+
+  auto claim = [&](ref_count<task_impl> t) -> ref_count<task_impl> {
+    if (t->all_work_started()) {
+      // No more threads can start working on this task.
+      return nullptr;
+    } else if (std::find(task_stack.begin(), task_stack.end(), &*t) != task_stack.end()) {
+      // Don't run the same loop multiple times on the same thread.
+      deferred.push_back(std::move(t));
+      return nullptr;
+    }
+    worker = t->allocate_worker();
+    if (worker < 0) {
+      // No more threads can start working on this loop.
+      return nullptr;
+    } else if (worker > 0) {
+      // More threads can work on this loop, put it back so they can find it.
+      push(w, t);
+    }
+    return t;
+  };
+
+  ref_count<task_impl> result;
+  if (w >= 0) {
+    while (auto t = workers_[w]->tasks.take()) {
+      if ((result = claim(std::move(t)))) break;
+    }
+  }
+  while (!result) {
+    auto t = injected_.pop();
+    if (!t) break;
+    result = claim(std::move(t));
+  }
+  while (!result && overflow_size_ > 0) {
+    ref_count<task_impl> t;
+    {
+      std::unique_lock l(overflow_mutex_);
+      if (overflow_.empty()) break;
+      t = std::move(overflow_.front());
+      overflow_.pop_front();
+      --overflow_size_;
+    }
+    result = claim(std::move(t));
+  }
+  while (!result) {
+    auto t = try_steal(w);
+    if (!t) break;
+    result = claim(std::move(t));
+  }
+
+  for (ref_count<task_impl>& i : deferred) {
+    push(w, std::move(i));
+  }
+  return result;
+}
+
+void thread_pool_ws::notify(bool all) {
+  // This fence pairs with the one in `wait_for`, so either we see the sleeping thread, or it sees the state we
+  // changed before calling this.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleepers_.load(std::memory_order_relaxed) == 0) return;
+  std::unique_lock l(mutex_);
+  if (all) {
+    cv_.notify_all();
+  } else {
+    cv_.notify_one();
+  }
+}
+
+ref_count<thread_pool::task> thread_pool_ws::enqueue(
+    std::size_t n, task_body t, int max_workers, std::size_t grain) {
+  assert(n > 0);
+  constexpr int max_shards = 8;
+
+  // See `thread_pool_impl::enqueue`.
+  const bool ordered = max_workers < std::numeric_limits<int>::max();
+
+  // Don't try to run more workers than there are work items.
+  max_workers = std::min<std::size_t>(n, max_workers);
+  const std::size_t shard_count = ordered ? 1 : std::min(max_shards, max_workers);
+  const std::size_t workers_per_shard =
+      ordered ? 0 : task_impl::guided_workers_per_shard(thread_count(), max_workers, shard_count);
+  auto loop = task_impl::make(shard_count, n, std::move(t), max_workers, 1, ordered ? 1 : grain, workers_per_shard);
+  push(worker_index(), loop);
+  ++enqueued_;
+  notify(/*all=*/max_workers > 1);
+  return loop;
+}
+
+void thread_pool_ws::wait_for(predicate_ref condition) {
+  // We want to spin a few times before letting the OS take over.
+  const int spin_count = 1000;
+  int spins = spin_count;
+
+  const int w = worker_index();
+  while (true) {
+    {
+      std::unique_lock l(mutex_);
+      if (condition()) return;
+    }
+    // Any task enqueued after this will wake us up if we go to sleep.
+    const std::size_t enqueued = enqueued_.load();
+    int worker;
+    if (auto task = find_task(w, worker)) {
+      if (work_on_task(task, worker)) {
+        // We completed the loop, wake up threads that might be waiting for it.
+        notify();
+      }
+      // We did a task, reset the spin counter.
+      spins = spin_count;
+    } else if (spins-- > 0) {
+      std::this_thread::yield();
+    } else {
+      std::unique_lock l(mutex_);
+      ++sleepers_;
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      while (!condition() && enqueued_.load(std::memory_order_relaxed) == enqueued) {
+        cv_.wait(l);
+      }
+      --sleepers_;
+      spins = spin_count;
+    }
+  }
+}
+
+void thread_pool_ws::atomic_call(function_ref<void()> t) {
+  std::unique_lock l(mutex_);
+  t();
+  cv_.notify_all();
+}
+
+void thread_pool_ws::wait_for(task* t) {
+  task_impl* task = reinterpret_cast<task_impl*>(t);
+  bool completed = work_on_task(task);
+  if (!completed || !task->done()) {
+    // We want to spin a few times before waiting on the condition variable.
+    const int spin_count = 1000;
+    for (int i = 0; i < spin_count; ++i) {
+      std::this_thread::yield();
+      if (task->done()) return;
+    }
+
+    // The loop isn't done, work on other tasks while waiting for it to complete.
+    wait_for([&]() { return task->done(); });
+  }
+}
+
+}  // namespace slinky
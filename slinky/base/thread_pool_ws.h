@@ -0,0 +1,153 @@
+#ifndef SLINKY_BASE_THREAD_POOL_WS_H
+#define SLINKY_BASE_THREAD_POOL_WS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "slinky/base/function_ref.h"
+#include "slinky/base/ref_count.h"
+#include "slinky/base/thread_pool.h"
+#include "slinky/base/thread_pool_impl.h"
+
+namespace slinky {
+
+// A thread pool where each worker has its own deque of tasks. Workers push tasks they enqueue to their own deque, and
+// take tasks from the back of it. When a worker runs out of tasks, it steals tasks from the front of the deque of a
+// randomly chosen worker. Threads that are not workers of the pool enqueue tasks to a shared lock-free queue. The
+// scheduler only takes a lock to sleep, to wake sleeping threads, and to check `wait_for` conditions.
+//
+// Tasks are the same as `thread_pool_impl::task_impl`, so loops are divided among the threads working on them in the
+// same way as `thread_pool_impl`.
+class thread_pool_ws final : public thread_pool {
+public:
+  using task_impl = thread_pool_impl::task_impl;
+
+  // A Chase-Lev work stealing deque of tasks. The owner can push and take from the back, other threads can steal from
+  // the front. The deque holds a reference to each task in it.
+  class deque {
+    struct ring {
+      std::int64_t capacity;
+      std::unique_ptr<std::atomic<task_impl*>[]> items;
+
+      explicit ring(std::int64_t capacity) : capacity(capacity), items(new std::atomic<task_impl*>[capacity]) {}
+
+      task_impl* get(std::int64_t i) const { return items[i & (capacity - 1)].load(std::memory_order_acquire); }
+      void put(std::int64_t i, task_impl* t) { items[i & (capacity - 1)].store(t, std::memory_order_release); }
+    };
+
+    alignas(cache_line_size) std::atomic<std::int64_t> top_{0};
+    alignas(cache_line_size) std::atomic<std::int64_t> bottom_{0};
+    std::atomic<ring*> ring_;
+    // Rings that have been replaced by bigger rings. Thieves may still be reading them, so we keep them until the deque
+    // is destroyed.
+    std::vector<std::unique_ptr<ring>> rings_;
+
+  public:
+    deque();
+    ~deque();
+
+    deque(const deque&) = delete;
+    deque& operator=(const deque&) = delete;
+
+    // These may only be called by the owner of the deque.
+    void push(ref_count<task_impl> t);
+    ref_count<task_impl> take();
+
+    // This may be called by any thread. Returns null if the deque is empty or if another thread took the task we tried
+    // to steal.
+    ref_count<task_impl> steal();
+
+    bool empty() const {
+      return bottom_.load(std::memory_order_relaxed) <= top_.load(std::memory_order_relaxed);
+    }
+  };
+
+  // A bounded lock-free multi-producer multi-consumer queue of tasks.
+  class queue {
+    struct cell {
+      std::atomic<std::size_t> sequence;
+      task_impl* task;
+    };
+    static constexpr std::size_t capacity = 1024;
+    std::unique_ptr<cell[]> cells_;
+
+    alignas(cache_line_size) std::atomic<std::size_t> push_{0};
+    alignas(cache_line_size) std::atomic<std::size_t> pop_{0};
+
+  public:
+    queue();
+    ~queue();
+
+    queue(const queue&) = delete;
+    queue& operator=(const queue&) = delete;
+
+    // Returns false if the queue is full.
+    bool push(ref_count<task_impl>& t);
+    ref_count<task_impl> pop();
+
+    bool empty() const { return push_.load(std::memory_order_relaxed) <= pop_.load(std::memory_order_relaxed); }
+  };
+
+private:
+  struct alignas(cache_line_size) worker {
+    deque tasks;
+  };
+  std::vector<std::unique_ptr<worker>> workers_;
+  std::vector<std::thread> threads_;
+  std::atomic<bool> stop_{false};
+
+  // Tasks enqueued by threads that are not workers of this pool.
+  queue injected_;
+  // Tasks enqueued while `injected_` was full.
+  std::deque<ref_count<task_impl>> overflow_;
+  std::atomic<std::size_t> overflow_size_{0};
+  std::mutex overflow_mutex_;
+
+  // The mutex is only used to sleep and wake threads, and to make `wait_for` conditions and `atomic_call` atomic.
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::atomic<int> sleepers_{0};
+  // Incremented every time a task is enqueued. Idle threads sleep until this changes, rather than until the deques are
+  // empty: a task that a thread can't work on (because it is already working on it) stays in the deques.
+  std::atomic<std::size_t> enqueued_{0};
+
+  // Returns the index of the calling thread in `workers_`, or -1 if it is not a worker of this thread pool.
+  int worker_index() const;
+
+  // Add a task to the deque of worker `w`, or to the shared queue if `w` is negative.
+  void push(int w, ref_count<task_impl> t);
+
+  // Find a task for the calling thread (worker `w`) to work on, and allocate the worker ID `worker` for it.
+  ref_count<task_impl> find_task(int w, int& worker);
+  ref_count<task_impl> try_steal(int w);
+
+  void notify(bool all = true);
+
+  void run_worker(int w);
+
+public:
+  // `workers` indicates how many worker threads the thread pool will have.
+  // `init` is a task that is run on each newly created thread.
+  thread_pool_ws(int workers = 3, function_ref<void()> init = nullptr);
+  ~thread_pool_ws() override;
+
+  int thread_count() const override { return static_cast<int>(workers_.size()); }
+
+  ref_count<task> enqueue(
+      std::size_t n, task_body t, int max_workers = std::numeric_limits<int>::max(), std::size_t grain = 1) override;
+  using thread_pool::enqueue;
+  void wait_for(task* t) override;
+  void wait_for(predicate_ref condition) override;
+  void atomic_call(function_ref<void()> t) override;
+};
+
+}  // namespace slinky
+
+#endif  // SLINKY_BASE_THREAD_POOL_WS_H
@@ -0,0 +1,919 @@
+#include "slinky/builder/generate_source.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "slinky/runtime/buffer.h"
+#include "slinky/runtime/depends_on.h"
+#include "slinky/runtime/evaluate.h"
+#include "slinky/runtime/expr.h"
+#include "slinky/runtime/stmt.h"
+
+namespace slinky {
+
+namespace {
+
+// Returns true if `op` is a copy implemented by `build_pipeline`.
+bool is_copy(const call_stmt* op) { return op->target.target<copy_call>() != nullptr; }
+
+// Finds the `call_stmt`s of a stmt, in the order they are given indices in the table of callables. Copies are called
+// directly by the generated code, so they are not in the table.
+class call_finder : public recursive_node_visitor {
+public:
+  std::vector<const call_stmt*> calls;
+  std::map<const call_stmt*, std::size_t> indices;
+
+  void visit(const call_stmt* op) override {
+    if (is_copy(op)) return;
+    if (indices.emplace(op, calls.size()).second) {
+      calls.push_back(op);
+    }
+  }
+};
+
+// Finds the symbols referenced by an expression.
+class variable_finder : public recursive_node_visitor {
+public:
+  std::vector<var> vars;
+
+  void visit(const variable* op) override {
+    if (std::find(vars.begin(), vars.end(), op->sym) == vars.end()) {
+      vars.push_back(op->sym);
+    }
+  }
+};
+
+std::string literal(index_t value) {
+  if (value == std::numeric_limits<index_t>::min()) {
+    return "(" + std::to_string(value + 1) + " - 1)";
+  } else if (value < 0) {
+    return "(" + std::to_string(value) + ")";
+  } else {
+    return std::to_string(value);
+  }
+}
+
+std::string string_literal(const std::string& s) {
+  std::string result = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      result += '\\';
+      result += c;
+    } else if (c == '\n') {
+      result += "\\n";
+    } else {
+      result += c;
+    }
+  }
+  return result + "\"";
+}
+
+const char* binary_op_name(expr_node_type type) {
+  switch (type) {
+  case expr_node_type::add: return "add";
+  case expr_node_type::sub: return "sub";
+  case expr_node_type::mul: return "mul";
+  case expr_node_type::div: return "div";
+  case expr_node_type::mod: return "mod";
+  case expr_node_type::min: return "min";
+  case expr_node_type::max: return "max";
+  case expr_node_type::equal: return "equal";
+  case expr_node_type::not_equal: return "not_equal";
+  case expr_node_type::less: return "less";
+  case expr_node_type::less_equal: return "less_equal";
+  case expr_node_type::logical_and: return "logical_and";
+  case expr_node_type::logical_or: return "logical_or";
+  default: return nullptr;
+  }
+}
+
+const char* field_name(buffer_field field) {
+  switch (field) {
+  case buffer_field::rank: return "rank";
+  case buffer_field::elem_size: return "elem_size";
+  case buffer_field::size_bytes: return "size_bytes";
+  case buffer_field::min: return "min";
+  case buffer_field::max: return "max";
+  case buffer_field::stride: return "stride";
+  case buffer_field::fold_factor: return "fold_factor";
+  default: return nullptr;
+  }
+}
+
+const char* intrinsic_name(intrinsic fn) {
+  switch (fn) {
+  case intrinsic::abs: return "abs";
+  case intrinsic::and_then: return "and_then";
+  case intrinsic::or_else: return "or_else";
+  case intrinsic::buffer_at: return "buffer_at";
+  case intrinsic::semaphore_init: return "semaphore_init";
+  case intrinsic::semaphore_signal: return "semaphore_signal";
+  case intrinsic::semaphore_wait: return "semaphore_wait";
+  case intrinsic::wait_for: return "wait_for";
+  case intrinsic::trace_begin: return "trace_begin";
+  case intrinsic::trace_end: return "trace_end";
+  case intrinsic::free: return "free";
+  default: return nullptr;
+  }
+}
+
+const char* memory_type_name(memory_type type) {
+  switch (type) {
+  case memory_type::stack: return "stack";
+  case memory_type::heap: return "heap";
+  default: return "automatic";
+  }
+}
+
+// Generates the body of the pipeline function. Symbols are stored in `index_t` locals, named `_<id>`, or `_<id>_<n>` if
+// the symbol is declared more than once. Statements that fail return the result from the enclosing function or lambda.
+// Callbacks are called with the `eval_context` named by `ctx`, and the symbols they may access are copied into it
+// before the call.
+class source_generator {
+  std::ostringstream os_;
+  std::ostringstream globals_;
+  std::string fname_;
+  int indent_ = 1;
+
+  symbol_map<std::string> names_;
+  std::map<std::size_t, int> declarations_;
+  std::map<const call_stmt*, std::size_t> call_indices_;
+  std::map<const constant_buffer*, std::string> constants_;
+  std::size_t context_size_;
+  std::string ctx_ = "ctx";
+  int next_temp_ = 0;
+
+  void fail() { ok = false; }
+
+  std::ostream& line() {
+    for (int i = 0; i < indent_; ++i) {
+      os_ << "  ";
+    }
+    return os_;
+  }
+  void open(const std::string& s = "{") {
+    line() << s << "\n";
+    ++indent_;
+  }
+  void close(const std::string& s = "}") {
+    --indent_;
+    line() << s << "\n";
+  }
+  void reopen(const std::string& s) {
+    --indent_;
+    line() << s << "\n";
+    ++indent_;
+  }
+
+  std::string temp(const char* prefix) { return prefix + std::string("_") + std::to_string(next_temp_++); }
+
+  // Makes a new name for `sym`, which must be bound with `declare` after any exprs that refer to the previous
+  // declaration of `sym` are generated.
+  std::string new_name(var sym) {
+    int& n = declarations_[sym.id];
+    std::string name = "_" + std::to_string(sym.id);
+    if (n > 0) name += "_" + std::to_string(n);
+    ++n;
+    return name;
+  }
+  scoped_value_in_symbol_map<std::string> declare(var sym, const std::string& name) {
+    return {names_, sym, name};
+  }
+
+  std::string name(var sym) {
+    std::optional<std::string> result = names_.lookup(sym);
+    if (!result) {
+      fail();
+      return "0";
+    }
+    return *result;
+  }
+
+  std::string buf(var sym) { return "g::buf(" + name(sym) + ")"; }
+
+public:
+  bool ok = true;
+
+  source_generator(const pipeline& p, std::string fname) : fname_(std::move(fname)) {
+    call_finder calls;
+    p.body.accept(&calls);
+    call_indices_ = std::move(calls.indices);
+    context_size_ = std::max(p.context_size, find_context_size(p.body));
+  }
+
+  std::string globals() const { return globals_.str(); }
+  std::string body() const { return os_.str(); }
+  std::size_t context_size() const { return context_size_; }
+
+  // Declare a symbol with an initial value in the body of the function. These are never undeclared.
+  void declare_global(var sym, const std::string& value) {
+    if (!sym.defined()) return;
+    std::string n = new_name(sym);
+    line() << "const index_t " << n << " = " << value << ";\n";
+    names_[sym] = n;
+  }
+  void emit_line(const std::string& s) { line() << s << "\n"; }
+  void emit_open(const std::string& s) { open(s); }
+  void emit_close(const std::string& s) { close(s); }
+
+  std::string emit(const expr& e) {
+    switch (e.type()) {
+    case expr_node_type::variable: {
+      const variable* op = e.as<variable>();
+      if (op->field == buffer_field::none) return name(op->sym);
+      const char* field = field_name(op->field);
+      if (!field) {
+        fail();
+        return "0";
+      }
+      std::string result = std::string("g::buffer_") + field + "(" + name(op->sym);
+      if (op->dim >= 0) result += ", " + std::to_string(op->dim);
+      return result + ")";
+    }
+    case expr_node_type::constant: return literal(e.as<constant>()->value);
+    case expr_node_type::let: {
+      const let* op = e.as<let>();
+      std::string result = "[&]() -> index_t { ";
+      std::vector<scoped_value_in_symbol_map<std::string>> decls;
+      for (const auto& i : op->lets) {
+        std::string value = emit(i.second);
+        std::string n = new_name(i.first);
+        result += "const index_t " + n + " = " + value + "; ";
+        decls.push_back(declare(i.first, n));
+      }
+      return result + "return " + emit(op->body) + "; }()";
+    }
+    case expr_node_type::add: return "(" + emit(e.as<add>()->a) + " + " + emit(e.as<add>()->b) + ")";
+    case expr_node_type::sub: return "(" + emit(e.as<sub>()->a) + " - " + emit(e.as<sub>()->b) + ")";
+    case expr_node_type::mul: return "(" + emit(e.as<mul>()->a) + " * " + emit(e.as<mul>()->b) + ")";
+    case expr_node_type::div:
+      return "slinky::euclidean_div<index_t>(" + emit(e.as<div>()->a) + ", " + emit(e.as<div>()->b) + ")";
+    case expr_node_type::mod:
+      return "slinky::euclidean_mod<index_t>(" + emit(e.as<mod>()->a) + ", " + emit(e.as<mod>()->b) + ")";
+    case expr_node_type::min:
+      return "std::min<index_t>(" + emit(e.as<class min>()->a) + ", " + emit(e.as<class min>()->b) + ")";
+    case expr_node_type::max:
+      return "std::max<index_t>(" + emit(e.as<class max>()->a) + ", " + emit(e.as<class max>()->b) + ")";
+    case expr_node_type::equal: return emit_comparison(e, " == ");
+    case expr_node_type::not_equal: return emit_comparison(e, " != ");
+    case expr_node_type::less: return emit_comparison(e, " < ");
+    case expr_node_type::less_equal: return emit_comparison(e, " <= ");
+    case expr_node_type::logical_and: return emit_comparison(e, " && ");
+    case expr_node_type::logical_or: return emit_comparison(e, " || ");
+    case expr_node_type::logical_not: return "index_t(" + emit(e.as<logical_not>()->a) + " == 0)";
+    case expr_node_type::select: {
+      const class select* op = e.as<class select>();
+      return "(" + emit(op->condition) + " ? " + emit(op->true_value) + " : " + emit(op->false_value) + ")";
+    }
+    case expr_node_type::call: return emit(e.as<call>());
+    default: fail(); return "0";
+    }
+  }
+
+  std::string emit_comparison(const expr& e, const char* op) {
+    const binary_op* b = static_cast<const binary_op*>(e.get());
+    return "index_t(" + emit(b->a) + op + emit(b->b) + ")";
+  }
+
+  std::string emit(const expr& e, const std::string& def) { return e.defined() ? emit(e) : def; }
+
+  std::string emit_args(const std::vector<expr>& args, std::size_t begin = 0) {
+    std::string result;
+    for (std::size_t i = begin; i < args.size(); ++i) {
+      if (i > begin) result += ", ";
+      result += emit(args[i]);
+    }
+    return result;
+  }
+
+  // Semaphore intrinsics take pairs of (semaphore, count) arguments, where the count may be undefined.
+  std::string emit_semaphore_args(const std::vector<expr>& args, const char* def) {
+    std::string result;
+    for (std::size_t i = 0; i < args.size(); ++i) {
+      if (i > 0) result += ", ";
+      result += emit(args[i], i % 2 == 0 ? "0" : def);
+    }
+    return result;
+  }
+
+  std::string emit(const call* op) {
+    switch (op->intrinsic) {
+    case intrinsic::abs: return "std::abs(" + emit(op->args[0]) + ")";
+    case intrinsic::and_then:
+    case intrinsic::or_else: {
+      bool is_and = op->intrinsic == intrinsic::and_then;
+      if (op->args.empty()) return is_and ? "1" : "0";
+      std::string result = "index_t(";
+      for (std::size_t i = 0; i < op->args.size(); ++i) {
+        if (i > 0) result += is_and ? " && " : " || ";
+        result += emit(op->args[i]);
+      }
+      return result + ")";
+    }
+    case intrinsic::buffer_at: {
+      const std::optional<var> sym = as_variable(op->args[0]);
+      if (!sym) {
+        fail();
+        return "0";
+      }
+      std::string result = buf(*sym) + "->base";
+      for (std::size_t d = 0; d + 1 < op->args.size(); ++d) {
+        if (op->args[d + 1].defined()) {
+          result = "g::at(" + result + ", " + buf(*sym) + ", " + std::to_string(d) + ", " + emit(op->args[d + 1]) + ")";
+        }
+      }
+      return "g::value(" + result + ")";
+    }
+    case intrinsic::semaphore_init:
+      return "g::semaphore_init(" + ctx_ + ", " + emit_semaphore_args(op->args, "0") + ")";
+    case intrinsic::semaphore_signal:
+      return "g::semaphore_signal(" + ctx_ + ", {" + emit_semaphore_args(op->args, "1") + "})";
+    case intrinsic::semaphore_wait:
+      return "g::semaphore_wait(" + ctx_ + ", {" + emit_semaphore_args(op->args, "1") + "})";
+    case intrinsic::wait_for: return "g::wait_for(" + ctx_ + ", {" + emit_args(op->args) + "})";
+    case intrinsic::trace_begin: return "g::trace_begin(" + ctx_ + ", " + emit(op->args[0]) + ")";
+    case intrinsic::trace_end: return "g::trace_end(" + ctx_ + ", " + emit(op->args[0]) + ")";
+    case intrinsic::free: return "g::free(" + emit(op->args[0]) + ")";
+    default:
+      // User defined calls, infinities, and indeterminate can't be generated.
+      fail();
+      return "0";
+    }
+  }
+
+  // Generate code that constructs `e`, for the `call_stmt`s passed to callbacks and the conditions of failed checks.
+  std::string construct(const expr& e) {
+    switch (e.type()) {
+    case expr_node_type::none: return "slinky::expr()";
+    case expr_node_type::variable: {
+      const variable* op = e.as<variable>();
+      std::string result = "slinky::variable::make(slinky::var(" + std::to_string(op->sym.id) + ")";
+      if (op->field != buffer_field::none) {
+        const char* field = field_name(op->field);
+        if (!field) {
+          fail();
+          return "slinky::expr()";
+        }
+        result += std::string(", slinky::buffer_field::") + field + ", " + std::to_string(op->dim);
+      }
+      return result + ")";
+    }
+    case expr_node_type::constant: return "slinky::expr(" + literal(e.as<constant>()->value) + ")";
+    case expr_node_type::let: {
+      const let* op = e.as<let>();
+      std::string result = "slinky::let::make({";
+      for (std::size_t i = 0; i < op->lets.size(); ++i) {
+        if (i > 0) result += ", ";
+        result += "{slinky::var(" + std::to_string(op->lets[i].first.id) + "), " + construct(op->lets[i].second) + "}";
+      }
+      return result + "}, " + construct(op->body) + ")";
+    }
+    case expr_node_type::logical_not: return "slinky::logical_not::make(" + construct(e.as<logical_not>()->a) + ")";
+    case expr_node_type::select: {
+      const class select* op = e.as<class select>();
+      return "slinky::select::make(" + construct(op->condition) + ", " + construct(op->true_value) + ", " +
+             construct(op->false_value) + ")";
+    }
+    case expr_node_type::call: {
+      const call* op = e.as<call>();
+      const char* fn = intrinsic_name(op->intrinsic);
+      if (!fn) {
+        fail();
+        return "slinky::expr()";
+      }
+      std::string result = std::string("slinky::call::make(slinky::intrinsic::") + fn + ", {";
+      for (std::size_t i = 0; i < op->args.size(); ++i) {
+        if (i > 0) result += ", ";
+        result += construct(op->args[i]);
+      }
+      return result + "})";
+    }
+    default: {
+      const binary_op* op = static_cast<const binary_op*>(e.get());
+      return std::string("slinky::") + binary_op_name(e.type()) + "::make(" + construct(op->a) + ", " +
+             construct(op->b) + ")";
+    }
+    }
+  }
+
+  std::string construct(const std::vector<var>& syms) {
+    std::string result = "{";
+    for (std::size_t i = 0; i < syms.size(); ++i) {
+      if (i > 0) result += ", ";
+      result += syms[i].defined() ? "slinky::var(" + std::to_string(syms[i].id) + ")" : "slinky::var()";
+    }
+    return result + "}";
+  }
+
+  // Copy the value of `sym` to the context, so callbacks can access it.
+  void sync(var sym) {
+    if (!sym.defined()) return;
+    line() << ctx_ << ".set(slinky::var(" << sym.id << "), " << name(sym) << ");\n";
+  }
+
+  // Emit a stmt, as a sequence of C++ statements that return the result of the stmt if it is not zero.
+  void emit(const stmt& s) {
+    switch (s.type()) {
+    case stmt_node_type::none: return;
+    case stmt_node_type::call_stmt: return emit(s.as<call_stmt>());
+    case stmt_node_type::let_stmt: return emit(s.as<let_stmt>());
+    case stmt_node_type::block:
+      for (const stmt& i : s.as<block>()->stmts) {
+        emit(i);
+      }
+      return;
+    case stmt_node_type::loop: return emit(s.as<loop>());
+    case stmt_node_type::async: return emit(s.as<async>());
+    case stmt_node_type::allocate: return emit(s.as<allocate>());
+    case stmt_node_type::make_buffer: return emit(s.as<make_buffer>());
+    case stmt_node_type::constant_buffer: return emit(s.as<constant_buffer>());
+    case stmt_node_type::clone_buffer: return emit(s.as<clone_buffer>());
+    case stmt_node_type::crop_buffer: return emit(s.as<crop_buffer>());
+    case stmt_node_type::crop_dim: return emit(s.as<crop_dim>());
+    case stmt_node_type::slice_buffer: return emit(s.as<slice_buffer>());
+    case stmt_node_type::slice_dim: return emit(s.as<slice_dim>());
+    case stmt_node_type::transpose: return emit(s.as<transpose>());
+    case stmt_node_type::check: return emit(s.as<check>());
+    default:
+      // copy_stmt should have been implemented by calls to copy/pad.
+      fail();
+      return;
+    }
+  }
+
+  // Emit `body` in a lambda, returning its result.
+  std::string emit_lambda(const stmt& body, std::string ctx) {
+    std::string result = temp("result");
+    std::swap(ctx_, ctx);
+    open("const index_t " + result + " = [&]() -> index_t {");
+    emit(body);
+    line() << "return 0;\n";
+    close("}();");
+    std::swap(ctx_, ctx);
+    return result;
+  }
+
+  // Emit the body of a stmt that declares `sym` with the value `value`.
+  void emit_with_value(var sym, const std::string& value, const stmt& body) {
+    std::string n = new_name(sym);
+    line() << "const index_t " << n << " = " << value << ";\n";
+    auto decl = declare(sym, n);
+    emit(body);
+  }
+
+  void emit_copy(const call_stmt* op) {
+    // The outputs of the call are the src, dst, and (optional) pad buffers of the copy, see `copy_call`. Copying to an
+    // empty dst does nothing, so `skip_if_empty` doesn't need to be checked.
+    assert(op->outputs.size() == 3);
+    std::string pad = op->outputs[2].defined() ? buf(op->outputs[2]) : "&slinky::no_padding";
+    line() << "g::copy(" << ctx_ << ", " << buf(op->outputs[0]) << ", " << buf(op->outputs[1]) << ", " << pad
+           << ");\n";
+  }
+
+  void emit(const call_stmt* op) {
+    if (is_copy(op)) return emit_copy(op);
+    auto index = call_indices_.find(op);
+    assert(index != call_indices_.end());
+    std::string n = temp("call");
+    open("{");
+    std::string scalars;
+    variable_finder deps;
+    for (std::size_t i = 0; i < op->scalars.size(); ++i) {
+      if (i > 0) scalars += ", ";
+      scalars += construct(op->scalars[i]);
+      if (op->scalars[i].defined()) op->scalars[i].accept(&deps);
+    }
+    line() << "static const slinky::stmt " << n << " = slinky::call_stmt::make(nullptr, " << construct(op->inputs)
+           << ", " << construct(op->outputs) << ", {" << scalars << "}, {" << op->attrs.allow_in_place << ", "
+           << op->attrs.min_rank << ", " << string_literal(op->attrs.name) << ", "
+           << (op->attrs.skip_if_empty ? "true" : "false") << ", " << (op->attrs.full_tile ? "true" : "false")
+           << "});\n";
+    for (var i : op->inputs) {
+      sync(i);
+    }
+    for (var i : op->outputs) {
+      sync(i);
+    }
+    for (var i : deps.vars) {
+      // Symbols declared by lets in the scalars aren't in scope here.
+      if (names_.contains(i)) sync(i);
+    }
+    line() << "const slinky::call_stmt* op = " << n << ".as<slinky::call_stmt>();\n";
+    const bool skip_if_empty = op->attrs.skip_if_empty && !op->outputs.empty();
+    if (skip_if_empty) open("if (!g::outputs_empty(" + ctx_ + ", op)) {");
+    line() << "if (index_t r = calls[" << index->second << "](op, " << ctx_ << ")) return g::call_failed(" << ctx_
+           << ", op, r);\n";
+    if (skip_if_empty) close();
+    close();
+  }
+
+  void emit(const let_stmt* op) {
+    open("{");
+    std::vector<scoped_value_in_symbol_map<std::string>> decls;
+    for (const auto& i : op->lets) {
+      std::string value = emit(i.second);
+      std::string n = new_name(i.first);
+      line() << "const index_t " << n << " = " << value << ";\n";
+      decls.push_back(declare(i.first, n));
+    }
+    emit(op->body);
+    close();
+  }
+
+  void emit_serial(const loop* op, const std::string& min, const std::string& max, const std::string& step) {
+    std::string n = new_name(op->sym);
+    open("for (index_t " + n + " = " + min + "; " + min + " <= " + n + " && " + n + " <= " + max + "; " + n +
+         " += " + step + ") {");
+    auto decl = declare(op->sym, n);
+    emit(op->body);
+    close();
+  }
+
+  void emit_parallel(const loop* op, const std::string& min, const std::string& max, const std::string& step,
+      const std::string& max_workers) {
+    open("{");
+    std::string n = temp("n");
+    std::string result = temp("result");
+    std::string i = temp("i");
+    std::string ctx = temp("ctx");
+    line() << "const index_t " << n << " = std::max<index_t>(0, slinky::ceil_div<index_t>(" << max << " - " << min
+           << " + 1, " << step << "));\n";
+    line() << "std::atomic<index_t> " << result << "{0};\n";
+    // Each worker makes a copy of the lambda, and so has its own context for calling callbacks.
+    open(ctx_ + ".config->thread_pool->parallel_for(static_cast<std::size_t>(" + n + "), [&, " + ctx +
+         " = slinky::eval_context()](std::size_t " + i + ") mutable {");
+    line() << "g::init_context(" << ctx << ", " << ctx_ << ", " << context_size_ << ");\n";
+    std::string sym = new_name(op->sym);
+    line() << "const index_t " << sym << " = static_cast<index_t>(" << i << ") * " << step << " + " << min << ";\n";
+    {
+      auto decl = declare(op->sym, sym);
+      std::string body = emit_lambda(op->body, ctx);
+      line() << "g::set_result(" << result << ", " << body << ");\n";
+    }
+    std::string grain;
+    if (op->grain.defined()) {
+      grain = ", static_cast<std::size_t>(std::max<index_t>(1, " + emit(op->grain) + "))";
+    }
+    close("}, " + max_workers + grain + ");");
+    line() << "if (index_t r = " << result << ") return r;\n";
+    close();
+  }
+
+  void emit(const loop* op) {
+    open("{");
+    std::string min = temp("min");
+    std::string max = temp("max");
+    std::string step = temp("step");
+    line() << "const index_t " << min << " = " << emit(op->bounds.min) << ";\n";
+    line() << "const index_t " << max << " = " << (op->bounds.is_point() ? min : emit(op->bounds.max)) << ";\n";
+    line() << "const index_t " << step << " = " << emit(op->step, "1") << ";\n";
+    if (std::optional<index_t> max_workers = as_constant(op->max_workers)) {
+      if (*max_workers > 1) {
+        index_t clamped = std::min<index_t>(*max_workers, std::numeric_limits<int>::max());
+        emit_parallel(op, min, max, step, std::to_string(clamped));
+      } else {
+        emit_serial(op, min, max, step);
+      }
+    } else {
+      std::string workers = temp("max_workers");
+      line() << "const index_t " << workers << " = " << emit(op->max_workers) << ";\n";
+      open("if (" + workers + " > 1) {");
+      emit_parallel(op, min, max, step,
+          "static_cast<int>(std::min<index_t>(" + workers + ", std::numeric_limits<int>::max()))");
+      reopen("} else {");
+      emit_serial(op, min, max, step);
+      close();
+    }
+    close();
+  }
+
+  void emit(const async* op) {
+    open("{");
+    std::string task_result = temp("task_result");
+    std::string task = temp("task");
+    std::string ctx = temp("ctx");
+    std::string pool = temp("pool");
+    std::string handle = temp("handle");
+    line() << "index_t " << task_result << " = 0;\n";
+    open("auto " + task + " = [&]() {");
+    line() << "slinky::eval_context " << ctx << ";\n";
+    line() << "g::init_context(" << ctx << ", " << ctx_ << ", " << context_size_ << ");\n";
+    std::string result = emit_lambda(op->task, ctx);
+    line() << task_result << " = " << result << ";\n";
+    close("};");
+    line() << "slinky::thread_pool* " << pool << " = " << ctx_ << ".config->thread_pool;\n";
+    line() << "slinky::ref_count<slinky::thread_pool::task> " << handle << ";\n";
+    open("if (" + pool + ") {");
+    line() << handle << " = " << pool << "->enqueue(std::move(" << task << "));\n";
+    reopen("} else {");
+    line() << task << "();\n";
+    close();
+    std::string task_ptr = "static_cast<slinky::thread_pool::task*>(" + handle + ")";
+    std::optional<scoped_value_in_symbol_map<std::string>> decl;
+    if (op->sym.defined()) {
+      std::string sym = new_name(op->sym);
+      line() << "const index_t " << sym << " = g::value(" << task_ptr << ");\n";
+      decl.emplace(names_, op->sym, sym);
+    }
+    result = emit_lambda(op->body, ctx_);
+    line() << "if (" << pool << ") " << pool << "->wait_for(" << task_ptr << ");\n";
+    line() << "if (" << task_result << ") return " << task_result << ";\n";
+    line() << "if (" << result << ") return " << result << ";\n";
+    close();
+  }
+
+  // Emit code to initialize the dims of the buffer `b` from `dims`.
+  void emit_dims(const std::string& b, const std::vector<dim_expr>& dims, const char* default_stride) {
+    for (std::size_t d = 0; d < dims.size(); ++d) {
+      const dim_expr& dim = dims[d];
+      std::string min = emit(dim.bounds.min);
+      std::string max = dim.bounds.is_point() ? "" : emit(dim.bounds.max);
+      if (dim.bounds.is_point()) {
+        max = temp("x");
+        line() << "const index_t " << max << " = " << min << ";\n";
+        min = max;
+      }
+      line() << b << ".dims[" << d << "] = slinky::dim(" << min << ", " << max << ", "
+             << emit(dim.stride, default_stride) << ", " << emit(dim.fold_factor, "slinky::dim::unfolded") << ");\n";
+    }
+    line() << b << ".remove_trailing_broadcasts();\n";
+  }
+
+  void emit(const allocate* op) {
+    open("{");
+    std::string b = temp("buffer");
+    line() << "g::allocated_buffer " << b << "(" << op->dims.size() << ");\n";
+    line() << b << ".elem_size = " << emit(op->elem_size) << ";\n";
+    emit_dims(b, op->dims, "slinky::dim::auto_stride");
+    if (op->storage == memory_type::heap) {
+      line() << b << ".allocate_heap(*" << ctx_ << ".config, slinky::var(" << op->sym.id << "));\n";
+      emit_with_value(op->sym, "g::value(&" + b + ")", op->body);
+    } else {
+      // The stack memory is freed when the lambda returns.
+      std::string result = temp("result");
+      open("const index_t " + result + " = [&]() -> index_t {");
+      open("if (std::size_t size = " + b + ".init_stack(*" + ctx_ + ".config, slinky::var(" +
+           std::to_string(op->sym.id) + "), slinky::memory_type::" + memory_type_name(op->storage) + ")) {");
+      line() << b << ".set_stack(*" << ctx_ << ".config, SLINKY_ALLOCA(char, size));\n";
+      close();
+      emit_with_value(op->sym, "g::value(&" + b + ")", op->body);
+      line() << "return 0;\n";
+      close("}();");
+      line() << "if (" << result << ") return " << result << ";\n";
+    }
+    close();
+  }
+
+  void emit(const make_buffer* op) {
+    open("{");
+    std::string b = temp("buffer");
+    line() << "g::local_buffer " << b << "(" << op->dims.size() << ");\n";
+    line() << b << ".elem_size = " << emit(op->elem_size, "0") << ";\n";
+    line() << b << ".base = reinterpret_cast<void*>(" << emit(op->base, "0") << ");\n";
+    emit_dims(b, op->dims, "slinky::dim::auto_stride");
+    emit_with_value(op->sym, "g::value(&" + b + ")", op->body);
+    close();
+  }
+
+  // Constant buffers are stored densely in the generated code.
+  std::string define_constant(const constant_buffer* op) {
+    auto i = constants_.find(op);
+    if (i != constants_.end()) return i->second;
+
+    raw_buffer_ptr value = raw_buffer::make_copy(*op->value);
+    std::string n = fname_ + "_constant_" + std::to_string(constants_.size());
+    std::size_t size = value->size_bytes();
+    std::string data = "nullptr";
+    if (size > 0 && value->base) {
+      data = n + "_data";
+      globals_ << "alignas(16) unsigned char " << data << "[] = {";
+      const unsigned char* bytes = reinterpret_cast<const unsigned char*>(value->base);
+      for (std::size_t j = 0; j < size; ++j) {
+        if (j % 32 == 0) globals_ << "\n    ";
+        globals_ << static_cast<int>(bytes[j]) << ",";
+      }
+      globals_ << "\n};\n";
+    }
+    std::string dims = "nullptr";
+    if (value->rank > 0) {
+      dims = n + "_dims";
+      globals_ << "slinky::dim " << dims << "[] = {";
+      for (std::size_t d = 0; d < value->rank; ++d) {
+        const slinky::dim& dim = value->dim(d);
+        if (d > 0) globals_ << ", ";
+        globals_ << "slinky::dim(" << literal(dim.min()) << ", " << literal(dim.max()) << ", "
+                 << literal(dim.stride()) << ", " << literal(dim.fold_factor()) << ")";
+      }
+      globals_ << "};\n";
+    }
+    globals_ << "slinky::raw_buffer " << n << " = slinky::generated::make_raw_buffer(" << data << ", "
+             << value->elem_size << ", " << value->rank << ", " << dims << ");\n";
+    constants_[op] = n;
+    return n;
+  }
+
+  void emit(const constant_buffer* op) {
+    open("{");
+    emit_with_value(op->sym, "g::value(&" + define_constant(op) + ")", op->body);
+    close();
+  }
+
+  void emit(const clone_buffer* op) {
+    open("{");
+    std::string b = temp("buffer");
+    line() << "g::local_buffer " << b << "(*" << buf(op->src) << ");\n";
+    emit_with_value(op->sym, "g::value(&" + b + ")", op->body);
+    close();
+  }
+
+  // Emit code to crop dimension `d` of the buffer pointed to by `b`. Undefined bounds are unchanged.
+  void emit_crop(const std::string& b, int d, const interval_expr& bounds) {
+    if (!bounds.min.defined() && !bounds.max.defined()) return;
+    std::string min = emit(bounds.min, b + "->dim(" + std::to_string(d) + ").min()");
+    std::string max;
+    if (bounds.is_point()) {
+      max = temp("x");
+      line() << "const index_t " << max << " = " << min << ";\n";
+      min = max;
+    } else {
+      max = emit(bounds.max, b + "->dim(" + std::to_string(d) + ").max()");
+    }
+    line() << "g::crop(" << b << ", " << d << ", " << min << ", " << max << ");\n";
+  }
+
+  void emit(const crop_buffer* op) {
+    open("{");
+    std::size_t rank = op->bounds.size();
+    while (rank > 0 && !op->bounds[rank - 1].min.defined() && !op->bounds[rank - 1].max.defined()) {
+      --rank;
+    }
+    std::string b = temp("buffer");
+    if (op->sym == op->src) {
+      line() << "slinky::raw_buffer* " << b << " = " << buf(op->src) << ";\n";
+      if (rank > 0) line() << "g::crop_guard<" << rank << "> " << temp("guard") << "(" << b << ");\n";
+      for (std::size_t d = 0; d < rank; ++d) {
+        emit_crop(b, d, op->bounds[d]);
+      }
+      emit(op->body);
+    } else {
+      line() << "g::local_buffer " << b << "(*" << buf(op->src) << ");\n";
+      for (std::size_t d = 0; d < rank; ++d) {
+        emit_crop("(&" + b + ")", d, op->bounds[d]);
+      }
+      emit_with_value(op->sym, "g::value(&" + b + ")", op->body);
+    }
+    close();
+  }
+
+  void emit(const crop_dim* op) {
+    open("{");
+    std::string b = temp("buffer");
+    if (op->sym == op->src) {
+      line() << "slinky::raw_buffer* " << b << " = " << buf(op->src) << ";\n";
+      line() << "g::crop_dim_guard " << temp("guard") << "(" << b << ", " << op->dim << ");\n";
+      emit_crop(b, op->dim, op->bounds);
+      emit(op->body);
+    } else {
+      line() << "g::local_buffer " << b << "(*" << buf(op->src) << ");\n";
+      emit_crop("(&" + b + ")", op->dim, op->bounds);
+      emit_with_value(op->sym, "g::value(&" + b + ")", op->body);
+    }
+    close();
+  }
+
+  void emit(const slice_buffer* op) {
+    if (op->at.size() > 64) {
+      fail();
+      return;
+    }
+    open("{");
+    std::string src = temp("src");
+    std::string b = temp("buffer");
+    line() << "const slinky::raw_buffer* " << src << " = " << buf(op->src) << ";\n";
+    line() << "g::local_buffer " << b << "(" << src << "->rank);\n";
+    line() << b << ".base = " << src << "->base;\n";
+    std::uint64_t sliced = 0;
+    for (std::size_t d = 0; d < op->at.size(); ++d) {
+      if (!op->at[d].defined()) continue;
+      sliced |= std::uint64_t{1} << d;
+      line() << "if (" << d << " < " << src << "->rank) " << b << ".base = g::at(" << b << ".base, " << src << ", " << d
+             << ", " << emit(op->at[d]) << ");\n";
+    }
+    line() << "g::slice_dims(" << b << ", *" << src << ", " << "std::uint64_t{" << sliced << "u});\n";
+    emit_with_value(op->sym, "g::value(&" + b + ")", op->body);
+    close();
+  }
+
+  void emit(const slice_dim* op) {
+    open("{");
+    std::string src = temp("src");
+    std::string b = temp("buffer");
+    line() << "const slinky::raw_buffer* " << src << " = " << buf(op->src) << ";\n";
+    line() << "g::local_buffer " << b << "(" << src << "->rank);\n";
+    line() << "g::slice_dim(" << b << ", *" << src << ", " << op->dim << ", " << emit(op->at) << ");\n";
+    emit_with_value(op->sym, "g::value(&" + b + ")", op->body);
+    close();
+  }
+
+  void emit(const transpose* op) {
+    open("{");
+    if (op->sym == op->src && op->is_truncate()) {
+      line() << "g::rank_guard " << temp("guard") << "(" << buf(op->src) << ", " << op->dims.size() << ");\n";
+      emit(op->body);
+    } else {
+      std::string src = temp("src");
+      std::string b = temp("buffer");
+      line() << "const slinky::raw_buffer* " << src << " = " << buf(op->src) << ";\n";
+      line() << "g::local_buffer " << b << "(" << op->dims.size() << ");\n";
+      line() << b << ".base = " << src << "->base;\n";
+      line() << b << ".elem_size = " << src << "->elem_size;\n";
+      for (std::size_t d = 0; d < op->dims.size(); ++d) {
+        line() << b << ".dims[" << d << "] = " << src << "->dim(" << op->dims[d] << ");\n";
+      }
+      line() << b << ".remove_trailing_broadcasts();\n";
+      emit_with_value(op->sym, "g::value(&" + b + ")", op->body);
+    }
+    close();
+  }
+
+  void emit(const check* op) {
+    open("if (!" + emit(op->condition) + ") {");
+    std::string c = temp("condition");
+    line() << "static const slinky::expr " << c << " = " << construct(op->condition) << ";\n";
+    line() << "return g::check_failed(" << ctx_ << ", " << c << ");\n";
+    close();
+  }
+};
+
+}  // namespace
+
+std::vector<call_stmt::callable> generated_pipeline_calls(const pipeline& p) {
+  call_finder calls;
+  p.body.accept(&calls);
+  std::vector<call_stmt::callable> result;
+  result.reserve(calls.calls.size());
+  for (const call_stmt* i : calls.calls) {
+    result.push_back(i->target);
+  }
+  return result;
+}
+
+std::string generate_pipeline_source(const pipeline& p, const std::string& fname) {
+  source_generator gen(p, fname);
+
+  gen.emit_line("using slinky::index_t;");
+  gen.emit_line("namespace g = slinky::generated;");
+  gen.emit_line("ctx.reserve(" + std::to_string(gen.context_size()) + ");");
+  for (std::size_t i = 0; i < p.args.size(); ++i) {
+    gen.declare_global(p.args[i], "args[" + std::to_string(i) + "]");
+  }
+  for (std::size_t i = 0; i < p.inputs.size(); ++i) {
+    gen.declare_global(p.inputs[i], "g::value(inputs[" + std::to_string(i) + "])");
+  }
+  for (std::size_t i = 0; i < p.outputs.size(); ++i) {
+    gen.declare_global(p.outputs[i], "g::value(outputs[" + std::to_string(i) + "])");
+  }
+  if (p.heap_high_water.defined()) {
+    gen.emit_open("if (ctx.config->use_arena) {");
+    gen.emit_line("slinky::reserve_thread_arena(*ctx.config, " + gen.emit(p.heap_high_water) + ", " +
+                  std::to_string(p.heap_high_water_allocations) + ");");
+    gen.emit_close("}");
+  }
+  gen.emit(p.body);
+  gen.emit_line("return 0;");
+  if (!gen.ok) return std::string();
+
+  call_finder calls;
+  p.body.accept(&calls);
+
+  std::stringstream os;
+  os << "// Generated by slinky::generate_pipeline_source.\n";
+  os << "#include \"slinky/runtime/generated_support.h\"\n\n";
+  std::string globals = gen.globals();
+  if (!globals.empty()) {
+    os << "namespace {\n\n" << globals << "\n}  // namespace\n\n";
+  }
+  os << "extern const char* const " << fname << "_calls[] = {";
+  for (const call_stmt* i : calls.calls) {
+    os << string_literal(i->attrs.name) << ", ";
+  }
+  os << "nullptr};\n";
+  os << "extern const std::size_t " << fname << "_call_count = " << calls.calls.size() << ";\n\n";
+  os << "slinky::index_t " << fname
+     << "(const slinky::call_stmt::callable* calls, slinky::span<const slinky::index_t> args,\n"
+     << "    slinky::span<const slinky::raw_buffer*> inputs, slinky::span<const slinky::raw_buffer*> outputs,\n"
+     << "    slinky::eval_context& ctx) {\n";
+  os << gen.body();
+  os << "}\n";
+  return os.str();
+}
+
+}  // namespace slinky
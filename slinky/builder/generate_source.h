@@ -0,0 +1,38 @@
+#ifndef SLINKY_BUILDER_GENERATE_SOURCE_H
+#define SLINKY_BUILDER_GENERATE_SOURCE_H
+
+#include <string>
+#include <vector>
+
+#include "slinky/runtime/pipeline.h"
+#include "slinky/runtime/stmt.h"
+
+namespace slinky {
+
+// Generate C++ source code that implements the already built pipeline `p`, so it can be compiled ahead of time instead
+// of being interpreted by `evaluate`. The generated code defines a function named `fname`:
+//
+//   slinky::index_t fname(const slinky::call_stmt::callable* calls, slinky::span<const slinky::index_t> args,
+//       slinky::span<const slinky::raw_buffer*> inputs, slinky::span<const slinky::raw_buffer*> outputs,
+//       slinky::eval_context& ctx);
+//
+// which has the same behavior as `p.evaluate(args, inputs, outputs, ctx)`. The targets of the `call_stmt`s of the
+// pipeline are not part of the generated code, they are called via `calls`, which should be the result of
+// `generated_pipeline_calls(p)` (or callables that are equivalent to them). The code also defines `fname_calls`, an
+// array of the names of the targets in the same order, and `fname_call_count`, the size of that array. Copies
+// implemented by `build_pipeline` are not in `calls`, the generated code calls `slinky::copy` (or `parallel_copy`)
+// directly, so copies with a custom implementation (see `func::make_copy`) behave as if they used the default. The
+// contents of constant buffers are copied into the generated code. The generated code requires
+// "slinky/runtime/generated_support.h".
+//
+// Returns an empty string if `p` can't be generated, because it contains `copy_stmt`s (which should have been
+// implemented by `build_pipeline`), calls to user defined `call` exprs, or exprs that can't be evaluated.
+std::string generate_pipeline_source(const pipeline& p, const std::string& fname = "p");
+
+// Returns the targets of the `call_stmt`s of `p` that are not copies, in the order expected by the code generated by
+// `generate_pipeline_source`.
+std::vector<call_stmt::callable> generated_pipeline_calls(const pipeline& p);
+
+}  // namespace slinky
+
+#endif  // SLINKY_BUILDER_GENERATE_SOURCE_H
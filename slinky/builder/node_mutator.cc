@@ -41,7 +41,7 @@ expr mutate_binary(node_mutator* this_, const T* op) {
 }  // namespace
 
 stmt clone_with(const loop* op, var sym, stmt new_body) {
-  return loop::make(sym, op->max_workers, op->bounds, op->step, std::move(new_body));
+  return loop::make(sym, op->max_workers, op->bounds, op->step, std::move(new_body), op->grain);
 }
 stmt clone_with(const allocate* op, var sym, stmt new_body) {
   return allocate::make(sym, op->storage, op->elem_size, op->dims, std::move(new_body));
@@ -198,12 +198,14 @@ void node_mutator::visit(const loop* op) {
   interval_expr bounds = mutate(op->bounds);
   expr step = mutate(op->step);
   expr max_workers = mutate(op->max_workers);
+  expr grain = mutate(op->grain);
   stmt body = mutate(op->body);
   if (bounds.same_as(op->bounds) && step.same_as(op->step) && max_workers.same_as(op->max_workers) &&
-      body.same_as(op->body)) {
+      grain.same_as(op->grain) && body.same_as(op->body)) {
     set_result(op);
   } else {
-    set_result(loop::make(op->sym, std::move(max_workers), std::move(bounds), std::move(step), std::move(body)));
+    set_result(loop::make(
+        op->sym, std::move(max_workers), std::move(bounds), std::move(step), std::move(body), std::move(grain)));
   }
 }
 void node_mutator::visit(const call_stmt* op) {
@@ -1200,21 +1200,9 @@ stmt implement_copy(const copy_stmt* op, node_context& ctx) {
   // We're going to slice this buffer, to avoid messing with metadata in the user expressions, work on a clone instead.
   var dst = ctx.insert_unique(ctx.name(op->dst) + ".sliced");
   call_stmt::attributes copy_attrs;
-  copy_attrs.name = "copy";
-  stmt result = call_stmt::make(
-      [impl = op->impl](const call_stmt* op, const eval_context& ctx) -> index_t {
-        // TODO: This passes the src buffer as an output, not an input, because slinky thinks the bounds of inputs
-        // don't matter. But in this case, they do...
-        const raw_buffer* src_buf = ctx.lookup_buffer(op->outputs[0]);
-        const raw_buffer* dst_buf = ctx.lookup_buffer(op->outputs[1]);
-        const raw_buffer* pad_buf = op->outputs[2].defined() ? ctx.lookup_buffer(op->outputs[2]) : &no_padding;
-        assert(src_buf);
-        assert(dst_buf);
-        assert(pad_buf);
-        impl(*src_buf, *dst_buf, *pad_buf);
-        return 0;
-      },
-      {}, {op->src, dst, op->pad}, {}, std::move(copy_attrs));
+  // Name the call after the destination, so profiles and traces can tell the copies of a pipeline apart.
+  copy_attrs.name = "copy(" + ctx.name(op->dst) + ")";
+  stmt result = call_stmt::make(copy_call{op->impl}, {}, {op->src, dst, op->pad}, {}, std::move(copy_attrs));
 
   std::vector<expr> src_x = op->src_x;
   std::vector<var> dst_x = op->dst_x;
@@ -1385,6 +1373,327 @@ stmt insert_early_free(const stmt& s) {
 
 namespace {
 
+// Finds the allocations in a region of a stmt (not including the bodies of loops in the region) that could be placed
+// in a slab allocated at the beginning of the region, and the interval of the region in which each is used.
+class allocation_lifetime_finder : public recursive_node_visitor {
+  bounds_map bounds;
+
+  // The symbols declared inside the region we are currently inside of.
+  std::vector<var> decls;
+
+  // The buffers we are currently inside, with the bounds of their dimensions in terms of the enclosing buffers.
+  struct buffer_info {
+    var sym;
+    var src;
+    std::vector<dim_expr> dims;
+  };
+  std::vector<buffer_info> buffers;
+
+  // Which allocation each buffer symbol refers to the memory of.
+  symbol_map<std::size_t> allocation_of;
+
+  // The number of `call_stmt`, `copy_stmt`, `check` and `loop` nodes visited so far.
+  index_t position = 0;
+
+  // Rewrite `e` to depend on the bounds of the buffers declared outside the region instead of buffers inside of it.
+  expr resolve_buffers(expr e) const {
+    for (auto i = buffers.rbegin(); i != buffers.rend(); ++i) {
+      e = substitute_buffer(e, i->sym, i->dims, i->src);
+    }
+    return e;
+  }
+
+  // The number of bytes used by a buffer allocated with dense strides by `op`, which is the same as the size of the
+  // allocation `evaluate` would make when the stride alignment is 1.
+  static expr dense_size(const allocate* op) {
+    expr size = op->elem_size;
+    for (const dim_expr& d : op->dims) {
+      if (d.stride.defined()) return expr();
+      if (d.fold_factor.defined()) {
+        if (!is_positive(d.fold_factor)) return expr();
+        size *= d.fold_factor;
+      } else {
+        size *= max(d.bounds.extent(), 0);
+      }
+    }
+    return size;
+  }
+
+  // Record a use of the allocations that the symbols `s` depends on refer to.
+  template <typename T>
+  void visit_use(const T& s) {
+    for (var i : find_dependencies(s)) {
+      if (std::optional<std::size_t> a = allocation_of.lookup(i)) {
+        allocation& alloc = allocations[*a];
+        if (alloc.begin < 0) alloc.begin = position;
+        alloc.end = position;
+      }
+    }
+    ++position;
+  }
+
+  template <typename T>
+  void visit_decl(const T* op, std::optional<std::size_t> alias = std::nullopt) {
+    auto set_alias = set_value_in_scope(allocation_of, op->sym, alias);
+    decls.push_back(op->sym);
+    recursive_node_visitor::visit(op);
+    decls.pop_back();
+  }
+
+  std::optional<std::size_t> alias_of_base(const expr& base) {
+    for (var i : find_dependencies(base)) {
+      if (std::optional<std::size_t> a = allocation_of.lookup(i)) return a;
+    }
+    return std::nullopt;
+  }
+
+  void visit_crop(var sym, var src, const box_expr& crop, const stmt& body) {
+    box_expr clamped(crop.size());
+    for (std::size_t d = 0; d < crop.size(); ++d) {
+      clamped[d] = crop[d] & buffer_bounds(src, d);
+    }
+    auto set_alias = set_value_in_scope(allocation_of, sym, allocation_of.lookup(src));
+    buffers.push_back({sym, src, make_dims_from_bounds(clamped)});
+    decls.push_back(sym);
+    body.accept(this);
+    decls.pop_back();
+    buffers.pop_back();
+  }
+
+public:
+  struct allocation {
+    var sym;
+    memory_type storage;
+    // An upper bound of the size of the allocation, in terms of symbols declared outside the region.
+    expr size;
+    // The allocation is used in the interval [begin, end] of positions, or not at all if begin is negative.
+    index_t begin;
+    index_t end;
+  };
+  std::vector<allocation> allocations;
+
+  // `async` runs stmts concurrently, which breaks the assumption that positions are executed in order.
+  bool found_async = false;
+
+  void visit(const loop* op) override { visit_use(stmt(op)); }
+  void visit(const call_stmt* op) override { visit_use(stmt(op)); }
+  void visit(const copy_stmt* op) override { visit_use(stmt(op)); }
+  void visit(const check* op) override {
+    // Frees inserted by `insert_early_free` are not uses.
+    if (!as_intrinsic(op->condition, intrinsic::free)) visit_use(op->condition);
+  }
+  void visit(const async*) override { found_async = true; }
+
+  void visit(const let_stmt* op) override {
+    std::vector<scoped_value_in_symbol_map<interval_expr>> set_bounds;
+    std::vector<scoped_value_in_symbol_map<std::size_t>> set_aliases;
+    set_bounds.reserve(op->lets.size());
+    set_aliases.reserve(op->lets.size());
+    for (const auto& i : op->lets) {
+      visit_use(i.second);
+      set_bounds.push_back(set_value_in_scope(bounds, i.first, bounds_of(i.second, bounds)));
+      // The value may be a pointer into an allocation (e.g. `buffer_at`), so uses of the variable are uses of the
+      // allocation too.
+      set_aliases.push_back(set_value_in_scope(allocation_of, i.first, alias_of_base(i.second)));
+      decls.push_back(i.first);
+    }
+    op->body.accept(this);
+    decls.resize(decls.size() - op->lets.size());
+  }
+
+  void visit(const make_buffer* op) override { visit_decl(op, alias_of_base(op->base)); }
+  void visit(const constant_buffer* op) override { visit_decl(op); }
+  void visit(const clone_buffer* op) override { visit_decl(op, allocation_of.lookup(op->src)); }
+  void visit(const slice_buffer* op) override { visit_decl(op, allocation_of.lookup(op->src)); }
+  void visit(const slice_dim* op) override { visit_decl(op, allocation_of.lookup(op->src)); }
+  void visit(const transpose* op) override { visit_decl(op, allocation_of.lookup(op->src)); }
+  void visit(const crop_buffer* op) override { visit_crop(op->sym, op->src, op->bounds, op->body); }
+  void visit(const crop_dim* op) override {
+    box_expr crop(op->dim + 1, interval_expr::all());
+    crop[op->dim] = op->bounds;
+    visit_crop(op->sym, op->src, crop, op->body);
+  }
+
+  void visit(const allocate* op) override {
+    std::optional<std::size_t> index;
+    if (op->storage != memory_type::stack) {
+      expr size = dense_size(op);
+      if (size.defined()) {
+        size = simplify(bounds_of(resolve_buffers(size), bounds).max);
+      }
+      if (size.defined() && !is_infinity(size) && !depends_on(size, decls).any()) {
+        index = allocations.size();
+        allocations.push_back({op->sym, op->storage, size, -1, -1});
+      }
+    }
+
+    buffers.push_back({op->sym, var(), {}});
+    for (const dim_expr& d : op->dims) {
+      buffers.back().dims.push_back({d.bounds});
+    }
+    visit_decl(op, index);
+    buffers.pop_back();
+  }
+};
+
+// Replaces the planned allocations in a region with `make_buffer` at an offset in a slab, and removes their frees.
+class slab_allocation_rewriter : public stmt_mutator {
+public:
+  struct planned {
+    var slab;
+    expr offset;
+  };
+  symbol_map<planned> plan;
+
+  void visit(const allocate* op) override {
+    stmt body = mutate(op->body);
+    const std::optional<planned>& p = plan[op->sym];
+    if (!p) {
+      set_result(clone_with(op, std::move(body)));
+      return;
+    }
+
+    std::vector<dim_expr> dims;
+    dims.reserve(op->dims.size());
+    expr stride = op->elem_size;
+    for (const dim_expr& d : op->dims) {
+      dims.push_back({d.bounds, stride, d.fold_factor});
+      stride = simplify(stride * (d.fold_factor.defined() ? d.fold_factor : max(d.bounds.extent(), 0)));
+    }
+    set_result(make_buffer::make(op->sym, buffer_at(p->slab, p->offset), op->elem_size, std::move(dims), body));
+  }
+
+  void visit(const check* op) override {
+    if (const call* c = as_intrinsic(op->condition, intrinsic::free)) {
+      if (std::optional<var> sym = as_variable(c->args[0]); sym && plan[*sym]) {
+        set_result(stmt());
+        return;
+      }
+    }
+    set_result(op);
+  }
+};
+
+class memory_planner : public stmt_mutator {
+  node_context& ctx;
+  index_t alignment;
+
+  // The largest peak of the slabs of the loop bodies inside the region being planned.
+  expr inner_peak = 0;
+
+  // Plan the allocations in `s`, not including those inside loops.
+  stmt plan_region(const stmt& s) {
+    allocation_lifetime_finder finder;
+    s.accept(&finder);
+    if (finder.found_async) {
+      peak = inner_peak;
+      return s;
+    }
+
+    slab_allocation_rewriter rewriter;
+    std::vector<std::pair<var, memory_type>> slabs;
+    std::vector<expr> slab_sizes;
+    for (memory_type storage : {memory_type::automatic, memory_type::heap}) {
+      std::vector<const allocation_lifetime_finder::allocation*> allocations;
+      for (const auto& i : finder.allocations) {
+        if (i.storage == storage) allocations.push_back(&i);
+      }
+      if (allocations.size() < 2) continue;
+
+      var slab = ctx.insert_unique("slab");
+      // The offsets and ends of the allocations we've placed so far.
+      std::vector<std::pair<expr, expr>> placed(allocations.size());
+      expr slab_size = 0;
+      for (std::size_t i = 0; i < allocations.size(); ++i) {
+        const auto& a = *allocations[i];
+        expr size = simplify(align_up(a.size, alignment));
+        auto overlaps = [&](std::size_t j) {
+          const auto& b = *allocations[j];
+          return a.begin >= 0 && b.begin >= 0 && a.begin <= b.end && b.begin <= a.end;
+        };
+
+        // Try to place this allocation at the beginning of the slab, or at the end of another allocation, such that
+        // we can prove it doesn't overlap any allocation that is live at the same time. If we can't prove that, we
+        // place it after all of the allocations that are live at the same time.
+        std::vector<expr> candidates = {0};
+        for (std::size_t j = 0; j < i; ++j) {
+          candidates.push_back(placed[j].second);
+        }
+        expr offset;
+        for (const expr& candidate : candidates) {
+          bool ok = true;
+          for (std::size_t j = 0; j < i && ok; ++j) {
+            if (!overlaps(j)) continue;
+            ok = prove_true(candidate + size <= placed[j].first || placed[j].second <= candidate);
+          }
+          if (ok) {
+            offset = candidate;
+            break;
+          }
+        }
+        if (!offset.defined()) {
+          offset = 0;
+          for (std::size_t j = 0; j < i; ++j) {
+            if (overlaps(j)) offset = max(offset, placed[j].second);
+          }
+          offset = simplify(offset);
+        }
+        placed[i] = {offset, simplify(offset + size)};
+        slab_size = simplify(max(slab_size, placed[i].second));
+        rewriter.plan[a.sym] = {slab, offset};
+      }
+      slabs.push_back({slab, storage});
+      slab_sizes.push_back(slab_size);
+    }
+    // The slabs of this region are live while the slabs of the loop bodies inside it are allocated.
+    peak = inner_peak;
+    for (const expr& i : slab_sizes) {
+      peak += i;
+    }
+    peak = simplify(peak);
+    if (slabs.empty()) return s;
+
+    stmt result = rewriter.mutate(s);
+    for (std::size_t i = 0; i < slabs.size(); ++i) {
+      result = allocate::make(slabs[i].first, slabs[i].second, 1, {dim_expr{{0, slab_sizes[i] - 1}}}, result);
+    }
+    return result;
+  }
+
+public:
+  // The number of bytes of the slabs allocated at the same time by the last region planned.
+  expr peak = 0;
+
+  memory_planner(node_context& ctx, index_t alignment) : ctx(ctx), alignment(alignment) {}
+
+  stmt plan(const stmt& s) {
+    expr old_inner_peak = std::exchange(inner_peak, 0);
+    stmt result = plan_region(mutate(s));
+    inner_peak = std::move(old_inner_peak);
+    return result;
+  }
+
+  void visit(const loop* op) override {
+    stmt body = plan(op->body);
+    // The peak of the loop body may depend on the loop variable.
+    expr body_peak = simplify(bounds_of(peak, {{op->sym, op->bounds}}).max);
+    inner_peak = simplify(max(inner_peak, body_peak));
+    set_result(clone_with(op, std::move(body)));
+  }
+};
+
+}  // namespace
+
+stmt plan_memory(const stmt& s, node_context& ctx, index_t alignment, expr* peak) {
+  scoped_trace trace("plan_memory");
+  memory_planner planner(ctx, alignment);
+  stmt result = planner.plan(s);
+  if (peak) *peak = planner.peak;
+  return result;
+}
+
+namespace {
+
 class pure_dims_remover : public stmt_mutator {
   // Track dimensions of buffers that are provably one.
   using sliceable_dims = std::bitset<64>;
@@ -1554,6 +1863,194 @@ stmt remove_pure_dims(const stmt& s) {
 
 namespace {
 
+// Matches `value`, or `value` clamped by `clamp`, i.e. `max(clamp, value)` if `is_min` is true, or `min(clamp, value)`
+// otherwise.
+bool match_clamped(const expr& e, const expr& value, bool is_min, expr& clamp) {
+  if (prove_true(e == value)) return true;
+  expr a, b;
+  if (is_min) {
+    const class max* m = e.as<class max>();
+    if (!m) return false;
+    a = m->a;
+    b = m->b;
+  } else {
+    const class min* m = e.as<class min>();
+    if (!m) return false;
+    a = m->a;
+    b = m->b;
+  }
+  if (prove_true(b == value)) {
+    clamp = a;
+    return true;
+  } else if (prove_true(a == value)) {
+    clamp = b;
+    return true;
+  }
+  return false;
+}
+
+class loop_tail_splitter : public stmt_mutator {
+  node_context& ctx;
+
+  struct tile_crop {
+    const crop_dim* op;
+    // The bounds of the crop when the tile is entirely inside the buffer, i.e. without any clamps.
+    interval_expr tile;
+    bool full;
+  };
+
+  // For each buffer, whether every dimension cropped to a tile of a loop has an extent equal to the step of that loop.
+  symbol_map<bool> full_tiles;
+  // The crops to a tile of the loops we are in.
+  std::vector<tile_crop> tile_crops;
+  // The number of calls we've marked as operating on full tiles.
+  int full_calls = 0;
+
+  template <typename T>
+  void visit_decl(const T* op, std::optional<bool> full) {
+    auto set_full = set_value_in_scope(full_tiles, op->sym, full);
+    stmt_mutator::visit(op);
+  }
+
+public:
+  loop_tail_splitter(node_context& ctx) : ctx(ctx) {}
+
+  void visit(const loop* op) override {
+    // `func::loops` crops the outputs of the func to one tile at the start of the loop body. The crops may be clamped
+    // to the bounds of the buffer, or to the bounds of a buffer cropped to the same tile earlier in the chain.
+    const interval_expr tile = {op->sym, simplify(expr(op->sym) + op->step - 1)};
+    expr lo = op->bounds.min;
+    expr hi = op->bounds.max;
+    std::vector<tile_crop> crops;
+    for (const crop_dim* c = op->body.as<crop_dim>(); c; c = c->body.as<crop_dim>()) {
+      expr clamp_min, clamp_max;
+      if (!match_clamped(c->bounds.min, tile.min, /*is_min=*/true, clamp_min)) break;
+      if (!match_clamped(c->bounds.max, tile.max, /*is_min=*/false, clamp_max)) break;
+      bool valid = true;
+      for (expr* clamp : {&clamp_min, &clamp_max}) {
+        if (!clamp->defined()) continue;
+        for (const tile_crop& i : crops) {
+          if (!depends_on(*clamp, i.op->sym).any()) continue;
+          // Clamping to the bounds of another tile crop of the same dimension doesn't change the full tiles.
+          if (i.op->dim == c->dim && (is_variable(*clamp, i.op->sym, buffer_field::min, c->dim) ||
+                                         is_variable(*clamp, i.op->sym, buffer_field::max, c->dim))) {
+            *clamp = expr();
+          } else {
+            valid = false;
+          }
+        }
+      }
+      if (!valid) break;
+      // The source of this crop may be another crop in the chain, which isn't declared outside the loop.
+      var src = c->src;
+      for (auto i = crops.rbegin(); i != crops.rend(); ++i) {
+        if (i->op->sym == src) src = i->op->src;
+      }
+      lo = max(lo, buffer_min(src, c->dim));
+      hi = min(hi, buffer_max(src, c->dim));
+      if (clamp_min.defined()) lo = max(lo, clamp_min);
+      if (clamp_max.defined()) hi = min(hi, clamp_max);
+      crops.push_back({c, tile, true});
+    }
+    if (crops.empty()) {
+      stmt_mutator::visit(op);
+      return;
+    }
+
+    const std::size_t tile_crops_size = tile_crops.size();
+    tile_crops.insert(tile_crops.end(), crops.begin(), crops.end());
+    const int full_calls_before = full_calls;
+    stmt full_body = mutate(op->body);
+    const bool any_full_calls = full_calls > full_calls_before;
+    for (std::size_t i = tile_crops_size; i < tile_crops.size(); ++i) {
+      tile_crops[i].full = false;
+    }
+    stmt partial_body = mutate(op->body);
+    tile_crops.resize(tile_crops_size);
+
+    if (!any_full_calls) {
+      // Nothing in this loop cares about having full tiles.
+      if (partial_body.same_as(op->body)) {
+        set_result(op);
+      } else {
+        set_result(loop::make(op->sym, op->max_workers, op->bounds, op->step, std::move(partial_body), op->grain));
+      }
+      return;
+    }
+
+    // Find the iterations of the loop where the tiles are entirely inside the buffers being cropped. We leave
+    // simplifying these to the simplifier, which knows the bounds of the buffers. If there are no full tiles, the loop
+    // over the partial tiles before them must still stop at the end of the loop.
+    var full_min(ctx, ctx.name(op->sym) + ".full_min");
+    var full_end(ctx, ctx.name(op->sym) + ".full_end");
+    std::vector<std::pair<var, expr>> lets = {
+        {full_min, min(op->bounds.min + align_up(max(lo - op->bounds.min, 0), op->step), op->bounds.max + 1)},
+        {full_end, full_min + align_down(max(hi - full_min + 1, 0), op->step)},
+    };
+    stmt result = block::make({
+        loop::make(op->sym, op->max_workers, {op->bounds.min, full_min - 1}, op->step, partial_body, op->grain),
+        loop::make(op->sym, op->max_workers, {full_min, full_end - op->step}, op->step, full_body, op->grain),
+        loop::make(op->sym, op->max_workers, {full_end, op->bounds.max}, op->step, partial_body, op->grain),
+    });
+    set_result(let_stmt::make(std::move(lets), std::move(result)));
+  }
+
+  void visit(const crop_dim* op) override {
+    for (const tile_crop& i : tile_crops) {
+      if (i.op != op) continue;
+      if (!i.full || !full_tiles.lookup(op->src).value_or(true)) break;
+      // This is a full tile, we don't need the clamps.
+      interval_expr tile = i.tile;
+      stmt body;
+      {
+        auto set_full = set_value_in_scope(full_tiles, op->sym, true);
+        body = mutate(op->body);
+      }
+      set_result(crop_dim::make(op->sym, op->src, op->dim, std::move(tile), std::move(body)));
+      return;
+    }
+    visit_decl(op, false);
+  }
+  void visit(const crop_buffer* op) override { visit_decl(op, false); }
+  void visit(const slice_buffer* op) override { visit_decl(op, full_tiles.lookup(op->src)); }
+  void visit(const slice_dim* op) override { visit_decl(op, full_tiles.lookup(op->src)); }
+  void visit(const transpose* op) override { visit_decl(op, full_tiles.lookup(op->src)); }
+  void visit(const clone_buffer* op) override { visit_decl(op, full_tiles.lookup(op->src)); }
+  void visit(const allocate* op) override { visit_decl(op, std::nullopt); }
+  void visit(const make_buffer* op) override { visit_decl(op, std::nullopt); }
+
+  void visit(const call_stmt* op) override {
+    bool full = !op->outputs.empty();
+    for (var i : op->outputs) {
+      full = full && full_tiles.lookup(i).value_or(false);
+    }
+    if (!full) {
+      set_result(op);
+      return;
+    }
+    ++full_calls;
+    if (op->attrs.full_tile) {
+      set_result(op);
+      return;
+    }
+    call_stmt::attributes attrs = op->attrs;
+    attrs.full_tile = true;
+    set_result(call_stmt::make(op->target, op->inputs, op->outputs, op->scalars, std::move(attrs)));
+  }
+  void visit(const copy_stmt* op) override { set_result(op); }
+
+  using stmt_mutator::visit;
+};
+
+}  // namespace
+
+stmt split_loop_tails(const stmt& s, node_context& ctx) {
+  scoped_trace trace("split_loop_tails");
+  return loop_tail_splitter(ctx).mutate(s);
+}
+
+namespace {
+
 class deshadower : public substitutor {
   node_context& ctx;
   symbol_map<var> symbols;
@@ -1590,6 +2087,7 @@ public:
     interval_expr bounds = mutate(op->bounds);
     expr step = mutate(op->step);
     expr max_workers = mutate(op->max_workers);
+    expr grain = mutate(op->grain);
     var sym = symbols.contains(op->sym) ? rename(op->sym) : op->sym;
     auto s = set_value_in_scope(symbols, op->sym, sym);
     var old_in_loop = in_loop;
@@ -1597,10 +2095,11 @@ public:
     stmt body = mutate(op->body);
     in_loop = old_in_loop;
     if (sym == op->sym && bounds.same_as(op->bounds) && step.same_as(op->step) &&
-        max_workers.same_as(op->max_workers) && body.same_as(op->body)) {
+        max_workers.same_as(op->max_workers) && grain.same_as(op->grain) && body.same_as(op->body)) {
       set_result(op);
     } else {
-      set_result(loop::make(sym, std::move(max_workers), std::move(bounds), std::move(step), std::move(body)));
+      set_result(loop::make(
+          sym, std::move(max_workers), std::move(bounds), std::move(step), std::move(body), std::move(grain)));
     }
   }
 
@@ -1700,7 +2199,7 @@ public:
   void visit(const loop* op) override {
     if (!prove_true(op->max_workers == loop::serial)) {
       stmt body = mutate_closure(op->body);
-      set_result(loop::make(op->sym, op->max_workers, op->bounds, op->step, std::move(body)));
+      set_result(loop::make(op->sym, op->max_workers, op->bounds, op->step, std::move(body), op->grain));
     } else {
       stmt_mutator::visit(op);
     }
@@ -1727,6 +2226,94 @@ public:
   void visit(const transpose* op) override { visit_buffer_mutator(op); }
 };
 
+// Finds the order in which symbols should be renumbered. Symbols used in deeper loops come first, so the parts of the
+// context accessed most frequently are close together.
+class symbol_orderer : public symbol_visitor {
+  int depth = 0;
+
+  // For each symbol, the deepest loop depth at which it is used.
+  symbol_map<int> depths;
+  // The symbols in the order we first found them.
+  std::vector<var> found;
+
+public:
+  void visit_symbol(var sym) override {
+    if (!sym.defined()) return;
+    std::optional<int>& d = depths[sym];
+    if (!d) {
+      d = depth;
+      found.push_back(sym);
+    } else {
+      d = std::max(*d, depth);
+    }
+  }
+
+  const std::vector<var>& found_order() const { return found; }
+
+  // Returns the symbols found, deepest first. Symbols found at the same depth remain in the order they were found.
+  std::vector<var> order() const {
+    std::vector<var> result = found;
+    std::stable_sort(result.begin(), result.end(), [this](var a, var b) { return *depths[a] > *depths[b]; });
+    return result;
+  }
+
+  void visit(const loop* op) override {
+    op->bounds.min.accept(this);
+    op->bounds.max.accept(this);
+    if (op->step.defined()) op->step.accept(this);
+    if (op->max_workers.defined()) op->max_workers.accept(this);
+    if (op->grain.defined()) op->grain.accept(this);
+    ++depth;
+    visit_symbol(op->sym);
+    if (op->body.defined()) op->body.accept(this);
+    --depth;
+  }
+
+  using symbol_visitor::visit;
+};
+
+// Renames every symbol according to a one-to-one mapping. Because the mapping is one-to-one, we don't need to worry
+// about shadowing.
+class symbol_renamer : public substitutor {
+  const symbol_map<var>& names;
+
+public:
+  symbol_renamer(const symbol_map<var>& names) : names(names) {}
+
+  var rename(var x) const {
+    if (!x.defined()) return x;
+    std::optional<var> result = names[x];
+    if (!result) {
+      SLINKY_UNREACHABLE << "no new name for symbol " << x.id;
+    }
+    return *result;
+  }
+
+  var visit_symbol(var x) override { return rename(x); }
+  var enter_decl(var x) override { return rename(x); }
+
+  void visit(const let_stmt* op) override {
+    // We need to preserve closures, which the substitutor does not do.
+    std::vector<std::pair<var, expr>> lets;
+    lets.reserve(op->lets.size());
+    for (const auto& i : op->lets) {
+      lets.push_back({rename(i.first), mutate(i.second)});
+    }
+    set_result(let_stmt::make(std::move(lets), mutate(op->body), op->is_closure));
+  }
+
+  void visit(const loop* op) override {
+    interval_expr bounds = mutate(op->bounds);
+    expr step = mutate(op->step);
+    expr max_workers = mutate(op->max_workers);
+    expr grain = mutate(op->grain);
+    set_result(loop::make(rename(op->sym), std::move(max_workers), std::move(bounds), std::move(step), mutate(op->body),
+        std::move(grain)));
+  }
+
+  using substitutor::visit;
+};
+
 }  // namespace
 
 stmt deshadow(const stmt& s, span<var> symbols, node_context& ctx) {
@@ -1738,6 +2325,37 @@ stmt optimize_symbols(const stmt& s, node_context& ctx) {
   return reuse_shadows().mutate(s);
 }
 
+stmt compact_symbols(const stmt& s, mutable_span<var> external_symbols) {
+  scoped_trace trace("compact_symbols");
+  symbol_orderer orderer;
+  if (s.defined()) s.accept(&orderer);
+  // External symbols that are not used by `s` still need an id.
+  for (var i : external_symbols) {
+    orderer.visit_symbol(i);
+  }
+
+  symbol_map<var> names;
+  std::vector<var> order = orderer.order();
+  for (std::size_t i = 0; i < order.size(); ++i) {
+    names[order[i]] = var(i);
+  }
+
+  symbol_renamer renamer(names);
+  for (var& i : external_symbols) {
+    i = renamer.rename(i);
+  }
+  return renamer.mutate(s);
+}
+
+std::vector<var> find_symbols(const stmt& s) {
+  symbol_orderer orderer;
+  if (s.defined()) s.accept(&orderer);
+  return orderer.found_order();
+}
+
+stmt rename_symbols(const stmt& s, const symbol_map<var>& names) { return symbol_renamer(names).mutate(s); }
+expr rename_symbols(const expr& e, const symbol_map<var>& names) { return symbol_renamer(names).mutate(e); }
+
 namespace {
 
 class node_canonicalizer : public node_mutator {
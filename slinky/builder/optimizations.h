@@ -27,19 +27,44 @@ stmt implement_copies(const stmt& s, node_context& ctx);
 // Find allocate nodes and try to insert free into them.
 stmt insert_early_free(const stmt& s);
 
+// Find allocations that are not inside a loop, or are inside the same loop body, and place them at offsets in one slab
+// allocated at the beginning of the loop body (or of `s`), such that allocations that are not live at the same time
+// (according to the `free` calls inserted by `insert_early_free`) share memory. The planned allocations become
+// `make_buffer` with dense strides, each aligned to `alignment` bytes in the slab. If `peak` is not null, it is set to
+// an upper bound of the bytes of slabs a thread has allocated at once.
+stmt plan_memory(const stmt& s, node_context& ctx, index_t alignment = 64, expr* peak = nullptr);
+
 // Find call_stmt nodes and try to decrease the rank of the operation
 // using the optionally specificed function min_rank.
 stmt remove_pure_dims(const stmt& s);
 
+// Split loops over tiles of the outputs of a func (see `func::loops`) into a loop over the tiles that are entirely
+// inside the cropped buffers, and loops over the partial tiles before and after them. The calls in the loop over full
+// tiles have `call_stmt::attributes::full_tile` set.
+stmt split_loop_tails(const stmt& s, node_context& ctx);
+
 // The simplifier can't handle shadowed symbols. This mutator rewrites all declarations to avoid any shadowing.
 stmt deshadow(const stmt& s, span<var> external_symbols, node_context& ctx);
 
 // We can improve `evaluate`'s performance and memory usage if:
 // - Buffer mutators are self-shadowing, so they can be performed in-place on existing buffers.
 // - Make closures for parallel loop bodies, so evaluate doesn't need to copy the entire context.
-// - (TODO) Symbols are indexed such that there are no unused symbol indices.
+// Also see `compact_symbols`.
 stmt optimize_symbols(const stmt& s, node_context& ctx);
 
+// Renumber the symbols used by `s` and `external_symbols` (which are renamed in place) such that there are no unused
+// symbol indices, with symbols used in the innermost loops first. The resulting symbols no longer correspond to the
+// names in the node_context the stmt was built with.
+stmt compact_symbols(const stmt& s, mutable_span<var> external_symbols);
+
+// Find every symbol used or declared by `s`, in the order they are first found.
+std::vector<var> find_symbols(const stmt& s);
+
+// Rename the symbols of `s` according to `names`, which must be a one-to-one mapping that contains every symbol used
+// by `s`.
+stmt rename_symbols(const stmt& s, const symbol_map<var>& names);
+expr rename_symbols(const expr& e, const symbol_map<var>& names);
+
 // Guarantees that if match(a, b) is true, then a.same_as(b) is true, i.e. it rewrites matching nodes to be the same
 // object.
 expr canonicalize_nodes(const expr& s);
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstddef>
 #include <cstdlib>
 #include <iostream>
@@ -161,7 +162,9 @@ stmt make_copy_func(copy_stmt::callable impl, const func::input& src, const func
 
 }  // namespace
 
-stmt func::make_call() const {
+stmt func::make_call() const { return make_call(impl_, copy_impl_); }
+
+stmt func::make_call(const call_stmt::callable& impl, const copy_stmt::callable& copy_impl) const {
   if (impl_) {
     call_stmt::symbol_list inputs;
     call_stmt::symbol_list outputs;
@@ -171,16 +174,16 @@ stmt func::make_call() const {
     for (const func::output& i : outputs_) {
       outputs.push_back(i.sym());
     }
-    return call_stmt::make(impl_, std::move(inputs), std::move(outputs), scalars_, attrs_);
+    return call_stmt::make(impl, std::move(inputs), std::move(outputs), scalars_, attrs_);
   } else if (is_padded_copy_) {
     assert(inputs_.size() == 2);
     assert(outputs_.size() == 1);
-    return make_copy_func(copy_impl_, inputs_[0], outputs_[0], inputs_[1].sym());
+    return make_copy_func(copy_impl, inputs_[0], outputs_[0], inputs_[1].sym());
   } else {
     std::vector<stmt> copies;
     assert(outputs_.size() == 1);
     for (const func::input& input : inputs_) {
-      copies.push_back(make_copy_func(copy_impl_, input, outputs_[0]));
+      copies.push_back(make_copy_func(copy_impl, input, outputs_[0]));
     }
     return block::make(std::move(copies));
   }
@@ -609,6 +612,7 @@ void find_dependent_dims(
 
 class pipeline_builder {
   node_context& ctx;
+  const func_callbacks_map& callbacks_;
 
   struct allocation_candidate {
     buffer_expr_ptr buffer;
@@ -791,7 +795,10 @@ class pipeline_builder {
   // Returns generated statement for this function, as well as the
   // lifetime range covered by it.
   statement_with_range produce(const func* f) {
-    stmt result = sanitizer_.mutate(f->make_call());
+    auto callbacks = callbacks_.find(f);
+    stmt call = callbacks != callbacks_.end() ? f->make_call(callbacks->second.impl, callbacks->second.copy_impl)
+                                               : f->make_call();
+    stmt result = sanitizer_.mutate(call);
 
     for (const func::output& o : f->outputs()) {
       const buffer_expr_ptr& b = o.buffer;
@@ -1211,9 +1218,9 @@ class pipeline_builder {
   }
 
 public:
-  pipeline_builder(
-      node_context& ctx, const std::vector<buffer_expr_ptr>& inputs, const std::vector<buffer_expr_ptr>& outputs)
-      : ctx(ctx), sanitizer_(ctx) {
+  pipeline_builder(node_context& ctx, const std::vector<buffer_expr_ptr>& inputs,
+      const std::vector<buffer_expr_ptr>& outputs, const func_callbacks_map& callbacks)
+      : ctx(ctx), callbacks_(callbacks), sanitizer_(ctx) {
     // Dependencies between the functions.
     std::map<const func*, std::vector<const func*>> deps;
     topological_sort(outputs, order_, deps);
@@ -1400,7 +1407,7 @@ public:
     loop_var_name += ctx.name(loop.sym());
     var loop_var = ctx.insert_unique(loop_var_name);
     body.body = substitute(body.body, loop.sym(), loop_var);
-    body.body = loop::make(loop_var, loop.max_workers, loop_bounds, loop_step, body.body);
+    body.body = loop::make(loop_var, loop.max_workers, loop_bounds, loop_step, body.body, loop.grain);
 
     return body;
   }
@@ -1530,12 +1537,51 @@ stmt inject_traces(const stmt& s, node_context& ctx) {
   return result;
 }
 
+// Counts the nodes in a stmt. Nodes that are shared are counted once per reference.
+class node_counter : public node_mutator {
+public:
+  std::size_t count = 0;
+
+  expr mutate(const expr& e) override {
+    count += e.defined();
+    return node_mutator::mutate(e);
+  }
+  stmt mutate(const stmt& s) override {
+    count += s.defined();
+    return node_mutator::mutate(s);
+  }
+  using node_mutator::mutate;
+};
+
+// Records the time since the previous pass finished (or since construction), and the size of the result, of each pass
+// in `stats`, if it is not null.
+class pass_recorder {
+  build_stats* stats_;
+  std::chrono::steady_clock::time_point begin_;
+
+public:
+  pass_recorder(build_stats* stats) : stats_(stats), begin_(std::chrono::steady_clock::now()) {}
+
+  void operator()(const char* name, const stmt& result) {
+    if (!stats_) return;
+    auto end = std::chrono::steady_clock::now();
+    node_counter counter;
+    counter.mutate(result);
+    stats_->passes.push_back({name, end - begin_, counter.count});
+    // Don't count the time spent counting nodes in the next pass.
+    begin_ = std::chrono::steady_clock::now();
+  }
+};
+
 stmt build_pipeline(node_context& ctx, const std::vector<buffer_expr_ptr>& inputs,
-    const std::vector<buffer_expr_ptr>& outputs, std::vector<std::pair<var, expr>> lets, const build_options& options) {
+    const std::vector<buffer_expr_ptr>& outputs, std::vector<std::pair<var, expr>> lets, const build_options& options,
+    const func_callbacks_map& callbacks) {
   scoped_trace trace("build_pipeline");
   const node_context* old_context = set_default_print_context(&ctx);
 
-  pipeline_builder builder(ctx, inputs, outputs);
+  pass_recorder record(options.stats);
+
+  pipeline_builder builder(ctx, inputs, outputs, callbacks);
 
   stmt result;
   result = builder.make_loop(nullptr, 0).body;
@@ -1564,48 +1610,80 @@ stmt build_pipeline(node_context& ctx, const std::vector<buffer_expr_ptr>& input
     check_buffer(i, buffer_checks);
   }
   result = block::make(std::move(buffer_checks), std::move(result));
+  record("make_loops", result);
 
   result = slide_and_fold_storage(result, ctx);
+  record("slide_and_fold_storage", result);
   result = deshadow(result, builder.external_symbols(), ctx);
+  record("deshadow", result);
   result = simplify(result);
+  record("simplify", result);
 
   // Try to reuse buffers and eliminate copies where possible.
   if (!options.no_alias_buffers) {
     result = alias_copies(result, ctx, inputs, outputs);
+    record("alias_copies", result);
     result = alias_in_place(result, outputs);
+    record("alias_in_place", result);
+  }
+
+  if (options.split_loop_tails) {
+    result = split_loop_tails(result, ctx);
+    record("split_loop_tails", result);
   }
 
   // `evaluate` currently can't handle `copy_stmt`, so this is required.
   result = implement_copies(result, ctx);
+  record("implement_copies", result);
 
   result = remove_pure_dims(result);
+  record("remove_pure_dims", result);
 
   // `implement_copies` adds shadowed declarations, remove them before simplifying.
   result = deshadow(result, builder.external_symbols(), ctx);
+  record("deshadow", result);
 
   result = cleanup_semaphores(result);
+  record("cleanup_semaphores", result);
 
   result = simplify(result);
+  record("simplify", result);
 
   result = fuse_siblings(result);
+  record("fuse_siblings", result);
 
   if (options.no_checks) {
     result = recursive_mutate<check>(
         result, [](const check* op) { return has_side_effects(op->condition) ? stmt(op) : stmt(); });
+    record("remove_checks", result);
     // Simplify again, in case there are lets that the checks used that are now dead.
     result = simplify(result);
+    record("simplify", result);
   }
 
   result = insert_early_free(result);
+  record("insert_early_free", result);
+
+  if (options.plan_memory) {
+    expr peak;
+    result = plan_memory(result, ctx, options.plan_memory_alignment, &peak);
+    record("plan_memory", result);
+    if (is_verbose()) {
+      std::cout << "planned slab peak: " << peak << std::endl;
+    }
+  }
 
   if (options.trace) {
     result = inject_traces(result, ctx);
+    record("inject_traces", result);
   }
 
   // This pass adds closures around parallel loop bodies, any following passes need to maintain this closure.
   result = optimize_symbols(result, ctx);
+  record("optimize_symbols", result);
 
   result = canonicalize_nodes(result);
+  record("canonicalize_nodes", result);
 
   if (is_verbose()) {
     std::cout << result << std::endl;
@@ -1616,6 +1694,148 @@ stmt build_pipeline(node_context& ctx, const std::vector<buffer_expr_ptr>& input
   return result;
 }
 
+// The size of the eval_context needed to evaluate `p`.
+std::size_t context_size(const pipeline& p) {
+  std::size_t result = find_context_size(p.body);
+  for (const std::vector<var>* syms : {&p.args, &p.inputs, &p.outputs}) {
+    for (var i : *syms) {
+      result = std::max(result, i.id + 1);
+    }
+  }
+  return result;
+}
+
+// Finds an upper bound of the heap memory needed at once by one thread evaluating a stmt. This is the largest total
+// size of a heap allocation and the heap allocations it is nested in. The sizes do not include the padding added to
+// align each allocation, which depends on the `eval_config`. Instead, we also find the largest number of nested heap
+// allocations.
+class heap_high_water_finder : public recursive_node_visitor {
+  bounds_map bounds;
+  // The total size and number of the heap allocations we are currently inside.
+  expr live = 0;
+  std::size_t live_allocations = 0;
+
+  // The buffers we are currently inside, with the bounds of their dimensions in terms of the enclosing buffers.
+  struct buffer_info {
+    var sym;
+    var src;
+    std::vector<dim_expr> dims;
+  };
+  std::vector<buffer_info> buffers;
+
+  // Rewrite `e` to depend on the bounds of the outermost buffers instead of any buffers we are inside.
+  expr resolve_buffers(expr e) const {
+    for (auto i = buffers.rbegin(); i != buffers.rend(); ++i) {
+      e = substitute_buffer(e, i->sym, i->dims, i->src);
+    }
+    return e;
+  }
+
+  void visit_crop(var sym, var src, const box_expr& crop, const stmt& body) {
+    box_expr clamped(crop.size());
+    for (std::size_t d = 0; d < crop.size(); ++d) {
+      clamped[d] = crop[d] & buffer_bounds(src, d);
+    }
+    buffers.push_back({sym, src, make_dims_from_bounds(clamped)});
+    body.accept(this);
+    buffers.pop_back();
+  }
+
+  expr allocation_size(const allocate* op) {
+    bool dense = std::all_of(op->dims.begin(), op->dims.end(), [](const dim_expr& d) { return !d.stride.defined(); });
+    bool strided = std::all_of(op->dims.begin(), op->dims.end(), [](const dim_expr& d) { return d.stride.defined(); });
+    if (!dense && !strided) return expr();
+
+    expr size = dense ? op->elem_size : expr(0);
+    for (const dim_expr& d : op->dims) {
+      expr extent = max(d.bounds.extent(), 0);
+      if (d.fold_factor.defined()) extent = min(extent, d.fold_factor);
+      if (dense) {
+        size *= extent;
+      } else {
+        size += max(extent - 1, 0) * abs(d.stride);
+      }
+    }
+    if (!dense) size += op->elem_size;
+    return size;
+  }
+
+public:
+  expr result = 0;
+  std::size_t allocations = 0;
+
+  void visit(const let_stmt* op) override {
+    std::vector<scoped_value_in_symbol_map<interval_expr>> set_bounds;
+    set_bounds.reserve(op->lets.size());
+    for (const auto& i : op->lets) {
+      set_bounds.push_back(set_value_in_scope(bounds, i.first, bounds_of(i.second, bounds)));
+    }
+    op->body.accept(this);
+  }
+
+  void visit(const loop* op) override {
+    auto set_bounds = set_value_in_scope(bounds, op->sym, bounds_of(op->bounds, bounds));
+    op->body.accept(this);
+  }
+
+  void visit(const crop_buffer* op) override { visit_crop(op->sym, op->src, op->bounds, op->body); }
+  void visit(const crop_dim* op) override {
+    box_expr crop(op->dim + 1, interval_expr::all());
+    crop[op->dim] = op->bounds;
+    visit_crop(op->sym, op->src, crop, op->body);
+  }
+
+  void visit(const allocate* op) override {
+    if (!result.defined()) return;
+
+    buffers.push_back({op->sym, var(), {}});
+    for (const dim_expr& d : op->dims) {
+      buffers.back().dims.push_back({d.bounds});
+    }
+    if (op->storage == memory_type::stack) {
+      op->body.accept(this);
+      buffers.pop_back();
+      return;
+    }
+    expr size = allocation_size(op);
+    expr bound = size.defined() ? simplify(bounds_of(resolve_buffers(size), bounds).max) : expr();
+    if (!bound.defined() || is_infinity(bound)) {
+      result = expr();
+      buffers.pop_back();
+      return;
+    }
+    expr old_live = live;
+    live = simplify(live + bound);
+    result = simplify(max(result, live));
+    ++live_allocations;
+    allocations = std::max(allocations, live_allocations);
+    op->body.accept(this);
+    --live_allocations;
+    live = old_live;
+    buffers.pop_back();
+  }
+};
+
+// Set `p.heap_high_water` to an upper bound on the heap memory needed at once by one thread to evaluate `p`, or
+// undefined if we couldn't find one in terms of the pipeline's arguments, inputs, and outputs.
+void find_heap_high_water(pipeline& p) {
+  heap_high_water_finder finder;
+  p.body.accept(&finder);
+  if (!finder.result.defined()) return;
+
+  std::vector<var> external_symbols;
+  for (const std::vector<var>* syms : {&p.args, &p.inputs, &p.outputs}) {
+    external_symbols.insert(external_symbols.end(), syms->begin(), syms->end());
+  }
+  for (var i : find_dependencies(finder.result)) {
+    if (std::find(external_symbols.begin(), external_symbols.end(), i) == external_symbols.end()) {
+      return;
+    }
+  }
+  p.heap_high_water = finder.result;
+  p.heap_high_water_allocations = finder.allocations;
+}
+
 std::vector<var> vars(const std::vector<buffer_expr_ptr>& bufs) {
   std::vector<var> result;
   result.reserve(bufs.size());
@@ -1628,13 +1848,53 @@ std::vector<var> vars(const std::vector<buffer_expr_ptr>& bufs) {
 }  // namespace
 
 pipeline build_pipeline(node_context& ctx, std::vector<var> args, const std::vector<buffer_expr_ptr>& inputs,
-    const std::vector<buffer_expr_ptr>& outputs, std::vector<std::pair<var, expr>> lets, const build_options& options) {
-  stmt body = build_pipeline(ctx, inputs, outputs, lets, options);
+    const std::vector<buffer_expr_ptr>& outputs, std::vector<std::pair<var, expr>> lets, const build_options& options,
+    const func_callbacks_map& callbacks) {
+  std::optional<simplify_cache> cache;
+  if (options.memoize_simplify) cache.emplace();
+
+  stmt body = build_pipeline(ctx, inputs, outputs, lets, options, callbacks);
+  pass_recorder record(options.stats);
   pipeline p;
   p.args = args;
   p.inputs = vars(inputs);
   p.outputs = vars(outputs);
   p.body = std::move(body);
+  p.context_size = context_size(p);
+
+  if (options.compact_symbols) {
+    std::vector<var> external_symbols;
+    for (const std::vector<var>* syms : {&p.args, &p.inputs, &p.outputs}) {
+      external_symbols.insert(external_symbols.end(), syms->begin(), syms->end());
+    }
+    p.body = canonicalize_nodes(compact_symbols(p.body, external_symbols));
+    record("compact_symbols", p.body);
+    auto next = external_symbols.begin();
+    for (std::vector<var>* syms : {&p.args, &p.inputs, &p.outputs}) {
+      std::copy_n(next, syms->size(), syms->begin());
+      next += syms->size();
+    }
+
+    std::size_t old_context_size = p.context_size;
+    p.context_size = context_size(p);
+    if (is_verbose()) {
+      std::cout << "compact_symbols: context size " << old_context_size << " -> " << p.context_size << std::endl;
+    }
+  } else if (is_verbose()) {
+    std::cout << "context size: " << p.context_size << std::endl;
+  }
+
+  if (options.heap_high_water) {
+    find_heap_high_water(p);
+    record("heap_high_water", p.body);
+    if (is_verbose()) {
+      std::cout << "heap high water: " << p.heap_high_water << std::endl;
+    }
+  }
+  if (cache && options.stats) {
+    options.stats->simplify_cache_hits += cache->hits();
+    options.stats->simplify_cache_misses += cache->misses();
+  }
   return p;
 }
 
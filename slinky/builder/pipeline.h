@@ -1,7 +1,12 @@
 #ifndef SLINKY_BUILDER_PIPELINE_H
 #define SLINKY_BUILDER_PIPELINE_H
 
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <string>
 #include <type_traits>
+#include <vector>
 
 #include "slinky/base/ref_count.h"
 #include "slinky/runtime/evaluate.h"
@@ -174,10 +179,12 @@ public:
     slinky::var var;
     expr step;
     expr max_workers;
+    // The minimum number of consecutive iterations a worker runs at a time, see `loop::grain`.
+    expr grain;
 
     loop_info() = default;
-    loop_info(slinky::var var, expr step = 1, expr max_workers = loop::serial)
-        : var(var), step(step), max_workers(max_workers) {}
+    loop_info(slinky::var var, expr step = 1, expr max_workers = loop::serial, expr grain = expr())
+        : var(var), step(step), max_workers(max_workers), grain(grain) {}
 
     slinky::var sym() const { return var; }
 
@@ -314,31 +321,33 @@ public:
 
   // The following functions make various forms of copy operations. `impl` is a function that can customize the
   // implementation of the copy. The function must be equivalent to `slinky::copy`. The `impl` function may not be
-  // called if the copy is aliased.
+  // called if the copy is aliased. If `impl` is empty, the copy uses `copy_with_pool` with the thread pool of the
+  // `eval_config`.
 
   // Make a copy from a single input to a single output.
-  static func make_copy(input src, output dst, copy_stmt::callable impl = slinky::copy) {
+  static func make_copy(input src, output dst, copy_stmt::callable impl = {}) {
     return func(std::move(impl), {std::move(src)}, std::move(dst));
   }
   // Make a copy from a single input to a single output, with padding outside the output crop.
-  static func make_copy(input src, output dst, input pad, copy_stmt::callable impl = slinky::copy) {
+  static func make_copy(input src, output dst, input pad, copy_stmt::callable impl = {}) {
     return func(std::move(impl), std::move(src), std::move(dst), std::move(pad));
   }
   // Make a copy from multiple inputs with undefined padding.
-  static func make_copy(std::vector<input> src, output dst, copy_stmt::callable impl = slinky::copy) {
+  static func make_copy(std::vector<input> src, output dst, copy_stmt::callable impl = {}) {
     return func(std::move(impl), std::move(src), std::move(dst));
   }
   // Make a concatenation copy. This is a helper function for `make_copy`, where the crop for input i is a `crop_dim` in
   // dimension `dim` on the interval `[bounds[i], bounds[i + 1])`, and the input is translated by `-bounds[i]`.
   static func make_concat(std::vector<buffer_expr_ptr> src, output dst, std::size_t dim, std::vector<expr> bounds,
-      copy_stmt::callable impl = slinky::copy);
+      copy_stmt::callable impl = {});
   // Make a stack copy. This is a helper function for `make_copy`, where the crop for input i is a `slice_dim` of
   // dimension `dim` at i. If `dim` is greater than the rank of `out` (the default), the new stack dimension will be the
   // last dimension of the output.
   static func make_stack(
-      std::vector<buffer_expr_ptr> src, output dst, std::size_t dim = -1, copy_stmt::callable impl = slinky::copy);
+      std::vector<buffer_expr_ptr> src, output dst, std::size_t dim = -1, copy_stmt::callable impl = {});
 
   const call_stmt::callable& impl() const { return impl_; }
+  const copy_stmt::callable& copy_impl() const { return copy_impl_; }
   const std::vector<input>& inputs() const { return inputs_; }
   const std::vector<output>& outputs() const { return outputs_; }
   const call_stmt::attributes& attrs() const { return attrs_; }
@@ -347,6 +356,34 @@ public:
   bool is_padded_copy() const { return is_padded_copy_; }
 
   stmt make_call() const;
+  // Make the call for this func, using `impl` and `copy_impl` instead of the callbacks of this func.
+  stmt make_call(const call_stmt::callable& impl, const copy_stmt::callable& copy_impl) const;
+};
+
+// Callbacks to use instead of the callbacks of a func when building a pipeline. A callback is only replaced if the func
+// has that kind of callback.
+struct func_callbacks {
+  call_stmt::callable impl;
+  copy_stmt::callable copy_impl;
+};
+using func_callbacks_map = std::map<const func*, func_callbacks>;
+
+// Statistics about the passes run by `build_pipeline`.
+struct build_stats {
+  struct pass {
+    std::string name;
+    // The time spent running the pass.
+    std::chrono::nanoseconds time;
+    // The number of nodes (counting shared nodes once per reference) in the stmt produced by the pass.
+    std::size_t nodes;
+  };
+  // The passes in the order they ran. Passes that run more than once (e.g. `simplify`) appear more than once.
+  std::vector<pass> passes;
+
+  // The number of calls to `simplify`, `bounds_of`, and the proving functions that used or computed a memoized result
+  // when `build_options::memoize_simplify` is set.
+  std::size_t simplify_cache_hits = 0;
+  std::size_t simplify_cache_misses = 0;
 };
 
 struct build_options {
@@ -358,12 +395,43 @@ struct build_options {
 
   // Generate trace_begin/trace_end calls to log the pipeline execution.
   bool trace = false;
+
+  // Renumber the symbols of the pipeline (including `pipeline::args`, `pipeline::inputs` and `pipeline::outputs`) to
+  // be dense, which makes the `eval_context` needed to evaluate the pipeline smaller. The symbols of the resulting
+  // pipeline no longer correspond to the names in the node_context, so callbacks must only access buffers via the
+  // call_stmt's inputs and outputs.
+  bool compact_symbols = false;
+
+  // Place intermediate buffers that are allocated in the same loop body (or outside of all loops) at offsets in a
+  // single allocation, reusing the memory of buffers that are no longer live (see `plan_memory`). The strides of these
+  // buffers do not respect `eval_config::stride_alignment`.
+  bool plan_memory = false;
+  // The alignment in bytes of each buffer placed by `plan_memory`.
+  index_t plan_memory_alignment = 64;
+
+  // Split each loop of `func::loops` into a loop over the tiles that are entirely inside the buffers cropped by the
+  // loop, and loops over the partial tiles before and after them. The calls in the loop over full tiles have
+  // `call_stmt::attributes::full_tile` set, so they can assume the extent of the tiles is the step of the loop.
+  bool split_loop_tails = false;
+
+  // Memoize the results of `simplify`, `bounds_of`, and the proving functions of exprs while building the pipeline
+  // (see `simplify_cache`).
+  bool memoize_simplify = false;
+
+  // Find `pipeline::heap_high_water`, which allows evaluating the pipeline with `eval_config::use_arena` to reserve the
+  // memory it needs up front. This requires finding the bounds of the size of every heap allocation.
+  bool heap_high_water = false;
+
+  // If not null, `build_pipeline` appends the time taken by each pass (including analyses of the result, such as
+  // `pipeline::heap_high_water`), and the size of its result, to this object.
+  build_stats* stats = nullptr;
 };
 
-// Constructs a body and a pipeline object for a graph described by input and output buffers.
+// Constructs a body and a pipeline object for a graph described by input and output buffers. The funcs in `callbacks`
+// are called with the given callbacks instead of their own; the funcs themselves are not modified.
 pipeline build_pipeline(node_context& ctx, std::vector<var> args, const std::vector<buffer_expr_ptr>& inputs,
     const std::vector<buffer_expr_ptr>& outputs, std::vector<std::pair<var, expr>> lets = {},
-    const build_options& options = build_options());
+    const build_options& options = build_options(), const func_callbacks_map& callbacks = {});
 pipeline build_pipeline(node_context& ctx, const std::vector<buffer_expr_ptr>& inputs,
     const std::vector<buffer_expr_ptr>& outputs, const build_options& options = build_options());
 
@@ -0,0 +1,458 @@
+#include "slinky/builder/pipeline_cache.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "slinky/base/chrome_trace.h"
+#include "slinky/builder/node_mutator.h"
+#include "slinky/builder/optimizations.h"
+#include "slinky/builder/pipeline.h"
+#include "slinky/runtime/evaluate.h"
+#include "slinky/runtime/expr.h"
+#include "slinky/runtime/stmt.h"
+
+namespace slinky {
+
+namespace {
+
+// Builds a string describing the structure of a graph of funcs. Symbols, funcs, and buffers are described by the
+// order in which they are first found.
+class key_builder : public expr_visitor {
+  std::string key_;
+  bool valid_ = true;
+
+  symbol_map<std::size_t> var_ids_;
+  std::map<const func*, std::size_t> func_ids_;
+  std::map<const buffer_expr*, std::size_t> buffer_ids_;
+  std::deque<const func*> pending_;
+
+public:
+  // The symbols, funcs, and buffers in the order they were found.
+  std::vector<var> vars;
+  std::vector<const func*> funcs;
+  std::vector<buffer_expr_ptr> buffers;
+
+  void append(std::int64_t x) { key_.append(reinterpret_cast<const char*>(&x), sizeof(x)); }
+  void append(const std::string& s) {
+    append(static_cast<std::int64_t>(s.size()));
+    key_.append(s);
+  }
+  void append(bool x) { append(static_cast<std::int64_t>(x)); }
+  template <typename T>
+  void append_enum(T x) {
+    append(static_cast<std::int64_t>(x));
+  }
+
+  void append(var x) {
+    if (!x.defined()) {
+      append(static_cast<std::int64_t>(-1));
+      return;
+    }
+    std::optional<std::size_t>& id = var_ids_[x];
+    if (!id) {
+      id = vars.size();
+      vars.push_back(x);
+    }
+    append(static_cast<std::int64_t>(*id));
+  }
+
+  void append(const expr& e) {
+    if (e.defined()) {
+      append_enum(e.type());
+      e.accept(this);
+    } else {
+      append_enum(expr_node_type::none);
+    }
+  }
+  void append(const interval_expr& x) {
+    append(x.min);
+    append(x.max);
+  }
+  void append(const dim_expr& d) {
+    append(d.bounds);
+    append(d.stride);
+    append(d.fold_factor);
+  }
+  template <typename T>
+  void append(const std::vector<T>& v) {
+    append(static_cast<std::int64_t>(v.size()));
+    for (const T& i : v) {
+      append(i);
+    }
+  }
+
+  void append(const std::optional<loop_id>& at) {
+    append(at.has_value());
+    if (!at) return;
+    append(at->func ? static_cast<std::int64_t>(find(at->func)) : -1);
+    append(at->var);
+  }
+
+  std::size_t find(const func* f) {
+    auto i = func_ids_.find(f);
+    if (i != func_ids_.end()) return i->second;
+    std::size_t id = funcs.size();
+    func_ids_[f] = id;
+    funcs.push_back(f);
+    pending_.push_back(f);
+    return id;
+  }
+
+  void append(const buffer_expr_ptr& b) {
+    auto i = buffer_ids_.find(&*b);
+    if (i != buffer_ids_.end()) {
+      append(static_cast<std::int64_t>(i->second));
+      return;
+    }
+    std::size_t id = buffers.size();
+    buffer_ids_[&*b] = id;
+    buffers.push_back(b);
+    append(static_cast<std::int64_t>(id));
+
+    append(b->sym());
+    append(b->elem_size());
+    append(b->dims());
+    append_enum(b->storage());
+    append(b->store_at());
+    append(b->constant() != nullptr);
+    append(b->producer() ? static_cast<std::int64_t>(find(b->producer())) : -1);
+  }
+
+  void append(const func::input& i) {
+    append(i.buffer);
+    append(i.bounds);
+    append(i.input_crop);
+    append(i.output_crop);
+    append(i.output_slice);
+  }
+
+  void append(const func::output& o) {
+    append(o.buffer);
+    append(o.dims);
+  }
+
+  void append(const func::loop_info& l) {
+    append(l.var);
+    append(l.step);
+    append(l.max_workers);
+    append(l.grain);
+  }
+
+  void append(const func& f) {
+    append(f.impl() != nullptr);
+    append(f.is_padded_copy());
+    append(static_cast<std::int64_t>(f.attrs().allow_in_place));
+    append(static_cast<std::int64_t>(f.attrs().min_rank));
+    append(f.attrs().name);
+    append(f.attrs().skip_if_empty);
+    append(f.attrs().full_tile);
+    append(f.inputs());
+    append(f.outputs());
+    append(f.loops());
+    append(f.compute_at());
+  }
+
+  // Describe the funcs found so far, and any funcs they depend on.
+  void append_pending_funcs() {
+    while (!pending_.empty()) {
+      const func* f = pending_.front();
+      pending_.pop_front();
+      append(*f);
+    }
+  }
+
+  void append(const build_options& options) {
+    append(options.no_checks);
+    append(options.no_alias_buffers);
+    append(options.trace);
+    append(options.compact_symbols);
+    append(options.plan_memory);
+    append(static_cast<std::int64_t>(options.plan_memory_alignment));
+    append(options.split_loop_tails);
+    append(options.heap_high_water);
+  }
+
+  std::string key() const { return valid_ ? key_ : std::string(); }
+
+  void visit(const variable* op) override {
+    append(op->sym);
+    append_enum(op->field);
+    append(static_cast<std::int64_t>(op->dim));
+  }
+  void visit(const constant* op) override { append(op->value); }
+  void visit(const let* op) override {
+    append(static_cast<std::int64_t>(op->lets.size()));
+    for (const auto& i : op->lets) {
+      append(i.first);
+      append(i.second);
+    }
+    append(op->body);
+  }
+  template <typename T>
+  void visit_binary(const T* op) {
+    append(op->a);
+    append(op->b);
+  }
+  void visit(const add* op) override { visit_binary(op); }
+  void visit(const sub* op) override { visit_binary(op); }
+  void visit(const mul* op) override { visit_binary(op); }
+  void visit(const div* op) override { visit_binary(op); }
+  void visit(const mod* op) override { visit_binary(op); }
+  void visit(const class min* op) override { visit_binary(op); }
+  void visit(const class max* op) override { visit_binary(op); }
+  void visit(const equal* op) override { visit_binary(op); }
+  void visit(const not_equal* op) override { visit_binary(op); }
+  void visit(const less* op) override { visit_binary(op); }
+  void visit(const less_equal* op) override { visit_binary(op); }
+  void visit(const logical_and* op) override { visit_binary(op); }
+  void visit(const logical_or* op) override { visit_binary(op); }
+  void visit(const logical_not* op) override { append(op->a); }
+  void visit(const class select* op) override {
+    append(op->condition);
+    append(op->true_value);
+    append(op->false_value);
+  }
+  void visit(const call* op) override {
+    // We can't tell if two user defined calls are the same.
+    if (op->target) valid_ = false;
+    append_enum(op->intrinsic);
+    append(op->args);
+  }
+};
+
+std::string structural_key(key_builder& key, const std::vector<var>& args, const std::vector<buffer_expr_ptr>& inputs,
+    const std::vector<buffer_expr_ptr>& outputs, const std::vector<std::pair<var, expr>>& lets,
+    const build_options& options) {
+  key.append(args);
+  key.append(inputs);
+  key.append(outputs);
+  key.append(static_cast<std::int64_t>(lets.size()));
+  for (const auto& i : lets) {
+    key.append(i.first);
+    key.append(i.second);
+  }
+  key.append(options);
+  key.append_pending_funcs();
+  return key.key();
+}
+
+// Placeholders for the callbacks of funcs in cached pipelines, which are replaced by the callbacks of the funcs of the
+// pipeline being built.
+struct call_slot {
+  std::size_t index;
+  index_t operator()(const call_stmt*, eval_context&) const {
+    SLINKY_UNREACHABLE << "call_slot should have been replaced";
+    return 0;
+  }
+};
+struct copy_slot {
+  std::size_t index;
+  void operator()(const raw_buffer&, const raw_buffer&, const raw_buffer&) const {
+    SLINKY_UNREACHABLE << "copy_slot should have been replaced";
+  }
+};
+
+// Replaces the placeholder callbacks with the callbacks of the funcs, and the constant buffers of the cached pipeline
+// with the constant buffers of the new pipeline.
+class callback_binder : public node_mutator {
+  const std::vector<call_stmt::callable>& calls;
+  const std::vector<copy_stmt::callable>& copies;
+  const std::map<const raw_buffer*, const_raw_buffer_ptr>& constants;
+
+public:
+  callback_binder(const std::vector<call_stmt::callable>& calls, const std::vector<copy_stmt::callable>& copies,
+      const std::map<const raw_buffer*, const_raw_buffer_ptr>& constants)
+      : calls(calls), copies(copies), constants(constants) {}
+
+  // Calls, copies, and constant buffers that the builder made itself don't need to be replaced.
+  void visit(const call_stmt* op) override {
+    if (const call_slot* slot = op->target.target<call_slot>()) {
+      set_result(call_stmt::make(calls[slot->index], op->inputs, op->outputs, op->scalars, op->attrs));
+    } else if (const copy_call* copy = op->target.target<copy_call>()) {
+      // This is a copy that has been implemented by `implement_copy`.
+      if (const copy_slot* slot = copy->impl.target<copy_slot>()) {
+        set_result(call_stmt::make(copy_call{copies[slot->index]}, op->inputs, op->outputs, op->scalars, op->attrs));
+      } else {
+        set_result(op);
+      }
+    } else {
+      set_result(op);
+    }
+  }
+
+  void visit(const copy_stmt* op) override {
+    if (const copy_slot* slot = op->impl.target<copy_slot>()) {
+      set_result(copy_stmt::make(copies[slot->index], op->src, op->src_x, op->dst, op->dst_x, op->pad));
+    } else {
+      set_result(op);
+    }
+  }
+
+  void visit(const constant_buffer* op) override {
+    auto i = constants.find(op->value.get());
+    stmt body = mutate(op->body);
+    if (i != constants.end()) {
+      set_result(constant_buffer::make(op->sym, i->second, std::move(body)));
+    } else if (!body.same_as(op->body)) {
+      set_result(constant_buffer::make(op->sym, op->value, std::move(body)));
+    } else {
+      set_result(op);
+    }
+  }
+
+  using node_mutator::visit;
+};
+
+}  // namespace
+
+std::string structural_key(const std::vector<var>& args, const std::vector<buffer_expr_ptr>& inputs,
+    const std::vector<buffer_expr_ptr>& outputs, const std::vector<std::pair<var, expr>>& lets,
+    const build_options& options) {
+  key_builder key;
+  return structural_key(key, args, inputs, outputs, lets, options);
+}
+
+std::uint64_t structural_hash(const std::vector<var>& args, const std::vector<buffer_expr_ptr>& inputs,
+    const std::vector<buffer_expr_ptr>& outputs, const std::vector<std::pair<var, expr>>& lets,
+    const build_options& options) {
+  return std::hash<std::string>()(structural_key(args, inputs, outputs, lets, options));
+}
+
+struct pipeline_cache::entry {
+  // The pipeline, with placeholder callbacks.
+  pipeline p;
+  // The symbols of the graph the pipeline was built from, in the order found by `key_builder`.
+  std::vector<var> vars;
+  // The names of all the symbols used by `p`.
+  symbol_map<std::string> names;
+  // For each constant buffer of the graph, in the order found by `key_builder`, the buffer used in `p`.
+  std::vector<const raw_buffer*> constants;
+};
+
+pipeline_cache& pipeline_cache::global() {
+  static pipeline_cache cache;
+  return cache;
+}
+
+pipeline pipeline_cache::build(node_context& ctx, std::vector<var> args, const std::vector<buffer_expr_ptr>& inputs,
+    const std::vector<buffer_expr_ptr>& outputs, std::vector<std::pair<var, expr>> lets, const build_options& options) {
+  scoped_trace trace("pipeline_cache::build");
+  key_builder graph;
+  std::string key = structural_key(graph, args, inputs, outputs, lets, options);
+  if (key.empty()) {
+    return build_pipeline(ctx, std::move(args), inputs, outputs, std::move(lets), options);
+  }
+
+  std::vector<call_stmt::callable> calls;
+  std::vector<copy_stmt::callable> copies;
+  for (const func* f : graph.funcs) {
+    calls.push_back(f->impl());
+    copies.push_back(f->copy_impl());
+  }
+
+  std::shared_ptr<const entry> cached;
+  {
+    std::unique_lock l(mutex_);
+    auto i = entries_.find(key);
+    if (i != entries_.end()) {
+      cached = i->second;
+      ++hits_;
+    } else {
+      ++misses_;
+    }
+  }
+
+  if (!cached) {
+    // Build the pipeline with placeholder callbacks, so we can find which callback belongs to which func.
+    func_callbacks_map slots;
+    for (std::size_t i = 0; i < graph.funcs.size(); ++i) {
+      func_callbacks& f = slots[graph.funcs[i]];
+      if (calls[i]) f.impl = call_slot{i};
+      if (copies[i]) f.copy_impl = copy_slot{i};
+    }
+    auto new_entry = std::make_shared<entry>();
+    new_entry->p = build_pipeline(ctx, args, inputs, outputs, lets, options, slots);
+
+    new_entry->vars = graph.vars;
+    for (var i : find_symbols(new_entry->p.body)) {
+      new_entry->names[i] = ctx.name(i);
+    }
+    for (const buffer_expr_ptr& b : graph.buffers) {
+      if (b->constant()) new_entry->constants.push_back(b->constant().get());
+    }
+
+    std::unique_lock l(mutex_);
+    cached = entries_.emplace(key, std::move(new_entry)).first->second;
+  }
+
+  pipeline result = cached->p;
+  if (!options.compact_symbols) {
+    // Rename the symbols of the cached pipeline to the symbols of this graph, and make new symbols for the rest. If
+    // the pipeline uses compacted symbols, the symbols don't correspond to the graph anyways.
+    symbol_map<var> names;
+    for (std::size_t i = 0; i < cached->vars.size(); ++i) {
+      names[cached->vars[i]] = graph.vars[i];
+    }
+    for (var i : find_symbols(result.body)) {
+      if (!names[i]) names[i] = ctx.insert_unique(*cached->names[i]);
+    }
+    result.body = rename_symbols(result.body, names);
+    for (std::vector<var>* syms : {&result.args, &result.inputs, &result.outputs}) {
+      for (var& i : *syms) {
+        i = *names[i];
+      }
+    }
+    if (result.heap_high_water.defined()) {
+      result.heap_high_water = rename_symbols(result.heap_high_water, names);
+    }
+    result.context_size = 0;
+    for (const std::optional<var>& i : names) {
+      if (i) result.context_size = std::max(result.context_size, i->id + 1);
+    }
+  }
+
+  std::map<const raw_buffer*, const_raw_buffer_ptr> constants;
+  std::size_t next_constant = 0;
+  for (const buffer_expr_ptr& b : graph.buffers) {
+    if (b->constant()) constants[cached->constants[next_constant++]] = b->constant();
+  }
+  result.body = callback_binder(calls, copies, constants).mutate(result.body);
+  return result;
+}
+
+pipeline pipeline_cache::build(node_context& ctx, const std::vector<buffer_expr_ptr>& inputs,
+    const std::vector<buffer_expr_ptr>& outputs, const build_options& options) {
+  return build(ctx, {}, inputs, outputs, {}, options);
+}
+
+std::size_t pipeline_cache::size() {
+  std::unique_lock l(mutex_);
+  return entries_.size();
+}
+std::size_t pipeline_cache::hits() {
+  std::unique_lock l(mutex_);
+  return hits_;
+}
+std::size_t pipeline_cache::misses() {
+  std::unique_lock l(mutex_);
+  return misses_;
+}
+void pipeline_cache::clear() {
+  std::unique_lock l(mutex_);
+  entries_.clear();
+  hits_ = 0;
+  misses_ = 0;
+}
+
+}  // namespace slinky
@@ -0,0 +1,65 @@
+#ifndef SLINKY_BUILDER_PIPELINE_CACHE_H
+#define SLINKY_BUILDER_PIPELINE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "slinky/builder/pipeline.h"
+
+namespace slinky {
+
+// Computes a key describing the structure of the pipeline that `build_pipeline` would build from these arguments: the
+// graph of funcs and buffers, the schedule (`loops`, `compute_at`, `store_at`, `store_in`), and the build options.
+// The key does not depend on the ids or names of the symbols, the callbacks of the funcs, or the contents of constant
+// buffers. Returns an empty string if the pipeline can't be described by a key (e.g. it uses user defined `call`
+// exprs).
+std::string structural_key(const std::vector<var>& args, const std::vector<buffer_expr_ptr>& inputs,
+    const std::vector<buffer_expr_ptr>& outputs, const std::vector<std::pair<var, expr>>& lets = {},
+    const build_options& options = build_options());
+
+// A hash of `structural_key`.
+std::uint64_t structural_hash(const std::vector<var>& args, const std::vector<buffer_expr_ptr>& inputs,
+    const std::vector<buffer_expr_ptr>& outputs, const std::vector<std::pair<var, expr>>& lets = {},
+    const build_options& options = build_options());
+
+// A cache of built pipelines. Building a pipeline with a graph of funcs that is structurally identical to a graph that
+// was previously built (see `structural_key`) returns a copy of the previously built pipeline, with the callbacks and
+// constant buffers of the new funcs, and the symbols renamed to the symbols of the new graph.
+class pipeline_cache {
+  struct entry;
+
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<const entry>> entries_;
+  std::size_t hits_ = 0;
+  std::size_t misses_ = 0;
+
+public:
+  pipeline_cache() = default;
+  pipeline_cache(const pipeline_cache&) = delete;
+  pipeline_cache& operator=(const pipeline_cache&) = delete;
+
+  // The cache shared by the whole process.
+  static pipeline_cache& global();
+
+  // Equivalent to `build_pipeline`, using a previously built pipeline if possible.
+  pipeline build(node_context& ctx, std::vector<var> args, const std::vector<buffer_expr_ptr>& inputs,
+      const std::vector<buffer_expr_ptr>& outputs, std::vector<std::pair<var, expr>> lets = {},
+      const build_options& options = build_options());
+  pipeline build(node_context& ctx, const std::vector<buffer_expr_ptr>& inputs,
+      const std::vector<buffer_expr_ptr>& outputs, const build_options& options = build_options());
+
+  std::size_t size();
+  std::size_t hits();
+  std::size_t misses();
+  void clear();
+};
+
+}  // namespace slinky
+
+#endif  // SLINKY_BUILDER_PIPELINE_CACHE_H
@@ -268,6 +268,9 @@ public:
     std::string v = print(loopinfo.var);
     std::string step = print_expr_maybe_inlined(loopinfo.step);
     std::string max_workers = print_max_workers(loopinfo.max_workers);
+    if (loopinfo.grain.defined()) {
+      return print_string_vector({v, step, max_workers, print_expr_maybe_inlined(loopinfo.grain)});
+    }
     return print_string_vector({v, step, max_workers});
   }
 
@@ -288,6 +291,14 @@ public:
       if (!a.empty()) a += ", ";
       a += ".name = \"" + attrs.name + "\"";
     }
+    if (attrs.skip_if_empty) {
+      if (!a.empty()) a += ", ";
+      a += ".skip_if_empty = true";
+    }
+    if (attrs.full_tile) {
+      if (!a.empty()) a += ", ";
+      a += ".full_tile = true";
+    }
     return "{" + a + "}";
   }
 
@@ -382,6 +393,9 @@ public:
     if (opt.no_alias_buffers) {
       values.push_back(".no_alias_buffers = true");
     }
+    if (opt.split_loop_tails) {
+      values.push_back(".split_loop_tails = true");
+    }
     return print_vector(values);
   }
 
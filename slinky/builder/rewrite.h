@@ -2,6 +2,8 @@
 #define SLINKY_BUILDER_REWRITE_H
 
 #include <iostream>
+#include <tuple>
+#include <type_traits>
 
 #include "slinky/builder/substitute.h"
 #include "slinky/runtime/evaluate.h"
@@ -814,6 +816,103 @@ SLINKY_UNIQUE auto staircase_sum_min(
   return replacement_staircase_sum_bound<A1, B1, C1, A2, B2, C2>{a1, b1, c1, a2, b2, c2, -1};
 }
 
+// `may_match` is a conservative approximation of `match` that only compares the node types (and constants) of the
+// pattern and the target, without binding any wildcards or trying the variants of commutative ops one at a time. If
+// `may_match` is false, `match` must also fail. Most rules fail to match because of the types of the operands of the
+// target, so checking this first avoids most of the cost of trying rules that can't succeed. Because the patterns are
+// types, the pattern side of these checks is resolved at compile time, so each rule is reduced to a few comparisons of
+// node types, and the rules for an op are effectively a discrimination tree on the types of its operands.
+template <typename T>
+struct is_pattern_optional : std::false_type {};
+template <typename A, index_t Default>
+struct is_pattern_optional<pattern_optional<A, Default>> : std::true_type {};
+
+SLINKY_UNIQUE bool may_match(index_t p, expr_ref x) { return is_constant(x, p); }
+SLINKY_UNIQUE bool may_match(const pattern_expr&, expr_ref) { return true; }
+template <int N>
+SLINKY_UNIQUE bool may_match(const pattern_wildcard<N>&, expr_ref) {
+  return true;
+}
+template <int N>
+SLINKY_UNIQUE bool may_match(const pattern_constant<N>&, expr_ref x) {
+  return x.type() == expr_node_type::constant;
+}
+template <typename A, index_t Default>
+SLINKY_UNIQUE bool may_match(const pattern_optional<A, Default>& p, expr_ref x) {
+  return may_match(p.a, x);
+}
+template <typename X, typename A, typename B, typename C>
+SLINKY_UNIQUE bool may_match(const pattern_staircase<X, A, B, C>&, expr_ref) {
+  return true;
+}
+
+template <typename T, typename A, typename B>
+SLINKY_UNIQUE bool may_match_binary(const pattern_binary<T, A, B>& p, expr_ref a, expr_ref b) {
+  if (pattern_info<pattern_binary<T, A, B>>::could_commute) {
+    return (may_match(p.a, a) && may_match(p.b, b)) || (may_match(p.a, b) && may_match(p.b, a));
+  } else {
+    return may_match(p.a, a) && may_match(p.b, b);
+  }
+}
+
+template <typename T, typename A, typename B>
+SLINKY_UNIQUE bool may_match(const pattern_binary<T, A, B>& p, expr_ref x) {
+  if (const T* t = x.as<T>()) {
+    return may_match_binary(p, t->a, t->b);
+  } else if (is_pattern_optional<A>::value) {
+    // The optional operand takes its default value, and the other operand must match all of x.
+    return may_match(p.b, x);
+  } else if (is_pattern_optional<B>::value) {
+    return may_match(p.a, x);
+  } else {
+    return false;
+  }
+}
+
+template <typename T, typename A, typename B>
+SLINKY_UNIQUE bool may_match(const pattern_binary<T, A, B>& p, const pattern_binary<T, pattern_expr, pattern_expr>& x) {
+  return may_match_binary(p, x.a.e, x.b.e);
+}
+
+template <typename T, typename A>
+SLINKY_UNIQUE bool may_match(const pattern_unary<T, A>& p, expr_ref x) {
+  const T* t = x.as<T>();
+  return t && may_match(p.a, t->a);
+}
+
+template <typename T, typename A>
+SLINKY_UNIQUE bool may_match(const pattern_unary<T, A>& p, const pattern_unary<T, pattern_expr>& x) {
+  return may_match(p.a, x.a.e);
+}
+
+template <typename C, typename T, typename F>
+SLINKY_UNIQUE bool may_match(const pattern_select<C, T, F>& p, expr_ref x) {
+  const class select* s = x.as<class select>();
+  return s && may_match(p.c, s->condition) && may_match(p.t, s->true_value) && may_match(p.f, s->false_value);
+}
+
+template <typename C, typename T, typename F>
+SLINKY_UNIQUE bool may_match(
+    const pattern_select<C, T, F>& p, const pattern_select<pattern_expr, pattern_expr, pattern_expr>& x) {
+  return may_match(p.c, x.c.e) && may_match(p.t, x.t.e) && may_match(p.f, x.f.e);
+}
+
+SLINKY_UNIQUE bool may_match(const pattern_call<>& p, expr_ref x) {
+  const call* c = x.as<call>();
+  return c && c->intrinsic == p.fn;
+}
+template <typename A>
+SLINKY_UNIQUE bool may_match(const pattern_call<A>& p, expr_ref x) {
+  const call* c = x.as<call>();
+  return c && c->intrinsic == p.fn && may_match(std::get<0>(p.args), c->args[0]);
+}
+template <typename A, typename B>
+SLINKY_UNIQUE bool may_match(const pattern_call<A, B>& p, expr_ref x) {
+  const call* c = x.as<call>();
+  return c && c->intrinsic == p.fn && may_match(std::get<0>(p.args), c->args[0]) &&
+         may_match(std::get<1>(p.args), c->args[1]);
+}
+
 template <typename Pattern, typename Target>
 SLINKY_UNIQUE bool match_any_variant(Pattern p, const Target& x, match_context& ctx) {
   static_assert(pattern_info<Pattern>::is_canonical);
@@ -886,6 +985,8 @@ public:
   // The last predicate is optional and defaults to true.
   template <typename Pattern, typename... ReplacementPredicate>
   SLINKY_INLINE bool operator()(Pattern p, ReplacementPredicate... r_pr) {
+    if (!may_match(p, x)) return false;
+
     match_context ctx;
     if (!match_any_variant(p, x, ctx)) return false;
 
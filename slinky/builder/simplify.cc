@@ -10,6 +10,7 @@
 #include <optional>
 #include <set>
 #include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -1302,7 +1303,12 @@ public:
           // This crop was not contiguous, we can't drop the loop.
           return body;
         }
-      } else if (result.as<call_stmt>() || result.as<copy_stmt>()) {
+      } else if (const call_stmt* call = result.as<call_stmt>()) {
+        // We've found the actual body of the loop. A call that expects tiles of the loop step can't be merged into one
+        // call.
+        if (call->attrs.full_tile) return body;
+        break;
+      } else if (result.as<copy_stmt>()) {
         // We've found the actual body of the loop.
         break;
       } else {
@@ -1322,6 +1328,7 @@ public:
     interval_expr bounds = mutate(op->bounds);
     expr step = mutate(op->step);
     expr max_workers = mutate(op->max_workers);
+    expr grain = mutate(op->grain);
 
     // TODO: Try not to assume that step > 0.
     auto knowledge = learn_from_true(step > 0);
@@ -1428,8 +1435,8 @@ public:
           result.push_back(i->first);
         }
         std::reverse(loop_body.begin(), loop_body.end());
-        result.push_back(
-            mutate(loop::make(op->sym, std::move(max_workers), bounds, step, block::make(std::move(loop_body)))));
+        result.push_back(mutate(
+            loop::make(op->sym, std::move(max_workers), bounds, step, block::make(std::move(loop_body)), grain)));
         set_result(block::make(std::move(result)));
         return;
       } else {
@@ -1450,10 +1457,11 @@ public:
     }
 
     if (bounds.same_as(op->bounds) && step.same_as(op->step) && max_workers.same_as(op->max_workers) &&
-        body.same_as(op->body)) {
+        grain.same_as(op->grain) && body.same_as(op->body)) {
       set_result(op);
     } else {
-      set_result(loop::make(op->sym, std::move(max_workers), std::move(bounds), std::move(step), std::move(body)));
+      set_result(loop::make(
+          op->sym, std::move(max_workers), std::move(bounds), std::move(step), std::move(body), std::move(grain)));
     }
   }
 
@@ -2371,10 +2379,211 @@ public:
   using node_mutator::visit;
 };
 
+enum class memoized_fn {
+  simplify,
+  bounds_of,
+  where_true,
+};
+
+void hash_combine(std::size_t& h, std::size_t x) { h ^= x + 0x9e3779b9 + (h << 6) + (h >> 2); }
+
+// A hash of the structure of `e`, consistent with `match`.
+std::size_t structural_hash(expr_ref e) {
+  std::size_t h = static_cast<std::size_t>(e.type());
+  switch (e.type()) {
+  case expr_node_type::none: return h;
+  case expr_node_type::variable: {
+    const variable* v = e.as<variable>();
+    hash_combine(h, v->sym.id);
+    hash_combine(h, static_cast<std::size_t>(v->field));
+    hash_combine(h, static_cast<std::size_t>(v->dim));
+    return h;
+  }
+  case expr_node_type::constant: hash_combine(h, static_cast<std::size_t>(e.as<constant>()->value)); return h;
+  case expr_node_type::let: {
+    const let* l = e.as<let>();
+    for (const auto& i : l->lets) {
+      hash_combine(h, i.first.id);
+      hash_combine(h, structural_hash(i.second));
+    }
+    hash_combine(h, structural_hash(l->body));
+    return h;
+  }
+  case expr_node_type::logical_not: hash_combine(h, structural_hash(e.as<logical_not>()->a)); return h;
+  case expr_node_type::select: {
+    const class select* op = e.as<class select>();
+    hash_combine(h, structural_hash(op->condition));
+    hash_combine(h, structural_hash(op->true_value));
+    hash_combine(h, structural_hash(op->false_value));
+    return h;
+  }
+  case expr_node_type::call: {
+    const call* op = e.as<call>();
+    hash_combine(h, static_cast<std::size_t>(op->intrinsic));
+    for (const expr& i : op->args) {
+      hash_combine(h, structural_hash(i));
+    }
+    return h;
+  }
+  default: {
+    const binary_op* op = static_cast<const binary_op*>(e.get());
+    hash_combine(h, structural_hash(op->a));
+    hash_combine(h, structural_hash(op->b));
+    return h;
+  }
+  }
+}
+
+// A bounds or alignment fact that a memoized result depends on.
+struct simplify_fact {
+  var sym;
+  std::optional<interval_expr> bounds;
+  std::optional<alignment_type> alignment;
+};
+
+// The facts that a memoized result depends on, sorted by symbol.
+using simplify_facts = std::vector<simplify_fact>;
+
+// Find the facts about the variables `e` depends on, and the variables that the bounds of those variables depend on.
+// This is much smaller than `bounds` and `alignment`, which may contain facts about many unrelated variables.
+simplify_facts relevant_facts(const expr& e, const bounds_map& bounds, const alignment_map& alignment) {
+  simplify_facts result;
+  std::vector<var> visited;
+  std::vector<var> pending = find_dependencies(e);
+  while (!pending.empty()) {
+    const var i = pending.back();
+    pending.pop_back();
+    if (std::find(visited.begin(), visited.end(), i) != visited.end()) continue;
+    visited.push_back(i);
+
+    std::optional<interval_expr> b = bounds.lookup(i);
+    std::optional<alignment_type> a = alignment.lookup(i);
+    if (!b && !a) continue;
+    if (b) {
+      for (const expr* j : {&b->min, &b->max}) {
+        std::vector<var> deps = find_dependencies(*j);
+        pending.insert(pending.end(), deps.begin(), deps.end());
+      }
+    }
+    result.push_back({i, std::move(b), a});
+  }
+  std::sort(result.begin(), result.end(), [](const simplify_fact& a, const simplify_fact& b) { return a.sym < b.sym; });
+  return result;
+}
+
+std::size_t hash_facts(const simplify_facts& facts) {
+  std::size_t h = 0;
+  for (const simplify_fact& i : facts) {
+    hash_combine(h, i.sym.id);
+    if (i.bounds) {
+      hash_combine(h, structural_hash(i.bounds->min));
+      hash_combine(h, structural_hash(i.bounds->max));
+    }
+    if (i.alignment) {
+      hash_combine(h, static_cast<std::size_t>(i.alignment->modulus));
+      hash_combine(h, static_cast<std::size_t>(i.alignment->remainder));
+    }
+  }
+  return h;
+}
+
+bool facts_equal(const simplify_facts& a, const simplify_facts& b) {
+  if (a.size() != b.size()) return false;
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    if (a[i].sym != b[i].sym) return false;
+    if (a[i].bounds.has_value() != b[i].bounds.has_value()) return false;
+    if (a[i].bounds && !match(*a[i].bounds, *b[i].bounds)) return false;
+    if (!(a[i].alignment == b[i].alignment)) return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+struct simplify_cache::impl {
+  struct key {
+    memoized_fn fn;
+    expr e;
+    // Index into `facts`.
+    std::size_t facts;
+    std::size_t hash;
+
+    bool operator==(const key& other) const {
+      return fn == other.fn && facts == other.facts && match(e, other.e);
+    }
+  };
+  struct key_hash {
+    std::size_t operator()(const key& k) const { return k.hash; }
+  };
+
+  std::vector<simplify_facts> facts;
+  std::unordered_multimap<std::size_t, std::size_t> facts_by_hash;
+  std::unordered_map<key, interval_expr, key_hash> results;
+  std::size_t hits = 0;
+  std::size_t misses = 0;
+
+  // Returns the index of the facts `e` depends on in `facts`, adding them if necessary.
+  std::size_t find_facts(const expr& e, const bounds_map& bounds, const alignment_map& alignment) {
+    simplify_facts f = relevant_facts(e, bounds, alignment);
+    const std::size_t h = hash_facts(f);
+    auto range = facts_by_hash.equal_range(h);
+    for (auto i = range.first; i != range.second; ++i) {
+      if (facts_equal(facts[i->second], f)) return i->second;
+    }
+    facts.push_back(std::move(f));
+    facts_by_hash.emplace(h, facts.size() - 1);
+    return facts.size() - 1;
+  }
+
+  template <typename Fn>
+  interval_expr memoize(
+      memoized_fn fn, const expr& e, const bounds_map& bounds, const alignment_map& alignment, Fn&& compute) {
+    key k{fn, e, find_facts(e, bounds, alignment), 0};
+    k.hash = static_cast<std::size_t>(fn);
+    hash_combine(k.hash, k.facts);
+    hash_combine(k.hash, structural_hash(e));
+
+    auto i = results.find(k);
+    if (i != results.end()) {
+      ++hits;
+      return i->second;
+    }
+    ++misses;
+    // `compute` may use this cache too, so we can't hold on to iterators while calling it.
+    interval_expr result = compute();
+    results.emplace(std::move(k), result);
+    return result;
+  }
+};
+
+namespace {
+
+thread_local simplify_cache::impl* current_simplify_cache = nullptr;
+
+template <typename Fn>
+interval_expr memoize(
+    memoized_fn fn, const expr& e, const bounds_map& bounds, const alignment_map& alignment, Fn&& compute) {
+  if (!current_simplify_cache || !e.defined()) return compute();
+  return current_simplify_cache->memoize(fn, e, bounds, alignment, std::forward<Fn>(compute));
+}
+
 }  // namespace
 
+simplify_cache::simplify_cache() : impl_(std::make_unique<impl>()), prev_(current_simplify_cache) {
+  current_simplify_cache = impl_.get();
+}
+simplify_cache::~simplify_cache() {
+  assert(current_simplify_cache == impl_.get());
+  current_simplify_cache = prev_;
+}
+
+std::size_t simplify_cache::hits() const { return impl_->hits; }
+std::size_t simplify_cache::misses() const { return impl_->misses; }
+
 expr simplify(const expr& e, const bounds_map& bounds, const alignment_map& alignment) {
-  return simplifier(bounds, alignment).mutate(e, nullptr);
+  return memoize(memoized_fn::simplify, e, bounds, alignment, [&]() {
+    return point(simplifier(bounds, alignment).mutate(e, nullptr));
+  }).min;
 }
 
 stmt simplify(const stmt& s, const bounds_map& bounds, const alignment_map& alignment) {
@@ -2388,11 +2597,13 @@ interval_expr simplify(const interval_expr& e, const bounds_map& bounds, const a
 }
 
 interval_expr bounds_of(const expr& x, const bounds_map& expr_bounds, const alignment_map& alignment) {
-  scoped_trace trace("bounds_of");
-  simplifier s(expr_bounds, alignment);
-  simplifier::expr_info result;
-  s.mutate(x, &result);
-  return result.bounds;
+  return memoize(memoized_fn::bounds_of, x, expr_bounds, alignment, [&]() {
+    scoped_trace trace("bounds_of");
+    simplifier s(expr_bounds, alignment);
+    simplifier::expr_info result;
+    s.mutate(x, &result);
+    return result.bounds;
+  });
 }
 
 interval_expr bounds_of(const interval_expr& x, const bounds_map& expr_bounds, const alignment_map& alignment) {
@@ -2707,20 +2918,26 @@ std::optional<index_t> evaluate_constant_upper_bound(const expr& x) {
   return as_constant(constant_evaluator().mutate(x, 1));
 }
 
+namespace {
+
+interval_expr where_true(const expr& condition, const bounds_map& expr_bounds, const alignment_map& alignment) {
+  return memoize(memoized_fn::where_true, condition, expr_bounds, alignment,
+      [&]() { return simplifier(expr_bounds, alignment).where_true(condition); });
+}
+
+}  // namespace
+
 std::optional<bool> attempt_to_prove(
     const expr& condition, const bounds_map& expr_bounds, const alignment_map& alignment) {
-  simplifier s(expr_bounds, alignment);
-  return s.attempt_to_prove(condition);
+  return simplifier::attempt_to_prove(where_true(condition, expr_bounds, alignment));
 }
 
 bool prove_true(const expr& condition, const bounds_map& expr_bounds, const alignment_map& alignment) {
-  simplifier s(expr_bounds, alignment);
-  return s.prove_true(condition);
+  return simplifier::prove_constant_true(where_true(condition, expr_bounds, alignment).min);
 }
 
 bool prove_false(const expr& condition, const bounds_map& expr_bounds, const alignment_map& alignment) {
-  simplifier s(expr_bounds, alignment);
-  return s.prove_false(condition);
+  return simplifier::prove_constant_false(where_true(condition, expr_bounds, alignment).max);
 }
 
 }  // namespace slinky
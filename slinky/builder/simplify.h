@@ -1,6 +1,9 @@
 #ifndef SLINKY_BUILDER_SIMPLIFY_H
 #define SLINKY_BUILDER_SIMPLIFY_H
 
+#include <cstddef>
+#include <memory>
+
 #include "slinky/base/modulus_remainder.h"
 #include "slinky/runtime/expr.h"
 #include "slinky/runtime/stmt.h"
@@ -42,6 +45,33 @@ bool prove_true(
 bool prove_false(
     const expr& condition, const bounds_map& bounds = bounds_map(), const alignment_map& alignment = alignment_map());
 
+// While a `simplify_cache` is alive, the results of `simplify`, `bounds_of`, and `attempt_to_prove` (and `prove_true`,
+// `prove_false`) of exprs called on the thread that created it are memoized. The results are keyed on the structure of
+// the expr, and the bounds and alignment facts about the variables it depends on (directly, or via the bounds of other
+// variables).
+class simplify_cache {
+public:
+  struct impl;
+
+private:
+  std::unique_ptr<impl> impl_;
+  impl* prev_;
+
+public:
+  simplify_cache();
+  ~simplify_cache();
+
+  simplify_cache(const simplify_cache&) = delete;
+  simplify_cache(simplify_cache&&) = delete;
+  simplify_cache& operator=(const simplify_cache&) = delete;
+  simplify_cache& operator=(simplify_cache&&) = delete;
+
+  // The number of calls that used a memoized result.
+  std::size_t hits() const;
+  // The number of calls that computed a new result.
+  std::size_t misses() const;
+};
+
 // Helpers for producing simplified versions of ops. These do not recursively simplify their
 // operands. `op` is an existing node that may be returned if op is equivalent. `op` may be null.
 expr simplify(const class min* op, expr a, expr b);
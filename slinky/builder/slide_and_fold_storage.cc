@@ -139,6 +139,86 @@ bool is_produced_by(var v, const stmt& body) {
   return f.found;
 }
 
+// Remove the calls and copies from the body of a warmup loop that don't produce one of `warmup_buffers`, or a buffer
+// needed to produce them. This assumes that a loop body produces the buffers it consumes before consuming them.
+class warmup_pruner : public stmt_mutator {
+  // Maps aliases of buffers to the buffer they alias.
+  symbol_map<var> roots;
+  symbol_map<bool> needed;
+
+  var root(var x) const { return roots.lookup(x).value_or(x); }
+
+  bool visit_call_or_copy(span<const var> inputs, span<const var> outputs) {
+    bool is_needed = outputs.empty();
+    for (var i : outputs) {
+      is_needed = is_needed || needed.lookup(root(i)).value_or(false);
+    }
+    if (!is_needed) return false;
+    for (var i : inputs) {
+      needed[root(i)] = true;
+    }
+    return true;
+  }
+
+  template <typename T>
+  void visit_alias(const T* op) {
+    auto set_root = set_value_in_scope(roots, op->sym, root(op->src));
+    stmt_mutator::visit(op);
+  }
+  template <typename T>
+  void visit_decl(const T* op) {
+    auto set_root = set_value_in_scope(roots, op->sym, op->sym);
+    stmt_mutator::visit(op);
+  }
+
+public:
+  warmup_pruner(symbol_map<var> roots, span<const var> warmup_buffers) : roots(std::move(roots)) {
+    for (var i : warmup_buffers) {
+      needed[i] = true;
+    }
+  }
+
+  void visit(const block* op) override {
+    // Visit the stmts in reverse order, so we know what the consumers need before visiting the producers.
+    std::vector<stmt> stmts(op->stmts.size());
+    bool changed = false;
+    for (std::size_t i = op->stmts.size(); i > 0; --i) {
+      stmts[i - 1] = mutate(op->stmts[i - 1]);
+      changed = changed || !stmts[i - 1].same_as(op->stmts[i - 1]);
+    }
+    if (changed) {
+      set_result(block::make(std::move(stmts)));
+    } else {
+      set_result(op);
+    }
+  }
+
+  void visit(const call_stmt* op) override {
+    set_result(visit_call_or_copy(op->inputs, op->outputs) ? stmt(op) : stmt());
+  }
+  void visit(const copy_stmt* op) override {
+    set_result(visit_call_or_copy({&op->src, 1}, {&op->dst, 1}) ? stmt(op) : stmt());
+  }
+  void visit(const check* op) override {
+    // Checks may access buffers, e.g. semaphores.
+    for (var i : find_dependencies(op->condition)) {
+      needed[root(i)] = true;
+    }
+    set_result(op);
+  }
+
+  void visit(const allocate* op) override { visit_decl(op); }
+  void visit(const make_buffer* op) override { visit_decl(op); }
+  void visit(const crop_buffer* op) override { visit_alias(op); }
+  void visit(const crop_dim* op) override { visit_alias(op); }
+  void visit(const slice_buffer* op) override { visit_alias(op); }
+  void visit(const slice_dim* op) override { visit_alias(op); }
+  void visit(const transpose* op) override { visit_alias(op); }
+  void visit(const clone_buffer* op) override { visit_alias(op); }
+
+  using stmt_mutator::visit;
+};
+
 // Find a maximum value of x which makes `condition` expression true. The search goes
 // backwards from initial_guess up to some fixed depth.
 expr where_true_upper_bound(const expr& condition, var x, const expr& initial_guess, const bounds_map& expr_bounds,
@@ -211,6 +291,10 @@ public:
     // Unique loop ID.
     int loop_id = -1;
 
+    // The buffers that we slid by moving the loop min. The iterations before the original loop min only need to produce
+    // these buffers (and the buffers they depend on).
+    std::vector<var> warmup_buffers;
+
     bool add_synchronization() {
       if (prove_true(sync_stages + 1 >= max_workers)) {
         // It's pointless to add more stages to the loop, because we can't run then in parallel anyways, it would just
@@ -236,6 +320,10 @@ public:
   std::vector<loop_info> loops;
 
   symbol_map<var> aliases;
+  // The buffer declared outside of any aliases that each alias refers to.
+  symbol_map<var> roots;
+
+  var root_of(var x) const { return roots.lookup(x).value_or(x); }
 
   // We need an unknown to make equations of.
   var x;
@@ -414,6 +502,7 @@ public:
 
         if (!is_negative_infinity(new_loop_min)) {
           loop.bounds.min = new_loop_min;
+          loop.warmup_buffers.push_back(root_of(output));
 
           (*bounds)[d].min = new_min;
         } else {
@@ -525,6 +614,7 @@ public:
 
     auto set_bounds = set_value_in_scope(current_buffer_bounds(), op->sym, bounds);
     auto set_alias = set_value_in_scope(aliases, op->sym, op->src);
+    auto set_root = set_value_in_scope(roots, op->sym, root_of(op->src));
 
     slide_and_fold_buffer(op->sym, op->body);
 
@@ -555,6 +645,7 @@ public:
 
     auto set_bounds = set_value_in_scope(current_buffer_bounds(), op->sym, bounds);
     auto set_alias = set_value_in_scope(aliases, op->sym, op->src);
+    auto set_root = set_value_in_scope(roots, op->sym, root_of(op->src));
 
     slide_and_fold_buffer(op->sym, op->body);
 
@@ -579,6 +670,7 @@ public:
 
     auto set_bounds = set_value_in_scope(current_buffer_bounds(), op->sym, bounds);
     auto set_alias = set_value_in_scope(aliases, op->sym, op->src);
+    auto set_root = set_value_in_scope(roots, op->sym, root_of(op->src));
     stmt body = mutate(op->body);
     // TODO: If the bounds of the sliced dimensions are modified, do we need to insert an "if" here?
     if (body.same_as(op->body)) {
@@ -595,6 +687,7 @@ public:
 
     auto set_bounds = set_value_in_scope(current_buffer_bounds(), op->sym, bounds);
     auto set_alias = set_value_in_scope(aliases, op->sym, op->src);
+    auto set_root = set_value_in_scope(roots, op->sym, root_of(op->src));
     stmt body = mutate(op->body);
     // TODO: If the bounds of the sliced dimensions are modified, do we need to insert an "if" here?
     if (body.same_as(op->body)) {
@@ -606,6 +699,7 @@ public:
   void visit(const transpose*) override { SLINKY_UNREACHABLE << "transpose not handled by slide_and_fold_storage"; }
   void visit(const clone_buffer* op) override {
     auto set_alias = set_value_in_scope(aliases, op->sym, op->src);
+    auto set_root = set_value_in_scope(roots, op->sym, root_of(op->src));
     stmt_mutator::visit(op);
   }
 
@@ -655,7 +749,22 @@ public:
     const loop_info& l = loops.back();
     const int stage_count = l.sync_stages;
     expr max_workers = l.data_parallel ? op->max_workers : std::max(1, stage_count);
-    stmt result = loop::make(op->sym, max_workers, loop_bounds, op->step, std::move(body));
+    stmt result;
+    if (!l.warmup_buffers.empty()) {
+      // Peel the warmup iterations, which are the iterations that run entirely before the original loop min, into a
+      // separate loop that only produces the buffers needed by the following iterations.
+      expr warmup_end =
+          simplify(loop_bounds.min + align_up(max(0, expr(orig_min) - loop_bounds.min - op->step + 1), op->step));
+      stmt warmup_body = warmup_pruner(roots, l.warmup_buffers).mutate(body);
+      stmt warmup = loop::make(op->sym, loop::serial, {loop_bounds.min, min(warmup_end - 1, loop_bounds.max)}, op->step,
+          std::move(warmup_body));
+      result = block::make({
+          std::move(warmup),
+          loop::make(op->sym, max_workers, {warmup_end, loop_bounds.max}, op->step, std::move(body), op->grain),
+      });
+    } else {
+      result = loop::make(op->sym, max_workers, loop_bounds, op->step, std::move(body), op->grain);
+    }
 
     // Substitute the placeholder worker_count.
     result = substitute(result, l.worker_count, max_workers);
@@ -0,0 +1,225 @@
+#include "slinky/builder/specialize.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "slinky/base/chrome_trace.h"
+#include "slinky/builder/node_mutator.h"
+#include "slinky/builder/optimizations.h"
+#include "slinky/builder/simplify.h"
+#include "slinky/builder/substitute.h"
+#include "slinky/runtime/depends_on.h"
+#include "slinky/runtime/expr.h"
+#include "slinky/runtime/stmt.h"
+
+namespace slinky {
+
+namespace {
+
+// Replaces the metadata of buffers with the metadata of some raw_buffers.
+class shape_substitutor : public substitutor {
+  // Buffers that are shadowed are null in this map.
+  symbol_map<const raw_buffer*> buffers_;
+  std::vector<scoped_value_in_symbol_map<const raw_buffer*>> decls_;
+
+public:
+  void add(var sym, const raw_buffer* buf) { buffers_[sym] = buf; }
+
+  const raw_buffer* lookup(var x) const {
+    std::optional<const raw_buffer*> buf = buffers_.lookup(x);
+    return buf ? *buf : nullptr;
+  }
+
+  var enter_decl(var x) override {
+    decls_.push_back(set_value_in_scope(buffers_, x, static_cast<const raw_buffer*>(nullptr)));
+    return x;
+  }
+  void exit_decls(int n) override { decls_.erase(decls_.end() - n, decls_.end()); }
+
+  std::size_t get_target_buffer_rank(var x) override {
+    const raw_buffer* buf = lookup(x);
+    return buf ? buf->rank : 0;
+  }
+
+  expr mutate_variable(const variable* op, var buf, buffer_field field, int dim) override {
+    const raw_buffer* b = lookup(buf);
+    if (!b) return expr(op);
+
+    switch (field) {
+    case buffer_field::rank: return static_cast<index_t>(b->rank);
+    case buffer_field::elem_size: return static_cast<index_t>(b->elem_size);
+    case buffer_field::size_bytes: return static_cast<index_t>(b->size_bytes());
+    case buffer_field::min: return b->dim(dim).min();
+    case buffer_field::max: return b->dim(dim).max();
+    case buffer_field::stride: return b->dim(dim).stride();
+    case buffer_field::fold_factor: return b->dim(dim).fold_factor();
+    default: SLINKY_UNREACHABLE << "got scalar var instead of buffer";
+    }
+  }
+
+  using substitutor::mutate;
+};
+
+// The closures made by `optimize_symbols` aren't preserved by the simplifier, we remove them and make them again after
+// simplifying.
+class closure_remover : public stmt_mutator {
+public:
+  void visit(const let_stmt* op) override {
+    if (op->is_closure) {
+      set_result(mutate(op->body));
+    } else {
+      stmt_mutator::visit(op);
+    }
+  }
+
+  using stmt_mutator::visit;
+};
+
+void append_shape(std::vector<index_t>& result, const raw_buffer* buf) {
+  result.push_back(buf->rank);
+  result.push_back(buf->elem_size);
+  for (std::size_t d = 0; d < buf->rank; ++d) {
+    const slinky::dim& dim = buf->dim(d);
+    result.push_back(dim.min());
+    result.push_back(dim.max());
+    result.push_back(dim.stride());
+    result.push_back(dim.fold_factor());
+  }
+}
+
+}  // namespace
+
+std::vector<index_t> shape_signature(pipeline::buffers inputs, pipeline::buffers outputs) {
+  std::vector<index_t> result;
+  for (const raw_buffer* i : inputs) {
+    append_shape(result, i);
+  }
+  for (const raw_buffer* i : outputs) {
+    append_shape(result, i);
+  }
+  return result;
+}
+
+pipeline specialize(const pipeline& p, pipeline::buffers inputs, pipeline::buffers outputs) {
+  scoped_trace trace("specialize");
+  assert(inputs.size() == p.inputs.size());
+  assert(outputs.size() == p.outputs.size());
+
+  std::vector<var> external_symbols;
+  for (const std::vector<var>* syms : {&p.args, &p.inputs, &p.outputs}) {
+    external_symbols.insert(external_symbols.end(), syms->begin(), syms->end());
+  }
+
+  // The body of a built pipeline mutates buffers in place, but the simplifier can't handle shadowed symbols. We need
+  // a node_context to make new symbols, which must not collide with the symbols already used by the pipeline.
+  node_context ctx;
+  std::size_t context_size = find_context_size(p.body);
+  for (var i : external_symbols) {
+    context_size = std::max(context_size, i.id + 1);
+  }
+  for (std::size_t i = 0; i < context_size; ++i) {
+    ctx.insert("_" + std::to_string(i));
+  }
+
+  shape_substitutor shapes;
+  for (std::size_t i = 0; i < inputs.size(); ++i) {
+    shapes.add(p.inputs[i], inputs[i]);
+  }
+  for (std::size_t i = 0; i < outputs.size(); ++i) {
+    shapes.add(p.outputs[i], outputs[i]);
+  }
+
+  stmt body = closure_remover().mutate(p.body);
+  body = deshadow(body, external_symbols, ctx);
+  body = shapes.mutate(body);
+  body = simplify(body);
+  body = optimize_symbols(body, ctx);
+  body = canonicalize_nodes(body);
+
+  pipeline result;
+  result.args = p.args;
+  result.inputs = p.inputs;
+  result.outputs = p.outputs;
+  result.body = std::move(body);
+  if (p.context_size > 0) {
+    result.context_size = std::max(context_size, find_context_size(result.body));
+  }
+  if (p.heap_high_water.defined()) {
+    result.heap_high_water = simplify(shapes.mutate(p.heap_high_water));
+    result.heap_high_water_allocations = p.heap_high_water_allocations;
+  }
+  return result;
+}
+
+specializing_pipeline::specializing_pipeline(pipeline generic, std::size_t max_specializations)
+    : generic_(std::move(generic)), max_specializations_(max_specializations) {}
+
+std::shared_ptr<const pipeline> specializing_pipeline::specialization(
+    pipeline::buffers inputs, pipeline::buffers outputs) {
+  std::vector<index_t> signature = shape_signature(inputs, outputs);
+  {
+    std::unique_lock l(mutex_);
+    auto i = specializations_.find(signature);
+    if (i != specializations_.end()) {
+      ++hits_;
+      return i->second;
+    }
+    ++misses_;
+    if (specializations_.size() >= max_specializations_) return nullptr;
+  }
+
+  // Specialize without holding the lock, if another thread specializes the same shape concurrently, the first one wins.
+  auto result = std::make_shared<const pipeline>(specialize(generic_, inputs, outputs));
+
+  std::unique_lock l(mutex_);
+  if (specializations_.size() >= max_specializations_) return result;
+  return specializations_.emplace(std::move(signature), std::move(result)).first->second;
+}
+
+index_t specializing_pipeline::evaluate(
+    pipeline::scalars args, pipeline::buffers inputs, pipeline::buffers outputs, eval_context& ctx) {
+  std::shared_ptr<const pipeline> p = specialization(inputs, outputs);
+  return p ? p->evaluate(args, inputs, outputs, ctx) : generic_.evaluate(args, inputs, outputs, ctx);
+}
+
+index_t specializing_pipeline::evaluate(pipeline::buffers inputs, pipeline::buffers outputs, eval_context& ctx) {
+  return evaluate(pipeline::scalars(), inputs, outputs, ctx);
+}
+
+index_t specializing_pipeline::evaluate(
+    pipeline::scalars args, pipeline::buffers inputs, pipeline::buffers outputs) {
+  eval_context ctx;
+  return evaluate(args, inputs, outputs, ctx);
+}
+
+index_t specializing_pipeline::evaluate(pipeline::buffers inputs, pipeline::buffers outputs) {
+  eval_context ctx;
+  return evaluate(pipeline::scalars(), inputs, outputs, ctx);
+}
+
+std::size_t specializing_pipeline::size() {
+  std::unique_lock l(mutex_);
+  return specializations_.size();
+}
+std::size_t specializing_pipeline::hits() {
+  std::unique_lock l(mutex_);
+  return hits_;
+}
+std::size_t specializing_pipeline::misses() {
+  std::unique_lock l(mutex_);
+  return misses_;
+}
+void specializing_pipeline::clear() {
+  std::unique_lock l(mutex_);
+  specializations_.clear();
+  hits_ = 0;
+  misses_ = 0;
+}
+
+}  // namespace slinky
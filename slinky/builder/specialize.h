@@ -0,0 +1,61 @@
+#ifndef SLINKY_BUILDER_SPECIALIZE_H
+#define SLINKY_BUILDER_SPECIALIZE_H
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "slinky/runtime/evaluate.h"
+#include "slinky/runtime/pipeline.h"
+
+namespace slinky {
+
+// Describes the shapes of buffers: the rank, elem_size, and the bounds, stride, and fold factor of each dimension.
+std::vector<index_t> shape_signature(pipeline::buffers inputs, pipeline::buffers outputs);
+
+// Make a copy of `p` specialized for input and output buffers with the same shapes as `inputs` and `outputs`: the
+// metadata of these buffers is substituted into the body of `p` as constants, and the result is simplified again. This
+// can remove most checks, and make loop bounds, fold factors, and allocation sizes constant. The result must only be
+// evaluated with buffers that have the same `shape_signature` as `inputs` and `outputs`.
+pipeline specialize(const pipeline& p, pipeline::buffers inputs, pipeline::buffers outputs);
+
+// Evaluates specializations of a pipeline (see `specialize`) for the shapes of the buffers it is evaluated with. The
+// specializations are made the first time a shape is evaluated, and cached for subsequent evaluations. At most
+// `max_specializations` are made, after that shapes without a specialization use the generic pipeline.
+class specializing_pipeline {
+  pipeline generic_;
+  std::size_t max_specializations_;
+
+  std::mutex mutex_;
+  std::map<std::vector<index_t>, std::shared_ptr<const pipeline>> specializations_;
+  std::size_t hits_ = 0;
+  std::size_t misses_ = 0;
+
+public:
+  explicit specializing_pipeline(pipeline generic, std::size_t max_specializations = 16);
+  specializing_pipeline(const specializing_pipeline&) = delete;
+  specializing_pipeline& operator=(const specializing_pipeline&) = delete;
+
+  const pipeline& generic() const { return generic_; }
+
+  // Returns the specialization for the shapes of `inputs` and `outputs`, making it if necessary. Returns null if there
+  // are already `max_specializations` specializations.
+  std::shared_ptr<const pipeline> specialization(pipeline::buffers inputs, pipeline::buffers outputs);
+
+  // Equivalent to the corresponding `pipeline::evaluate` of the generic pipeline.
+  index_t evaluate(pipeline::scalars args, pipeline::buffers inputs, pipeline::buffers outputs, eval_context& ctx);
+  index_t evaluate(pipeline::buffers inputs, pipeline::buffers outputs, eval_context& ctx);
+  index_t evaluate(pipeline::scalars args, pipeline::buffers inputs, pipeline::buffers outputs);
+  index_t evaluate(pipeline::buffers inputs, pipeline::buffers outputs);
+
+  std::size_t size();
+  std::size_t hits();
+  std::size_t misses();
+  void clear();
+};
+
+}  // namespace slinky
+
+#endif  // SLINKY_BUILDER_SPECIALIZE_H
@@ -0,0 +1,191 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "slinky/builder/pipeline.h"
+#include "slinky/builder/test/funcs.h"
+#include "slinky/runtime/expr.h"
+
+namespace slinky {
+
+// These benchmarks measure the time taken by each pass of `build_pipeline` on large synthetic pipelines. The size of
+// the pipelines is given by the argument of the benchmark. The time spent in each pass (summed over passes that run
+// more than once) is reported in the counter `<pass>_ms`, and the number of nodes in the built pipeline in `nodes`.
+// The second argument enables `build_options::memoize_simplify`.
+// When memoizing, the fraction of calls to the simplifier that used a memoized result is reported in `simplify_hits`.
+
+// The funcs of a pipeline must outlive the call to `build_pipeline`.
+struct synthetic_pipeline {
+  node_context ctx;
+  std::vector<buffer_expr_ptr> inputs;
+  std::vector<buffer_expr_ptr> outputs;
+  std::deque<func> funcs;
+};
+
+// A chain of `n` 3x3 stencils, computed in a sliding window over rows of the output.
+void make_stencil_chain(synthetic_pipeline& p, int n) {
+  var x(p.ctx, "x");
+  var y(p.ctx, "y");
+
+  buffer_expr_ptr in = buffer_expr::make(p.ctx, "in", 2, sizeof(short));
+  p.inputs = {in};
+  for (int i = 0; i < n; ++i) {
+    buffer_expr_ptr out = buffer_expr::make(p.ctx, "stencil" + std::to_string(i), 2, sizeof(short));
+    p.funcs.push_back(func::make(sum3x3<short>, {{in, {bounds(-1, 1) + x, bounds(-1, 1) + y}}}, {{out, {x, y}}}));
+    in = out;
+  }
+  p.funcs.back().loops({{y, 1}});
+  p.outputs = {in};
+}
+
+// A chain of `n` 3x3 stencils of padded copies of the previous stage, computed in a sliding window over rows of the
+// output.
+void make_padded_stencil_chain(synthetic_pipeline& p, int n) {
+  var x(p.ctx, "x");
+  var y(p.ctx, "y");
+
+  buffer_expr_ptr in = buffer_expr::make(p.ctx, "in", 2, sizeof(short));
+  p.inputs = {in};
+  for (int i = 0; i < n; ++i) {
+    buffer_expr_ptr padded = buffer_expr::make(p.ctx, "padded" + std::to_string(i), 2, sizeof(short));
+    buffer_expr_ptr out = buffer_expr::make(p.ctx, "stencil" + std::to_string(i), 2, sizeof(short));
+    p.funcs.push_back(func::make_copy({in, {point(x), point(y)}, p.inputs[0]->bounds()}, {padded, {x, y}},
+        {buffer_expr::make_scalar<short>(p.ctx, "padding" + std::to_string(i), 0)}));
+    p.funcs.push_back(
+        func::make(sum3x3<short>, {{padded, {bounds(-1, 1) + x, bounds(-1, 1) + y}}}, {{out, {x, y}}}));
+    in = out;
+  }
+  p.funcs.back().loops({{y, 1}});
+  p.outputs = {in};
+}
+
+// An image pyramid with `n` levels, computed in a sliding window over rows of the output.
+void make_pyramid(synthetic_pipeline& p, int n) {
+  var x(p.ctx, "x");
+  var y(p.ctx, "y");
+
+  buffer_expr_ptr in = buffer_expr::make(p.ctx, "in", 2, sizeof(int));
+  p.inputs = {in};
+  std::vector<buffer_expr_ptr> down = {in};
+  for (int i = 0; i < n; ++i) {
+    buffer_expr_ptr out = buffer_expr::make(p.ctx, "down" + std::to_string(i), 2, sizeof(int));
+    p.funcs.push_back(
+        func::make(downsample2x, {{down.back(), {2 * x + bounds(0, 1), 2 * y + bounds(0, 1)}}}, {{out, {x, y}}}));
+    down.push_back(out);
+  }
+  buffer_expr_ptr up = down.back();
+  for (int i = n - 1; i >= 0; --i) {
+    buffer_expr_ptr out = buffer_expr::make(p.ctx, "up" + std::to_string(i), 2, sizeof(int));
+    p.funcs.push_back(func::make(pyramid_upsample2x,
+        {{down[i], {point(x), point(y)}}, {up, {bounds(x, x + 1) / 2, bounds(y, y + 1) / 2}}}, {{out, {x, y}}}));
+    up = out;
+  }
+  p.funcs.back().loops({{y, 1}});
+  p.outputs = {up};
+}
+
+// `n` independent stencils of one input, reduced to one output with a tree of elementwise operations, computed in
+// parallel tiles of rows of the output.
+void make_parallel_stencils(synthetic_pipeline& p, int n) {
+  var x(p.ctx, "x");
+  var y(p.ctx, "y");
+
+  buffer_expr_ptr in = buffer_expr::make(p.ctx, "in", 2, sizeof(short));
+  p.inputs = {in};
+  std::vector<buffer_expr_ptr> stages;
+  for (int i = 0; i < n; ++i) {
+    buffer_expr_ptr scaled = buffer_expr::make(p.ctx, "scaled" + std::to_string(i), 2, sizeof(short));
+    buffer_expr_ptr out = buffer_expr::make(p.ctx, "stencil" + std::to_string(i), 2, sizeof(short));
+    p.funcs.push_back(func::make(multiply_2<short>, {{in, {point(x), point(y)}}}, {{scaled, {x, y}}}));
+    if (i % 2 == 0) {
+      p.funcs.push_back(
+          func::make(sum3x3<short>, {{scaled, {bounds(-1, 1) + x, bounds(-1, 1) + y}}}, {{out, {x, y}}}));
+    } else {
+      p.funcs.push_back(
+          func::make(sum5x5<short>, {{scaled, {bounds(-2, 2) + x, bounds(-2, 2) + y}}}, {{out, {x, y}}}));
+    }
+    stages.push_back(out);
+  }
+  int next = 0;
+  while (stages.size() > 1) {
+    std::vector<buffer_expr_ptr> reduced;
+    for (std::size_t i = 0; i + 1 < stages.size(); i += 2) {
+      buffer_expr_ptr out = buffer_expr::make(p.ctx, "sub" + std::to_string(next++), 2, sizeof(short));
+      p.funcs.push_back(func::make(subtract<short>,
+          {{stages[i], {point(x), point(y)}}, {stages[i + 1], {point(x), point(y)}}}, {{out, {x, y}}}));
+      reduced.push_back(out);
+    }
+    if (stages.size() % 2 == 1) reduced.push_back(stages.back());
+    stages = std::move(reduced);
+  }
+  p.funcs.back().loops({{y, 8, loop::parallel}});
+  p.outputs = {stages.front()};
+}
+
+void benchmark_build(benchmark::State& state, void (*make)(synthetic_pipeline&, int)) {
+  const int n = state.range(0);
+  const bool memoize_simplify = state.range(1) != 0;
+
+  std::map<std::string, std::chrono::nanoseconds> pass_times;
+  std::size_t nodes = 0;
+  std::size_t simplify_hits = 0;
+  std::size_t simplify_calls = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    synthetic_pipeline p;
+    make(p, n);
+    build_stats stats;
+    state.ResumeTiming();
+
+    build_pipeline(p.ctx, p.inputs, p.outputs,
+        build_options{.compact_symbols = true, .memoize_simplify = memoize_simplify, .stats = &stats});
+
+    state.PauseTiming();
+    for (const build_stats::pass& i : stats.passes) {
+      pass_times[i.name] += i.time;
+    }
+    nodes = stats.passes.back().nodes;
+    simplify_hits += stats.simplify_cache_hits;
+    simplify_calls += stats.simplify_cache_hits + stats.simplify_cache_misses;
+    state.ResumeTiming();
+  }
+
+  for (const auto& i : pass_times) {
+    state.counters[i.first + "_ms"] = benchmark::Counter(
+        std::chrono::duration<double, std::milli>(i.second).count(), benchmark::Counter::kAvgIterations);
+  }
+  state.counters["nodes"] = nodes;
+  if (memoize_simplify) {
+    state.counters["simplify_hits"] = static_cast<double>(simplify_hits) / std::max<std::size_t>(simplify_calls, 1);
+  }
+}
+
+void BM_build_stencil_chain(benchmark::State& state) { benchmark_build(state, make_stencil_chain); }
+void BM_build_padded_stencil_chain(benchmark::State& state) { benchmark_build(state, make_padded_stencil_chain); }
+void BM_build_pyramid(benchmark::State& state) { benchmark_build(state, make_pyramid); }
+void BM_build_parallel_stencils(benchmark::State& state) { benchmark_build(state, make_parallel_stencils); }
+
+BENCHMARK(BM_build_stencil_chain)
+    ->ArgsProduct({{4, 8, 16, 32}, {0, 1}})
+    ->ArgNames({"n", "memoize"})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_build_padded_stencil_chain)
+    ->ArgsProduct({{2, 4, 8}, {0, 1}})
+    ->ArgNames({"n", "memoize"})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_build_pyramid)
+    ->ArgsProduct({{2, 4, 6, 8}, {0, 1}})
+    ->ArgNames({"n", "memoize"})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_build_parallel_stencils)
+    ->ArgsProduct({{4, 8, 16}, {0, 1}})
+    ->ArgNames({"n", "memoize"})
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace slinky
@@ -51,7 +51,7 @@ test_context::test_context() {
   copy = [this](const raw_buffer& src, const raw_buffer& dst, const raw_buffer& pad) {
     ++copy_calls;
     copy_elements += dst.elem_count();
-    slinky::copy(src, dst, pad);
+    copy_with_pool(config.thread_pool, src, dst, pad);
   };
 
   config.thread_pool = &threads;
@@ -513,6 +513,124 @@ TEST_P(concatenated_output, pipeline) {
   }
 }
 
+TEST(concatenated_output, large) {
+  // Make the pipeline
+  node_context ctx;
+
+  auto in1 = buffer_expr::make(ctx, "in1", 2, sizeof(int));
+  auto in2 = buffer_expr::make(ctx, "in2", 2, sizeof(int));
+  auto out = buffer_expr::make(ctx, "out", 2, sizeof(int));
+
+  var x(ctx, "x");
+  var y(ctx, "y");
+
+  // These copies are big enough to be split into chunks that run on the thread pool.
+  func concatenated =
+      func::make_concat({in1, in2}, {out, {x, y}}, 1, {0, in1->dim(1).extent(), out->dim(1).extent()});
+
+  pipeline p = build_pipeline(ctx, {in1, in2}, {out});
+
+  // Run the pipeline.
+  const int W = 1000;
+  const int H1 = 300;
+  const int H2 = 700;
+  buffer<int, 2> in1_buf({W, H1});
+  buffer<int, 2> in2_buf({W, H2});
+  init_random(in1_buf);
+  init_random(in2_buf);
+
+  buffer<int, 2> out_buf({W, H1 + H2});
+  out_buf.allocate();
+
+  const raw_buffer* inputs[] = {&in1_buf, &in2_buf};
+  const raw_buffer* outputs[] = {&out_buf};
+  test_context eval_ctx;
+  p.evaluate(inputs, outputs, eval_ctx);
+
+  for (int y = 0; y < H1 + H2; ++y) {
+    for (int x = 0; x < W; ++x) {
+      ASSERT_EQ(out_buf(x, y), y < H1 ? in1_buf(x, y) : in2_buf(x, y - H1));
+    }
+  }
+}
+
+TEST(copy_pipeline, profile) {
+  // Make the pipeline
+  node_context ctx;
+
+  auto in1 = buffer_expr::make(ctx, "in1", 1, sizeof(int));
+  auto in2 = buffer_expr::make(ctx, "in2", 1, sizeof(int));
+  auto out1 = buffer_expr::make(ctx, "out1", 1, sizeof(int));
+  auto out2 = buffer_expr::make(ctx, "out2", 1, sizeof(int));
+
+  var x(ctx, "x");
+
+  func copy1 = func::make_copy({in1, {point(x)}}, {out1, {x}});
+  func copy2 = func::make_copy({in2, {point(x)}}, {out2, {x}});
+
+  pipeline p = build_pipeline(ctx, {in1, in2}, {out1, out2});
+
+  // Run the pipeline.
+  const int W1 = 10;
+  const int W2 = 20;
+  buffer<int, 1> in1_buf({W1});
+  buffer<int, 1> in2_buf({W2});
+  init_random(in1_buf);
+  init_random(in2_buf);
+
+  buffer<int, 1> out1_buf({W1});
+  buffer<int, 1> out2_buf({W2});
+  out1_buf.allocate();
+  out2_buf.allocate();
+
+  const raw_buffer* inputs[] = {&in1_buf, &in2_buf};
+  const raw_buffer* outputs[] = {&out1_buf, &out2_buf};
+  eval_profile profile;
+  test_context eval_ctx;
+  eval_ctx.config.profile = &profile;
+  p.evaluate(inputs, outputs, eval_ctx);
+
+  // The copies are profiled separately, keyed by their destination.
+  std::map<std::string, call_profile> calls = profile.calls();
+  ASSERT_EQ(calls.size(), 2);
+  ASSERT_EQ(calls["copy(out1)"].calls, 1);
+  ASSERT_EQ(calls["copy(out1)"].elements, W1);
+  ASSERT_EQ(calls["copy(out2)"].calls, 1);
+  ASSERT_EQ(calls["copy(out2)"].elements, W2);
+}
+
+TEST(copy_pipeline, custom_impl) {
+  // Make the pipeline
+  node_context ctx;
+
+  auto in = buffer_expr::make(ctx, "in", 1, sizeof(int));
+  auto out = buffer_expr::make(ctx, "out", 1, sizeof(int));
+
+  var x(ctx, "x");
+
+  // `slinky::copy` can be used as the implementation of a copy directly.
+  func copy = func::make_copy({in, {point(x)}}, {out, {x}}, slinky::copy);
+
+  pipeline p = build_pipeline(ctx, {in}, {out});
+
+  // Run the pipeline.
+  const int W = 10;
+  buffer<int, 1> in_buf({W});
+  init_random(in_buf);
+
+  buffer<int, 1> out_buf({W});
+  out_buf.allocate();
+
+  const raw_buffer* inputs[] = {&in_buf};
+  const raw_buffer* outputs[] = {&out_buf};
+  test_context eval_ctx;
+  p.evaluate(inputs, outputs, eval_ctx);
+
+  for (int x = 0; x < W; ++x) {
+    ASSERT_EQ(out_buf(x), in_buf(x));
+  }
+}
+
 class transposed_output : public testing::TestWithParam<std::tuple<bool, int, int, int>> {};
 
 auto iota3 = testing::Values(0, 1, 2);
@@ -1,10 +1,16 @@
 #ifndef SLINKY_BUILDER_TEST_FUNCS_H
 #define SLINKY_BUILDER_TEST_FUNCS_H
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <functional>
+#include <limits>
 #include <vector>
 
+#include "slinky/builder/pipeline.h"
 #include "slinky/runtime/buffer.h"
+#include "slinky/runtime/expr.h"
 
 namespace slinky {
 
@@ -150,6 +156,327 @@ index_t sum(const buffer<const T>& in, const buffer<T>& out, std::vector<std::tu
   return 0;
 }
 
+// Matrix multiplication (not fast!)
+template <typename T>
+index_t matmul(const buffer<const T>& a, const buffer<const T>& b, const buffer<T>& c) {
+  assert(a.rank == 2);
+  assert(b.rank == 2);
+  assert(c.rank == 2);
+  assert(a.dim(1).begin() == b.dim(0).begin());
+  assert(a.dim(1).end() == b.dim(0).end());
+  assert(a.dim(1).stride() == sizeof(T));
+  assert(b.dim(1).stride() == sizeof(T));
+  assert(c.dim(1).stride() == sizeof(T));
+  for (index_t i = c.dim(0).begin(); i < c.dim(0).end(); ++i) {
+    for (index_t j = c.dim(1).begin(); j < c.dim(1).end(); ++j) {
+      c(i, j) = 0;
+      for (index_t k = a.dim(1).begin(); k < a.dim(1).end(); ++k) {
+        c(i, j) += a(i, k) * b(k, j);
+      }
+    }
+  }
+  return 0;
+}
+
+// The stages of an image pyramid: a 2x downsample, and a 2x upsample added to a skip connection.
+inline index_t downsample2x(const buffer<const int>& in, const buffer<int>& out) {
+  for (index_t y = out.dim(1).begin(); y < out.dim(1).end(); ++y) {
+    for (index_t x = out.dim(0).begin(); x < out.dim(0).end(); ++x) {
+      out(x, y) = (in(2 * x + 0, 2 * y + 0) + in(2 * x + 1, 2 * y + 0) + in(2 * x + 0, 2 * y + 1) +
+                      in(2 * x + 1, 2 * y + 1) + 2) /
+                  4;
+    }
+  }
+  return 0;
+}
+
+inline index_t pyramid_upsample2x(const buffer<const int>& skip, const buffer<const int>& in, const buffer<int>& out) {
+  for (index_t y = out.dim(1).begin(); y < out.dim(1).end(); ++y) {
+    for (index_t x = out.dim(0).begin(); x < out.dim(0).end(); ++x) {
+      out(x, y) = in((x + 0) >> 1, (y + 0) >> 1) + in((x + 1) >> 1, (y + 0) >> 1) + in((x + 0) >> 1, (y + 1) >> 1) +
+                  in((x + 1) >> 1, (y + 1) >> 1) + skip(x, y);
+    }
+  }
+  return 0;
+}
+
+// The stages of softmax. These are not intended to be fast, they are only intended to model the data dependencies.
+inline index_t max_dim0(const buffer<const float>& in, const buffer<float>& max_in) {
+  for (index_t b = max_in.dim(0).begin(); b < max_in.dim(0).end(); ++b) {
+    max_in(b) = -std::numeric_limits<float>::infinity();
+    for (index_t c = in.dim(0).begin(); c < in.dim(0).end(); ++c) {
+      max_in(b) = std::max(max_in(b), in(c, b));
+    }
+  }
+  return 0;
+}
+
+inline index_t sum_exp(const buffer<const float>& in, const buffer<const float>& max_in, const buffer<float>& exp_in,
+    const buffer<float>& sum_exp_in) {
+  assert(exp_in.dim(1).min() == sum_exp_in.dim(0).min());
+  assert(exp_in.dim(1).max() == sum_exp_in.dim(0).max());
+  for (index_t b = exp_in.dim(1).begin(); b < exp_in.dim(1).end(); ++b) {
+    sum_exp_in(b) = 0.0f;
+    for (index_t c = exp_in.dim(0).begin(); c < exp_in.dim(0).end(); ++c) {
+      exp_in(c, b) = std::exp(in(c, b) - max_in(b));
+      sum_exp_in(b) += exp_in(c, b);
+    }
+  }
+  return 0;
+}
+
+inline index_t normalize(
+    const buffer<const float>& in, const buffer<const float>& sum_exp_in, const buffer<float>& out) {
+  for (index_t b = out.dim(1).begin(); b < out.dim(1).end(); ++b) {
+    for (index_t c = out.dim(0).begin(); c < out.dim(0).end(); ++c) {
+      out(c, b) = in(c, b) / sum_exp_in(b);
+    }
+  }
+  return 0;
+}
+
+// A stage of l2_norm.
+inline index_t reciprocal_sqrt(const buffer<const float>& in, const buffer<float>& out) {
+  assert(in.rank == out.rank);
+  for_each_element([&](float* out, const float* in) { *out = 1.0f / std::sqrt(*in); }, out, in);
+  return 0;
+}
+
+// The graphs of the pipelines used by several tests and benchmarks. Each graph makes its buffers and funcs in its own
+// `node_context`, the schedule is left to the user of the graph. The funcs refer to each other and to the graph's
+// buffers, so graphs can't be moved.
+
+// out(c, b) = softmax(in(c, b) + 1) + 1, where the softmax is over c. If `copy_out` is true, the last stage produces
+// `add_out` instead of `out`, and the user of the graph should add a copy from `add_out` to `out`.
+struct softmax_graph {
+  node_context ctx;
+  buffer_expr_ptr in, out, softmax_in, max_in, exp_in, sum_exp_in, softmax_out, add_out;
+  var c, b;
+  func pass0, pass1, pass2, pass3, pass4;
+
+  softmax_graph(bool copy_out = false) {
+    in = buffer_expr::make(ctx, "in", 2, sizeof(float));
+    out = buffer_expr::make(ctx, "out", 2, sizeof(float));
+
+    softmax_in = buffer_expr::make(ctx, "softmax_in", 2, sizeof(float));
+    max_in = buffer_expr::make(ctx, "max_in", 1, sizeof(float));
+    exp_in = buffer_expr::make(ctx, "exp_in", 2, sizeof(float));
+    sum_exp_in = buffer_expr::make(ctx, "sum_exp_in", 1, sizeof(float));
+    softmax_out = buffer_expr::make(ctx, "softmax_out", 2, sizeof(float));
+    add_out = buffer_expr::make(ctx, "add_out", 2, sizeof(float));
+
+    c = var(ctx, "c");
+    b = var(ctx, "b");
+
+    interval_expr all_c = out->dim(0).bounds;
+
+    // Add a trivial producer so we can have an inner loop here.
+    pass0 = func::make(
+        add_1<float>, {{in, {point(c), point(b)}}}, {{softmax_in, {c, b}}}, call_stmt::attributes{.name = "producer"});
+    pass1 = func::make(
+        max_dim0, {{softmax_in, {all_c, point(b)}}}, {{max_in, {b}}}, call_stmt::attributes{.name = "max_dim0"});
+    pass2 = func::make(sum_exp, {{in, {all_c, point(b)}}, {max_in, {point(b)}}}, {{exp_in, {c, b}}, {sum_exp_in, {b}}},
+        call_stmt::attributes{.name = "exp_in"});
+    pass3 = func::make(normalize, {{exp_in, {all_c, point(b)}}, {sum_exp_in, {point(b)}}}, {{softmax_out, {c, b}}},
+        call_stmt::attributes{.name = "normalize"});
+
+    // Add a trivial consumer so we can have an inner loop here too.
+    pass4 = func::make(add_1<float>, {{softmax_out, {point(c), point(b)}}}, {{copy_out ? add_out : out, {c, b}}},
+        call_stmt::attributes{.name = "consumer"});
+  }
+};
+
+// A 2x downsample of `in`, upsampled again and added to `in`.
+struct pyramid_graph {
+  node_context ctx;
+  buffer_expr_ptr in, out, intm;
+  var x, y;
+  func downsample, upsample;
+
+  pyramid_graph() {
+    in = buffer_expr::make(ctx, "in", 2, sizeof(int));
+    out = buffer_expr::make(ctx, "out", 2, sizeof(int));
+
+    intm = buffer_expr::make(ctx, "intm", 2, sizeof(int));
+
+    x = var(ctx, "x");
+    y = var(ctx, "y");
+
+    downsample = func::make(downsample2x, {{in, {2 * x + bounds(0, 1), 2 * y + bounds(0, 1)}}}, {{intm, {x, y}}});
+    upsample = func::make(pyramid_upsample2x,
+        {{in, {point(x), point(y)}}, {intm, {bounds(x, x + 1) / 2, bounds(y, y + 1) / 2}}}, {{out, {x, y}}});
+  }
+};
+
+// out = sum3x3(sum3x3(in + 1)).
+struct stencil_chain_graph {
+  node_context ctx;
+  buffer_expr_ptr in, out, intm, intm2;
+  var x, y;
+  func add, stencil1, stencil2;
+
+  stencil_chain_graph() {
+    in = buffer_expr::make(ctx, "in", 2, sizeof(short));
+    out = buffer_expr::make(ctx, "out", 2, sizeof(short));
+
+    intm = buffer_expr::make(ctx, "add_result", 2, sizeof(short));
+    intm2 = buffer_expr::make(ctx, "stencil1_result", 2, sizeof(short));
+
+    x = var(ctx, "x");
+    y = var(ctx, "y");
+
+    add = func::make(
+        add_1<short>, {{in, {point(x), point(y)}}}, {{intm, {x, y}}}, call_stmt::attributes{.name = "add_1"});
+    stencil1 = func::make(sum3x3<short>, {{intm, {bounds(-1, 1) + x, bounds(-1, 1) + y}}}, {{intm2, {x, y}}},
+        call_stmt::attributes{.name = "sum3x3"});
+    stencil2 = func::make(sum3x3<short>, {{intm2, {bounds(-1, 1) + x, bounds(-1, 1) + y}}}, {{out, {x, y}}},
+        call_stmt::attributes{.name = "sum3x3"});
+  }
+};
+
+// out = sum3x3(in + 1), where in + 1 is padded with 6 outside the bounds of `in`.
+struct padded_stencil_graph {
+  node_context ctx;
+  buffer_expr_ptr in, out, intm, padded_intm;
+  var x, y;
+  func add, padded, stencil;
+
+  padded_stencil_graph() {
+    in = buffer_expr::make(ctx, "in", 2, sizeof(short));
+    out = buffer_expr::make(ctx, "out", 2, sizeof(short));
+
+    intm = buffer_expr::make(ctx, "intm", 2, sizeof(short));
+    padded_intm = buffer_expr::make(ctx, "padded_intm", 2, sizeof(short));
+
+    x = var(ctx, "x");
+    y = var(ctx, "y");
+
+    add = func::make(add_1<short>, {{in, {point(x), point(y)}}}, {{intm, {x, y}}});
+    padded = func::make_copy({intm, {point(x), point(y)}, in->bounds()}, {padded_intm, {x, y}},
+        {buffer_expr::make_scalar<short>(ctx, "padding", 6)});
+    stencil = func::make(sum3x3<short>, {{padded_intm, {bounds(-1, 1) + x, bounds(-1, 1) + y}}}, {{out, {x, y}}});
+  }
+};
+
+// Two matrix multiplies: abc = (a x b) x c. The matrices are stored with dimension 1 innermost.
+struct matmuls_graph {
+  node_context ctx;
+  buffer_expr_ptr a, b, c, abc, ab;
+  var i, j;
+  func matmul_ab, matmul_abc;
+
+  matmuls_graph() {
+    a = buffer_expr::make(ctx, "a", 2, sizeof(int));
+    b = buffer_expr::make(ctx, "b", 2, sizeof(int));
+    c = buffer_expr::make(ctx, "c", 2, sizeof(int));
+    abc = buffer_expr::make(ctx, "abc", 2, sizeof(int));
+
+    ab = buffer_expr::make(ctx, "ab", 2, sizeof(int));
+
+    i = var(ctx, "i");
+    j = var(ctx, "j");
+
+    // The bounds required of the dimensions consumed by the reduction depend on the size of the
+    // buffers passed in. Note that we haven't used any constants yet.
+    auto K_ab = a->dim(1).bounds;
+    auto K_abc = c->dim(0).bounds;
+
+    // We use int for this pipeline so we can test for correctness exactly.
+    matmul_ab = func::make(matmul<int>, {{a, {point(i), K_ab}}, {b, {K_ab, point(j)}}}, {{ab, {i, j}}});
+    matmul_abc = func::make(matmul<int>, {{ab, {point(i), K_abc}}, {c, {K_abc, point(j)}}}, {{abc, {i, j}}});
+
+    a->dim(1).stride = a->elem_size();
+    b->dim(1).stride = b->elem_size();
+    c->dim(1).stride = c->elem_size();
+    abc->dim(1).stride = abc->elem_size();
+
+    // TODO: There should be a more user friendly way to control the strides.
+    ab->dim(1).stride = ab->elem_size();
+  }
+};
+
+// out(c, b) = in(c, b) / sqrt(sum(in(c, b)^2)), where the sum is over c.
+struct l2_norm_graph {
+  node_context ctx;
+  buffer_expr_ptr in, out, in_sq, sum_in_sq, inv_sqrt_sum, inv_sqrt_broadcast;
+  var c, b;
+  func pass1, pass2, pass3, broadcast, pass4;
+
+  l2_norm_graph() {
+    in = buffer_expr::make(ctx, "in", 2, sizeof(float));
+    out = buffer_expr::make(ctx, "out", 2, sizeof(float));
+
+    in_sq = buffer_expr::make(ctx, "in_sq", 2, sizeof(float));
+    sum_in_sq = buffer_expr::make(ctx, "sum_in_sq", 1, sizeof(float));
+    inv_sqrt_sum = buffer_expr::make(ctx, "inv_sqrt_sum", 1, sizeof(float));
+    inv_sqrt_broadcast = buffer_expr::make(ctx, "inv_sqrt_broadcast", 2, sizeof(float));
+
+    c = var(ctx, "c");
+    b = var(ctx, "b");
+
+    interval_expr all_c = out->dim(0).bounds;
+
+    // Add a trivial producer so we can have an inner loop here.
+    pass1 = func::make(
+        square<float>, {{in, {point(c), point(b)}}}, {{in_sq, {c, b}}}, call_stmt::attributes{.name = "square"});
+    pass2 = func::make(
+        [](const buffer<const float>& in, const buffer<float>& out) -> index_t {
+          sum(in, out, {{0, in.dim(0).min(), in.dim(0).max()}});
+          return 0;
+        },
+        {{in_sq, {all_c, point(b)}}}, {{sum_in_sq, {b}}}, call_stmt::attributes{.name = "sum_in_sq"});
+    pass3 = func::make(reciprocal_sqrt, {{sum_in_sq, {point(b)}}}, {{inv_sqrt_sum, {b}}},
+        call_stmt::attributes{.name = "reciprocal_sqrt"});
+    broadcast = func::make_copy({inv_sqrt_sum, {point(b)}}, {inv_sqrt_broadcast, {c, b}});
+    pass4 = func::make(multiply<float>, {{in, {point(c), point(b)}}, {inv_sqrt_broadcast, {point(c), point(b)}}},
+        {{out, {c, b}}}, call_stmt::attributes{.name = "multiply"});
+  }
+
+  // Compute everything in tiles of `split` rows of the output.
+  void schedule(int split, int max_workers = loop::serial) {
+    pass4.loops({{b, split, max_workers}});
+    pass3.compute_at({&pass4, b});
+    pass2.compute_at({&pass4, b});
+    pass1.compute_at({&pass4, b});
+    in_sq->store_at({&pass4, b});
+    sum_in_sq->store_at({&pass4, b});
+    inv_sqrt_sum->store_at({&pass4, b});
+    inv_sqrt_broadcast->store_at({&pass4, b});
+  }
+};
+
+// out = sum3x3(in1 + 1) - sum5x5(in2 * 2).
+struct parallel_stencils_graph {
+  node_context ctx;
+  buffer_expr_ptr in1, in2, intm1, intm2, intm3, intm4, out;
+  var x, y;
+  func add1, mul2, stencil1, stencil2, diff;
+
+  parallel_stencils_graph() {
+    in1 = buffer_expr::make(ctx, "in1", 2, sizeof(short));
+    in2 = buffer_expr::make(ctx, "in2", 2, sizeof(short));
+    intm1 = buffer_expr::make(ctx, "intm1", 2, sizeof(short));
+    intm2 = buffer_expr::make(ctx, "intm2", 2, sizeof(short));
+    intm3 = buffer_expr::make(ctx, "intm3", 2, sizeof(short));
+    intm4 = buffer_expr::make(ctx, "intm4", 2, sizeof(short));
+    out = buffer_expr::make(ctx, "out", 2, sizeof(short));
+
+    x = var(ctx, "x");
+    y = var(ctx, "y");
+
+    add1 = func::make(
+        add_1<short>, {{in1, {point(x), point(y)}}}, {{intm1, {x, y}}}, call_stmt::attributes{.name = "add1"});
+    mul2 = func::make(
+        multiply_2<short>, {{in2, {point(x), point(y)}}}, {{intm2, {x, y}}}, call_stmt::attributes{.name = "mul2"});
+    stencil1 = func::make(sum3x3<short>, {{intm1, {bounds(-1, 1) + x, bounds(-1, 1) + y}}}, {{intm3, {x, y}}},
+        call_stmt::attributes{.name = "sum3x3"});
+    stencil2 = func::make(sum5x5<short>, {{intm2, {bounds(-2, 2) + x, bounds(-2, 2) + y}}}, {{intm4, {x, y}}},
+        call_stmt::attributes{.name = "sum5x5"});
+    diff = func::make(subtract<short>, {{intm3, {point(x), point(y)}}, {intm4, {point(x), point(y)}}}, {{out, {x, y}}},
+        call_stmt::attributes{.name = "subtract"});
+  }
+};
+
 }  // namespace slinky
 
 #endif  // SLINKY_BUILDER_TEST_FUNCS_H
\ No newline at end of file
@@ -0,0 +1,25 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "slinky/builder/generate_source.h"
+#include "slinky/builder/test/generated_pipelines.h"
+
+// Writes the source code generated for the pipelines in generated_pipelines.h to the file given by the first argument.
+int main(int argc, const char** argv) {
+  if (argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " <output file>" << std::endl;
+    return 1;
+  }
+  std::ofstream file(argv[1]);
+  for (int i = 0; i < slinky::generated_pipeline_count; ++i) {
+    std::string name = std::string("generated_") + slinky::generated_pipeline_names[i];
+    std::string source = slinky::generate_pipeline_source(slinky::make_generated_pipeline(i).p, name);
+    if (source.empty()) {
+      std::cerr << "Failed to generate " << name << std::endl;
+      return 1;
+    }
+    file << source << std::endl;
+  }
+  return file.good() ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "slinky/builder/generate_source.h"
+#include "slinky/builder/pipeline.h"
+#include "slinky/builder/test/context.h"
+#include "slinky/builder/test/funcs.h"
+#include "slinky/builder/test/generated_pipelines.h"
+#include "slinky/runtime/buffer.h"
+#include "slinky/runtime/evaluate.h"
+#include "slinky/runtime/expr.h"
+#include "slinky/runtime/pipeline.h"
+#include "slinky/runtime/stmt.h"
+
+// These are defined by the source code generated by generate_pipelines.
+#define DECLARE_GENERATED_PIPELINE(name)                                                                               \
+  slinky::index_t generated_##name(const slinky::call_stmt::callable* calls,                                           \
+      slinky::span<const slinky::index_t> args, slinky::span<const slinky::raw_buffer*> inputs,                        \
+      slinky::span<const slinky::raw_buffer*> outputs, slinky::eval_context& ctx);                                     \
+  extern const char* const generated_##name##_calls[];                                                                 \
+  extern const std::size_t generated_##name##_call_count;
+
+DECLARE_GENERATED_PIPELINE(softmax)
+DECLARE_GENERATED_PIPELINE(pyramid)
+DECLARE_GENERATED_PIPELINE(stencil_chain)
+DECLARE_GENERATED_PIPELINE(padded_stencil)
+DECLARE_GENERATED_PIPELINE(matmuls)
+DECLARE_GENERATED_PIPELINE(l2_norm)
+DECLARE_GENERATED_PIPELINE(parallel_stencils)
+
+namespace slinky {
+
+namespace {
+
+struct generated_pipeline {
+  index_t (*fn)(const call_stmt::callable*, span<const index_t>, span<const raw_buffer*>, span<const raw_buffer*>,
+      eval_context&);
+  const char* const* calls;
+  std::size_t call_count;
+};
+
+#define GENERATED_PIPELINE(name) {generated_##name, generated_##name##_calls, generated_##name##_call_count}
+
+const generated_pipeline generated_pipelines[] = {
+    GENERATED_PIPELINE(softmax),
+    GENERATED_PIPELINE(pyramid),
+    GENERATED_PIPELINE(stencil_chain),
+    GENERATED_PIPELINE(padded_stencil),
+    GENERATED_PIPELINE(matmuls),
+    GENERATED_PIPELINE(l2_norm),
+    GENERATED_PIPELINE(parallel_stencils),
+};
+static_assert(sizeof(generated_pipelines) / sizeof(generated_pipelines[0]) == generated_pipeline_count);
+
+std::vector<const raw_buffer*> buffers(const std::vector<raw_buffer_ptr>& bufs) {
+  std::vector<const raw_buffer*> result;
+  for (const raw_buffer_ptr& i : bufs) {
+    result.push_back(i.get());
+  }
+  return result;
+}
+
+}  // namespace
+
+class generate_source : public testing::TestWithParam<std::tuple<int, bool>> {};
+
+INSTANTIATE_TEST_SUITE_P(pipeline_arena, generate_source,
+    testing::Combine(testing::Range(0, generated_pipeline_count), testing::Bool()));
+
+TEST_P(generate_source, equivalence) {
+  const int index = std::get<0>(GetParam());
+  const bool use_arena = std::get<1>(GetParam());
+  const generated_pipeline& generated = generated_pipelines[index];
+
+  generated_pipeline_instance instance = make_generated_pipeline(index);
+  const pipeline& p = instance.p;
+  std::vector<call_stmt::callable> calls = generated_pipeline_calls(p);
+  ASSERT_EQ(calls.size(), generated.call_count);
+
+  std::vector<const raw_buffer*> inputs = buffers(instance.inputs);
+  std::vector<const raw_buffer*> expected_outputs = buffers(instance.outputs);
+  test_context expected_ctx;
+  expected_ctx.config.use_arena = use_arena;
+  ASSERT_EQ(p.evaluate(inputs, expected_outputs, expected_ctx), 0);
+
+  std::vector<raw_buffer_ptr> out_bufs;
+  for (const raw_buffer_ptr& i : instance.outputs) {
+    out_bufs.push_back(raw_buffer::make(i->rank, i->elem_size, i->dims));
+  }
+  std::vector<const raw_buffer*> outputs = buffers(out_bufs);
+  test_context eval_ctx;
+  eval_ctx.config.use_arena = use_arena;
+  ASSERT_EQ(generated.fn(calls.data(), {}, inputs, outputs, eval_ctx), 0);
+
+  for (std::size_t i = 0; i < outputs.size(); ++i) {
+    ASSERT_EQ(outputs[i]->size_bytes(), expected_outputs[i]->size_bytes());
+    ASSERT_EQ(memcmp(outputs[i]->base, expected_outputs[i]->base, outputs[i]->size_bytes()), 0);
+  }
+
+  // The generated code should make the same allocations.
+  std::sort(eval_ctx.heap.allocs.begin(), eval_ctx.heap.allocs.end());
+  std::sort(expected_ctx.heap.allocs.begin(), expected_ctx.heap.allocs.end());
+  ASSERT_EQ(eval_ctx.heap.allocs, expected_ctx.heap.allocs);
+  ASSERT_EQ(eval_ctx.heap.live_count, 0);
+}
+
+TEST(generate_source, calls) {
+  node_context ctx;
+  var in(ctx, "in");
+  var out(ctx, "out");
+  var x(ctx, "x");
+
+  call_stmt::callable f = [](const call_stmt*, eval_context&) -> index_t { return 1; };
+  stmt call_f = call_stmt::make(f, {in}, {out}, {}, {0, 1, "f"});
+  stmt call_g = call_stmt::make(f, {out}, {in}, {}, {0, 1, "g"});
+
+  pipeline p;
+  p.args = {x};
+  p.inputs = {in};
+  p.outputs = {out};
+  p.body = block::make({call_g, loop::make(x, loop::serial, {0, x}, 1, block::make({call_f, call_g}))});
+
+  // Each call_stmt is called via one entry of the table, in the order they appear.
+  ASSERT_EQ(generated_pipeline_calls(p).size(), 2);
+  std::string source = generate_pipeline_source(p, "calls");
+  ASSERT_NE(source.find("calls_calls[] = {\"g\", \"f\", nullptr}"), std::string::npos);
+  ASSERT_NE(source.find("calls_call_count = 2"), std::string::npos);
+}
+
+TEST(generate_source, copies) {
+  padded_stencil_graph g;
+  g.stencil.loops({g.y});
+  pipeline p = build_pipeline(g.ctx, {g.in}, {g.out});
+
+  // The copy is called directly by the generated code, only the funcs are called via the table.
+  std::vector<call_stmt::callable> calls = generated_pipeline_calls(p);
+  ASSERT_FALSE(calls.empty());
+  for (const call_stmt::callable& i : calls) {
+    ASSERT_EQ(i.target<copy_call>(), nullptr);
+  }
+  std::string source = generate_pipeline_source(p, "copies");
+  ASSERT_NE(source.find("g::copy(ctx, "), std::string::npos);
+}
+
+TEST(generate_source, unsupported) {
+  node_context ctx;
+  var in(ctx, "in");
+  var out(ctx, "out");
+  var x(ctx, "x");
+
+  pipeline p;
+  p.inputs = {in};
+  p.outputs = {out};
+
+  p.body = check::make(x < 3);
+  ASSERT_TRUE(generate_pipeline_source(p).empty());
+
+  p.args = {x};
+  ASSERT_FALSE(generate_pipeline_source(p).empty());
+
+  // copy_stmt should have been implemented by build_pipeline.
+  p.body = copy_stmt::make(nullptr, in, {x}, out, {x}, var());
+  ASSERT_TRUE(generate_pipeline_source(p).empty());
+
+  p.body = check::make(call::make([](const call*, eval_context&) -> index_t { return 1; }, {}));
+  ASSERT_TRUE(generate_pipeline_source(p).empty());
+
+  p.body = check::make(x < positive_infinity());
+  ASSERT_TRUE(generate_pipeline_source(p).empty());
+}
+
+}  // namespace slinky
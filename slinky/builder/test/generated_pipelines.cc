@@ -0,0 +1,128 @@
+#include "slinky/builder/test/generated_pipelines.h"
+
+#include <cassert>
+#include <utility>
+
+#include "slinky/builder/pipeline.h"
+#include "slinky/builder/test/funcs.h"
+#include "slinky/runtime/buffer.h"
+#include "slinky/runtime/expr.h"
+
+namespace slinky {
+
+namespace {
+
+// These pipelines are tested with and without `eval_config::use_arena`.
+const build_options options = {.heap_high_water = true};
+
+template <typename T>
+raw_buffer_ptr make_input(index_t width, index_t height, index_t offset = 0) {
+  buffer<T, 2> buf({width + 2 * offset, height + 2 * offset});
+  buf.translate(-offset, -offset);
+  init_random(buf);
+  return raw_buffer::make_copy(buf);
+}
+
+template <typename T>
+raw_buffer_ptr make_output(index_t width, index_t height) {
+  buffer<T, 2> buf({width, height});
+  return raw_buffer::make(buf.rank, buf.elem_size, buf.dims);
+}
+
+generated_pipeline_instance make_softmax() {
+  softmax_graph g;
+  g.pass0.loops({{g.b, 1}});
+  g.pass4.loops({{g.b, 1}});
+  g.pass1.compute_at({&g.pass4, g.b});
+  g.max_in->store_at({&g.pass4, g.b});
+  g.max_in->store_in(memory_type::stack);
+
+  const int D = 30;
+  const int B = 20;
+  return {build_pipeline(g.ctx, {g.in}, {g.out}, options), {make_input<float>(D, B)}, {make_output<float>(D, B)}};
+}
+
+generated_pipeline_instance make_pyramid() {
+  pyramid_graph g;
+  g.upsample.loops({{g.y, 1, loop::parallel}});
+
+  const int W = 10;
+  const int H = 10;
+  return {build_pipeline(g.ctx, {g.in}, {g.out}, options), {make_input<int>(W + 2, H + 2)}, {make_output<int>(W, H)}};
+}
+
+generated_pipeline_instance make_stencil_chain() {
+  stencil_chain_graph g;
+  g.stencil2.loops({{g.y, 2, loop::parallel}});
+
+  const int W = 20;
+  const int H = 30;
+  return {build_pipeline(g.ctx, {g.in}, {g.out}, build_options{.trace = true, .heap_high_water = true}),
+      {make_input<short>(W, H, 2)}, {make_output<short>(W, H)}};
+}
+
+generated_pipeline_instance make_padded_stencil() {
+  padded_stencil_graph g;
+  g.stencil.loops({g.y});
+
+  const int W = 20;
+  const int H = 30;
+  return {build_pipeline(g.ctx, {g.in}, {g.out}, options), {make_input<short>(W, H)}, {make_output<short>(W, H)}};
+}
+
+generated_pipeline_instance make_matmuls() {
+  matmuls_graph g;
+  g.matmul_abc.loops({{g.i, 2, loop::parallel}});
+  g.ab->store_at({&g.matmul_abc, g.i});
+
+  // The matrices are stored with dimension 1 innermost.
+  const int M = 10;
+  const int N = 10;
+  auto transposed = [](raw_buffer_ptr buf) {
+    std::swap(buf->mutable_dim(0), buf->mutable_dim(1));
+    return buf;
+  };
+  return {build_pipeline(g.ctx, {g.a, g.b, g.c}, {g.abc}, options),
+      {transposed(make_input<int>(N, M)), transposed(make_input<int>(N, M)), transposed(make_input<int>(N, M))},
+      {transposed(make_output<int>(N, M))}};
+}
+
+generated_pipeline_instance make_l2_norm() {
+  l2_norm_graph g;
+  g.schedule(4, loop::parallel);
+
+  const int D = 30;
+  const int B = 20;
+  return {build_pipeline(g.ctx, {g.in}, {g.out}, options), {make_input<float>(D, B)}, {make_output<float>(D, B)}};
+}
+
+generated_pipeline_instance make_parallel_stencils() {
+  parallel_stencils_graph g;
+  g.diff.loops({{g.y, 2}});
+  g.stencil1.loops({{g.y, 1}});
+  g.stencil2.loops({{g.y, 2}});
+  g.add1.compute_root();
+  g.mul2.compute_at({&g.diff, g.y});
+
+  const int W = 20;
+  const int H = 30;
+  return {build_pipeline(g.ctx, {g.in1, g.in2}, {g.out}, options),
+      {make_input<short>(W, H, 1), make_input<short>(W, H, 2)}, {make_output<short>(W, H)}};
+}
+
+}  // namespace
+
+generated_pipeline_instance make_generated_pipeline(int index) {
+  switch (index) {
+  case 0: return make_softmax();
+  case 1: return make_pyramid();
+  case 2: return make_stencil_chain();
+  case 3: return make_padded_stencil();
+  case 4: return make_matmuls();
+  case 5: return make_l2_norm();
+  case 6: return make_parallel_stencils();
+  default: assert(false); return {};
+  }
+}
+
+}  // namespace slinky
@@ -0,0 +1,37 @@
+#ifndef SLINKY_BUILDER_TEST_GENERATED_PIPELINES_H
+#define SLINKY_BUILDER_TEST_GENERATED_PIPELINES_H
+
+#include <vector>
+
+#include "slinky/runtime/buffer.h"
+#include "slinky/runtime/pipeline.h"
+
+namespace slinky {
+
+// Pipelines for testing `generate_pipeline_source`. These are the graphs of funcs.h, with schedules like those used by
+// the tests of those graphs. Source code for these is generated by `generate_pipelines` when the test is built, and
+// the test compares the generated code to evaluating the same pipelines.
+constexpr const char* generated_pipeline_names[] = {
+    "softmax",
+    "pyramid",
+    "stencil_chain",
+    "padded_stencil",
+    "matmuls",
+    "l2_norm",
+    "parallel_stencils",
+};
+constexpr int generated_pipeline_count = sizeof(generated_pipeline_names) / sizeof(generated_pipeline_names[0]);
+
+struct generated_pipeline_instance {
+  pipeline p;
+  // The inputs of the pipeline, initialized with random values.
+  std::vector<raw_buffer_ptr> inputs;
+  // Allocated buffers for the outputs of the pipeline.
+  std::vector<raw_buffer_ptr> outputs;
+};
+
+generated_pipeline_instance make_generated_pipeline(int index);
+
+}  // namespace slinky
+
+#endif  // SLINKY_BUILDER_TEST_GENERATED_PIPELINES_H
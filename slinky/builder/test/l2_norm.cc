@@ -10,13 +10,6 @@
 
 namespace slinky {
 
-// This implementation of l2_norm is not intended to be fast, it is only intended to model the data dependencies.
-index_t reciprocal_sqrt(const buffer<const float>& in, const buffer<float>& out) {
-  assert(in.rank == out.rank);
-  for_each_element([&](float* out, const float* in) { *out = 1.0f / std::sqrt(*in); }, out, in);
-  return 0;
-}
-
 index_t fused_l2_norm(const buffer<const float>& in, const buffer<float>& out) {
   for (index_t b = out.dim(1).begin(); b < out.dim(1).end(); ++b) {
     float sum_sq = 0.0f;
@@ -64,48 +57,14 @@ TEST_P(l2_norm, pipeline) {
   const int split = GetParam();
 
   // Make the pipeline
-  node_context ctx;
-
   constexpr int rank = 2;
-
-  auto in = buffer_expr::make(ctx, "in", rank, sizeof(float));
-  auto out = buffer_expr::make(ctx, "out", rank, sizeof(float));
-
-  auto in_sq = buffer_expr::make(ctx, "in_sq", rank, sizeof(float));
-  auto sum_in_sq = buffer_expr::make(ctx, "sum_in_sq", rank - 1, sizeof(float));
-  auto inv_sqrt_sum = buffer_expr::make(ctx, "inv_sqrt_sum", rank - 1, sizeof(float));
-  auto inv_sqrt_broadcast = buffer_expr::make(ctx, "inv_sqrt_broadcast", rank, sizeof(float));
-
-  var c(ctx, "c");
-  var b(ctx, "b");
-
-  interval_expr all_c = out->dim(0).bounds;
-
-  // Add a trivial producer so we can have an inner loop here.
-  func pass1 = func::make(
-      square<float>, {{in, {point(c), point(b)}}}, {{in_sq, {c, b}}}, call_stmt::attributes{.name = "square"});
-  func pass2 = func::make(
-      [](const buffer<const float>& in, const buffer<float>& out) -> index_t {
-        sum(in, out, {{0, in.dim(0).min(), in.dim(0).max()}});
-        return 0;
-      },
-      {{in_sq, {all_c, point(b)}}}, {{sum_in_sq, {b}}}, call_stmt::attributes{.name = "sum_in_sq"});
-  func pass3 = func::make(reciprocal_sqrt, {{sum_in_sq, {point(b)}}}, {{inv_sqrt_sum, {b}}},
-      call_stmt::attributes{.name = "reciprocal_sqrt"});
-  func broadcast = func::make_copy({inv_sqrt_sum, {point(b)}}, {inv_sqrt_broadcast, {c, b}});
-  func pass4 =
-      func::make(multiply<float>, {{in, {point(c), point(b)}}, {inv_sqrt_broadcast, {point(c), point(b)}}},
-          {{out, {c, b}}}, call_stmt::attributes{.name = "multiply"});
+  l2_norm_graph g;
+  node_context& ctx = g.ctx;
+  auto& in = g.in;
+  auto& out = g.out;
 
   if (split > 0) {
-    pass4.loops({{b, split}});
-    pass3.compute_at({&pass4, b});
-    pass2.compute_at({&pass4, b});
-    pass1.compute_at({&pass4, b});
-    in_sq->store_at({&pass4, b});
-    sum_in_sq->store_at({&pass4, b});
-    inv_sqrt_sum->store_at({&pass4, b});
-    inv_sqrt_broadcast->store_at({&pass4, b});
+    g.schedule(split);
   }
 
   pipeline p = build_pipeline(ctx, {in}, {out});
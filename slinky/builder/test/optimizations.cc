@@ -409,4 +409,33 @@ TEST(optimizations, parallelize_tasks) {
       })));
 }
 
+TEST(optimizations, plan_memory) {
+  auto make_body = [](stmt body) {
+    body = allocate::make(v, memory_type::heap, 4, {{{0, 9}, expr(), expr()}}, body);
+    return allocate::make(u, memory_type::heap, 4, {{{0, 9}, expr(), expr()}}, body);
+  };
+
+  // u and v are never live at the same time, so they can share memory.
+  expr peak;
+  plan_memory(make_body(block::make({dummy_call({}, {u}), dummy_call({u}, {w}), dummy_call({}, {v}),
+                  dummy_call({v}, {w})})),
+      symbols, 64, &peak);
+  ASSERT_THAT(peak, matches(64));
+
+  // A pointer to u escapes through a let, and is used after v is produced.
+  plan_memory(make_body(let_stmt::make({{z, buffer_at(u)}},
+                  block::make({dummy_call({}, {u}), dummy_call({}, {v}), dummy_call({v}, {w}),
+                      call_stmt::make(nullptr, {}, {w}, {z}, {})}))),
+      symbols, 64, &peak);
+  ASSERT_THAT(peak, matches(128));
+
+  // The slabs of a loop body are allocated while the slabs outside the loop are live.
+  plan_memory(make_body(block::make({dummy_call({}, {u}), dummy_call({u}, {v}),
+                  loop::make(x, loop::serial, {0, 3}, 1,
+                      make_body(block::make({dummy_call({}, {u}), dummy_call({u}, {v})}))),
+                  dummy_call({v}, {w})})),
+      symbols, 64, &peak);
+  ASSERT_THAT(peak, matches(256));
+}
+
 }  // namespace slinky
@@ -1,17 +1,23 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <array>
+#include <atomic>
 #include <numeric>
+#include <sstream>
 
+#include "slinky/base/arena.h"
 #include "slinky/builder/pipeline.h"
 #include "slinky/builder/replica_pipeline.h"
 #include "slinky/builder/substitute.h"
 #include "slinky/builder/test/context.h"
 #include "slinky/builder/test/funcs.h"
 #include "slinky/builder/test/util.h"
+#include "slinky/runtime/depends_on.h"
 #include "slinky/runtime/expr.h"
 #include "slinky/runtime/pipeline.h"
 #include "slinky/runtime/print.h"
+#include "slinky/runtime/serialize.h"
 
 namespace slinky {
 
@@ -27,28 +33,6 @@ public:
 
 stmt nullify_calls(const stmt& s) { return call_nullifier().mutate(s); }
 
-// Matrix multiplication (not fast!)
-template <typename T>
-index_t matmul(const buffer<const T>& a, const buffer<const T>& b, const buffer<T>& c) {
-  assert(a.rank == 2);
-  assert(b.rank == 2);
-  assert(c.rank == 2);
-  assert(a.dim(1).begin() == b.dim(0).begin());
-  assert(a.dim(1).end() == b.dim(0).end());
-  assert(a.dim(1).stride() == sizeof(T));
-  assert(b.dim(1).stride() == sizeof(T));
-  assert(c.dim(1).stride() == sizeof(T));
-  for (index_t i = c.dim(0).begin(); i < c.dim(0).end(); ++i) {
-    for (index_t j = c.dim(1).begin(); j < c.dim(1).end(); ++j) {
-      c(i, j) = 0;
-      for (index_t k = a.dim(1).begin(); k < a.dim(1).end(); ++k) {
-        c(i, j) += a(i, k) * b(k, j);
-      }
-    }
-  }
-  return 0;
-}
-
 const auto loop_modes = testing::Values(loop::serial, loop::parallel);
 
 class trivial : public testing::TestWithParam<std::tuple<int, int>> {};
@@ -253,6 +237,270 @@ TEST_P(elementwise, pipeline_2d) {
   }
 }
 
+class compact_symbols : public testing::TestWithParam<int> {};
+
+INSTANTIATE_TEST_SUITE_P(mode, compact_symbols, loop_modes);
+
+TEST_P(compact_symbols, pipeline) {
+  int max_workers = GetParam();
+
+  // Make the pipeline
+  node_context ctx;
+
+  // Make a lot of unrelated symbols, like we'd have if we built many pipelines in this context.
+  for (int i = 0; i < 1000; ++i) {
+    ctx.insert_unique();
+  }
+
+  auto in = buffer_expr::make(ctx, "in", 2, sizeof(int));
+  auto out = buffer_expr::make(ctx, "out", 2, sizeof(int));
+  auto intm = buffer_expr::make(ctx, "intm", 2, sizeof(int));
+
+  var x(ctx, "x");
+  var y(ctx, "y");
+  var unused(ctx, "unused");
+
+  func mul = func::make(multiply_2<int>, {{in, {point(x), point(y)}}}, {{intm, {x, y}}});
+  func add = func::make(add_1<int>, {{intm, {point(x), point(y)}}}, {{out, {x, y}}});
+
+  add.loops({{x, 4, max_workers}, {y, 2, max_workers}});
+  intm->store_at({&add, x});
+
+  build_options options;
+  options.compact_symbols = true;
+  pipeline p = build_pipeline(ctx, {unused}, {in}, {out}, {}, options);
+
+  // The unused arg is the only symbol not in the body, it should get the last id.
+  ASSERT_LT(p.context_size, 100);
+  ASSERT_EQ(p.context_size, find_context_size(p.body) + 1);
+  ASSERT_EQ(p.args[0].id, p.context_size - 1);
+  ASSERT_LT(p.inputs[0].id, p.context_size);
+  ASSERT_LT(p.outputs[0].id, p.context_size);
+
+  // Run the pipeline
+  const int W = 15;
+  const int H = 10;
+
+  buffer<int, 2> in_buf({W, H});
+  in_buf.allocate();
+  for (int y = 0; y < H; ++y) {
+    for (int x = 0; x < W; ++x) {
+      in_buf(x, y) = y * W + x;
+    }
+  }
+
+  buffer<int, 2> out_buf({W, H});
+  out_buf.allocate();
+
+  const index_t args[] = {0};
+  const raw_buffer* inputs[] = {&in_buf};
+  const raw_buffer* outputs[] = {&out_buf};
+  test_context eval_ctx;
+  p.evaluate(args, inputs, outputs, eval_ctx);
+
+  for (int y = 0; y < H; ++y) {
+    for (int x = 0; x < W; ++x) {
+      ASSERT_EQ(out_buf(x, y), 2 * (y * W + x) + 1);
+    }
+  }
+}
+
+class heap_arena : public testing::TestWithParam<int> {};
+
+INSTANTIATE_TEST_SUITE_P(mode, heap_arena, loop_modes);
+
+TEST_P(heap_arena, pipeline) {
+  int max_workers = GetParam();
+
+  // Make the pipeline
+  node_context ctx;
+
+  auto in = buffer_expr::make(ctx, "in", 2, sizeof(int));
+  auto out = buffer_expr::make(ctx, "out", 2, sizeof(int));
+  auto intm = buffer_expr::make(ctx, "intm", 2, sizeof(int));
+  auto intm2 = buffer_expr::make(ctx, "intm2", 2, sizeof(int));
+
+  var x(ctx, "x");
+  var y(ctx, "y");
+
+  func mul = func::make(multiply_2<int>, {{in, {point(x), point(y)}}}, {{intm, {x, y}}});
+  func add = func::make(add_1<int>, {{intm, {point(x), point(y)}}}, {{intm2, {x, y}}});
+  func add2 = func::make(add_1<int>, {{intm2, {point(x), point(y)}}}, {{out, {x, y}}});
+
+  add2.loops({{y, 2, max_workers}});
+  intm->store_in(memory_type::heap);
+  intm2->store_in(memory_type::heap);
+  intm->store_at({&add2, y});
+  intm2->store_at({&add2, y});
+
+  pipeline p = build_pipeline(ctx, {in}, {out}, build_options{.heap_high_water = true});
+  ASSERT_TRUE(p.heap_high_water.defined());
+
+  // Run the pipeline
+  const int W = 20;
+  const int H = 10;
+
+  buffer<int, 2> in_buf({W, H});
+  in_buf.allocate();
+  for (int y = 0; y < H; ++y) {
+    for (int x = 0; x < W; ++x) {
+      in_buf(x, y) = y * W + x;
+    }
+  }
+
+  buffer<int, 2> out_buf({W, H});
+  out_buf.allocate();
+
+  const raw_buffer* inputs[] = {&in_buf};
+  const raw_buffer* outputs[] = {&out_buf};
+  test_context eval_ctx;
+  eval_ctx.config.use_arena = true;
+  p.setup(inputs, outputs, eval_ctx);
+  ASSERT_GT(evaluate(p.heap_high_water, eval_ctx), 0);
+  ASSERT_GT(p.heap_high_water_allocations, 0);
+
+  slinky::arena& arena = thread_arena();
+  for (int i = 0; i < 4; ++i) {
+    // Use an alignment bigger than the arena's alignment in the last iterations.
+    eval_ctx.config.base_alignment = i < 2 ? alignof(std::max_align_t) : 4096;
+    std::size_t system_allocations = arena.system_allocations();
+    p.evaluate(inputs, outputs, eval_ctx);
+    ASSERT_EQ(arena.live(), 0);
+    // The arena should have been reserved to be big enough before evaluating the pipeline.
+    ASSERT_LE(arena.system_allocations(), system_allocations + 1);
+    if (i != 0 && i != 2) {
+      // The arena should have been big enough already.
+      ASSERT_EQ(arena.system_allocations(), system_allocations);
+    }
+
+    for (int y = 0; y < H; ++y) {
+      for (int x = 0; x < W; ++x) {
+        ASSERT_EQ(out_buf(x, y), 2 * (y * W + x) + 2);
+      }
+    }
+  }
+  ASSERT_EQ(eval_ctx.heap.allocs.size(), 0);
+}
+
+class plan_memory : public testing::TestWithParam<int> {};
+
+INSTANTIATE_TEST_SUITE_P(mode, plan_memory, loop_modes);
+
+TEST_P(plan_memory, pipeline) {
+  int max_workers = GetParam();
+
+  // Make the pipeline
+  node_context ctx;
+
+  auto in = buffer_expr::make(ctx, "in", 2, sizeof(int));
+  auto out = buffer_expr::make(ctx, "out", 2, sizeof(int));
+  auto intm1 = buffer_expr::make(ctx, "intm1", 2, sizeof(int));
+  auto intm2 = buffer_expr::make(ctx, "intm2", 2, sizeof(int));
+  auto intm3 = buffer_expr::make(ctx, "intm3", 2, sizeof(int));
+  auto intm4 = buffer_expr::make(ctx, "intm4", 2, sizeof(int));
+
+  var x(ctx, "x");
+  var y(ctx, "y");
+
+  func f1 = func::make(multiply_2<int>, {{in, {point(x), point(y)}}}, {{intm1, {x, y}}});
+  func f2 = func::make(add_1<int>, {{intm1, {point(x), point(y)}}}, {{intm2, {x, y}}});
+  func f3 = func::make(multiply_2<int>, {{intm2, {point(x), point(y)}}}, {{intm3, {x, y}}});
+  func f4 = func::make(add_1<int>, {{intm3, {point(x), point(y)}}}, {{intm4, {x, y}}});
+  func f5 = func::make(multiply_2<int>, {{intm4, {point(x), point(y)}}}, {{out, {x, y}}});
+
+  f5.loops({{y, 1, max_workers}});
+  for (func* f : {&f1, &f2, &f3, &f4}) {
+    f->compute_root();
+  }
+  for (buffer_expr_ptr b : {intm1, intm2, intm3, intm4}) {
+    b->store_in(memory_type::heap);
+  }
+
+  build_options options;
+  options.plan_memory = true;
+  options.plan_memory_alignment = 128;
+  pipeline p = build_pipeline(ctx, {in}, {out}, options);
+
+  // Run the pipeline
+  const int W = 20;
+  const int H = 10;
+
+  buffer<int, 2> in_buf({W, H});
+  in_buf.allocate();
+  for (int y = 0; y < H; ++y) {
+    for (int x = 0; x < W; ++x) {
+      in_buf(x, y) = y * W + x;
+    }
+  }
+
+  buffer<int, 2> out_buf({W, H});
+  out_buf.allocate();
+
+  const raw_buffer* inputs[] = {&in_buf};
+  const raw_buffer* outputs[] = {&out_buf};
+  test_context eval_ctx;
+  p.evaluate(inputs, outputs, eval_ctx);
+
+  for (int y = 0; y < H; ++y) {
+    for (int x = 0; x < W; ++x) {
+      ASSERT_EQ(out_buf(x, y), ((2 * (y * W + x) + 1) * 2 + 1) * 2);
+    }
+  }
+
+  // All of the intermediates should be in one allocation, with at most two of them live at once. Each buffer in the
+  // slab is aligned to 128 bytes.
+  const index_t intm_size = (W * H * sizeof(int) + 127) / 128 * 128;
+  ASSERT_EQ(eval_ctx.heap.allocs.size(), 1);
+  ASSERT_EQ(eval_ctx.heap.allocs[0], 2 * intm_size);
+}
+
+TEST(pipeline, loop_grain) {
+  // Make the pipeline
+  node_context ctx;
+
+  auto in = buffer_expr::make(ctx, "in", 2, sizeof(int));
+  auto out = buffer_expr::make(ctx, "out", 2, sizeof(int));
+
+  var x(ctx, "x");
+  var y(ctx, "y");
+
+  func mul = func::make(multiply_2<int>, {{in, {point(x), point(y)}}}, {{out, {x, y}}});
+  mul.loops({{y, 1, loop::parallel, 4}});
+
+  pipeline p = build_pipeline(ctx, {in}, {out});
+
+  // The grain should be carried to the loop.
+  std::stringstream body;
+  print(body, p.body, &ctx);
+  ASSERT_NE(body.str().find("grain=4"), std::string::npos) << body.str();
+
+  // Run the pipeline
+  const int W = 20;
+  const int H = 10;
+
+  buffer<int, 2> in_buf({W, H});
+  in_buf.allocate();
+  for (int y = 0; y < H; ++y) {
+    for (int x = 0; x < W; ++x) {
+      in_buf(x, y) = y * W + x;
+    }
+  }
+
+  buffer<int, 2> out_buf({W, H});
+  out_buf.allocate();
+
+  const raw_buffer* inputs[] = {&in_buf};
+  const raw_buffer* outputs[] = {&out_buf};
+  test_context eval_ctx;
+  ASSERT_EQ(p.evaluate(inputs, outputs, eval_ctx), 0);
+
+  for (int y = 0; y < H; ++y) {
+    for (int x = 0; x < W; ++x) {
+      ASSERT_EQ(out_buf(x, y), 2 * (y * W + x));
+    }
+  }
+}
+
 class store_at : public testing::TestWithParam<bool> {};
 
 INSTANTIATE_TEST_SUITE_P(alias_in_place, store_at, testing::Bool());
@@ -397,34 +645,15 @@ TEST_P(matmuls, pipeline) {
   int split = std::get<1>(GetParam());
 
   // Make the pipeline
-  node_context ctx;
-
-  auto a = buffer_expr::make(ctx, "a", 2, sizeof(int));
-  auto b = buffer_expr::make(ctx, "b", 2, sizeof(int));
-  auto c = buffer_expr::make(ctx, "c", 2, sizeof(int));
-  auto abc = buffer_expr::make(ctx, "abc", 2, sizeof(int));
-
-  auto ab = buffer_expr::make(ctx, "ab", 2, sizeof(int));
-
-  var i(ctx, "i");
-  var j(ctx, "j");
-
-  // The bounds required of the dimensions consumed by the reduction depend on the size of the
-  // buffers passed in. Note that we haven't used any constants yet.
-  auto K_ab = a->dim(1).bounds;
-  auto K_abc = c->dim(0).bounds;
-
-  // We use int for this pipeline so we can test for correctness exactly.
-  func matmul_ab = func::make(matmul<int>, {{a, {point(i), K_ab}}, {b, {K_ab, point(j)}}}, {{ab, {i, j}}});
-  func matmul_abc = func::make(matmul<int>, {{ab, {point(i), K_abc}}, {c, {K_abc, point(j)}}}, {{abc, {i, j}}});
-
-  a->dim(1).stride = a->elem_size();
-  b->dim(1).stride = b->elem_size();
-  c->dim(1).stride = c->elem_size();
-  abc->dim(1).stride = abc->elem_size();
-
-  // TODO: There should be a more user friendly way to control the strides.
-  ab->dim(1).stride = ab->elem_size();
+  matmuls_graph g;
+  node_context& ctx = g.ctx;
+  auto& a = g.a;
+  auto& b = g.b;
+  auto& c = g.c;
+  auto& abc = g.abc;
+  auto& ab = g.ab;
+  auto& i = g.i;
+  auto& matmul_abc = g.matmul_abc;
 
   if (split > 0) {
     matmul_abc.loops({{i, split, max_workers}});
@@ -645,23 +874,12 @@ TEST_P(stencil_chain, pipeline) {
   int split = std::get<1>(GetParam());
 
   // Make the pipeline
-  node_context ctx;
-
-  auto in = buffer_expr::make(ctx, "in", 2, sizeof(short));
-  auto out = buffer_expr::make(ctx, "out", 2, sizeof(short));
-
-  auto intm = buffer_expr::make(ctx, "add_result", 2, sizeof(short));
-  auto intm2 = buffer_expr::make(ctx, "stencil1_result", 2, sizeof(short));
-
-  var x(ctx, "x");
-  var y(ctx, "y");
-
-  func add =
-      func::make(add_1<short>, {{in, {point(x), point(y)}}}, {{intm, {x, y}}}, call_stmt::attributes{.name = "add_1"});
-  func stencil1 = func::make(sum3x3<short>, {{intm, {bounds(-1, 1) + x, bounds(-1, 1) + y}}}, {{intm2, {x, y}}},
-      call_stmt::attributes{.name = "sum3x3"});
-  func stencil2 = func::make(sum3x3<short>, {{intm2, {bounds(-1, 1) + x, bounds(-1, 1) + y}}}, {{out, {x, y}}},
-      call_stmt::attributes{.name = "sum3x3"});
+  stencil_chain_graph g;
+  node_context& ctx = g.ctx;
+  auto& in = g.in;
+  auto& out = g.out;
+  auto& y = g.y;
+  auto& stencil2 = g.stencil2;
 
   if (split > 0) {
     stencil2.loops({{y, split, max_workers}});
@@ -725,6 +943,144 @@ TEST_P(stencil_chain, pipeline) {
   }
 }
 
+class warmup : public testing::TestWithParam<bool> {};
+
+INSTANTIATE_TEST_SUITE_P(skip_if_empty, warmup, testing::Bool());
+
+TEST_P(warmup, pipeline) {
+  bool skip_if_empty = GetParam();
+
+  // Make the pipeline
+  node_context ctx;
+
+  auto in = buffer_expr::make(ctx, "in", 2, sizeof(short));
+  auto out = buffer_expr::make(ctx, "out", 2, sizeof(short));
+
+  auto intm = buffer_expr::make(ctx, "add_result", 2, sizeof(short));
+  auto intm2 = buffer_expr::make(ctx, "stencil1_result", 2, sizeof(short));
+
+  var x(ctx, "x");
+  var y(ctx, "y");
+
+  // Count the calls of each stage, and how many of those calls had empty outputs.
+  std::array<int, 3> calls = {0, 0, 0};
+  std::array<int, 3> empty_calls = {0, 0, 0};
+  auto counter = [&](int stage, auto fn) {
+    return [&calls, &empty_calls, stage, fn](const buffer<const short>& in, const buffer<short>& out) -> index_t {
+      ++calls[stage];
+      if (out.empty()) ++empty_calls[stage];
+      return fn(in, out);
+    };
+  };
+
+  call_stmt::attributes attrs;
+  attrs.skip_if_empty = skip_if_empty;
+  func add = func::make(counter(0, add_1<short>), {{in, {point(x), point(y)}}}, {{intm, {x, y}}}, attrs);
+  func stencil1 = func::make(
+      counter(1, sum3x3<short>), {{intm, {bounds(-1, 1) + x, bounds(-1, 1) + y}}}, {{intm2, {x, y}}}, attrs);
+  func stencil2 = func::make(
+      counter(2, sum3x3<short>), {{intm2, {bounds(-1, 1) + x, bounds(-1, 1) + y}}}, {{out, {x, y}}}, attrs);
+
+  stencil2.loops({{y, 1}});
+
+  pipeline p = build_pipeline(ctx, {in}, {out});
+
+  // Run the pipeline.
+  const int W = 20;
+  const int H = 30;
+  buffer<short, 2> in_buf({W + 4, H + 4});
+  in_buf.translate(-2, -2);
+  buffer<short, 2> out_buf({W, H});
+
+  init_random(in_buf);
+  out_buf.allocate();
+
+  const raw_buffer* inputs[] = {&in_buf};
+  const raw_buffer* outputs[] = {&out_buf};
+  test_context eval_ctx;
+  p.evaluate(inputs, outputs, eval_ctx);
+
+  // The warmup iterations of the loop should not call the last stage.
+  ASSERT_EQ(calls[2], H);
+  ASSERT_EQ(empty_calls[2], 0);
+  if (skip_if_empty) {
+    // The intermediate stages start sliding on different iterations, so some of the warmup iterations produce empty
+    // buffers, which should be skipped.
+    ASSERT_EQ(calls[0], H + 4);
+    ASSERT_EQ(calls[1], H + 2);
+    ASSERT_EQ(empty_calls[0], 0);
+    ASSERT_EQ(empty_calls[1], 0);
+  }
+}
+
+class split_loop_tails : public testing::TestWithParam<int> {};
+
+INSTANTIATE_TEST_SUITE_P(mode, split_loop_tails, loop_modes);
+
+TEST_P(split_loop_tails, pipeline) {
+  int max_workers = GetParam();
+
+  // Make the pipeline
+  node_context ctx;
+
+  auto in = buffer_expr::make(ctx, "in", 2, sizeof(int));
+  auto out = buffer_expr::make(ctx, "out", 2, sizeof(int));
+  auto intm = buffer_expr::make(ctx, "intm", 2, sizeof(int));
+
+  var x(ctx, "x");
+  var y(ctx, "y");
+
+  const int tile_x = 4;
+  const int tile_y = 2;
+
+  // Count the calls of the last stage, and how many of them were marked as full tiles.
+  std::atomic<int> calls = 0;
+  std::atomic<int> full_tiles = 0;
+  auto add_impl = [&](const call_stmt* op, eval_context& ctx) -> index_t {
+    const buffer<const int>& in_buf = ctx.lookup_buffer(op->inputs[0])->cast<const int>();
+    const buffer<int>& out_buf = ctx.lookup_buffer(op->outputs[0])->cast<int>();
+    ++calls;
+    if (op->attrs.full_tile) {
+      ++full_tiles;
+      if (out_buf.dim(0).extent() != tile_x || out_buf.dim(1).extent() != tile_y) return 1;
+    }
+    return add_1<int>(in_buf, out_buf);
+  };
+
+  func mul = func::make(multiply_2<int>, {{in, {point(x), point(y)}}}, {{intm, {x, y}}});
+  func add(add_impl, {{intm, {point(x), point(y)}}}, {{out, {x, y}}}, {});
+
+  add.loops({{x, tile_x, max_workers}, {y, tile_y, max_workers}});
+
+  build_options options;
+  options.split_loop_tails = true;
+  pipeline p = build_pipeline(ctx, {in}, {out}, options);
+
+  // Run the pipeline
+  const int W = 15;
+  const int H = 9;
+
+  buffer<int, 2> in_buf({W, H});
+  init_random(in_buf);
+
+  buffer<int, 2> out_buf({W, H});
+  out_buf.allocate();
+
+  const raw_buffer* inputs[] = {&in_buf};
+  const raw_buffer* outputs[] = {&out_buf};
+  test_context eval_ctx;
+  ASSERT_EQ(0, p.evaluate(inputs, outputs, eval_ctx));
+
+  for (int y = 0; y < H; ++y) {
+    for (int x = 0; x < W; ++x) {
+      ASSERT_EQ(out_buf(x, y), 2 * in_buf(x, y) + 1);
+    }
+  }
+
+  ASSERT_EQ(calls, ceil_div(W, tile_x) * ceil_div(H, tile_y));
+  ASSERT_EQ(full_tiles, (W / tile_x) * (H / tile_y));
+}
+
 class multiple_outputs : public testing::TestWithParam<std::tuple<int, int, bool>> {};
 
 INSTANTIATE_TEST_SUITE_P(split_mode, multiple_outputs,
@@ -997,21 +1353,13 @@ TEST_P(padded_stencil, pipeline) {
   int schedule = GetParam();
 
   // Make the pipeline
-  node_context ctx;
-
-  auto in = buffer_expr::make(ctx, "in", 2, sizeof(short));
-  auto out = buffer_expr::make(ctx, "out", 2, sizeof(short));
-
-  auto intm = buffer_expr::make(ctx, "intm", 2, sizeof(short));
-  auto padded_intm = buffer_expr::make(ctx, "padded_intm", 2, sizeof(short));
-
-  var x(ctx, "x");
-  var y(ctx, "y");
-
-  func add = func::make(add_1<short>, {{in, {point(x), point(y)}}}, {{intm, {x, y}}});
-  func padded = func::make_copy({intm, {point(x), point(y)}, in->bounds()}, {padded_intm, {x, y}},
-      {buffer_expr::make_scalar<short>(ctx, "padding", 6)});
-  func stencil = func::make(sum3x3<short>, {{padded_intm, {bounds(-1, 1) + x, bounds(-1, 1) + y}}}, {{out, {x, y}}});
+  padded_stencil_graph g;
+  node_context& ctx = g.ctx;
+  auto& in = g.in;
+  auto& out = g.out;
+  auto& y = g.y;
+  auto& padded = g.padded;
+  auto& stencil = g.stencil;
 
   switch (schedule) {
   case 0: break;
@@ -1071,6 +1419,65 @@ TEST_P(padded_stencil, pipeline) {
   }
 }
 
+TEST(padded_stencil, serialize) {
+  node_context ctx;
+
+  auto in = buffer_expr::make(ctx, "in", 2, sizeof(short));
+  auto out = buffer_expr::make(ctx, "out", 2, sizeof(short));
+
+  auto intm = buffer_expr::make(ctx, "intm", 2, sizeof(short));
+  auto padded_intm = buffer_expr::make(ctx, "padded_intm", 2, sizeof(short));
+
+  var x(ctx, "x");
+  var y(ctx, "y");
+
+  // Serialized calls are found by name.
+  func add = func::make(add_1<short>, {{in, {point(x), point(y)}}}, {{intm, {x, y}}}, {.name = "add_1"});
+  func padded = func::make_copy({intm, {point(x), point(y)}, in->bounds()}, {padded_intm, {x, y}},
+      {buffer_expr::make_scalar<short>(ctx, "padding", 6)});
+  func stencil = func::make(
+      sum3x3<short>, {{padded_intm, {bounds(-1, 1) + x, bounds(-1, 1) + y}}}, {{out, {x, y}}}, {.name = "sum3x3"});
+  stencil.loops({y});
+
+  pipeline p = build_pipeline(ctx, {in}, {out});
+  std::vector<char> data = serialize_pipeline(p);
+  ASSERT_FALSE(data.empty());
+
+  test_context eval_ctx;
+  callback_registry callbacks;
+  callbacks.calls["add_1"] = add.impl();
+  callbacks.calls["sum3x3"] = stencil.impl();
+  callbacks.copy = eval_ctx.copy;
+  std::optional<pipeline> loaded = deserialize_pipeline(data, callbacks);
+  ASSERT_TRUE(loaded);
+  ASSERT_EQ(serialize_pipeline(*loaded), data);
+
+  const int W = 20;
+  const int H = 30;
+  buffer<short, 2> in_buf({W, H});
+  buffer<short, 2> out_buf({W, H});
+  buffer<short, 2> loaded_out_buf({W, H});
+  init_random(in_buf);
+  out_buf.allocate();
+  loaded_out_buf.allocate();
+
+  const raw_buffer* inputs[] = {&in_buf};
+  const raw_buffer* outputs[] = {&out_buf};
+  const raw_buffer* loaded_outputs[] = {&loaded_out_buf};
+  ASSERT_EQ(p.evaluate(inputs, outputs, eval_ctx), 0);
+  ASSERT_EQ(eval_ctx.copy_calls, 0);
+  ASSERT_EQ(loaded->evaluate(inputs, loaded_outputs, eval_ctx), 0);
+  // The copy was restored with the copy implementation from the registry, which copies one row of `padded_intm` at a
+  // time.
+  ASSERT_EQ(eval_ctx.copy_calls, H + 2);
+
+  for (int y = 0; y < H; ++y) {
+    for (int x = 0; x < W; ++x) {
+      ASSERT_EQ(out_buf(x, y), loaded_out_buf(x, y));
+    }
+  }
+}
+
 interval_expr dilate(interval_expr x, int dx) { return {x.min - dx, x.max + dx}; }
 
 class padded_stencil_separable : public testing::TestWithParam<std::tuple<bool, int>> {};
@@ -1274,29 +1681,17 @@ TEST_P(parallel_stencils, pipeline) {
   int schedule = GetParam();
 
   // Make the pipeline
-  node_context ctx;
-
-  auto in1 = buffer_expr::make(ctx, "in1", 2, sizeof(short));
-  auto in2 = buffer_expr::make(ctx, "in2", 2, sizeof(short));
-  auto intm1 = buffer_expr::make(ctx, "intm1", 2, sizeof(short));
-  auto intm2 = buffer_expr::make(ctx, "intm2", 2, sizeof(short));
-  auto intm3 = buffer_expr::make(ctx, "intm3", 2, sizeof(short));
-  auto intm4 = buffer_expr::make(ctx, "intm4", 2, sizeof(short));
-  auto out = buffer_expr::make(ctx, "out", 2, sizeof(short));
-
-  var x(ctx, "x");
-  var y(ctx, "y");
-
-  func add1 =
-      func::make(add_1<short>, {{in1, {point(x), point(y)}}}, {{intm1, {x, y}}}, call_stmt::attributes{.name = "add1"});
-  func mul2 = func::make(
-      multiply_2<short>, {{in2, {point(x), point(y)}}}, {{intm2, {x, y}}}, call_stmt::attributes{.name = "mul2"});
-  func stencil1 = func::make(sum3x3<short>, {{intm1, {bounds(-1, 1) + x, bounds(-1, 1) + y}}}, {{intm3, {x, y}}},
-      call_stmt::attributes{.name = "sum3x3"});
-  func stencil2 = func::make(sum5x5<short>, {{intm2, {bounds(-2, 2) + x, bounds(-2, 2) + y}}}, {{intm4, {x, y}}},
-      call_stmt::attributes{.name = "sum5x5"});
-  func diff = func::make(subtract<short>, {{intm3, {point(x), point(y)}}, {intm4, {point(x), point(y)}}},
-      {{out, {x, y}}}, call_stmt::attributes{.name = "subtract"});
+  parallel_stencils_graph g;
+  node_context& ctx = g.ctx;
+  auto& in1 = g.in1;
+  auto& in2 = g.in2;
+  auto& out = g.out;
+  auto& y = g.y;
+  auto& add1 = g.add1;
+  auto& mul2 = g.mul2;
+  auto& stencil1 = g.stencil1;
+  auto& stencil2 = g.stencil2;
+  auto& diff = g.diff;
 
   if (schedule == 0) {
     diff.loops({{y, 1}});
@@ -1665,4 +2060,29 @@ TEST(add_slices, pipeline) {
   ASSERT_EQ(eval_ctx.heap.allocs.size(), 0);
 }
 
+TEST(build_stats, passes) {
+  // Make the pipeline
+  node_context ctx;
+
+  auto in = buffer_expr::make(ctx, "in", 1, sizeof(int));
+  auto out = buffer_expr::make(ctx, "out", 1, sizeof(int));
+  auto intm = buffer_expr::make(ctx, "intm", 1, sizeof(int));
+
+  var x(ctx, "x");
+
+  func add = func::make(add_1<int>, {{in, {point(x)}}}, {{intm, {x}}});
+  func mul = func::make(multiply_2<int>, {{intm, {point(x)}}}, {{out, {x}}});
+  mul.loops({{x, 1}});
+
+  build_stats stats;
+  build_pipeline(ctx, {in}, {out}, build_options{.compact_symbols = true, .heap_high_water = true, .stats = &stats});
+
+  ASSERT_FALSE(stats.passes.empty());
+  ASSERT_EQ(stats.passes.front().name, "make_loops");
+  ASSERT_EQ(stats.passes.back().name, "heap_high_water");
+  for (const build_stats::pass& i : stats.passes) {
+    ASSERT_GT(i.nodes, 0) << i.name;
+  }
+}
+
 }  // namespace slinky
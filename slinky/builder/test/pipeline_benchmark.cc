@@ -0,0 +1,264 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "slinky/base/thread_pool_impl.h"
+#include "slinky/builder/pipeline.h"
+#include "slinky/builder/test/funcs.h"
+#include "slinky/runtime/evaluate.h"
+#include "slinky/runtime/expr.h"
+#include "slinky/runtime/pipeline.h"
+
+namespace slinky {
+
+// These benchmarks build and run the pipelines of the builder tests (the graphs of funcs.h) at realistic sizes. Each
+// benchmark is parameterized by the size of the output, the tile size of the loops of the pipeline, and the number of
+// threads. The benchmarks report the bandwidth of the pipeline (the size of the inputs and outputs per second), the
+// time taken to build the pipeline, and the peak size of the heap allocations made by the pipeline.
+
+using clock = std::chrono::steady_clock;
+
+// An eval_context that runs loops on a thread pool of `threads` threads, and tracks the peak size of the live heap
+// allocations.
+class benchmark_context : public eval_context {
+  std::atomic<index_t> live_size_ = 0;
+  std::atomic<index_t> peak_size_ = 0;
+
+public:
+  thread_pool_impl threads;
+  eval_config config;
+
+  benchmark_context(int threads) : threads(threads - 1) {
+    config.allocate = [this](var, raw_buffer* b) {
+      void* allocation = b->allocate();
+      index_t live_size = live_size_ += b->size_bytes();
+      index_t peak_size = peak_size_;
+      while (live_size > peak_size && !peak_size_.compare_exchange_weak(peak_size, live_size)) {
+      }
+      return allocation;
+    };
+    config.free = [this](var, raw_buffer* b, void* allocation) {
+      ::free(allocation);
+      live_size_ -= b->size_bytes();
+    };
+    config.thread_pool = &this->threads;
+    eval_context::config = &config;
+  }
+
+  index_t peak_size() const { return peak_size_; }
+};
+
+// Builds a pipeline with the given tile size and maximum number of workers for its loops.
+using pipeline_builder = std::function<pipeline(int tile, int max_workers)>;
+
+void run_benchmark(benchmark::State& state, const pipeline_builder& build, span<const raw_buffer*> inputs,
+    span<const raw_buffer*> outputs) {
+  const int tile = state.range(1);
+  const int threads = state.range(2);
+  const int max_workers = threads > 1 ? loop::parallel : loop::serial;
+
+  auto build_begin = clock::now();
+  pipeline p = build(tile, max_workers);
+  auto build_end = clock::now();
+
+  benchmark_context eval_ctx(threads);
+  for (auto _ : state) {
+    if (p.evaluate(inputs, outputs, eval_ctx) != 0) {
+      state.SkipWithError("pipeline failed");
+      return;
+    }
+  }
+
+  std::size_t bytes = 0;
+  for (const raw_buffer* i : inputs) {
+    bytes += i->size_bytes();
+  }
+  for (const raw_buffer* i : outputs) {
+    bytes += i->size_bytes();
+  }
+  state.SetBytesProcessed(state.iterations() * bytes);
+  state.counters["build_ms"] = std::chrono::duration<double, std::milli>(build_end - build_begin).count();
+  state.counters["peak_bytes"] = eval_ctx.peak_size();
+}
+
+void BM_softmax(benchmark::State& state) {
+  const int D = state.range(0);
+  const int B = state.range(0);
+
+  auto build = [](int tile, int max_workers) {
+    softmax_graph g;
+    g.pass0.loops({{g.b, tile, max_workers}});
+    g.pass4.loops({{g.b, tile, max_workers}});
+    g.pass1.compute_at({&g.pass4, g.b});
+    return build_pipeline(g.ctx, {g.in}, {g.out});
+  };
+
+  buffer<float, 2> in_buf({D, B});
+  buffer<float, 2> out_buf({D, B});
+  init_random(in_buf);
+  out_buf.allocate();
+
+  const raw_buffer* inputs[] = {&in_buf};
+  const raw_buffer* outputs[] = {&out_buf};
+  run_benchmark(state, build, inputs, outputs);
+}
+
+void BM_pyramid(benchmark::State& state) {
+  const int W = state.range(0);
+  const int H = state.range(0);
+
+  auto build = [](int tile, int max_workers) {
+    pyramid_graph g;
+    g.upsample.loops({{g.y, tile, max_workers}});
+    return build_pipeline(g.ctx, {g.in}, {g.out});
+  };
+
+  buffer<int, 2> in_buf({W + 2, H + 2});
+  buffer<int, 2> out_buf({W, H});
+  init_random(in_buf);
+  out_buf.allocate();
+
+  const raw_buffer* inputs[] = {&in_buf};
+  const raw_buffer* outputs[] = {&out_buf};
+  run_benchmark(state, build, inputs, outputs);
+}
+
+void BM_stencil_chain(benchmark::State& state) {
+  const int W = state.range(0);
+  const int H = state.range(0);
+
+  auto build = [](int tile, int max_workers) {
+    stencil_chain_graph g;
+    g.stencil2.loops({{g.y, tile, max_workers}});
+    return build_pipeline(g.ctx, {g.in}, {g.out});
+  };
+
+  buffer<short, 2> in_buf({W + 4, H + 4});
+  in_buf.translate(-2, -2);
+  buffer<short, 2> out_buf({W, H});
+  init_random(in_buf);
+  out_buf.allocate();
+
+  const raw_buffer* inputs[] = {&in_buf};
+  const raw_buffer* outputs[] = {&out_buf};
+  run_benchmark(state, build, inputs, outputs);
+}
+
+void BM_padded_stencil(benchmark::State& state) {
+  const int W = state.range(0);
+  const int H = state.range(0);
+
+  auto build = [](int tile, int max_workers) {
+    padded_stencil_graph g;
+    g.stencil.loops({{g.y, tile, max_workers}});
+    return build_pipeline(g.ctx, {g.in}, {g.out});
+  };
+
+  buffer<short, 2> in_buf({W, H});
+  buffer<short, 2> out_buf({W, H});
+  init_random(in_buf);
+  out_buf.allocate();
+
+  const raw_buffer* inputs[] = {&in_buf};
+  const raw_buffer* outputs[] = {&out_buf};
+  run_benchmark(state, build, inputs, outputs);
+}
+
+// Two matrix multiplies: D = (A x B) x C.
+void BM_matmuls(benchmark::State& state) {
+  const int N = state.range(0);
+
+  auto build = [](int tile, int max_workers) {
+    matmuls_graph g;
+    g.matmul_abc.loops({{g.i, tile, max_workers}});
+    if (max_workers != loop::serial) {
+      g.ab->store_at({&g.matmul_abc, g.i});
+    }
+    return build_pipeline(g.ctx, {g.a, g.b, g.c}, {g.abc});
+  };
+
+  buffer<int, 2> a_buf({N, N});
+  buffer<int, 2> b_buf({N, N});
+  buffer<int, 2> c_buf({N, N});
+  buffer<int, 2> abc_buf({N, N});
+  std::swap(a_buf.mutable_dim(1), a_buf.mutable_dim(0));
+  std::swap(b_buf.mutable_dim(1), b_buf.mutable_dim(0));
+  std::swap(c_buf.mutable_dim(1), c_buf.mutable_dim(0));
+  std::swap(abc_buf.mutable_dim(1), abc_buf.mutable_dim(0));
+  init_random(a_buf);
+  init_random(b_buf);
+  init_random(c_buf);
+  abc_buf.allocate();
+
+  const raw_buffer* inputs[] = {&a_buf, &b_buf, &c_buf};
+  const raw_buffer* outputs[] = {&abc_buf};
+  run_benchmark(state, build, inputs, outputs);
+}
+
+void BM_l2_norm(benchmark::State& state) {
+  const int D = state.range(0);
+  const int B = state.range(0);
+
+  auto build = [](int tile, int max_workers) {
+    l2_norm_graph g;
+    g.schedule(tile, max_workers);
+    return build_pipeline(g.ctx, {g.in}, {g.out});
+  };
+
+  buffer<float, 2> in_buf({D, B});
+  buffer<float, 2> out_buf({D, B});
+  init_random(in_buf);
+  out_buf.allocate();
+
+  const raw_buffer* inputs[] = {&in_buf};
+  const raw_buffer* outputs[] = {&out_buf};
+  run_benchmark(state, build, inputs, outputs);
+}
+
+void BM_parallel_stencils(benchmark::State& state) {
+  const int W = state.range(0);
+  const int H = state.range(0);
+
+  auto build = [](int tile, int max_workers) {
+    parallel_stencils_graph g;
+    g.diff.loops({{g.y, tile, max_workers}});
+    return build_pipeline(g.ctx, {g.in1, g.in2}, {g.out});
+  };
+
+  buffer<short, 2> in1_buf({W + 2, H + 2});
+  buffer<short, 2> in2_buf({W + 4, H + 4});
+  in1_buf.translate(-1, -1);
+  in2_buf.translate(-2, -2);
+  buffer<short, 2> out_buf({W, H});
+  init_random(in1_buf);
+  init_random(in2_buf);
+  out_buf.allocate();
+
+  const raw_buffer* inputs[] = {&in1_buf, &in2_buf};
+  const raw_buffer* outputs[] = {&out_buf};
+  run_benchmark(state, build, inputs, outputs);
+}
+
+// The arguments are {size, tile, threads}.
+void add_args(benchmark::internal::Benchmark* b, std::vector<int64_t> sizes) {
+  b->ArgsProduct({sizes, {1, 8, 64}, {1, 4}})->ArgNames({"size", "tile", "threads"})->UseRealTime();
+}
+void pipeline_args(benchmark::internal::Benchmark* b) { add_args(b, {256, 1024}); }
+// Our matrix multiply is very slow, use smaller matrices.
+void matmul_args(benchmark::internal::Benchmark* b) { add_args(b, {64, 256}); }
+
+BENCHMARK(BM_softmax)->Apply(pipeline_args);
+BENCHMARK(BM_pyramid)->Apply(pipeline_args);
+BENCHMARK(BM_stencil_chain)->Apply(pipeline_args);
+BENCHMARK(BM_padded_stencil)->Apply(pipeline_args);
+BENCHMARK(BM_matmuls)->Apply(matmul_args);
+BENCHMARK(BM_l2_norm)->Apply(pipeline_args);
+BENCHMARK(BM_parallel_stencils)->Apply(pipeline_args);
+
+}  // namespace slinky
@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+
+#include "slinky/builder/pipeline.h"
+#include "slinky/builder/pipeline_cache.h"
+#include "slinky/builder/test/context.h"
+#include "slinky/builder/test/funcs.h"
+#include "slinky/runtime/expr.h"
+#include "slinky/runtime/pipeline.h"
+
+namespace slinky {
+
+namespace {
+
+const int W = 20;
+const int H = 10;
+
+raw_buffer_ptr make_constant() {
+  slinky::dim dims[2];
+  dims[0].set_bounds(0, W);
+  dims[0].set_stride(1 * sizeof(short));
+  dims[1].set_bounds(0, H);
+  dims[1].set_stride(W * sizeof(short));
+
+  auto result = raw_buffer::make(2, sizeof(short), dims);
+  fill_random(result->cast<short>());
+  return result;
+}
+
+// out(x, y) = in(x, y) + constant(x, y) + k, with a copy from an intermediate buffer to the output.
+struct test_graph {
+  buffer_expr_ptr in, out, intm, constant;
+  func add, copy;
+  short k;
+
+  test_graph(node_context& ctx, short k, int split = 0, memory_type storage = memory_type::heap) : k(k) {
+    in = buffer_expr::make(ctx, "in", 2, sizeof(short));
+    out = buffer_expr::make(ctx, "out", 2, sizeof(short));
+    intm = buffer_expr::make(ctx, "intm", 2, sizeof(short));
+    constant = buffer_expr::make_constant(ctx, "constant", make_constant());
+    intm->store_in(storage);
+
+    var x(ctx, "x");
+    var y(ctx, "y");
+
+    add = func::make(
+        [k](const buffer<const short>& a, const buffer<const short>& b, const buffer<short>& c) -> index_t {
+          for_each_element([k](short* c, const short* a, const short* b) { *c = *a + *b + k; }, c, a, b);
+          return 0;
+        },
+        {{in, {point(x), point(y)}}, {constant, {point(x), point(y)}}}, {{intm, {x, y}}});
+    copy = func::make_copy({intm, {point(x), point(y)}}, {out, {x, y}});
+    if (split > 0) {
+      copy.loops({{y, split}});
+    }
+  }
+
+  void run(const pipeline& p) {
+    buffer<short, 2> in_buf({W, H});
+    buffer<short, 2> out_buf({W, H});
+    init_random(in_buf);
+    out_buf.allocate();
+
+    const raw_buffer* inputs[] = {&in_buf};
+    const raw_buffer* outputs[] = {&out_buf};
+    test_context eval_ctx;
+    ASSERT_EQ(p.evaluate(inputs, outputs, eval_ctx), 0);
+
+    for (int y = 0; y < H; ++y) {
+      for (int x = 0; x < W; ++x) {
+        short c = *reinterpret_cast<const short*>(constant->constant()->address_at(x, y));
+        ASSERT_EQ(out_buf(x, y), in_buf(x, y) + c + k);
+      }
+    }
+  }
+};
+
+}  // namespace
+
+TEST(pipeline_cache, structural_key) {
+  node_context ctx1;
+  test_graph a(ctx1, 1, 2);
+
+  // Use some symbols, so the symbols of the next graph are different.
+  node_context ctx2;
+  var unused(ctx2, "unused");
+  test_graph b(ctx2, 2, 2);
+  test_graph c(ctx2, 1, 3);
+  test_graph d(ctx2, 1, 2, memory_type::stack);
+
+  std::string key_a = structural_key({}, {a.in}, {a.out});
+  ASSERT_FALSE(key_a.empty());
+  ASSERT_EQ(key_a, structural_key({}, {b.in}, {b.out}));
+  ASSERT_EQ(structural_hash({}, {a.in}, {a.out}), structural_hash({}, {b.in}, {b.out}));
+  ASSERT_NE(key_a, structural_key({}, {c.in}, {c.out}));
+  ASSERT_NE(key_a, structural_key({}, {d.in}, {d.out}));
+
+  build_options options;
+  options.no_checks = true;
+  ASSERT_NE(key_a, structural_key({}, {b.in}, {b.out}, {}, options));
+
+  // User defined calls can't be cached.
+  a.in->dim(0).bounds.min = call::make([](const call*, eval_context&) -> index_t { return 0; }, {});
+  ASSERT_TRUE(structural_key({}, {a.in}, {a.out}).empty());
+}
+
+TEST(pipeline_cache, callbacks_map) {
+  node_context ctx;
+  test_graph a(ctx, 1);
+
+  // Replace the callback of `add` with one that counts the calls, without modifying `add`.
+  int calls = 0;
+  call_stmt::callable add_impl = a.add.impl();
+  func_callbacks_map callbacks;
+  callbacks[&a.add].impl = [&](const call_stmt* op, eval_context& ctx) -> index_t {
+    ++calls;
+    return add_impl(op, ctx);
+  };
+  pipeline p = build_pipeline(ctx, {}, {a.in}, {a.out}, {}, build_options(), callbacks);
+  a.run(p);
+  ASSERT_EQ(calls, 1);
+
+  // The func still has its own callback.
+  pipeline original = build_pipeline(ctx, {a.in}, {a.out});
+  a.run(original);
+  ASSERT_EQ(calls, 1);
+}
+
+class pipeline_cache_build : public testing::TestWithParam<bool> {};
+
+INSTANTIATE_TEST_SUITE_P(compact_symbols, pipeline_cache_build, testing::Bool());
+
+TEST_P(pipeline_cache_build, rebind) {
+  build_options options;
+  options.compact_symbols = GetParam();
+
+  pipeline_cache cache;
+
+  node_context ctx1;
+  test_graph a(ctx1, 1, 2);
+  pipeline pa = cache.build(ctx1, {a.in}, {a.out}, options);
+  ASSERT_EQ(cache.misses(), 1);
+  ASSERT_EQ(cache.hits(), 0);
+  a.run(pa);
+
+  // The same graph, in a different context, with different callbacks and constants.
+  node_context ctx2;
+  var unused(ctx2, "unused");
+  test_graph b(ctx2, 5, 2);
+  pipeline pb = cache.build(ctx2, {b.in}, {b.out}, options);
+  ASSERT_EQ(cache.misses(), 1);
+  ASSERT_EQ(cache.hits(), 1);
+  ASSERT_EQ(cache.size(), 1);
+  b.run(pb);
+  // The first pipeline still uses the first graph's callbacks and constants.
+  a.run(pa);
+
+  if (!options.compact_symbols) {
+    ASSERT_EQ(pb.inputs[0], b.in->sym());
+    ASSERT_EQ(pb.outputs[0], b.out->sym());
+  }
+
+  // A different schedule is a different pipeline.
+  test_graph c(ctx2, 3, 3);
+  pipeline pc = cache.build(ctx2, {c.in}, {c.out}, options);
+  ASSERT_EQ(cache.misses(), 2);
+  ASSERT_EQ(cache.size(), 2);
+  c.run(pc);
+
+  cache.clear();
+  ASSERT_EQ(cache.size(), 0);
+}
+
+}  // namespace slinky
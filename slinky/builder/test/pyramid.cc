@@ -15,27 +15,6 @@ namespace slinky {
 
 const auto loop_modes = testing::Values(loop::serial, loop::parallel);
 
-index_t pyramid_upsample2x(const buffer<const int>& skip, const buffer<const int>& in, const buffer<int>& out) {
-  for (index_t y = out.dim(1).begin(); y < out.dim(1).end(); ++y) {
-    for (index_t x = out.dim(0).begin(); x < out.dim(0).end(); ++x) {
-      out(x, y) = in((x + 0) >> 1, (y + 0) >> 1) + in((x + 1) >> 1, (y + 0) >> 1) + in((x + 0) >> 1, (y + 1) >> 1) +
-                  in((x + 1) >> 1, (y + 1) >> 1) + skip(x, y);
-    }
-  }
-  return 0;
-}
-
-index_t downsample2x(const buffer<const int>& in, const buffer<int>& out) {
-  for (index_t y = out.dim(1).begin(); y < out.dim(1).end(); ++y) {
-    for (index_t x = out.dim(0).begin(); x < out.dim(0).end(); ++x) {
-      out(x, y) = (in(2 * x + 0, 2 * y + 0) + in(2 * x + 1, 2 * y + 0) + in(2 * x + 0, 2 * y + 1) +
-                      in(2 * x + 1, 2 * y + 1) + 2) /
-                  4;
-    }
-  }
-  return 0;
-}
-
 class pyramid : public testing::TestWithParam<int> {};
 
 INSTANTIATE_TEST_SUITE_P(mode, pyramid, loop_modes);
@@ -43,19 +22,12 @@ INSTANTIATE_TEST_SUITE_P(mode, pyramid, loop_modes);
 TEST_P(pyramid, pipeline) {
   int max_workers = GetParam();
   // Make the pipeline
-  node_context ctx;
-
-  auto in = buffer_expr::make(ctx, "in", 2, sizeof(int));
-  auto out = buffer_expr::make(ctx, "out", 2, sizeof(int));
-
-  auto intm = buffer_expr::make(ctx, "intm", 2, sizeof(int));
-
-  var x(ctx, "x");
-  var y(ctx, "y");
-
-  func downsample = func::make(downsample2x, {{in, {2 * x + bounds(0, 1), 2 * y + bounds(0, 1)}}}, {{intm, {x, y}}});
-  func upsample = func::make(pyramid_upsample2x,
-      {{in, {point(x), point(y)}}, {intm, {bounds(x, x + 1) / 2, bounds(y, y + 1) / 2}}}, {{out, {x, y}}});
+  pyramid_graph g;
+  node_context& ctx = g.ctx;
+  auto& in = g.in;
+  auto& out = g.out;
+  auto& y = g.y;
+  auto& upsample = g.upsample;
 
   upsample.loops({{y, 1, max_workers}});
 
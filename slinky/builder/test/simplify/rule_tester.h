@@ -186,6 +186,9 @@ public:
     expr replacement = expr(substitute(r, m, overflowed));
     assert(!overflowed);
 
+    // The rewriter skips rules that `may_match` says can't match.
+    EXPECT_TRUE(rewrite::may_match(p, pattern)) << rule_str.str();
+
     // Make sure the expressions have the same value when evaluated.
     test_expr(pattern, replacement, rule_str.str());
 
@@ -208,6 +211,7 @@ public:
         expr pattern = expr(substitute(p, m));
         expr replacement = expr(substitute(r, m, overflowed));
         assert(!overflowed);
+        EXPECT_TRUE(rewrite::may_match(p, pattern)) << rule_str.str();
 
         // Make sure the expressions have the same value when evaluated.
         test_expr(pattern, replacement, rule_str.str());
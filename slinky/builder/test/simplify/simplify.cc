@@ -1392,6 +1392,51 @@ TEST(simplify, modulus_remainder) {
   ASSERT_THAT(simplify((x + 15) / 16, {}, {{x, {8, 0}}}), matches((x + 15) / 16));
 }
 
+TEST(simplify, cache) {
+  simplify_cache cache;
+
+  ASSERT_THAT(simplify(max(x + 1, x)), matches(x + 1));
+  ASSERT_THAT(simplify(max(x + 1, x)), matches(x + 1));
+  ASSERT_EQ(cache.hits(), 1);
+
+  // The facts are part of the key.
+  ASSERT_THAT(simplify((x + 15) / 16, {}, {{x, {16, 0}}}), matches(x / 16));
+  ASSERT_THAT(simplify((x + 15) / 16, {}, {{x, {16, 1}}}), matches(x / 16 + 1));
+  ASSERT_THAT(simplify((x + 15) / 16, {}, {{x, {16, 1}}}), matches(x / 16 + 1));
+  ASSERT_EQ(cache.hits(), 2);
+
+  ASSERT_TRUE(prove_true(x + 1 <= y, {{x, {0, 3}}, {y, {4, 5}}}));
+  ASSERT_FALSE(prove_true(x + 1 <= y, {{x, {0, 4}}, {y, {4, 5}}}));
+  ASSERT_FALSE(prove_false(x + 1 <= y, {{x, {0, 3}}, {y, {4, 5}}}));
+  ASSERT_EQ(attempt_to_prove(x + 1 <= y, {{x, {0, 3}}, {y, {4, 5}}}), true);
+  ASSERT_EQ(cache.hits(), 4);
+
+  ASSERT_THAT(bounds_of(x + y, {{x, {0, 3}}, {y, {4, 5}}}), matches(bounds(4, 8)));
+  ASSERT_THAT(bounds_of(x + y, {{x, {0, 3}}, {y, {4, 5}}}), matches(bounds(4, 8)));
+  ASSERT_EQ(cache.hits(), 5);
+
+  {
+    simplify_cache inner;
+    ASSERT_THAT(simplify(max(x + 1, x)), matches(x + 1));
+    ASSERT_EQ(inner.hits(), 0);
+    ASSERT_EQ(inner.misses(), 1);
+  }
+  ASSERT_THAT(simplify(max(x + 1, x)), matches(x + 1));
+  ASSERT_EQ(cache.hits(), 6);
+
+  // Facts about variables the expr doesn't depend on are not part of the key.
+  ASSERT_THAT(simplify(max(x + 1, x), {{z, {0, 1}}}, {{w, {4, 0}}}), matches(x + 1));
+  ASSERT_EQ(cache.hits(), 7);
+
+  // Facts about variables the bounds of other variables depend on are part of the key.
+  const std::size_t misses = cache.misses();
+  bounds_of(x + 1, {{x, {0, y}}, {y, {0, 9}}});
+  bounds_of(x + 1, {{x, {0, y}}, {y, {0, 10}}});
+  ASSERT_EQ(cache.misses(), misses + 2);
+  bounds_of(x + 1, {{x, {0, y}}, {y, {0, 10}}, {z, {0, 1}}});
+  ASSERT_EQ(cache.hits(), 8);
+}
+
 TEST(simplify, fuzz) {
   gtest_seeded_mt19937 rng;
   expr_generator<gtest_seeded_mt19937> gen(rng, 4);
@@ -0,0 +1,95 @@
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "slinky/builder/node_mutator.h"
+#include "slinky/builder/simplify.h"
+#include "slinky/builder/test/simplify/expr_generator.h"
+#include "slinky/runtime/expr.h"
+
+namespace slinky {
+
+// These benchmarks measure the cost of simplifying one node. The items processed by each benchmark are the nodes that
+// were simplified.
+
+constexpr int var_count = 6;
+constexpr int expr_count = 1000;
+
+class node_counter : public node_mutator {
+public:
+  std::size_t count = 0;
+
+  expr mutate(const expr& e) override {
+    count += e.defined();
+    return node_mutator::mutate(e);
+  }
+  using node_mutator::mutate;
+};
+
+// Simplify one op, given simplified operands. This mostly measures the cost of trying the rules for that op.
+template <typename T>
+void BM_simplify_op(benchmark::State& state) {
+  const int depth = state.range(0);
+  // The operands of logical ops should be conditions.
+  const bool boolean = T::static_type == expr_node_type::logical_and || T::static_type == expr_node_type::logical_or;
+
+  std::mt19937 rng(0);
+  expr_generator<std::mt19937> gen(rng, var_count);
+  std::vector<std::pair<expr, expr>> operands;
+  for (int i = 0; i < expr_count; ++i) {
+    if (boolean) {
+      operands.emplace_back(simplify(gen.random_condition(depth)), simplify(gen.random_condition(depth)));
+    } else {
+      operands.emplace_back(simplify(gen.random_expr(depth)), simplify(gen.random_expr(depth)));
+    }
+  }
+
+  for (auto _ : state) {
+    for (const auto& i : operands) {
+      benchmark::DoNotOptimize(simplify(static_cast<const T*>(nullptr), i.first, i.second));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * operands.size());
+}
+
+BENCHMARK(BM_simplify_op<add>)->DenseRange(0, 2);
+BENCHMARK(BM_simplify_op<sub>)->DenseRange(0, 2);
+BENCHMARK(BM_simplify_op<mul>)->DenseRange(0, 2);
+BENCHMARK(BM_simplify_op<div>)->DenseRange(0, 2);
+BENCHMARK(BM_simplify_op<mod>)->DenseRange(0, 2);
+BENCHMARK(BM_simplify_op<class min>)->DenseRange(0, 2);
+BENCHMARK(BM_simplify_op<class max>)->DenseRange(0, 2);
+BENCHMARK(BM_simplify_op<less>)->DenseRange(0, 2);
+BENCHMARK(BM_simplify_op<less_equal>)->DenseRange(0, 2);
+BENCHMARK(BM_simplify_op<equal>)->DenseRange(0, 2);
+BENCHMARK(BM_simplify_op<not_equal>)->DenseRange(0, 2);
+BENCHMARK(BM_simplify_op<logical_and>)->DenseRange(0, 2);
+BENCHMARK(BM_simplify_op<logical_or>)->DenseRange(0, 2);
+
+// Simplify random exprs of a given depth.
+void BM_simplify_expr(benchmark::State& state) {
+  const int depth = state.range(0);
+
+  std::mt19937 rng(0);
+  expr_generator<std::mt19937> gen(rng, var_count);
+  std::vector<expr> exprs;
+  node_counter counter;
+  for (int i = 0; i < expr_count; ++i) {
+    exprs.push_back(gen.random_expr(depth));
+    counter.mutate(exprs.back());
+  }
+
+  for (auto _ : state) {
+    for (const expr& i : exprs) {
+      benchmark::DoNotOptimize(simplify(i));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * counter.count);
+}
+
+BENCHMARK(BM_simplify_expr)->DenseRange(2, 6, 2);
+
+}  // namespace slinky
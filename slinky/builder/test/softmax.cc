@@ -11,40 +11,6 @@
 
 namespace slinky {
 
-// This implementation of softmax is not intended to be fast, it is only intended to model the data dependencies.
-index_t max_dim0(const buffer<const float>& in, const buffer<float>& max_in) {
-  for (index_t b = max_in.dim(0).begin(); b < max_in.dim(0).end(); ++b) {
-    max_in(b) = -std::numeric_limits<float>::infinity();
-    for (index_t c = in.dim(0).begin(); c < in.dim(0).end(); ++c) {
-      max_in(b) = std::max(max_in(b), in(c, b));
-    }
-  }
-  return 0;
-}
-
-index_t sum_exp(const buffer<const float>& in, const buffer<const float>& max_in, const buffer<float>& exp_in,
-    const buffer<float>& sum_exp_in) {
-  assert(exp_in.dim(1).min() == sum_exp_in.dim(0).min());
-  assert(exp_in.dim(1).max() == sum_exp_in.dim(0).max());
-  for (index_t b = exp_in.dim(1).begin(); b < exp_in.dim(1).end(); ++b) {
-    sum_exp_in(b) = 0.0f;
-    for (index_t c = exp_in.dim(0).begin(); c < exp_in.dim(0).end(); ++c) {
-      exp_in(c, b) = std::exp(in(c, b) - max_in(b));
-      sum_exp_in(b) += exp_in(c, b);
-    }
-  }
-  return 0;
-}
-
-index_t normalize(const buffer<const float>& in, const buffer<const float>& sum_exp_in, const buffer<float>& out) {
-  for (index_t b = out.dim(1).begin(); b < out.dim(1).end(); ++b) {
-    for (index_t c = out.dim(0).begin(); c < out.dim(0).end(); ++c) {
-      out(c, b) = in(c, b) / sum_exp_in(b);
-    }
-  }
-  return 0;
-}
-
 index_t fused_softmax(const buffer<const float>& in, const buffer<float>& out) {
   buffer<float, 1> exp_in({out.dim(0).extent()});
   exp_in.allocate();
@@ -117,38 +83,18 @@ TEST_P(softmax, pipeline) {
   const int copy_at_the_end = std::get<3>(GetParam());
 
   // Make the pipeline
-  node_context ctx;
-
   constexpr int rank = 2;
-
-  auto in = buffer_expr::make(ctx, "in", rank, sizeof(float));
-  auto out = buffer_expr::make(ctx, "out", rank, sizeof(float));
-
-  auto softmax_in = buffer_expr::make(ctx, "softmax_in", rank, sizeof(float));
-  auto max_in = buffer_expr::make(ctx, "max_in", rank - 1, sizeof(float));
-  auto exp_in = buffer_expr::make(ctx, "exp_in", rank, sizeof(float));
-  auto sum_exp_in = buffer_expr::make(ctx, "sum_exp_in", rank - 1, sizeof(float));
-  auto softmax_out = buffer_expr::make(ctx, "softmax_out", rank, sizeof(float));
-  auto add_out = buffer_expr::make(ctx, "add_out", rank, sizeof(float));
-
-  var c(ctx, "c");
-  var b(ctx, "b");
-
-  interval_expr all_c = out->dim(0).bounds;
-
-  // Add a trivial producer so we can have an inner loop here.
-  func pass0 = func::make(
-      add_1<float>, {{in, {point(c), point(b)}}}, {{softmax_in, {c, b}}}, call_stmt::attributes{.name = "producer"});
-  func pass1 = func::make(
-      max_dim0, {{softmax_in, {all_c, point(b)}}}, {{max_in, {b}}}, call_stmt::attributes{.name = "max_dim0"});
-  func pass2 = func::make(sum_exp, {{in, {all_c, point(b)}}, {max_in, {point(b)}}},
-      {{exp_in, {c, b}}, {sum_exp_in, {b}}}, call_stmt::attributes{.name = "exp_in"});
-  func pass3 = func::make(normalize, {{exp_in, {all_c, point(b)}}, {sum_exp_in, {point(b)}}}, {{softmax_out, {c, b}}},
-      call_stmt::attributes{.name = "normalize"});
-
-  // Add a trivial consumer so we can have an inner loop here too.
-  func pass4 = func::make(add_1<float>, {{softmax_out, {point(c), point(b)}}},
-      {{copy_at_the_end ? add_out : out, {c, b}}}, call_stmt::attributes{.name = "consumer"});
+  softmax_graph g(copy_at_the_end > 0);
+  node_context& ctx = g.ctx;
+  auto& in = g.in;
+  auto& out = g.out;
+  auto& max_in = g.max_in;
+  auto& add_out = g.add_out;
+  auto& c = g.c;
+  auto& b = g.b;
+  auto& pass0 = g.pass0;
+  auto& pass1 = g.pass1;
+  auto& pass4 = g.pass4;
 
   func copy;
   if (copy_at_the_end > 0) {
@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <tuple>
+#include <vector>
+
+#include "slinky/builder/specialize.h"
+#include "slinky/builder/test/context.h"
+#include "slinky/builder/test/generated_pipelines.h"
+#include "slinky/runtime/buffer.h"
+#include "slinky/runtime/expr.h"
+#include "slinky/runtime/pipeline.h"
+#include "slinky/runtime/stmt.h"
+
+namespace slinky {
+
+namespace {
+
+class check_counter : public recursive_node_visitor {
+public:
+  int count = 0;
+
+  void visit(const check* op) override {
+    ++count;
+    recursive_node_visitor::visit(op);
+  }
+
+  using recursive_node_visitor::visit;
+};
+
+int count_checks(const stmt& s) {
+  check_counter counter;
+  if (s.defined()) s.accept(&counter);
+  return counter.count;
+}
+
+std::vector<const raw_buffer*> buffers(const std::vector<raw_buffer_ptr>& bufs) {
+  std::vector<const raw_buffer*> result;
+  for (const raw_buffer_ptr& i : bufs) {
+    result.push_back(i.get());
+  }
+  return result;
+}
+
+// Holds zero initialized buffers like `outputs`, and crops of them to evaluate a pipeline with. The crop is (min x,
+// extent x, min y, extent y), relative to the min of the outputs.
+class cropped_outputs {
+  std::vector<raw_buffer_ptr> bufs_;
+  std::vector<buffer<void, 2>> crops_;
+
+public:
+  cropped_outputs(const std::vector<raw_buffer_ptr>& outputs, const std::array<int, 4>& crop) {
+    for (const raw_buffer_ptr& i : outputs) {
+      raw_buffer_ptr buf = raw_buffer::make(i->rank, i->elem_size, i->dims);
+      memset(buf->base, 0, buf->size_bytes());
+      buffer<void, 2>& cropped = crops_.emplace_back(*buf);
+      cropped.crop(0, buf->dim(0).min() + crop[0], buf->dim(0).min() + crop[0] + crop[1] - 1);
+      cropped.crop(1, buf->dim(1).min() + crop[2], buf->dim(1).min() + crop[2] + crop[3] - 1);
+      bufs_.push_back(std::move(buf));
+    }
+  }
+
+  std::vector<const raw_buffer*> crops() const {
+    std::vector<const raw_buffer*> result;
+    for (const buffer<void, 2>& i : crops_) {
+      result.push_back(&i);
+    }
+    return result;
+  }
+
+  const std::vector<raw_buffer_ptr>& buffers() const { return bufs_; }
+};
+
+}  // namespace
+
+class specialization : public testing::TestWithParam<std::tuple<int, bool>> {};
+
+INSTANTIATE_TEST_SUITE_P(pipeline_arena, specialization,
+    testing::Combine(testing::Range(0, generated_pipeline_count), testing::Bool()));
+
+TEST_P(specialization, equivalence) {
+  const int index = std::get<0>(GetParam());
+  const bool use_arena = std::get<1>(GetParam());
+
+  generated_pipeline_instance instance = make_generated_pipeline(index);
+  specializing_pipeline p(instance.p);
+  std::vector<const raw_buffer*> inputs = buffers(instance.inputs);
+
+  // Evaluate some different crops of the outputs (min x, extent x, min y, extent y), each shape twice.
+  const index_t W = instance.outputs[0]->dim(0).extent();
+  const index_t H = instance.outputs[0]->dim(1).extent();
+  const std::vector<std::array<int, 4>> shapes = {
+      {0, W, 0, H},
+      {0, W / 2, 0, H},
+      {4, W - 8, 1, H / 3},
+  };
+  for (int i = 0; i < 2; ++i) {
+    for (std::size_t s = 0; s < shapes.size(); ++s) {
+      cropped_outputs expected(instance.outputs, shapes[s]);
+      test_context expected_ctx;
+      expected_ctx.config.use_arena = use_arena;
+      ASSERT_EQ(p.generic().evaluate(inputs, expected.crops(), expected_ctx), 0);
+
+      cropped_outputs outputs(instance.outputs, shapes[s]);
+      test_context eval_ctx;
+      eval_ctx.config.use_arena = use_arena;
+      ASSERT_EQ(p.evaluate(inputs, outputs.crops(), eval_ctx), 0);
+
+      for (std::size_t o = 0; o < instance.outputs.size(); ++o) {
+        const raw_buffer& out_buf = *outputs.buffers()[o];
+        ASSERT_EQ(memcmp(out_buf.base, expected.buffers()[o]->base, out_buf.size_bytes()), 0);
+      }
+      ASSERT_EQ(eval_ctx.heap.live_count, 0);
+
+      ASSERT_EQ(p.size(), i == 0 ? s + 1 : shapes.size());
+    }
+  }
+  ASSERT_EQ(p.misses(), shapes.size());
+  ASSERT_EQ(p.hits(), shapes.size());
+}
+
+TEST(specialize, checks) {
+  generated_pipeline_instance instance = make_generated_pipeline(0);
+  const pipeline& p = instance.p;
+
+  // The checks of the shapes of the buffers should be removed.
+  pipeline specialized = specialize(p, buffers(instance.inputs), buffers(instance.outputs));
+  ASSERT_GT(count_checks(p.body), 0);
+  ASSERT_LT(count_checks(specialized.body), count_checks(p.body));
+  ASSERT_TRUE(as_constant(specialized.heap_high_water) || !p.heap_high_water.defined());
+}
+
+TEST(specialize, max_specializations) {
+  generated_pipeline_instance instance = make_generated_pipeline(0);
+  specializing_pipeline p(instance.p, 1);
+  std::vector<const raw_buffer*> inputs = buffers(instance.inputs);
+
+  const index_t W = instance.outputs[0]->dim(0).extent();
+  const index_t H = instance.outputs[0]->dim(1).extent();
+  for (index_t extent : {W, W / 2, W}) {
+    cropped_outputs outputs(instance.outputs, {0, static_cast<int>(extent), 0, static_cast<int>(H)});
+    ASSERT_EQ(p.evaluate(inputs, outputs.crops()), 0);
+  }
+  // The second shape uses the generic pipeline.
+  ASSERT_EQ(p.size(), 1);
+  ASSERT_EQ(p.misses(), 2);
+  ASSERT_EQ(p.hits(), 1);
+
+  p.clear();
+  ASSERT_EQ(p.size(), 0);
+}
+
+}  // namespace slinky
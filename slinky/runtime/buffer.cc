@@ -8,6 +8,7 @@
 #include <functional>
 #include <limits>
 
+#include "slinky/base/thread_pool.h"
 #include "slinky/base/util.h"
 
 namespace slinky {
@@ -263,6 +264,114 @@ void unslice_dim0(raw_buffer& buf, const slinky::dim& d) {
   }
 }
 
+// Copy a `w` x `h` matrix from `src` to `dst`, where `dst` is contiguous in x, and `src` is contiguous in y. The
+// strides are in elements.
+template <typename T>
+void transpose(const void* src_void, index_t src_stride_x, void* dst_void, index_t dst_stride_y, index_t w, index_t h) {
+  const T* src = static_cast<const T*>(src_void);
+  T* dst = static_cast<T*>(dst_void);
+  // We transpose tiles of at least 16 bytes per row, and walk the tiles in blocks of 16x16 tiles. Within a tile, one
+  // side of the copy is contiguous. The block is small enough that the cache lines touched by the other side stay in
+  // the cache until they are fully used by the next tiles in the block.
+  constexpr index_t tile = std::max<index_t>(8, 16 / sizeof(T));
+  constexpr index_t block = tile * 16;
+  for (index_t yb = 0; yb < h; yb += block) {
+    const index_t yb_end = std::min(yb + block, h);
+    for (index_t xb = 0; xb < w; xb += block) {
+      const index_t xb_end = std::min(xb + block, w);
+      index_t y = yb;
+      for (; y + tile <= yb_end; y += tile) {
+        index_t x = xb;
+        for (; x + tile <= xb_end; x += tile) {
+          const T* src_tile = src + x * src_stride_x + y;
+          T* dst_tile = dst + y * dst_stride_y + x;
+          // The tile size is a constant, so the compiler can unroll and vectorize this.
+          for (index_t ty = 0; ty < tile; ++ty) {
+            for (index_t tx = 0; tx < tile; ++tx) {
+              dst_tile[ty * dst_stride_y + tx] = src_tile[tx * src_stride_x + ty];
+            }
+          }
+        }
+        for (index_t ty = y; ty < y + tile; ++ty) {
+          for (index_t tx = x; tx < xb_end; ++tx) {
+            dst[ty * dst_stride_y + tx] = src[tx * src_stride_x + ty];
+          }
+        }
+      }
+      for (; y < yb_end; ++y) {
+        for (index_t x = xb; x < xb_end; ++x) {
+          dst[y * dst_stride_y + x] = src[x * src_stride_x + y];
+        }
+      }
+    }
+  }
+}
+
+// Returns a dimension `d` such that the copy from `src` to `dst` is a transpose of dimensions 0 and `d` (`dst` is
+// contiguous in dimension 0, and `src` is contiguous in dimension `d`), and that we can implement with `transpose`.
+// Returns 0 if there is no such dimension.
+int find_transpose_dim(const raw_buffer& src, const raw_buffer& dst) {
+  const index_t elem_size = dst.elem_size;
+  if (elem_size != 1 && elem_size != 2 && elem_size != 4 && elem_size != 8) return 0;
+  if (dst.rank < 2 || src.rank < 2) return 0;
+  if (reinterpret_cast<uintptr_t>(src.base) % elem_size != 0) return 0;
+  if (reinterpret_cast<uintptr_t>(dst.base) % elem_size != 0) return 0;
+
+  auto is_simple = [=](const slinky::dim& d) {
+    return d.fold_factor() == dim::unfolded && d.stride() != 0 && d.stride() % elem_size == 0;
+  };
+  const slinky::dim& dst_dim0 = dst.dim(0);
+  const slinky::dim& src_dim0 = src.dim(0);
+  if (dst_dim0.stride() != elem_size || !is_simple(dst_dim0) || !is_simple(src_dim0)) return 0;
+  // The transpose is only worth it if the slices of the copy are small.
+  if (std::abs(src_dim0.stride()) == elem_size) return 0;
+
+  for (std::size_t d = 1; d < std::min(src.rank, dst.rank); ++d) {
+    if (src.dim(d).stride() == elem_size && is_simple(src.dim(d)) && is_simple(dst.dim(d))) {
+      return d;
+    }
+  }
+  return 0;
+}
+
+// Copy `src` to `dst`, where `d` is the result of `find_transpose_dim`.
+SLINKY_NO_STACK_PROTECTOR void transpose_impl(const raw_buffer& src, const raw_buffer& dst, std::size_t d) {
+  const slinky::dim& dst_x = dst.dim(0);
+  const slinky::dim& dst_y = dst.dim(d);
+  const slinky::dim& src_x = src.dim(0);
+  const slinky::dim& src_y = src.dim(d);
+  assert(src_x.contains(dst_x) && src_y.contains(dst_y));
+  const index_t w = dst_x.extent();
+  const index_t h = dst_y.extent();
+  const index_t elem_size = dst.elem_size;
+  const index_t src_stride_x = src_x.stride() / elem_size;
+  const index_t dst_stride_y = dst_y.stride() / elem_size;
+
+  // Make buffers of the other dimensions, which we copy one matrix at a time.
+  raw_buffer dst_rest = {dst.base, dst.elem_size, 0, SLINKY_ALLOCA(dim, dst.rank)};
+  raw_buffer src_rest = {nullptr, src.elem_size, 0, SLINKY_ALLOCA(dim, src.rank)};
+  for (std::size_t i = 1; i < dst.rank; ++i) {
+    if (i != d) dst_rest.dims[dst_rest.rank++] = dst.dim(i);
+  }
+  for (std::size_t i = 1; i < src.rank; ++i) {
+    if (i != d) src_rest.dims[src_rest.rank++] = src.dim(i);
+  }
+  src_rest.base = offset_bytes(src.base, src_x.flat_offset_bytes(dst_x.min()) + src_y.flat_offset_bytes(dst_y.min()));
+
+  auto kernel = [elem_size]() {
+    switch (elem_size) {
+    case 1: return transpose<uint8_t>;
+    case 2: return transpose<uint16_t>;
+    case 4: return transpose<uint32_t>;
+    case 8: return transpose<uint64_t>;
+    default: SLINKY_UNREACHABLE << "unsupported transpose elem_size " << elem_size;
+    }
+  }();
+  for_each_element(
+      [=](void* dst, const void* src) { kernel(src, src_stride_x, dst, dst_stride_y, w, h); },
+      dst_rest, src_rest);
+}
+
 // Perform an unpadded copy.
 void copy_impl(raw_buffer& src, raw_buffer& dst) {
   assert(src.elem_size == dst.elem_size);
@@ -277,6 +386,8 @@ void copy_impl(raw_buffer& src, raw_buffer& dst) {
 
     if (dst_dim0.empty()) {
       // Empty destination, nothing to do.
+    } else if (int d = find_transpose_dim(src, dst)) {
+      transpose_impl(src, dst, d);
     } else if (dst_dim0.fold_factor() > 0 || src_dim0.fold_factor() > 0 ||
                dst_dim0.stride() != elem_size || (src_dim0.stride() != 0 && src_dim0.stride() != elem_size)) {
       // There is some complication to the innermost dimension's copy.
@@ -359,6 +470,48 @@ void pad_impl(raw_buffer& src, raw_buffer& dst, raw_buffer& pad) {
   }
 }
 
+// Implements `copy` of buffers that have already been optimized with `optimize_dims`. If `pad` is not null, the
+// buffers are padded first. The buffers are modified.
+void copy_optimized(raw_buffer& src, raw_buffer& dst, raw_buffer* pad) {
+  if (pad) {
+    // Implement the padding in all but the first dimension.
+    pad_impl(src, dst, *pad);
+    if (src.base == dst.base) {
+      // This is an in-place padded copy, we're done.
+      return;
+    }
+  }
+  copy_impl(src, dst);
+}
+
+// Returns the number of chunks to split the outermost dimension of `dst` into for a parallel copy, or 1 if the copy
+// should not be split.
+index_t parallel_chunk_count(const thread_pool& pool, const raw_buffer& dst, index_t min_chunk_bytes) {
+  if (dst.rank == 0 || pool.thread_count() == 0) return 1;
+  const slinky::dim& outer = dst.dim(dst.rank - 1);
+  // Chunks of folded or broadcasted dimensions may overlap.
+  if (outer.fold_factor() != dim::unfolded || outer.stride() == 0) return 1;
+  const index_t size = static_cast<index_t>(dst.elem_count()) * dst.elem_size;
+  return std::max<index_t>(1, std::min(outer.extent(), size / std::max<index_t>(min_chunk_bytes, 1)));
+}
+
+// Calls `fn(chunk)` in parallel on `pool`, where `chunk` is `dst` cropped to one of `chunks` chunks of its outermost
+// dimension.
+template <typename Fn>
+void parallel_for_chunks(thread_pool& pool, const raw_buffer& dst, index_t chunks, const Fn& fn) {
+  const std::size_t outer_d = dst.rank - 1;
+  const slinky::dim& outer = dst.dim(outer_d);
+  const index_t chunk_extent = ceil_div(outer.extent(), chunks);
+  pool.parallel_for(ceil_div(outer.extent(), chunk_extent), [&](std::size_t i) {
+    raw_buffer chunk = dst;
+    chunk.dims = SLINKY_ALLOCA(dim, dst.rank);
+    internal::copy_small_n(dst.dims, dst.rank, chunk.dims);
+    const index_t min = outer.min() + static_cast<index_t>(i) * chunk_extent;
+    chunk.crop(outer_d, min, std::min(min + chunk_extent - 1, outer.max()));
+    fn(chunk);
+  });
+}
+
 }  // namespace
 
 SLINKY_NO_STACK_PROTECTOR void copy(const raw_buffer& src, const raw_buffer& dst, const raw_buffer& pad) {
@@ -388,19 +541,74 @@ SLINKY_NO_STACK_PROTECTOR void copy(const raw_buffer& src, const raw_buffer& dst
     internal::copy_small_n(pad.dims, pad.rank, pad_opt.dims);
 
     optimize_dims(dst_opt, src_opt, pad_opt);
+    copy_optimized(src_opt, dst_opt, &pad_opt);
+  } else {
+    optimize_dims(dst_opt, src_opt);
+    copy_optimized(src_opt, dst_opt, nullptr);
+  }
+}
 
-    // Implement the padding in all but the first dimension.
-    pad_impl(src_opt, dst_opt, pad_opt);
-    if (src_opt.base == dst_opt.base) {
-      // This is an in-place padded copy, we're done.
-      return;
-    }
+SLINKY_NO_STACK_PROTECTOR void parallel_copy(
+    thread_pool& pool, const raw_buffer& src, const raw_buffer& dst, const raw_buffer& pad, index_t min_chunk_bytes) {
+  assert(dst.elem_size == src.elem_size);
+  if (dst.rank == 0) {
+    copy(src, dst, pad);
+    return;
+  }
+
+  raw_buffer dst_opt = dst;
+  dst_opt.dims = SLINKY_ALLOCA(dim, dst.rank);
+  internal::copy_small_n(dst.dims, dst.rank, dst_opt.dims);
+
+  raw_buffer src_opt = src;
+  src_opt.dims = SLINKY_ALLOCA(dim, src.rank);
+  internal::copy_small_n(src.dims, src.rank, src_opt.dims);
+
+  raw_buffer pad_opt = pad;
+  pad_opt.dims = SLINKY_ALLOCA(dim, pad.rank);
+  internal::copy_small_n(pad.dims, pad.rank, pad_opt.dims);
+
+  const bool padded = src_opt.rank > 0 && pad.base;
+  if (padded) {
+    assert(dst_opt.elem_size == pad.elem_size);
+    optimize_dims(dst_opt, src_opt, pad_opt);
   } else {
     optimize_dims(dst_opt, src_opt);
   }
-  copy_impl(src_opt, dst_opt);
+
+  const index_t chunks = parallel_chunk_count(pool, dst_opt, min_chunk_bytes);
+  if (chunks <= 1) {
+    copy_optimized(src_opt, dst_opt, padded ? &pad_opt : nullptr);
+    return;
+  }
+
+  parallel_for_chunks(pool, dst_opt, chunks, [&](raw_buffer& dst_chunk) {
+    // The copy modifies the buffers, each chunk needs its own copy of them.
+    raw_buffer src_chunk = src_opt;
+    src_chunk.dims = SLINKY_ALLOCA(dim, src_opt.rank);
+    internal::copy_small_n(src_opt.dims, src_opt.rank, src_chunk.dims);
+
+    raw_buffer pad_chunk = pad_opt;
+    pad_chunk.dims = SLINKY_ALLOCA(dim, pad_opt.rank);
+    internal::copy_small_n(pad_opt.dims, pad_opt.rank, pad_chunk.dims);
+
+    copy_optimized(src_chunk, dst_chunk, padded ? &pad_chunk : nullptr);
+  });
+}
+
+namespace {
+
+// Make a buffer with the bounds `in_bounds` (and no data) to use as the src of a copy that only pads `dst`.
+raw_buffer pad_src(const dim* in_bounds, const raw_buffer& dst, dim* dims) {
+  raw_buffer src = {nullptr, dst.elem_size, dst.rank, dims};
+  for (std::size_t d = 0; d < dst.rank; ++d) {
+    src.mutable_dim(d) = {in_bounds[d].min(), in_bounds[d].max(), 0, in_bounds[d].fold_factor()};
+  }
+  return src;
 }
 
+}  // namespace
+
 void pad(const dim* in_bounds, const raw_buffer& dst, const raw_buffer& pad) {
   assert(dst.elem_size == pad.elem_size);
   if (dst.rank == 0) {
@@ -412,10 +620,7 @@ void pad(const dim* in_bounds, const raw_buffer& dst, const raw_buffer& pad) {
   dst_opt.dims = SLINKY_ALLOCA(dim, dst.rank);
   internal::copy_small_n(dst.dims, dst.rank, dst_opt.dims);
 
-  raw_buffer src = {nullptr, dst.elem_size, dst.rank, SLINKY_ALLOCA(dim, dst.rank)};
-  for (std::size_t d = 0; d < dst.rank; ++d) {
-    src.mutable_dim(d) = {in_bounds[d].min(), in_bounds[d].max(), 0, in_bounds[d].fold_factor()};
-  }
+  raw_buffer src = pad_src(in_bounds, dst, SLINKY_ALLOCA(dim, dst.rank));
 
   raw_buffer pad_opt = pad;
   pad_opt.dims = SLINKY_ALLOCA(dim, pad.rank);
@@ -427,6 +632,53 @@ void pad(const dim* in_bounds, const raw_buffer& dst, const raw_buffer& pad) {
   pad_impl(src, dst_opt, pad_opt);
 }
 
+SLINKY_NO_STACK_PROTECTOR void parallel_pad(
+    thread_pool& pool, const dim* in_bounds, const raw_buffer& dst, const raw_buffer& pad, index_t min_chunk_bytes) {
+  assert(dst.elem_size == pad.elem_size);
+  if (dst.rank == 0) {
+    return;
+  }
+
+  raw_buffer dst_opt = dst;
+  dst_opt.dims = SLINKY_ALLOCA(dim, dst.rank);
+  internal::copy_small_n(dst.dims, dst.rank, dst_opt.dims);
+
+  raw_buffer src = pad_src(in_bounds, dst, SLINKY_ALLOCA(dim, dst.rank));
+
+  raw_buffer pad_opt = pad;
+  pad_opt.dims = SLINKY_ALLOCA(dim, pad.rank);
+  internal::copy_small_n(pad.dims, pad.rank, pad_opt.dims);
+
+  optimize_dims(dst_opt, src, pad_opt);
+
+  const index_t chunks = parallel_chunk_count(pool, dst_opt, min_chunk_bytes);
+  if (chunks <= 1) {
+    pad_impl(src, dst_opt, pad_opt);
+    return;
+  }
+
+  parallel_for_chunks(pool, dst_opt, chunks, [&](raw_buffer& dst_chunk) {
+    // The padding modifies the buffers, each chunk needs its own copy of them.
+    raw_buffer src_chunk = src;
+    src_chunk.dims = SLINKY_ALLOCA(dim, src.rank);
+    internal::copy_small_n(src.dims, src.rank, src_chunk.dims);
+
+    raw_buffer pad_chunk = pad_opt;
+    pad_chunk.dims = SLINKY_ALLOCA(dim, pad_opt.rank);
+    internal::copy_small_n(pad_opt.dims, pad_opt.rank, pad_chunk.dims);
+
+    pad_impl(src_chunk, dst_chunk, pad_chunk);
+  });
+}
+
+void copy_with_pool(thread_pool* pool, const raw_buffer& src, const raw_buffer& dst, const raw_buffer& pad) {
+  if (pool) {
+    parallel_copy(*pool, src, dst, pad);
+  } else {
+    copy(src, dst, pad);
+  }
+}
+
 namespace internal {
 
 namespace {
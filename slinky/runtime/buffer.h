@@ -16,6 +16,8 @@
 
 namespace slinky {
 
+class thread_pool;
+
 // index_t needs to at least be as big as a pointer and must be signed.
 // Using ptrdiff_t or intptr_t here seems tempting, but those can
 // alias to `long` under some compilers which can cause some not so fun
@@ -401,6 +403,14 @@ public:
 
   std::size_t elem_count() const;
 
+  // Returns true if any dimension of this buffer is empty, i.e. `elem_count() == 0`.
+  bool empty() const {
+    for (std::size_t i = 0; i < rank; ++i) {
+      if (dims[i].empty()) return true;
+    }
+    return false;
+  }
+
   // If any strides are `auto_stride`, replace them with automatically determined strides.
   // `alignment` must be a power of 2.
   std::size_t init_strides(index_t alignment = 1);
@@ -702,6 +712,20 @@ void copy(const raw_buffer& src, const raw_buffer& dst, const raw_buffer& pad =
 // Performs only the padding operation of a copy. The region that would have been copied is unmodified.
 void pad(const dim* src_bounds, const raw_buffer& dst, const raw_buffer& pad);
 
+// Equivalent to `copy` and `pad`, but the outermost dimension of `dst` (after `optimize_dims`) is split into chunks of
+// at least `min_chunk_bytes` that are copied in parallel on `pool`. Copies smaller than two chunks are performed on the
+// calling thread.
+constexpr index_t parallel_copy_min_chunk_bytes = 1 << 20;
+void parallel_copy(thread_pool& pool, const raw_buffer& src, const raw_buffer& dst, const raw_buffer& pad = no_padding,
+    index_t min_chunk_bytes = parallel_copy_min_chunk_bytes);
+void parallel_pad(thread_pool& pool, const dim* src_bounds, const raw_buffer& dst, const raw_buffer& pad,
+    index_t min_chunk_bytes = parallel_copy_min_chunk_bytes);
+
+// Calls `parallel_copy` if `pool` is not null, or `copy` otherwise. This implements copies without a custom
+// implementation in pipelines (see `copy_stmt::impl`).
+void copy_with_pool(
+    thread_pool* pool, const raw_buffer& src, const raw_buffer& dst, const raw_buffer& pad = no_padding);
+
 // Returns true if the two dimensions can be fused.
 inline bool can_fuse(const dim& inner, const dim& outer) {
   if (inner.empty()) return false;
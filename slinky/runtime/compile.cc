@@ -0,0 +1,1266 @@
+#include "slinky/runtime/compile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "slinky/base/thread_pool.h"
+#include "slinky/runtime/buffer.h"
+#include "slinky/runtime/depends_on.h"
+#include "slinky/runtime/evaluate.h"
+#include "slinky/runtime/expr.h"
+#include "slinky/runtime/print.h"
+#include "slinky/runtime/stmt.h"
+
+namespace slinky {
+
+namespace {
+
+enum class opcode : std::int32_t {
+  // Expression instructions. These compute a value and write it to the register `dst`.
+
+  // r[dst] = imm
+  constant,
+  // r[dst] = context[imm]
+  load,
+  // r[dst] = <field> of the buffer context[imm], in dimension `a` for per-dimension fields.
+  load_rank,
+  load_elem_size,
+  load_size_bytes,
+  load_min,
+  load_max,
+  load_stride,
+  load_fold_factor,
+  // r[dst] = r[a] <op> r[b]
+  add,
+  sub,
+  mul,
+  div,
+  mod,
+  min,
+  max,
+  equal,
+  not_equal,
+  less,
+  less_equal,
+  logical_and,
+  logical_or,
+  // r[dst] = r[a] + imm
+  add_imm,
+  // r[dst] = <op>(r[a])
+  logical_not,
+  abs,
+  // Jump to the instruction `imm` instructions after the next instruction, possibly conditioned on r[a].
+  jump,
+  jump_if_zero,
+  jump_if_nonzero,
+  // swap(r[a], context[imm]). This is used to enter and exit the scope of a let expression.
+  swap,
+  // r[dst] = address of the element at coordinates r[a], ..., r[a + b - 1] of the buffer context[imm].
+  buffer_at,
+  // r[dst] = the result of evaluating exprs[imm] with the reference evaluator.
+  eval_expr,
+
+  // Statement instructions. Instructions that introduce a scope run the `n` instructions following the instruction as
+  // the body of the scope.
+
+  call_stmt,
+  // Evaluate stmts[imm] with the reference evaluator.
+  eval_stmt,
+  // Fail if r[a] is zero, reporting the failure of stmts[imm].
+  check,
+  // Run the body with context[imm] = r[a].
+  let,
+  // Run the body with context[imm] set to each value in the interval [r[a], r[a + 1]], with step r[a + 2].
+  loop,
+  // Same as `loop`, but with r[a + 3] determining the number of workers and r[a + 4] the grain at runtime.
+  loop_dynamic,
+  // Make a buffer context[imm] of the node's rank with the allocation described by r[a], r[a + 1], ...
+  allocate_heap,
+  allocate_stack,
+  allocate_automatic,
+  make_buffer,
+  clone_buffer,
+  // Crops where the node's `sym` is the same as the node's `src` are performed in place.
+  crop_buffer,
+  crop_buffer_in_place,
+  crop_dim,
+  crop_dim_in_place,
+  slice_buffer,
+  slice_dim,
+  transpose,
+};
+
+const char* to_string(opcode op) {
+  switch (op) {
+  case opcode::constant: return "constant";
+  case opcode::load: return "load";
+  case opcode::load_rank: return "load_rank";
+  case opcode::load_elem_size: return "load_elem_size";
+  case opcode::load_size_bytes: return "load_size_bytes";
+  case opcode::load_min: return "load_min";
+  case opcode::load_max: return "load_max";
+  case opcode::load_stride: return "load_stride";
+  case opcode::load_fold_factor: return "load_fold_factor";
+  case opcode::add: return "add";
+  case opcode::sub: return "sub";
+  case opcode::mul: return "mul";
+  case opcode::div: return "div";
+  case opcode::mod: return "mod";
+  case opcode::min: return "min";
+  case opcode::max: return "max";
+  case opcode::equal: return "equal";
+  case opcode::not_equal: return "not_equal";
+  case opcode::less: return "less";
+  case opcode::less_equal: return "less_equal";
+  case opcode::logical_and: return "logical_and";
+  case opcode::logical_or: return "logical_or";
+  case opcode::add_imm: return "add_imm";
+  case opcode::logical_not: return "logical_not";
+  case opcode::abs: return "abs";
+  case opcode::jump: return "jump";
+  case opcode::jump_if_zero: return "jump_if_zero";
+  case opcode::jump_if_nonzero: return "jump_if_nonzero";
+  case opcode::swap: return "swap";
+  case opcode::buffer_at: return "buffer_at";
+  case opcode::eval_expr: return "eval_expr";
+  case opcode::call_stmt: return "call_stmt";
+  case opcode::eval_stmt: return "eval_stmt";
+  case opcode::check: return "check";
+  case opcode::let: return "let";
+  case opcode::loop: return "loop";
+  case opcode::loop_dynamic: return "loop_dynamic";
+  case opcode::allocate_heap: return "allocate_heap";
+  case opcode::allocate_stack: return "allocate_stack";
+  case opcode::allocate_automatic: return "allocate_automatic";
+  case opcode::make_buffer: return "make_buffer";
+  case opcode::clone_buffer: return "clone_buffer";
+  case opcode::crop_buffer: return "crop_buffer";
+  case opcode::crop_buffer_in_place: return "crop_buffer_in_place";
+  case opcode::crop_dim: return "crop_dim";
+  case opcode::crop_dim_in_place: return "crop_dim_in_place";
+  case opcode::slice_buffer: return "slice_buffer";
+  case opcode::slice_dim: return "slice_dim";
+  case opcode::transpose: return "transpose";
+  default: SLINKY_UNREACHABLE << "unknown opcode " << static_cast<int>(op);
+  }
+}
+
+struct instruction {
+  opcode op;
+  // Register operands. For instructions that consume many registers, `a` is the first of a range of registers.
+  std::int32_t dst = 0;
+  std::int32_t a = 0;
+  std::int32_t b = 0;
+  // For instructions that introduce a scope, the number of instructions in the body of the scope.
+  std::int32_t n = 0;
+  // An immediate value, symbol, jump offset, or index into a side table, depending on `op`.
+  index_t imm = 0;
+  // The node this instruction implements, if the instruction needs more information than the above.
+  const void* node = nullptr;
+};
+
+struct allocated_buffer : public raw_buffer {
+  void* allocation;
+};
+
+struct interval {
+  index_t min, max;
+};
+
+SLINKY_INLINE void remove_trailing_broadcasts(raw_buffer& buffer) {
+  while (buffer.rank > 0 && buffer.dims[buffer.rank - 1].is_broadcast()) {
+    --buffer.rank;
+  }
+}
+
+}  // namespace
+
+struct compiled_stmt::program {
+  // The stmt this program was compiled from. This owns the nodes referenced by `instruction::node`.
+  stmt source;
+
+  std::vector<instruction> code;
+
+  // Nodes we fall back to the reference evaluator to evaluate.
+  std::vector<expr> exprs;
+  std::vector<stmt> stmts;
+
+  std::size_t register_count = 0;
+  std::size_t context_size = 0;
+};
+
+namespace {
+
+using program = compiled_stmt::program;
+
+class compiler {
+  program& p;
+
+  // Registers are allocated in a stack-like fashion.
+  int next_reg = 0;
+
+  // Buffers declared by `constant_buffer`, we can fold reads of their metadata.
+  symbol_map<const raw_buffer*> constants;
+
+  int alloc_reg() {
+    int result = next_reg++;
+    p.register_count = std::max<std::size_t>(p.register_count, next_reg);
+    return result;
+  }
+
+  void use(var sym) {
+    assert(sym.defined());
+    p.context_size = std::max(p.context_size, sym.id + 1);
+  }
+
+  std::size_t emit(const instruction& i) {
+    p.code.push_back(i);
+    return p.code.size() - 1;
+  }
+
+  // Point the jump instruction at `from` to the next instruction to be emitted.
+  void patch_jump(std::size_t from) { p.code[from].imm = p.code.size() - from - 1; }
+  // Close the scope of the instruction at `begin`, the body is all the instructions emitted since.
+  void end_scope(std::size_t begin) { p.code[begin].n = p.code.size() - begin - 1; }
+
+  // Declarations of a symbol hide constant buffers of the same name.
+  auto declare(var sym) {
+    use(sym);
+    return set_value_in_scope<const raw_buffer*>(constants, sym, nullptr);
+  }
+
+  const raw_buffer* constant_buffer(var sym) const { return constants.lookup(sym, nullptr); }
+
+  std::optional<index_t> fold_field(const variable* op) const {
+    if (op->field == buffer_field::none) return std::nullopt;
+    const raw_buffer* buf = constant_buffer(op->sym);
+    if (!buf) return std::nullopt;
+    switch (op->field) {
+    case buffer_field::rank: return buf->rank;
+    case buffer_field::elem_size: return buf->elem_size;
+    case buffer_field::size_bytes: return buf->size_bytes();
+    case buffer_field::min: return buf->dim(op->dim).min();
+    case buffer_field::max: return buf->dim(op->dim).max();
+    case buffer_field::stride: return buf->dim(op->dim).stride();
+    case buffer_field::fold_factor: return buf->dim(op->dim).fold_factor();
+    default: return std::nullopt;
+    }
+  }
+
+  template <typename T>
+  std::optional<index_t> fold_binary(const binary_op* op) const {
+    std::optional<index_t> a = fold(op->a);
+    if (!a) return std::nullopt;
+    std::optional<index_t> b = fold(op->b);
+    if (!b || binary_overflows<T>(*a, *b)) return std::nullopt;
+    return make_binary<T>(*a, *b);
+  }
+
+  // Returns the value of `e` if it can be determined at compile time.
+  std::optional<index_t> fold(const expr& e) const {
+    switch (e.type()) {
+    case expr_node_type::constant: return e.as<constant>()->value;
+    case expr_node_type::variable: return fold_field(e.as<variable>());
+    case expr_node_type::add: return fold_binary<add>(static_cast<const binary_op*>(e.get()));
+    case expr_node_type::sub: return fold_binary<sub>(static_cast<const binary_op*>(e.get()));
+    case expr_node_type::mul: return fold_binary<mul>(static_cast<const binary_op*>(e.get()));
+    case expr_node_type::div: return fold_binary<div>(static_cast<const binary_op*>(e.get()));
+    case expr_node_type::mod: return fold_binary<mod>(static_cast<const binary_op*>(e.get()));
+    case expr_node_type::min: return fold_binary<class min>(static_cast<const binary_op*>(e.get()));
+    case expr_node_type::max: return fold_binary<class max>(static_cast<const binary_op*>(e.get()));
+    case expr_node_type::equal: return fold_binary<equal>(static_cast<const binary_op*>(e.get()));
+    case expr_node_type::not_equal: return fold_binary<not_equal>(static_cast<const binary_op*>(e.get()));
+    case expr_node_type::less: return fold_binary<less>(static_cast<const binary_op*>(e.get()));
+    case expr_node_type::less_equal: return fold_binary<less_equal>(static_cast<const binary_op*>(e.get()));
+    case expr_node_type::logical_and: return fold_binary<logical_and>(static_cast<const binary_op*>(e.get()));
+    case expr_node_type::logical_or: return fold_binary<logical_or>(static_cast<const binary_op*>(e.get()));
+    case expr_node_type::logical_not: {
+      std::optional<index_t> a = fold(e.as<logical_not>()->a);
+      return a ? std::optional<index_t>(*a == 0) : std::nullopt;
+    }
+    default: return std::nullopt;
+    }
+  }
+
+  static opcode load_field_opcode(buffer_field field) {
+    switch (field) {
+    case buffer_field::none: return opcode::load;
+    case buffer_field::rank: return opcode::load_rank;
+    case buffer_field::elem_size: return opcode::load_elem_size;
+    case buffer_field::size_bytes: return opcode::load_size_bytes;
+    case buffer_field::min: return opcode::load_min;
+    case buffer_field::max: return opcode::load_max;
+    case buffer_field::stride: return opcode::load_stride;
+    case buffer_field::fold_factor: return opcode::load_fold_factor;
+    default: SLINKY_UNREACHABLE << "unknown buffer field " << to_string(field);
+    }
+  }
+
+  static opcode binary_opcode(expr_node_type type) {
+    switch (type) {
+    case expr_node_type::add: return opcode::add;
+    case expr_node_type::sub: return opcode::sub;
+    case expr_node_type::mul: return opcode::mul;
+    case expr_node_type::div: return opcode::div;
+    case expr_node_type::mod: return opcode::mod;
+    case expr_node_type::min: return opcode::min;
+    case expr_node_type::max: return opcode::max;
+    case expr_node_type::equal: return opcode::equal;
+    case expr_node_type::not_equal: return opcode::not_equal;
+    case expr_node_type::less: return opcode::less;
+    case expr_node_type::less_equal: return opcode::less_equal;
+    case expr_node_type::logical_and: return opcode::logical_and;
+    case expr_node_type::logical_or: return opcode::logical_or;
+    default: SLINKY_UNREACHABLE << "unknown binary operator " << to_string(type);
+    }
+  }
+
+  void compile_fallback(const expr& e, int dst) {
+    p.exprs.push_back(e);
+    emit({opcode::eval_expr, dst, 0, 0, 0, static_cast<index_t>(p.exprs.size() - 1)});
+  }
+
+  void compile_let(const let* op, int dst) {
+    int old_next_reg = next_reg;
+    std::vector<scoped_value_in_symbol_map<const raw_buffer*>> decls;
+    std::vector<std::pair<int, var>> saved;
+    for (const auto& i : op->lets) {
+      int value = alloc_reg();
+      compile(i.second, value);
+      decls.push_back(declare(i.first));
+      emit({opcode::swap, 0, value, 0, 0, static_cast<index_t>(i.first.id)});
+      saved.push_back({value, i.first});
+    }
+    compile(op->body, dst);
+    for (auto i = saved.rbegin(); i != saved.rend(); ++i) {
+      emit({opcode::swap, 0, i->first, 0, 0, static_cast<index_t>(i->second.id)});
+    }
+    next_reg = old_next_reg;
+  }
+
+  void compile_binary(const binary_op* op, int dst) {
+    if (op->type == expr_node_type::add || op->type == expr_node_type::sub) {
+      std::optional<index_t> b = fold(op->b);
+      if (b && (op->type == expr_node_type::add || *b != std::numeric_limits<index_t>::min())) {
+        compile(op->a, dst);
+        emit({opcode::add_imm, dst, dst, 0, 0, op->type == expr_node_type::add ? *b : -*b});
+        return;
+      }
+    }
+    compile(op->a, dst);
+    int old_next_reg = next_reg;
+    int b = alloc_reg();
+    compile(op->b, b);
+    emit({binary_opcode(op->type), dst, dst, b});
+    next_reg = old_next_reg;
+  }
+
+  void compile_select(const class select* op, int dst) {
+    compile(op->condition, dst);
+    std::size_t to_false = emit({opcode::jump_if_zero, 0, dst});
+    compile(op->true_value, dst);
+    std::size_t to_end = emit({opcode::jump});
+    patch_jump(to_false);
+    compile(op->false_value, dst);
+    patch_jump(to_end);
+  }
+
+  void compile_short_circuit(const call* op, int dst) {
+    const bool is_and = op->intrinsic == intrinsic::and_then;
+    std::vector<std::size_t> to_short_circuit;
+    for (const expr& i : op->args) {
+      compile(i, dst);
+      to_short_circuit.push_back(emit({is_and ? opcode::jump_if_zero : opcode::jump_if_nonzero, 0, dst}));
+    }
+    // None of the args short circuited.
+    emit({opcode::constant, dst, 0, 0, 0, is_and ? 1 : 0});
+    std::size_t to_end = emit({opcode::jump});
+    for (std::size_t i : to_short_circuit) {
+      patch_jump(i);
+    }
+    emit({opcode::constant, dst, 0, 0, 0, is_and ? 0 : 1});
+    patch_jump(to_end);
+  }
+
+  void compile_buffer_at(const call* op, int dst) {
+    std::optional<var> buf = as_variable(op->args[0]);
+    bool all_defined = std::all_of(op->args.begin(), op->args.end(), [](const expr& i) { return i.defined(); });
+    if (!buf || !all_defined) {
+      compile_fallback(expr(op), dst);
+      return;
+    }
+    use(*buf);
+    int old_next_reg = next_reg;
+    int first = next_reg;
+    for (std::size_t i = 1; i < op->args.size(); ++i) {
+      compile(op->args[i], alloc_reg());
+    }
+    emit({opcode::buffer_at, dst, first, static_cast<std::int32_t>(op->args.size() - 1), 0,
+        static_cast<index_t>(buf->id)});
+    next_reg = old_next_reg;
+  }
+
+  void compile_call(const call* op, int dst) {
+    switch (op->intrinsic) {
+    case intrinsic::abs:
+      assert(op->args.size() == 1);
+      compile(op->args[0], dst);
+      emit({opcode::abs, dst, dst});
+      return;
+    case intrinsic::and_then:
+    case intrinsic::or_else: compile_short_circuit(op, dst); return;
+    case intrinsic::buffer_at: compile_buffer_at(op, dst); return;
+    default:
+      for (var i : find_dependencies(expr(op))) {
+        use(i);
+      }
+      compile_fallback(expr(op), dst);
+      return;
+    }
+  }
+
+public:
+  compiler(program& p) : p(p) {}
+
+  // Compile `e` such that the result is placed in `dst`.
+  void compile(const expr& e, int dst) {
+    assert(e.defined());
+    if (std::optional<index_t> value = fold(e)) {
+      emit({opcode::constant, dst, 0, 0, 0, *value});
+      return;
+    }
+    switch (e.type()) {
+    case expr_node_type::variable: {
+      const variable* op = e.as<variable>();
+      use(op->sym);
+      emit({load_field_opcode(op->field), dst, op->dim, 0, 0, static_cast<index_t>(op->sym.id)});
+      return;
+    }
+    case expr_node_type::let: compile_let(e.as<let>(), dst); return;
+    case expr_node_type::logical_not:
+      compile(e.as<logical_not>()->a, dst);
+      emit({opcode::logical_not, dst, dst});
+      return;
+    case expr_node_type::select: compile_select(e.as<class select>(), dst); return;
+    case expr_node_type::call: compile_call(e.as<call>(), dst); return;
+    default: compile_binary(static_cast<const binary_op*>(e.get()), dst); return;
+    }
+  }
+
+  void compile(const expr& e, int dst, index_t def) {
+    if (e.defined()) {
+      compile(e, dst);
+    } else {
+      emit({opcode::constant, dst, 0, 0, 0, def});
+    }
+  }
+
+  // Compile the bounds of a crop of dimension `d` of `src` to registers `dst` and `dst + 1`. Undefined bounds are the
+  // existing bounds of `src`.
+  void compile_crop_bounds(const interval_expr& bounds, var src, int d, int dst) {
+    if (bounds.min.defined()) {
+      compile(bounds.min, dst);
+    } else {
+      compile(buffer_min(src, d), dst);
+    }
+    if (bounds.is_point()) {
+      emit({opcode::add_imm, dst + 1, dst, 0, 0, 0});
+    } else if (bounds.max.defined()) {
+      compile(bounds.max, dst + 1);
+    } else {
+      compile(buffer_max(src, d), dst + 1);
+    }
+  }
+
+  void compile_dims(const std::vector<dim_expr>& dims, index_t default_stride) {
+    for (const dim_expr& i : dims) {
+      int min = alloc_reg();
+      int max = alloc_reg();
+      compile(i.bounds.min, min);
+      if (i.bounds.is_point()) {
+        emit({opcode::add_imm, max, min, 0, 0, 0});
+      } else {
+        compile(i.bounds.max, max);
+      }
+      compile(i.stride, alloc_reg(), default_stride);
+      compile(i.fold_factor, alloc_reg(), dim::unfolded);
+    }
+  }
+
+  void compile_lets(const let_stmt* op) {
+    std::vector<scoped_value_in_symbol_map<const raw_buffer*>> decls;
+    std::vector<std::size_t> scopes;
+    for (const auto& i : op->lets) {
+      if (is_variable(i.second, i.first)) {
+        // This let (probably part of a closure) doesn't change anything.
+        continue;
+      }
+      next_reg = 0;
+      int value = alloc_reg();
+      compile(i.second, value);
+      decls.push_back(declare(i.first));
+      scopes.push_back(emit({opcode::let, 0, value, 0, 0, static_cast<index_t>(i.first.id)}));
+    }
+    compile(op->body);
+    for (auto i = scopes.rbegin(); i != scopes.rend(); ++i) {
+      end_scope(*i);
+    }
+  }
+
+  void compile_loop(const loop* op) {
+    next_reg = 0;
+    int bounds = alloc_reg();
+    alloc_reg();
+    compile_crop_bounds(op->bounds, var(), 0, bounds);
+    compile(op->step, alloc_reg(), 1);
+    std::optional<index_t> max_workers = fold(op->max_workers);
+    opcode code = opcode::loop;
+    if (!max_workers || *max_workers > 1) {
+      compile(op->max_workers, alloc_reg());
+      compile(op->grain, alloc_reg(), 1);
+      code = opcode::loop_dynamic;
+    }
+    // Closures are only needed to initialize the context of parallel workers, which we handle when running the loop.
+    // This only works if the closure doesn't rename anything, otherwise we just copy the whole context to the workers.
+    const let_stmt* closure = is_closure(op->body);
+    if (closure && !std::all_of(closure->lets.begin(), closure->lets.end(),
+                       [](const std::pair<var, expr>& i) { return is_variable(i.second, i.first); })) {
+      closure = nullptr;
+    }
+    std::size_t scope = emit({code, 0, bounds, closure ? 1 : 0, 0, static_cast<index_t>(op->sym.id), op});
+    auto decl = declare(op->sym);
+    compile(closure ? closure->body : op->body);
+    end_scope(scope);
+  }
+
+  void compile_allocate(const allocate* op) {
+    next_reg = 0;
+    int first = alloc_reg();
+    compile(op->elem_size, first);
+    compile_dims(op->dims, dim::auto_stride);
+    opcode code;
+    switch (op->storage) {
+    case memory_type::heap: code = opcode::allocate_heap; break;
+    case memory_type::stack: code = opcode::allocate_stack; break;
+    default: code = opcode::allocate_automatic; break;
+    }
+    std::size_t scope = emit({code, 0, first, 0, 0, static_cast<index_t>(op->sym.id), op});
+    auto decl = declare(op->sym);
+    compile(op->body);
+    end_scope(scope);
+  }
+
+  void compile_make_buffer(const class make_buffer* op) {
+    next_reg = 0;
+    int first = alloc_reg();
+    compile(op->base, first, 0);
+    compile(op->elem_size, alloc_reg(), 0);
+    compile_dims(op->dims, dim::auto_stride);
+    std::size_t scope = emit({opcode::make_buffer, 0, first, 0, 0, static_cast<index_t>(op->sym.id), op});
+    auto decl = declare(op->sym);
+    compile(op->body);
+    end_scope(scope);
+  }
+
+  void compile_constant_buffer(const class constant_buffer* op) {
+    next_reg = 0;
+    int value = alloc_reg();
+    emit({opcode::constant, value, 0, 0, 0, reinterpret_cast<index_t>(&*op->value)});
+    std::size_t scope = emit({opcode::let, 0, value, 0, 0, static_cast<index_t>(op->sym.id)});
+    use(op->sym);
+    auto decl = set_value_in_scope<const raw_buffer*>(constants, op->sym, &*op->value);
+    compile(op->body);
+    end_scope(scope);
+  }
+
+  void compile_crop_buffer(const crop_buffer* op) {
+    next_reg = 0;
+    int first = next_reg;
+    for (std::size_t d = 0; d < op->bounds.size(); ++d) {
+      int bounds = alloc_reg();
+      alloc_reg();
+      compile_crop_bounds(op->bounds[d], op->src, d, bounds);
+    }
+    use(op->src);
+    opcode code = op->sym == op->src ? opcode::crop_buffer_in_place : opcode::crop_buffer;
+    std::size_t scope = emit({code, 0, first, 0, 0, static_cast<index_t>(op->sym.id), op});
+    auto decl = declare(op->sym);
+    compile(op->body);
+    end_scope(scope);
+  }
+
+  void compile_crop_dim(const crop_dim* op) {
+    next_reg = 0;
+    int bounds = alloc_reg();
+    alloc_reg();
+    compile_crop_bounds(op->bounds, op->src, op->dim, bounds);
+    use(op->src);
+    opcode code = op->sym == op->src ? opcode::crop_dim_in_place : opcode::crop_dim;
+    std::size_t scope = emit({code, 0, bounds, 0, 0, static_cast<index_t>(op->sym.id), op});
+    auto decl = declare(op->sym);
+    compile(op->body);
+    end_scope(scope);
+  }
+
+  void compile_slice_buffer(const slice_buffer* op) {
+    next_reg = 0;
+    int first = next_reg;
+    for (const expr& i : op->at) {
+      if (i.defined()) compile(i, alloc_reg());
+    }
+    use(op->src);
+    std::size_t scope = emit({opcode::slice_buffer, 0, first, 0, 0, static_cast<index_t>(op->sym.id), op});
+    auto decl = declare(op->sym);
+    compile(op->body);
+    end_scope(scope);
+  }
+
+  void compile_slice_dim(const slice_dim* op) {
+    next_reg = 0;
+    int at = alloc_reg();
+    compile(op->at, at);
+    use(op->src);
+    std::size_t scope = emit({opcode::slice_dim, 0, at, 0, 0, static_cast<index_t>(op->sym.id), op});
+    auto decl = declare(op->sym);
+    compile(op->body);
+    end_scope(scope);
+  }
+
+  template <typename T>
+  void compile_buffer_decl(opcode code, const T* op) {
+    use(op->src);
+    std::size_t scope = emit({code, 0, 0, 0, 0, static_cast<index_t>(op->sym.id), op});
+    auto decl = declare(op->sym);
+    compile(op->body);
+    end_scope(scope);
+  }
+
+  void compile_fallback(const stmt& s) {
+    for (var i : find_dependencies(s)) {
+      use(i);
+    }
+    p.stmts.push_back(s);
+    emit({opcode::eval_stmt, 0, 0, 0, 0, static_cast<index_t>(p.stmts.size() - 1)});
+  }
+
+  void compile(const stmt& s) {
+    if (!s.defined()) return;
+    switch (s.type()) {
+    case stmt_node_type::call_stmt: {
+      const call_stmt* op = s.as<call_stmt>();
+      for (var i : op->inputs) use(i);
+      for (var i : op->outputs) use(i);
+      emit({opcode::call_stmt, 0, 0, 0, 0, 0, op});
+      return;
+    }
+    case stmt_node_type::let_stmt: compile_lets(s.as<let_stmt>()); return;
+    case stmt_node_type::block:
+      for (const stmt& i : s.as<block>()->stmts) {
+        compile(i);
+      }
+      return;
+    case stmt_node_type::loop: compile_loop(s.as<loop>()); return;
+    case stmt_node_type::allocate: compile_allocate(s.as<allocate>()); return;
+    case stmt_node_type::make_buffer: compile_make_buffer(s.as<class make_buffer>()); return;
+    case stmt_node_type::constant_buffer: compile_constant_buffer(s.as<class constant_buffer>()); return;
+    case stmt_node_type::clone_buffer: compile_buffer_decl(opcode::clone_buffer, s.as<clone_buffer>()); return;
+    case stmt_node_type::crop_buffer: compile_crop_buffer(s.as<crop_buffer>()); return;
+    case stmt_node_type::crop_dim: compile_crop_dim(s.as<crop_dim>()); return;
+    case stmt_node_type::slice_buffer: compile_slice_buffer(s.as<slice_buffer>()); return;
+    case stmt_node_type::slice_dim: compile_slice_dim(s.as<slice_dim>()); return;
+    case stmt_node_type::transpose: compile_buffer_decl(opcode::transpose, s.as<transpose>()); return;
+    case stmt_node_type::check: {
+      next_reg = 0;
+      int condition = alloc_reg();
+      compile(s.as<check>()->condition, condition);
+      p.stmts.push_back(s);
+      emit({opcode::check, 0, condition, 0, 0, static_cast<index_t>(p.stmts.size() - 1)});
+      return;
+    }
+    default:
+      // Everything else (`async` and `copy_stmt`) is rare enough that we just use the reference evaluator.
+      compile_fallback(s);
+      return;
+    }
+  }
+};
+
+class executor {
+public:
+  const program& p;
+  eval_context& context;
+  index_t* r;
+
+  executor(const program& p, eval_context& context, index_t* registers) : p(p), context(context), r(registers) {}
+
+  const raw_buffer* lookup_buffer(index_t sym) const { return context.lookup_buffer(var(sym)); }
+
+  SLINKY_INLINE index_t exec_body(const instruction* pc) { return exec(pc + 1, pc + 1 + pc->n); }
+
+  SLINKY_INLINE index_t exec_with_value(const instruction* pc, index_t value) {
+    var sym(pc->imm);
+    index_t old_value = context.set(sym, value);
+    index_t result = exec_body(pc);
+    context.set(sym, old_value);
+    return result;
+  }
+
+  SLINKY_NO_INLINE void call_failed(index_t result, const call_stmt* op) {
+    if (context.config->call_failed) {
+      context.config->call_failed(op);
+    } else {
+      std::cerr << "call_stmt failed: " << stmt(op) << "->" << result << std::endl;
+      std::abort();
+    }
+  }
+
+  // Returns true if `op` should not be called because all of its outputs are empty, as in `evaluate`.
+  bool skip_call(const call_stmt* op) const {
+    if (!op->attrs.skip_if_empty || op->outputs.empty()) return false;
+    for (var i : op->outputs) {
+      const raw_buffer* buf = context.lookup_buffer(i);
+      if (buf && !buf->empty()) return false;
+    }
+    return true;
+  }
+
+  SLINKY_NO_INLINE index_t check_failed(const instruction* pc) {
+    // The reference evaluator will report the failure, and return the failed result.
+    index_t result = evaluate(p.stmts[pc->imm], context);
+    assert(result != 0);
+    return result;
+  }
+
+  void* buffer_at(const instruction* pc) {
+    const raw_buffer* buf = lookup_buffer(pc->imm);
+    assert(buf);
+    void* result = buf->base;
+    for (std::int32_t d = 0; d < pc->b; ++d) {
+      index_t at = r[pc->a + d];
+      if (result && buf->dim(d).contains(at)) {
+        result = offset_bytes_non_null(result, buf->dim(d).flat_offset_bytes(at));
+      } else {
+        result = nullptr;
+      }
+    }
+    return result;
+  }
+
+  SLINKY_NO_INLINE index_t exec_loop_serial(const instruction* pc) {
+    interval bounds = {r[pc->a], r[pc->a + 1]};
+    index_t step = r[pc->a + 2];
+    assert(step != 0);
+    var sym(pc->imm);
+    index_t old_value = context.set(sym, 0);
+    index_t result = 0;
+    for (index_t i = bounds.min; result == 0 && bounds.min <= i && i <= bounds.max; i += step) {
+      context.set(sym, i);
+      result = exec_body(pc);
+    }
+    context.set(sym, old_value);
+    return result;
+  }
+
+  static void init_context(
+      eval_context& context, const eval_context& parent_context, const let_stmt* closure, var exclude) {
+    if (closure) {
+      // The body is a closure, so we know exactly which symbols we need to copy to the new local context.
+      context.reserve(parent_context.size());
+      context.config = parent_context.config;
+      for (const std::pair<var, expr>& i : closure->lets) {
+        if (i.first == exclude) continue;
+        auto src = as_variable(i.second);
+        assert(src);
+        context.set(i.first, parent_context.lookup(*src));
+      }
+    } else {
+      context = parent_context;
+    }
+  }
+
+  SLINKY_NO_INLINE index_t exec_loop_parallel(const instruction* pc) {
+    interval bounds = {r[pc->a], r[pc->a + 1]};
+    index_t step = r[pc->a + 2];
+    index_t max_workers = r[pc->a + 3];
+    if (max_workers <= 1) return exec_loop_serial(pc);
+    index_t grain = r[pc->a + 4];
+
+    assert(step != 0);
+    std::size_t n = ceil_div(bounds.max - bounds.min + 1, step);
+    if (n == 0) {
+      return 0;
+    } else if (n == 1) {
+      return exec_with_value(pc, bounds.min);
+    }
+
+    thread_pool* pool = context.config->thread_pool;
+    assert(pool);
+
+    struct shared_state {
+      const program& p;
+      const eval_context& context;
+      const instruction* begin;
+      const instruction* end;
+      index_t step;
+      index_t min;
+      var sym;
+      const let_stmt* closure;
+      std::atomic<index_t> result{0};
+    };
+    const loop* op = reinterpret_cast<const loop*>(pc->node);
+    const let_stmt* closure = pc->b ? is_closure(op->body) : nullptr;
+    shared_state state = {p, context, pc + 1, pc + 1 + pc->n, step, bounds.min, var(pc->imm), closure};
+
+    auto task = [&state, context = eval_context(), registers = std::vector<index_t>()](index_t i) mutable {
+      if (context.size() == 0) {
+        // As in `evaluate`, we initialize the context once per worker.
+        init_context(context, state.context, state.closure, state.sym);
+        registers.resize(state.p.register_count);
+      }
+      context.set(state.sym, i * state.step + state.min);
+      executor worker(state.p, context, registers.data());
+      index_t result_i = worker.exec(state.begin, state.end);
+      if (result_i != 0) {
+        index_t zero = 0;
+        state.result.compare_exchange_strong(zero, result_i);
+      }
+    };
+
+    pool->parallel_for(n, std::move(task), max_workers, std::max<index_t>(grain, 1));
+
+    return state.result;
+  }
+
+  SLINKY_INLINE void* allocate_heap(const allocate* op, var sym, raw_buffer& buffer) {
+    if (SLINKY_UNLIKELY(context.config->profile)) return heap_allocate_profiled(*context.config, op, sym, &buffer);
+    return heap_allocate(*context.config, sym, &buffer);
+  }
+
+  SLINKY_INLINE void free_heap(const allocate* op, var sym, allocated_buffer& buffer) {
+    if (SLINKY_UNLIKELY(context.config->profile)) {
+      heap_free_profiled(*context.config, op, sym, &buffer, buffer.allocation);
+    } else {
+      heap_free(*context.config, sym, &buffer, buffer.allocation);
+    }
+  }
+
+  // Not using SLINKY_NO_STACK_PROTECTOR here because this actually could allocate a lot of memory on the stack.
+  SLINKY_NO_INLINE index_t exec_allocate(const instruction* pc) {
+    const allocate* op = reinterpret_cast<const allocate*>(pc->node);
+    const index_t* regs = &r[pc->a];
+    allocated_buffer buffer;
+    buffer.elem_size = *regs++;
+    std::size_t rank = op->dims.size();
+    buffer.rank = rank;
+    buffer.dims = SLINKY_ALLOCA(dim, rank);
+    for (std::size_t d = 0; d < rank; ++d, regs += 4) {
+      dim& buf_d = buffer.dims[d];
+      buf_d.set_bounds(regs[0], regs[1]);
+      buf_d.set_stride(regs[2]);
+      buf_d.set_fold_factor(regs[3]);
+    }
+
+    remove_trailing_broadcasts(buffer);
+
+    var sym(pc->imm);
+    if (pc->op == opcode::allocate_heap) {
+      buffer.allocation = allocate_heap(op, sym, buffer);
+    } else {
+      std::size_t size = buffer.init_strides(context.config->stride_alignment);
+      if (pc->op == opcode::allocate_stack || size <= context.config->auto_stack_threshold) {
+        std::size_t alignment = context.config->base_alignment;
+        buffer.base = SLINKY_ALLOCA(char, size + alignment - 1);
+        buffer.base = align_up(buffer.base, alignment);
+        buffer.allocation = nullptr;
+      } else {
+        buffer.allocation = allocate_heap(op, sym, buffer);
+      }
+    }
+
+    index_t result = exec_with_value(pc, reinterpret_cast<index_t>(&buffer));
+
+    if (buffer.allocation) {
+      free_heap(op, sym, buffer);
+    }
+    return result;
+  }
+
+  SLINKY_NO_INLINE SLINKY_NO_STACK_PROTECTOR index_t exec_make_buffer(const instruction* pc) {
+    const make_buffer* op = reinterpret_cast<const make_buffer*>(pc->node);
+    const index_t* regs = &r[pc->a];
+    raw_buffer buffer;
+    buffer.base = reinterpret_cast<void*>(*regs++);
+    buffer.elem_size = *regs++;
+    std::size_t rank = op->dims.size();
+    buffer.rank = rank;
+    buffer.dims = SLINKY_ALLOCA(dim, rank);
+    for (std::size_t d = 0; d < rank; ++d, regs += 4) {
+      dim& buf_d = buffer.dims[d];
+      buf_d.set_bounds(regs[0], regs[1]);
+      buf_d.set_stride(regs[2]);
+      buf_d.set_fold_factor(regs[3]);
+    }
+
+    remove_trailing_broadcasts(buffer);
+
+    return exec_with_value(pc, reinterpret_cast<index_t>(&buffer));
+  }
+
+  SLINKY_NO_INLINE SLINKY_NO_STACK_PROTECTOR index_t exec_clone_buffer(const instruction* pc) {
+    const clone_buffer* op = reinterpret_cast<const clone_buffer*>(pc->node);
+    const raw_buffer* src_buf = context.lookup_buffer(op->src);
+    assert(src_buf);
+
+    raw_buffer clone = *src_buf;
+    clone.dims = SLINKY_ALLOCA(dim, src_buf->rank);
+    internal::copy_small_n(src_buf->dims, src_buf->rank, clone.dims);
+    return exec_with_value(pc, reinterpret_cast<index_t>(&clone));
+  }
+
+  SLINKY_NO_INLINE SLINKY_NO_STACK_PROTECTOR index_t exec_crop_buffer_in_place(const instruction* pc) {
+    const crop_buffer* op = reinterpret_cast<const crop_buffer*>(pc->node);
+    raw_buffer* buffer = reinterpret_cast<raw_buffer*>(context.lookup(op->sym));
+    assert(buffer);
+
+    std::size_t crop_rank = std::min(op->bounds.size(), buffer->rank);
+    interval* old_bounds = SLINKY_ALLOCA(interval, crop_rank);
+
+    void* old_base = buffer->base;
+    for (std::size_t d = 0; d < crop_rank; ++d) {
+      slinky::dim& dim = buffer->dims[d];
+      old_bounds[d] = {dim.min(), dim.max()};
+      buffer->crop(d, r[pc->a + d * 2], r[pc->a + d * 2 + 1]);
+    }
+
+    index_t result = exec_body(pc);
+
+    buffer->base = old_base;
+    for (std::size_t d = 0; d < crop_rank; ++d) {
+      buffer->dims[d].set_bounds(old_bounds[d].min, old_bounds[d].max);
+    }
+    return result;
+  }
+
+  SLINKY_NO_INLINE SLINKY_NO_STACK_PROTECTOR index_t exec_crop_buffer(const instruction* pc) {
+    const crop_buffer* op = reinterpret_cast<const crop_buffer*>(pc->node);
+    const raw_buffer* src_buf = context.lookup_buffer(op->src);
+    assert(src_buf);
+
+    raw_buffer sym_buf = *src_buf;
+    sym_buf.dims = SLINKY_ALLOCA(dim, src_buf->rank);
+    internal::copy_small_n(src_buf->dims, src_buf->rank, sym_buf.dims);
+    for (std::size_t d = 0; d < std::min(op->bounds.size(), src_buf->rank); ++d) {
+      sym_buf.crop(d, r[pc->a + d * 2], r[pc->a + d * 2 + 1]);
+    }
+
+    return exec_with_value(pc, reinterpret_cast<index_t>(&sym_buf));
+  }
+
+  SLINKY_NO_INLINE index_t exec_crop_dim_in_place(const instruction* pc) {
+    const crop_dim* op = reinterpret_cast<const crop_dim*>(pc->node);
+    raw_buffer* buffer = reinterpret_cast<raw_buffer*>(context.lookup(op->sym));
+    assert(buffer);
+
+    if (op->dim >= static_cast<int>(buffer->rank)) {
+      // Cropping a broadcast dimension is a no-op.
+      return exec_body(pc);
+    }
+
+    slinky::dim& dim = buffer->dims[op->dim];
+    index_t old_min = dim.min();
+    index_t old_max = dim.max();
+    void* old_base = buffer->base;
+
+    buffer->crop(op->dim, r[pc->a], r[pc->a + 1]);
+    index_t result = exec_body(pc);
+
+    buffer->base = old_base;
+    dim.set_bounds(old_min, old_max);
+
+    return result;
+  }
+
+  SLINKY_NO_INLINE SLINKY_NO_STACK_PROTECTOR index_t exec_crop_dim(const instruction* pc) {
+    const crop_dim* op = reinterpret_cast<const crop_dim*>(pc->node);
+    const raw_buffer* src_buf = context.lookup_buffer(op->src);
+    assert(src_buf);
+
+    raw_buffer sym_buf = *src_buf;
+    sym_buf.dims = SLINKY_ALLOCA(dim, src_buf->rank);
+    internal::copy_small_n(src_buf->dims, src_buf->rank, sym_buf.dims);
+    sym_buf.crop(op->dim, r[pc->a], r[pc->a + 1]);
+
+    return exec_with_value(pc, reinterpret_cast<index_t>(&sym_buf));
+  }
+
+  SLINKY_NO_INLINE SLINKY_NO_STACK_PROTECTOR index_t exec_slice_buffer(const instruction* pc) {
+    const slice_buffer* op = reinterpret_cast<const slice_buffer*>(pc->node);
+    const raw_buffer* src_buf = context.lookup_buffer(op->src);
+    assert(src_buf);
+    raw_buffer sym_buf;
+    sym_buf.base = src_buf->base;
+    sym_buf.elem_size = src_buf->elem_size;
+    sym_buf.dims = SLINKY_ALLOCA(dim, src_buf->rank);
+    sym_buf.rank = 0;
+
+    const index_t* at = &r[pc->a];
+    for (std::size_t d = 0; d < src_buf->rank; ++d) {
+      if (d < op->at.size() && op->at[d].defined()) {
+        index_t at_d = *at++;
+        if (sym_buf.base) {
+          if (src_buf->dims[d].contains(at_d)) {
+            sym_buf.base = offset_bytes_non_null(sym_buf.base, src_buf->dims[d].flat_offset_bytes(at_d));
+          } else {
+            sym_buf.base = nullptr;
+          }
+        }
+      } else {
+        sym_buf.dims[sym_buf.rank++] = src_buf->dims[d];
+      }
+    }
+
+    return exec_with_value(pc, reinterpret_cast<index_t>(&sym_buf));
+  }
+
+  SLINKY_NO_INLINE SLINKY_NO_STACK_PROTECTOR index_t exec_slice_dim(const instruction* pc) {
+    const slice_dim* op = reinterpret_cast<const slice_dim*>(pc->node);
+    const raw_buffer* src_buf = context.lookup_buffer(op->src);
+    assert(src_buf);
+
+    if (op->dim >= static_cast<int>(src_buf->rank)) {
+      // Slicing a broadcast dimension is a no-op: base and dims are unchanged.
+      raw_buffer sym_buf = *src_buf;
+      sym_buf.dims = SLINKY_ALLOCA(dim, src_buf->rank);
+      internal::copy_small_n(src_buf->dims, src_buf->rank, sym_buf.dims);
+      return exec_with_value(pc, reinterpret_cast<index_t>(&sym_buf));
+    }
+
+    raw_buffer sym_buf;
+    sym_buf.base = nullptr;
+    sym_buf.elem_size = src_buf->elem_size;
+    sym_buf.rank = src_buf->rank - 1;
+    sym_buf.dims = SLINKY_ALLOCA(dim, sym_buf.rank);
+
+    if (src_buf->base) {
+      index_t at = r[pc->a];
+      if (src_buf->dims[op->dim].contains(at)) {
+        sym_buf.base = offset_bytes_non_null(src_buf->base, src_buf->dims[op->dim].flat_offset_bytes(at));
+      }
+    }
+    for (int d = 0; d < op->dim; ++d) {
+      sym_buf.dims[d] = src_buf->dims[d];
+    }
+    for (int d = op->dim; d < static_cast<int>(sym_buf.rank); ++d) {
+      sym_buf.dims[d] = src_buf->dims[d + 1];
+    }
+
+    return exec_with_value(pc, reinterpret_cast<index_t>(&sym_buf));
+  }
+
+  SLINKY_NO_INLINE SLINKY_NO_STACK_PROTECTOR index_t exec_transpose(const instruction* pc) {
+    const transpose* op = reinterpret_cast<const transpose*>(pc->node);
+    if (op->sym == op->src && op->is_truncate()) {
+      raw_buffer* src_buf = reinterpret_cast<raw_buffer*>(context.lookup(op->src));
+      assert(src_buf);
+
+      // In-place truncate, all we need to do is set the rank (and restore it).
+      std::size_t old_rank = src_buf->rank;
+      src_buf->rank = op->dims.size();
+      index_t result = exec_body(pc);
+      src_buf->rank = old_rank;
+      return result;
+    } else {
+      const raw_buffer* src_buf = context.lookup_buffer(op->src);
+      assert(src_buf);
+
+      dim* dims = SLINKY_ALLOCA(dim, op->dims.size());
+      for (std::size_t i = 0; i < op->dims.size(); ++i) {
+        dims[i] = src_buf->dim(op->dims[i]);
+      }
+
+      raw_buffer sym_buf;
+      sym_buf.base = src_buf->base;
+      sym_buf.elem_size = src_buf->elem_size;
+      sym_buf.rank = op->dims.size();
+      sym_buf.dims = dims;
+
+      remove_trailing_broadcasts(sym_buf);
+
+      return exec_with_value(pc, reinterpret_cast<index_t>(&sym_buf));
+    }
+  }
+
+  // Run a statement instruction. Returns the result of the statement.
+  SLINKY_NO_INLINE index_t exec_stmt(const instruction* pc) {
+    switch (pc->op) {
+    case opcode::eval_stmt: return evaluate(p.stmts[pc->imm], context);
+    case opcode::let: return exec_with_value(pc, r[pc->a]);
+    case opcode::loop: return exec_loop_serial(pc);
+    case opcode::loop_dynamic: return exec_loop_parallel(pc);
+    case opcode::allocate_heap:
+    case opcode::allocate_stack:
+    case opcode::allocate_automatic: return exec_allocate(pc);
+    case opcode::make_buffer: return exec_make_buffer(pc);
+    case opcode::clone_buffer: return exec_clone_buffer(pc);
+    case opcode::crop_buffer: return exec_crop_buffer(pc);
+    case opcode::crop_buffer_in_place: return exec_crop_buffer_in_place(pc);
+    case opcode::crop_dim: return exec_crop_dim(pc);
+    case opcode::crop_dim_in_place: return exec_crop_dim_in_place(pc);
+    case opcode::slice_buffer: return exec_slice_buffer(pc);
+    case opcode::slice_dim: return exec_slice_dim(pc);
+    case opcode::transpose: return exec_transpose(pc);
+    default: SLINKY_UNREACHABLE << "unknown opcode " << to_string(pc->op);
+    }
+  }
+
+  index_t exec(const instruction* pc, const instruction* end) {
+    for (; pc < end; ++pc) {
+      switch (pc->op) {
+      case opcode::constant: r[pc->dst] = pc->imm; break;
+      case opcode::load: r[pc->dst] = context.lookup(var(pc->imm)); break;
+      case opcode::load_rank: r[pc->dst] = lookup_buffer(pc->imm)->rank; break;
+      case opcode::load_elem_size: r[pc->dst] = lookup_buffer(pc->imm)->elem_size; break;
+      case opcode::load_size_bytes: r[pc->dst] = lookup_buffer(pc->imm)->size_bytes(); break;
+      case opcode::load_min: r[pc->dst] = lookup_buffer(pc->imm)->dim(pc->a).min(); break;
+      case opcode::load_max: r[pc->dst] = lookup_buffer(pc->imm)->dim(pc->a).max(); break;
+      case opcode::load_stride: r[pc->dst] = lookup_buffer(pc->imm)->dim(pc->a).stride(); break;
+      case opcode::load_fold_factor: r[pc->dst] = lookup_buffer(pc->imm)->dim(pc->a).fold_factor(); break;
+      case opcode::add: r[pc->dst] = make_binary<add>(r[pc->a], r[pc->b]); break;
+      case opcode::sub: r[pc->dst] = make_binary<sub>(r[pc->a], r[pc->b]); break;
+      case opcode::mul: r[pc->dst] = make_binary<mul>(r[pc->a], r[pc->b]); break;
+      case opcode::div: r[pc->dst] = make_binary<div>(r[pc->a], r[pc->b]); break;
+      case opcode::mod: r[pc->dst] = make_binary<mod>(r[pc->a], r[pc->b]); break;
+      case opcode::min: r[pc->dst] = make_binary<class min>(r[pc->a], r[pc->b]); break;
+      case opcode::max: r[pc->dst] = make_binary<class max>(r[pc->a], r[pc->b]); break;
+      case opcode::equal: r[pc->dst] = make_binary<equal>(r[pc->a], r[pc->b]); break;
+      case opcode::not_equal: r[pc->dst] = make_binary<not_equal>(r[pc->a], r[pc->b]); break;
+      case opcode::less: r[pc->dst] = make_binary<less>(r[pc->a], r[pc->b]); break;
+      case opcode::less_equal: r[pc->dst] = make_binary<less_equal>(r[pc->a], r[pc->b]); break;
+      case opcode::logical_and: r[pc->dst] = make_binary<logical_and>(r[pc->a], r[pc->b]); break;
+      case opcode::logical_or: r[pc->dst] = make_binary<logical_or>(r[pc->a], r[pc->b]); break;
+      case opcode::add_imm: r[pc->dst] = r[pc->a] + pc->imm; break;
+      case opcode::logical_not: r[pc->dst] = r[pc->a] == 0; break;
+      case opcode::abs: r[pc->dst] = std::abs(r[pc->a]); break;
+      case opcode::jump: pc += pc->imm; break;
+      case opcode::jump_if_zero:
+        if (!r[pc->a]) pc += pc->imm;
+        break;
+      case opcode::jump_if_nonzero:
+        if (r[pc->a]) pc += pc->imm;
+        break;
+      case opcode::swap: std::swap(r[pc->a], context[var(pc->imm)]); break;
+      case opcode::buffer_at: r[pc->dst] = reinterpret_cast<index_t>(buffer_at(pc)); break;
+      case opcode::eval_expr: r[pc->dst] = evaluate(p.exprs[pc->imm], context); break;
+      case opcode::call_stmt: {
+        const call_stmt* op = reinterpret_cast<const call_stmt*>(pc->node);
+        if (SLINKY_UNLIKELY(op->attrs.skip_if_empty) && skip_call(op)) break;
+        index_t result =
+            SLINKY_UNLIKELY(context.config->profile) ? invoke_profiled(op, context) : op->target(op, context);
+        if (result) {
+          call_failed(result, op);
+          return result;
+        }
+        break;
+      }
+      case opcode::check:
+        if (!r[pc->a]) return check_failed(pc);
+        break;
+      default: {
+        index_t result = exec_stmt(pc);
+        if (result) return result;
+        pc += pc->n;
+        break;
+      }
+      }
+    }
+    return 0;
+  }
+};
+
+}  // namespace
+
+const stmt& compiled_stmt::source() const { return program_->source; }
+std::size_t compiled_stmt::size() const { return program_->code.size(); }
+std::size_t compiled_stmt::context_size() const { return program_->context_size; }
+
+compiled_stmt compile(const stmt& s) {
+  auto p = std::make_shared<program>();
+  p->source = s;
+  compiler(*p).compile(s);
+  return compiled_stmt(std::move(p));
+}
+
+SLINKY_NO_STACK_PROTECTOR index_t evaluate(const compiled_stmt& s, eval_context& context) {
+  const program& p = s.get();
+  context.reserve(p.context_size);
+  index_t* registers = SLINKY_ALLOCA(index_t, p.register_count);
+  executor exec(p, context, registers);
+  return exec.exec(p.code.data(), p.code.data() + p.code.size());
+}
+
+index_t evaluate(const compiled_stmt& s) {
+  eval_context ctx;
+  return evaluate(s, ctx);
+}
+
+std::ostream& operator<<(std::ostream& os, const compiled_stmt& s) {
+  const program& p = s.get();
+  os << "registers: " << p.register_count << ", context: " << p.context_size << std::endl;
+  for (std::size_t i = 0; i < p.code.size(); ++i) {
+    const instruction& in = p.code[i];
+    os << i << ": " << to_string(in.op) << " dst=" << in.dst << " a=" << in.a << " b=" << in.b << " n=" << in.n
+       << " imm=" << in.imm << std::endl;
+  }
+  return os;
+}
+
+compiled_pipeline::compiled_pipeline(pipeline p) : pipeline_(std::move(p)), body_(compile(pipeline_.body)) {}
+
+void compiled_pipeline::setup(scalars args, buffers inputs, buffers outputs, eval_context& ctx) const {
+  ctx.reserve(body_.context_size());
+  pipeline_.setup(args, inputs, outputs, ctx);
+}
+
+void compiled_pipeline::setup(buffers inputs, buffers outputs, eval_context& ctx) const {
+  setup({}, inputs, outputs, ctx);
+}
+
+index_t compiled_pipeline::evaluate(eval_context& ctx) const {
+  if (ctx.config->use_arena && pipeline_.heap_high_water.defined()) {
+    reserve_thread_arena(
+        *ctx.config, slinky::evaluate(pipeline_.heap_high_water, ctx), pipeline_.heap_high_water_allocations);
+  }
+  return slinky::evaluate(body_, ctx);
+}
+
+index_t compiled_pipeline::evaluate(scalars args, buffers inputs, buffers outputs, eval_context& ctx) const {
+  setup(args, inputs, outputs, ctx);
+  return evaluate(ctx);
+}
+
+index_t compiled_pipeline::evaluate(buffers inputs, buffers outputs, eval_context& ctx) const {
+  return evaluate({}, inputs, outputs, ctx);
+}
+
+index_t compiled_pipeline::evaluate(scalars args, buffers inputs, buffers outputs) const {
+  eval_context ctx;
+  return evaluate(args, inputs, outputs, ctx);
+}
+
+index_t compiled_pipeline::evaluate(buffers inputs, buffers outputs) const {
+  eval_context ctx;
+  return evaluate({}, inputs, outputs, ctx);
+}
+
+compiled_pipeline compile(const pipeline& p) { return compiled_pipeline(p); }
+
+}  // namespace slinky
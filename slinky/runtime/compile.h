@@ -0,0 +1,82 @@
+#ifndef SLINKY_RUNTIME_COMPILE_H
+#define SLINKY_RUNTIME_COMPILE_H
+
+#include <iostream>
+#include <memory>
+
+#include "slinky/runtime/evaluate.h"
+#include "slinky/runtime/pipeline.h"
+#include "slinky/runtime/stmt.h"
+
+namespace slinky {
+
+// A `stmt` lowered to a flat, linear bytecode program for a register based evaluator. Compiling a `stmt` resolves the
+// context slots of all symbols up front, folds reads of constant buffer metadata, and replaces the recursive
+// expression evaluation of `evaluate` with straight line register operations. The result should behave identically
+// to `evaluate` of the source `stmt`, which remains the reference implementation.
+class compiled_stmt {
+public:
+  struct program;
+
+private:
+  std::shared_ptr<const program> program_;
+
+public:
+  compiled_stmt() = default;
+  explicit compiled_stmt(std::shared_ptr<const program> p) : program_(std::move(p)) {}
+
+  bool defined() const { return program_ != nullptr; }
+
+  // The `stmt` this program was compiled from.
+  const stmt& source() const;
+
+  // The number of instructions in the program.
+  std::size_t size() const;
+
+  // One more than the largest symbol id used by the program. Contexts used to evaluate the program are grown to this
+  // size once, instead of on demand while evaluating.
+  std::size_t context_size() const;
+
+  const program& get() const { return *program_; }
+};
+
+compiled_stmt compile(const stmt& s);
+
+index_t evaluate(const compiled_stmt& s, eval_context& context);
+index_t evaluate(const compiled_stmt& s);
+
+// Print the instructions of a program, for debugging.
+std::ostream& operator<<(std::ostream& os, const compiled_stmt& s);
+
+// A pipeline with its body compiled to a `compiled_stmt`.
+class compiled_pipeline {
+  pipeline pipeline_;
+  compiled_stmt body_;
+
+public:
+  compiled_pipeline() = default;
+  explicit compiled_pipeline(pipeline p);
+
+  const pipeline& source() const { return pipeline_; }
+  const compiled_stmt& body() const { return body_; }
+
+  using scalars = pipeline::scalars;
+  using buffers = pipeline::buffers;
+
+  // These mirror the corresponding `pipeline` methods.
+  void setup(scalars args, buffers inputs, buffers outputs, eval_context& ctx) const;
+  void setup(buffers inputs, buffers outputs, eval_context& ctx) const;
+
+  index_t evaluate(eval_context& ctx) const;
+
+  index_t evaluate(scalars args, buffers inputs, buffers outputs, eval_context& ctx) const;
+  index_t evaluate(buffers inputs, buffers outputs, eval_context& ctx) const;
+  index_t evaluate(scalars args, buffers inputs, buffers outputs) const;
+  index_t evaluate(buffers inputs, buffers outputs) const;
+};
+
+compiled_pipeline compile(const pipeline& p);
+
+}  // namespace slinky
+
+#endif  // SLINKY_RUNTIME_COMPILE_H
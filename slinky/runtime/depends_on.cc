@@ -1,5 +1,6 @@
 #include "slinky/runtime/depends_on.h"
 
+#include <algorithm>
 #include <cassert>
 
 #include "slinky/base/chrome_trace.h"
@@ -142,6 +143,7 @@ public:
     op->bounds.max.accept(this);
     if (op->step.defined()) op->step.accept(this);
     if (op->max_workers.defined()) op->max_workers.accept(this);
+    if (op->grain.defined()) op->grain.accept(this);
 
     visit_sym_body(op->sym, nullptr, op->body);
   }
@@ -453,4 +455,87 @@ bool has_side_effects(expr_ref x) {
   return checker.has_side_effects;
 }
 
+namespace {
+
+template <typename T>
+void visit_decl(symbol_visitor* v, const T* op) {
+  v->visit_symbol(op->sym);
+  v->recursive_node_visitor::visit(op);
+}
+
+template <typename T>
+void visit_buffer_decl(symbol_visitor* v, const T* op) {
+  v->visit_symbol(op->src);
+  visit_decl(v, op);
+}
+
+}  // namespace
+
+void symbol_visitor::visit(const variable* op) { visit_symbol(op->sym); }
+void symbol_visitor::visit(const let* op) {
+  for (const auto& i : op->lets) {
+    visit_symbol(i.first);
+  }
+  recursive_node_visitor::visit(op);
+}
+void symbol_visitor::visit(const let_stmt* op) {
+  for (const auto& i : op->lets) {
+    visit_symbol(i.first);
+  }
+  recursive_node_visitor::visit(op);
+}
+void symbol_visitor::visit(const loop* op) {
+  visit_symbol(op->sym);
+  recursive_node_visitor::visit(op);
+}
+void symbol_visitor::visit(const call_stmt* op) {
+  for (var i : op->inputs) {
+    visit_symbol(i);
+  }
+  for (var i : op->outputs) {
+    visit_symbol(i);
+  }
+  for (const expr& i : op->scalars) {
+    if (i.defined()) i.accept(this);
+  }
+}
+void symbol_visitor::visit(const copy_stmt* op) {
+  visit_symbol(op->src);
+  visit_symbol(op->dst);
+  visit_symbol(op->pad);
+  for (var i : op->dst_x) {
+    visit_symbol(i);
+  }
+  recursive_node_visitor::visit(op);
+}
+void symbol_visitor::visit(const allocate* op) { visit_decl(this, op); }
+void symbol_visitor::visit(const make_buffer* op) { visit_decl(this, op); }
+void symbol_visitor::visit(const constant_buffer* op) { visit_decl(this, op); }
+void symbol_visitor::visit(const clone_buffer* op) { visit_buffer_decl(this, op); }
+void symbol_visitor::visit(const crop_buffer* op) { visit_buffer_decl(this, op); }
+void symbol_visitor::visit(const crop_dim* op) { visit_buffer_decl(this, op); }
+void symbol_visitor::visit(const slice_buffer* op) { visit_buffer_decl(this, op); }
+void symbol_visitor::visit(const slice_dim* op) { visit_buffer_decl(this, op); }
+void symbol_visitor::visit(const transpose* op) { visit_buffer_decl(this, op); }
+void symbol_visitor::visit(const async* op) { visit_decl(this, op); }
+
+namespace {
+
+class symbol_counter : public symbol_visitor {
+public:
+  std::size_t size = 0;
+
+  void visit_symbol(var sym) override {
+    if (sym.defined()) size = std::max(size, sym.id + 1);
+  }
+};
+
+}  // namespace
+
+std::size_t find_context_size(stmt_ref s) {
+  symbol_counter v;
+  if (s.defined()) s.accept(&v);
+  return v.size;
+}
+
 }  // namespace slinky
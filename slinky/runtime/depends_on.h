@@ -65,6 +65,35 @@ std::vector<var> find_buffer_dependencies(stmt_ref s);
 std::vector<var> find_buffer_dependencies(stmt_ref s, bool input, bool output);
 std::vector<var> find_buffer_dependencies(stmt_ref s, bool input, bool src, bool output, bool dst);
 
+// A visitor that calls `visit_symbol` for every symbol used or declared by the nodes it visits.
+class symbol_visitor : public recursive_node_visitor {
+public:
+  virtual void visit_symbol(var sym) = 0;
+
+  void visit(const variable* op) override;
+  void visit(const let* op) override;
+  void visit(const let_stmt* op) override;
+  void visit(const loop* op) override;
+  void visit(const call_stmt* op) override;
+  void visit(const copy_stmt* op) override;
+  void visit(const allocate* op) override;
+  void visit(const make_buffer* op) override;
+  void visit(const constant_buffer* op) override;
+  void visit(const clone_buffer* op) override;
+  void visit(const crop_buffer* op) override;
+  void visit(const crop_dim* op) override;
+  void visit(const slice_buffer* op) override;
+  void visit(const slice_dim* op) override;
+  void visit(const transpose* op) override;
+  void visit(const async* op) override;
+
+  using recursive_node_visitor::visit;
+};
+
+// Find one more than the largest id of any symbol used or declared by a stmt. This is the size of an `eval_context`
+// big enough to evaluate the stmt.
+std::size_t find_context_size(stmt_ref s);
+
 }  // namespace slinky
 
 #endif  // SLINKY_RUNTIME_DEPENDS_ON_H
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cstddef>
 #include <cstdlib>
 #include <cstring>
@@ -13,9 +14,12 @@
 #include <set>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <utility>
 
+#include "slinky/base/arena.h"
 #include "slinky/base/chrome_trace.h"
+#include "slinky/base/cpu_topology.h"
 #include "slinky/base/thread_pool.h"
 #include "slinky/runtime/buffer.h"
 #include "slinky/runtime/depends_on.h"
@@ -48,6 +52,237 @@ eval_context::eval_context() {
   config = &default_config;
 }
 
+arena& thread_arena() {
+  static thread_local arena a;
+  return a;
+}
+
+namespace {
+
+// The number of bytes we need to add to a heap allocation from the arena to align the base of the buffer.
+std::size_t arena_alignment_padding(const eval_config& config) {
+  return std::max<std::size_t>(config.base_alignment, 1) - 1;
+}
+
+}  // namespace
+
+namespace {
+
+// The address one past the last byte of `buf`. With negative strides or folds, this is not `base + size_bytes()`.
+const char* buffer_end(const raw_buffer& buf) {
+  index_t flat_max = 0;
+  for (std::size_t i = 0; i < buf.rank; ++i) {
+    const dim& d = buf.dim(i);
+    if (d.stride() == 0) continue;
+    const index_t extent = d.fold_factor() > 0 ? d.fold_factor() : d.extent();
+    if (extent <= 0) return nullptr;
+    flat_max += (extent - 1) * std::max<index_t>(0, d.stride());
+  }
+  return reinterpret_cast<const char*>(buf.base) + flat_max + buf.elem_size;
+}
+
+}  // namespace
+
+void reserve_thread_arena(const eval_config& config, std::size_t size, std::size_t allocations) {
+  // The arena also rounds up each allocation to a multiple of `arena::alignment`.
+  thread_arena().reserve(size + allocations * (arena_alignment_padding(config) + arena::alignment - 1));
+}
+
+void* heap_allocate(const eval_config& config, var sym, raw_buffer* buf) {
+  if (config.use_arena) {
+    std::size_t size = buf->init_strides(config.stride_alignment);
+    void* allocation = thread_arena().allocate(size + arena_alignment_padding(config));
+    buf->base = align_up(allocation, std::max<std::size_t>(config.base_alignment, 1));
+    return allocation;
+  } else {
+    void* allocation = config.allocate(sym, buf);
+    if (config.first_touch && allocation) {
+      // The buffer is somewhere in the allocation, which begins at `allocation`.
+      const char* begin = reinterpret_cast<const char*>(allocation);
+      const char* end = buffer_end(*buf);
+      if (end > begin) first_touch(allocation, end - begin);
+    }
+    return allocation;
+  }
+}
+
+void heap_free(const eval_config& config, var sym, raw_buffer* buf, void* allocation) {
+  if (config.use_arena) {
+    thread_arena().free(allocation);
+  } else {
+    config.free(sym, buf, allocation);
+  }
+}
+
+void call_profile::add(const call_profile& other) {
+  calls += other.calls;
+  total_time += other.total_time;
+  max_time = std::max(max_time, other.max_time);
+  elements += other.elements;
+  bytes_read += other.bytes_read;
+  bytes_written += other.bytes_written;
+  for (std::size_t i = 0; i < events.size(); ++i) {
+    events[i] += other.events[i];
+  }
+  events_counted |= other.events_counted;
+}
+
+void allocation_profile::add(const allocation_profile& other) {
+  allocations += other.allocations;
+  bytes += other.bytes;
+  time += other.time;
+}
+
+struct eval_profile::thread_stats {
+  std::thread::id thread;
+  // The counters of events of this thread, if the profile counts them.
+  std::unique_ptr<perf_counters> counters;
+  // We hold a reference to the stmts, so the keys remain valid.
+  std::unordered_map<const call_stmt*, std::pair<stmt, call_profile>> calls;
+  std::unordered_map<const allocate*, std::pair<stmt, allocation_profile>> allocations;
+
+  call_profile& at(const call_stmt* op) {
+    auto& i = calls[op];
+    if (!i.first.defined()) i.first = stmt(op);
+    return i.second;
+  }
+  allocation_profile& at(const allocate* op) {
+    auto& i = allocations[op];
+    if (!i.first.defined()) i.first = stmt(op);
+    return i.second;
+  }
+};
+
+eval_profile::eval_profile(bool count_events) : count_events_(count_events) {}
+eval_profile::~eval_profile() = default;
+
+eval_profile::thread_stats& eval_profile::this_thread() {
+  if (thread_stats* stats = cached_stats_.get()) return *stats;
+
+  const std::thread::id thread = std::this_thread::get_id();
+  std::unique_lock l(mtx_);
+  thread_stats* stats = nullptr;
+  for (const std::unique_ptr<thread_stats>& i : threads_) {
+    if (i->thread == thread) {
+      stats = i.get();
+      break;
+    }
+  }
+  if (!stats) {
+    threads_.push_back(std::make_unique<thread_stats>());
+    stats = threads_.back().get();
+    stats->thread = thread;
+    if (count_events_) stats->counters = std::make_unique<perf_counters>();
+  }
+  cached_stats_.set(stats);
+  return *stats;
+}
+
+call_profile eval_profile::calls(const call_stmt* op) const {
+  std::unique_lock l(mtx_);
+  call_profile result;
+  for (const std::unique_ptr<thread_stats>& i : threads_) {
+    auto c = i->calls.find(op);
+    if (c != i->calls.end()) result.add(c->second.second);
+  }
+  return result;
+}
+
+allocation_profile eval_profile::allocations(const allocate* op) const {
+  std::unique_lock l(mtx_);
+  allocation_profile result;
+  for (const std::unique_ptr<thread_stats>& i : threads_) {
+    auto a = i->allocations.find(op);
+    if (a != i->allocations.end()) result.add(a->second.second);
+  }
+  return result;
+}
+
+std::map<std::string, call_profile> eval_profile::calls() const {
+  std::unique_lock l(mtx_);
+  std::map<std::string, call_profile> result;
+  for (const std::unique_ptr<thread_stats>& i : threads_) {
+    for (const auto& c : i->calls) {
+      result[c.first->attrs.name].add(c.second.second);
+    }
+  }
+  return result;
+}
+
+allocation_profile eval_profile::allocations() const {
+  std::unique_lock l(mtx_);
+  allocation_profile result;
+  for (const std::unique_ptr<thread_stats>& i : threads_) {
+    for (const auto& a : i->allocations) {
+      result.add(a.second.second);
+    }
+  }
+  return result;
+}
+
+void eval_profile::clear() {
+  std::unique_lock l(mtx_);
+  for (const std::unique_ptr<thread_stats>& i : threads_) {
+    i->calls.clear();
+    i->allocations.clear();
+  }
+}
+
+index_t invoke_profiled(const call_stmt* op, eval_context& context) {
+  eval_profile::thread_stats& stats = context.config->profile->this_thread();
+  perf_counters::values events_before;
+  if (stats.counters) events_before = stats.counters->read();
+  auto t0 = std::chrono::steady_clock::now();
+  index_t result = op->target(op, context);
+  std::chrono::nanoseconds t = std::chrono::steady_clock::now() - t0;
+
+  call_profile& profile = stats.at(op);
+  if (stats.counters) {
+    perf_counters::values events_after = stats.counters->read();
+    for (std::size_t i = 0; i < profile.events.size(); ++i) {
+      profile.events[i] += events_after[i] - events_before[i];
+    }
+    profile.events_counted |= stats.counters->counted();
+  }
+  ++profile.calls;
+  profile.total_time += t;
+  profile.max_time = std::max(profile.max_time, t);
+  auto elem_bytes = [](const raw_buffer* buf) { return buf ? buf->elem_count() * buf->elem_size : 0; };
+  if (op->target.target<copy_call>()) {
+    // Copies pass all of their buffers as outputs, the destination is the second.
+    const raw_buffer* dst = context.lookup_buffer(op->outputs[1]);
+    profile.elements += dst ? dst->elem_count() : 0;
+    profile.bytes_read += elem_bytes(dst);
+    profile.bytes_written += elem_bytes(dst);
+  } else {
+    for (var i : op->inputs) {
+      profile.bytes_read += elem_bytes(context.lookup_buffer(i));
+    }
+    for (var i : op->outputs) {
+      const raw_buffer* buf = context.lookup_buffer(i);
+      profile.elements += buf ? buf->elem_count() : 0;
+      profile.bytes_written += elem_bytes(buf);
+    }
+  }
+  return result;
+}
+
+void* heap_allocate_profiled(const eval_config& config, const allocate* op, var sym, raw_buffer* buf) {
+  auto t0 = std::chrono::steady_clock::now();
+  void* allocation = heap_allocate(config, sym, buf);
+  allocation_profile& profile = config.profile->this_thread().at(op);
+  ++profile.allocations;
+  profile.bytes += buf->size_bytes();
+  profile.time += std::chrono::steady_clock::now() - t0;
+  return allocation;
+}
+
+void heap_free_profiled(const eval_config& config, const allocate* op, var sym, raw_buffer* buf, void* allocation) {
+  auto t0 = std::chrono::steady_clock::now();
+  heap_free(config, sym, buf, allocation);
+  config.profile->this_thread().at(op).time += std::chrono::steady_clock::now() - t0;
+}
+
 namespace {
 
 struct allocated_buffer : public raw_buffer {
@@ -69,12 +304,19 @@ SLINKY_INLINE void remove_trailing_broadcasts(raw_buffer& buffer) {
   }
 }
 
+// If `Unchecked` is true, the evaluator assumes the context is already big enough for every symbol it encounters, and
+// never grows it.
+template <bool Unchecked>
 class evaluator {
 public:
   eval_context& context;
 
   evaluator(eval_context& context) : context(context) {}
 
+  SLINKY_INLINE void reserve(std::size_t size) {
+    if (!Unchecked) context.reserve(size);
+  }
+
   // Assume `e` is defined, evaluate it and return the result.
   SLINKY_INLINE index_t eval(const expr& e) {
     // It helps a lot to inline this for common node types, but we don't want to do that for every node everywhere. So
@@ -171,7 +413,7 @@ public:
     for (const auto& let : op->lets) {
       context_size = std::max(context_size, let.first.id);
     }
-    context.reserve(context_size + 1);
+    reserve(context_size + 1);
 
     for (size_t i = 0; i < size; ++i) {
       const auto& let = op->lets[i];
@@ -293,6 +535,10 @@ public:
     assert(op->args.size() == 1);
     var sym = *as_variable(op->args[0]);
     allocated_buffer* buf = reinterpret_cast<allocated_buffer*>(context.lookup(sym));
+    if (context.config->use_arena) {
+      // Allocations from the arena must be freed in order, this allocation will be freed at the end of its scope.
+      return 1;
+    }
     context.config->free(sym, buf, buf->allocation);
     buf->allocation = nullptr;
     return 1;
@@ -356,7 +602,7 @@ public:
   }
 
   SLINKY_INLINE index_t eval_with_value(const stmt& op, var sym, index_t value) {
-    context.reserve(sym.id + 1);
+    reserve(sym.id + 1);
     index_t old_value = context.set(sym, value);
     index_t result = eval(op);
     // context might have grown and invalidated the ctx_value reference.
@@ -393,7 +639,7 @@ public:
     for (const auto& let : op->lets) {
       context_size = std::max(context_size, let.first.id);
     }
-    context.reserve(context_size + 1);
+    reserve(context_size + 1);
 
     for (size_t i = 0; i < size; ++i) {
       const auto& let = op->lets[i];
@@ -445,13 +691,14 @@ public:
     index_t step = eval(op->step, 1);
     assert(step != 0);
     std::size_t n = ceil_div(bounds.max - bounds.min + 1, step);
+    index_t grain = eval(op->grain, 1);
 
     if (n == 0) {
       return 0;
     } else if (n == 1) {
       return eval_with_value(op->body, op->sym, bounds.min);
     } else {
-      context.reserve(op->sym.id + 1);
+      reserve(op->sym.id + 1);
 
       thread_pool* pool = context.config->thread_pool;
       assert(pool);
@@ -483,27 +730,163 @@ public:
 
         context.set(state.sym, i * state.step + state.min);
         // Evaluate the parallel loop body with our copy of the context.
-        index_t result_i = evaluate(state.body, context);
+        index_t result_i = evaluator(context).eval(state.body);
         if (result_i != 0) {
           index_t zero = 0;
           state.result.compare_exchange_strong(zero, result_i);
         }
       };
 
-      pool->parallel_for(n, std::move(task), max_workers);
+      pool->parallel_for(n, std::move(task), max_workers, std::max<index_t>(grain, 1));
 
       return state.result;
     }
   }
 
-  SLINKY_NO_INLINE index_t eval_loop_serial(const loop* op) {
+  // A `crop_dim` with bounds that are the loop variable plus constant offsets, where the body of the crop is a
+  // `call_stmt`. This is what `func::loops` produces for the innermost loops, so it is worth a fast path.
+  struct crop_call {
+    const crop_dim* crop;
+    const call_stmt* call;
+    index_t min_offset;
+    index_t max_offset;
+  };
+
+  static bool is_loop_var_offset(const expr& e, var sym, index_t& offset) {
+    if (is_variable(e, sym)) {
+      offset = 0;
+      return true;
+    } else if (const add* a = e.as<add>()) {
+      std::optional<index_t> c = as_constant(a->b);
+      if (c && is_variable(a->a, sym)) {
+        offset = *c;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static bool as_crop_call(const stmt& s, var sym, crop_call& result) {
+    const crop_dim* crop = s.as<crop_dim>();
+    if (!crop) return false;
+    const call_stmt* call = crop->body.as<call_stmt>();
+    if (!call) return false;
+    if (!is_loop_var_offset(crop->bounds.min, sym, result.min_offset)) return false;
+    if (!is_loop_var_offset(crop->bounds.max, sym, result.max_offset)) return false;
+    result.crop = crop;
+    result.call = call;
+    return true;
+  }
+
+  // Returns the number of `crop_call`s in `body`, or 0 if `body` is not a `crop_call` or a block of them.
+  static std::size_t find_crop_calls(const stmt& body, var sym, crop_call* result) {
+    if (const block* b = body.as<block>()) {
+      for (std::size_t i = 0; i < b->stmts.size(); ++i) {
+        if (!as_crop_call(b->stmts[i], sym, result[i])) return 0;
+      }
+      return b->stmts.size();
+    } else {
+      return as_crop_call(body, sym, *result) ? 1 : 0;
+    }
+  }
+
+  // Evaluate a serial loop over `crop_call`s. Instead of evaluating the crop bounds and saving and restoring the
+  // cropped buffers on every iteration, we make a copy of each cropped buffer once, and compute its base and bounds
+  // from the loop variable directly.
+  SLINKY_NO_STACK_PROTECTOR index_t eval_loop_crop_calls(
+      const loop* op, interval bounds, index_t step, const crop_call* calls, std::size_t n) {
+    struct cropped_buffer {
+      raw_buffer buf;
+      int d;
+      void* src_base;
+      index_t src_min;
+      index_t src_max;
+      index_t stride;
+      bool folded;
+    };
+    cropped_buffer* bufs = SLINKY_ALLOCA(cropped_buffer, n);
+    for (std::size_t i = 0; i < n; ++i) {
+      const crop_dim* crop = calls[i].crop;
+      const raw_buffer* src = reinterpret_cast<const raw_buffer*>(context.lookup(crop->src));
+      assert(src);
+      cropped_buffer& b = bufs[i];
+      b.buf = *src;
+      b.buf.dims = SLINKY_ALLOCA(dim, src->rank);
+      internal::copy_small_n(src->dims, src->rank, b.buf.dims);
+      // Cropping a broadcast dimension is a no-op, we indicate this with a negative dimension.
+      b.d = crop->dim < static_cast<int>(src->rank) ? crop->dim : -1;
+      const slinky::dim& src_dim = src->dim(crop->dim);
+      b.src_base = src->base;
+      b.src_min = src_dim.min();
+      b.src_max = src_dim.max();
+      b.stride = src_dim.stride();
+      b.folded = src_dim.fold_factor() != dim::unfolded;
+      reserve(crop->sym.id + 1);
+    }
+
+    reserve(op->sym.id + 1);
+    index_t old_value = context.set(op->sym, 0);
+    index_t result = 0;
+    for (index_t i = bounds.min; result == 0 && bounds.min <= i && i <= bounds.max; i += step) {
+      context.set(op->sym, i);
+      for (std::size_t j = 0; result == 0 && j < n; ++j) {
+        const crop_call& c = calls[j];
+        cropped_buffer& b = bufs[j];
+        if (b.d >= 0) {
+          // This is `raw_buffer::crop` of the source buffer.
+          index_t min = std::max(i + c.min_offset, b.src_min);
+          index_t max = std::min(i + c.max_offset, b.src_max);
+          if (!b.src_base || max < min) {
+            b.buf.base = nullptr;
+          } else if (b.folded) {
+            b.buf.base = b.src_base;
+          } else {
+            b.buf.base = offset_bytes_non_null(b.src_base, (min - b.src_min) * b.stride);
+          }
+          b.buf.dims[b.d].set_bounds(min, max);
+        }
+
+        index_t old_buf = context.set(c.crop->sym, reinterpret_cast<index_t>(&b.buf));
+        if (!skip_call(c.call)) {
+          result = invoke(c.call);
+        }
+        context.set(c.crop->sym, old_buf);
+        if (result) {
+          call_failed(result, c.call);
+        }
+      }
+    }
+    context.set(op->sym, old_value);
+    return result;
+  }
+
+  SLINKY_NO_INLINE SLINKY_NO_STACK_PROTECTOR index_t eval_loop_serial(const loop* op) {
     interval bounds = eval(op->bounds);
     index_t step = eval(op->step, 1);
     assert(step != 0);
-    // TODO(https://github.com/dsharlet/slinky/issues/3): We don't get a reference to context[op->sym] here
-    // because the context could grow and invalidate the reference. This could be fixed by having evaluate
-    // fully traverse the expression to find the max var, and pre-allocate the context up front. It's
-    // not clear this optimization is necessary yet.
+    if (bounds.max > bounds.min) {
+      const block* b = op->body.as<block>();
+      crop_call* calls = SLINKY_ALLOCA(crop_call, b ? b->stmts.size() : 1);
+      std::size_t n = find_crop_calls(op->body, op->sym, calls);
+      if (n > 0) {
+        return eval_loop_crop_calls(op, bounds, step, calls, n);
+      }
+    }
+    if (Unchecked) {
+      // The context is already big enough for every symbol of the pipeline, so it can't grow, and we can hold a
+      // reference to the loop variable.
+      index_t& value = context.at(op->sym);
+      index_t old_value = value;
+      index_t result = 0;
+      for (index_t i = bounds.min; result == 0 && bounds.min <= i && i <= bounds.max; i += step) {
+        value = i;
+        result = eval(op->body);
+        assert(&value == &context.at(op->sym));
+      }
+      value = old_value;
+      return result;
+    }
+    // We don't get a reference to context[op->sym] here because the context could grow and invalidate the reference.
     context.reserve(op->sym.id + 1);
     index_t old_value = context.set(op->sym, 0);
     index_t result = 0;
@@ -530,7 +913,7 @@ public:
     if (closure) task = closure->body;
     init_context(context, this->context, closure);
 
-    return evaluate(task, context);
+    return evaluator(context).eval(task);
   }
 
   SLINKY_NO_INLINE index_t eval(const async* op) {
@@ -544,7 +927,7 @@ public:
       task_body();
     }
 
-    context.reserve(op->sym.id + 1);
+    reserve(op->sym.id + 1);
     index_t old_sym = 0;
     if (op->sym.defined()) context.set(op->sym, reinterpret_cast<index_t>(&*task));
 
@@ -568,16 +951,47 @@ public:
     }
   }
 
+  // Returns true if `op` asked to be skipped when its outputs are empty, and all of its outputs are empty.
+  bool skip_call(const call_stmt* op) {
+    if (!op->attrs.skip_if_empty || op->outputs.empty()) return false;
+    for (var i : op->outputs) {
+      const raw_buffer* buf = context.lookup_buffer(i);
+      if (buf && !buf->empty()) return false;
+    }
+    return true;
+  }
+
+  SLINKY_INLINE index_t invoke(const call_stmt* op) {
+    if (SLINKY_UNLIKELY(context.config->profile)) return invoke_profiled(op, context);
+    return op->target(op, context);
+  }
+
   SLINKY_INLINE index_t eval(const call_stmt* op) {
-    index_t result = op->target(op, context);
+    if (skip_call(op)) return 0;
+    index_t result = invoke(op);
     if (result) {
       call_failed(result, op);
     }
     return result;
   }
 
+  SLINKY_INLINE void* allocate_heap(const allocate* op, raw_buffer& buffer) {
+    if (SLINKY_UNLIKELY(context.config->profile)) return heap_allocate_profiled(*context.config, op, op->sym, &buffer);
+    return heap_allocate(*context.config, op->sym, &buffer);
+  }
+
+  SLINKY_INLINE void free_heap(const allocate* op, allocated_buffer& buffer) {
+    if (SLINKY_UNLIKELY(context.config->profile)) {
+      heap_free_profiled(*context.config, op, op->sym, &buffer, buffer.allocation);
+    } else {
+      heap_free(*context.config, op->sym, &buffer, buffer.allocation);
+    }
+  }
+
   index_t eval(const copy_stmt* op) {
     SLINKY_UNREACHABLE << "copy_stmt should have been implemented by calls to copy/pad.";
+    // The evaluator is a template, so the compiler doesn't see that this is unreachable.
+    return 0;
   }
 
   // Not using SLINKY_NO_STACK_PROTECTOR here because this actually could allocate a lot of memory on the stack.
@@ -600,7 +1014,7 @@ public:
     remove_trailing_broadcasts(buffer);
 
     if (op->storage == memory_type::heap) {
-      buffer.allocation = context.config->allocate(op->sym, &buffer);
+      buffer.allocation = allocate_heap(op, buffer);
     } else {
       std::size_t size = buffer.init_strides(context.config->stride_alignment);
       if (op->storage == memory_type::stack || size <= context.config->auto_stack_threshold) {
@@ -609,14 +1023,14 @@ public:
         buffer.base = align_up(buffer.base, alignment);
         buffer.allocation = nullptr;
       } else {
-        buffer.allocation = context.config->allocate(op->sym, &buffer);
+        buffer.allocation = allocate_heap(op, buffer);
       }
     }
 
     index_t result = eval_with_value(op->body, op->sym, reinterpret_cast<index_t>(&buffer));
 
     if (buffer.allocation) {
-      context.config->free(op->sym, &buffer, buffer.allocation);
+      free_heap(op, buffer);
     }
 
     return result;
@@ -878,12 +1292,17 @@ public:
 }  // namespace
 
 index_t evaluate(const expr& e, eval_context& context) {
-  evaluator eval(context);
+  evaluator<false> eval(context);
   return eval.eval(e);
 }
 
 index_t evaluate(const stmt& s, eval_context& context) {
-  evaluator eval(context);
+  evaluator<false> eval(context);
+  return eval.eval(s);
+}
+
+index_t evaluate_unchecked(const stmt& s, eval_context& context) {
+  evaluator<true> eval(context);
   return eval.eval(s);
 }
 
@@ -897,4 +1316,21 @@ index_t evaluate(const stmt& s) {
   return evaluate(s, ctx);
 }
 
+index_t copy_call::operator()(const call_stmt* op, const eval_context& ctx) const {
+  // TODO: This passes the src buffer as an output, not an input, because slinky thinks the bounds of inputs
+  // don't matter. But in this case, they do...
+  const raw_buffer* src_buf = ctx.lookup_buffer(op->outputs[0]);
+  const raw_buffer* dst_buf = ctx.lookup_buffer(op->outputs[1]);
+  const raw_buffer* pad_buf = op->outputs[2].defined() ? ctx.lookup_buffer(op->outputs[2]) : &no_padding;
+  assert(src_buf);
+  assert(dst_buf);
+  assert(pad_buf);
+  if (impl) {
+    impl(*src_buf, *dst_buf, *pad_buf);
+  } else {
+    copy_with_pool(ctx.config->thread_pool, *src_buf, *dst_buf, *pad_buf);
+  }
+  return 0;
+}
+
 }  // namespace slinky
@@ -1,15 +1,93 @@
 #ifndef SLINKY_RUNTIME_EVALUATE_H
 #define SLINKY_RUNTIME_EVALUATE_H
 
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
 #include "slinky/base/allocator.h"
+#include "slinky/base/perf_counters.h"
+#include "slinky/base/thread_cache.h"
 #include "slinky/base/util.h"
 #include "slinky/runtime/expr.h"
 #include "slinky/runtime/stmt.h"
 
 namespace slinky {
 
+class arena;
 class thread_pool;
 
+// Statistics of the calls to a `call_stmt`, or to all `call_stmt`s with the same name.
+struct call_profile {
+  std::size_t calls = 0;
+  // The total and the longest wall time of the calls.
+  std::chrono::nanoseconds total_time{0};
+  std::chrono::nanoseconds max_time{0};
+  // The number of elements of the output buffers of the calls.
+  std::size_t elements = 0;
+  // The number of bytes of the input and output buffers of the calls. For copies (calls to a `copy_call`), these are
+  // the bytes of the destination buffer.
+  std::size_t bytes_read = 0;
+  std::size_t bytes_written = 0;
+  // The number of each `perf_event` counted during the calls, if the profile counts them. `events_counted` is a bit
+  // mask of the events that were counted (see `perf_counters::counted`).
+  perf_counters::values events{};
+  std::uint32_t events_counted = 0;
+
+  void add(const call_profile& other);
+};
+
+// Statistics of the heap allocations made by an `allocate`, or by all of them.
+struct allocation_profile {
+  std::size_t allocations = 0;
+  std::size_t bytes = 0;
+  // The time spent in allocating and freeing the memory.
+  std::chrono::nanoseconds time{0};
+
+  void add(const allocation_profile& other);
+};
+
+// Aggregated statistics of the pipelines evaluated with this profile as `eval_config::profile`. The statistics are
+// accumulated by each thread separately, and merged when they are read. They must not be read while a pipeline using
+// this profile is being evaluated.
+class eval_profile {
+public:
+  struct thread_stats;
+
+private:
+  mutable std::mutex mtx_;
+  std::vector<std::unique_ptr<thread_stats>> threads_;
+  thread_cache<thread_stats> cached_stats_;
+  bool count_events_;
+
+public:
+  // If `count_events` is true, hardware events (such as cache misses) are counted during each call with
+  // `perf_counters`. This adds the overhead of two system calls to each call.
+  explicit eval_profile(bool count_events = false);
+  ~eval_profile();
+
+  eval_profile(const eval_profile&) = delete;
+  eval_profile& operator=(const eval_profile&) = delete;
+
+  // The statistics of the calling thread, used by the evaluator to record statistics.
+  thread_stats& this_thread();
+
+  // The statistics of `op`.
+  call_profile calls(const call_stmt* op) const;
+  allocation_profile allocations(const allocate* op) const;
+
+  // The statistics of all calls, keyed by `call_stmt::attributes::name`. `copy_stmt`s are implemented by calls named
+  // "copy(<dst>)", where <dst> is the name of the destination buffer.
+  std::map<std::string, call_profile> calls() const;
+  // The statistics of all heap allocations.
+  allocation_profile allocations() const;
+
+  void clear();
+};
+
 struct eval_config {
   // These two functions implement allocation. `allocate` is called before
   // running the body, and should assign `base` of the buffer to the address
@@ -41,6 +119,23 @@ struct eval_config {
 
   // Allocations with storage `memory_type::automatic` not bigger than this size (bytes) will be placed on the stack.
   std::size_t auto_stack_threshold = 4 * 1024;
+
+  // If true, heap allocations are made from an arena owned by the calling thread (see `thread_arena`) instead of
+  // calling `allocate` and `free`. The memory of the arena is kept after evaluation, so it is reused by later
+  // evaluations, and a pipeline evaluated repeatedly does not call the system allocator in the steady state. The arena
+  // keeps enough memory for the biggest evaluation made by the thread so far. Calls to the `free` intrinsic do not
+  // release memory early when using the arena.
+  bool use_arena = false;
+
+  // If true, the pages of heap allocations made by `allocate` are placed on the NUMA node of the thread making the
+  // allocation (see `first_touch`), before the producer of the buffer runs. Allocations inside a parallel loop are made
+  // by the worker running that iteration, which is also the worker that produces the buffer. This is most useful with
+  // a thread pool with workers pinned to NUMA nodes. `allocate` must return the address of the beginning of the memory
+  // of the buffer (as the default `allocate` does).
+  bool first_touch = false;
+
+  // If not null, statistics of the calls and heap allocations made by the pipeline are accumulated in this profile.
+  eval_profile* profile = nullptr;
 };
 
 class eval_context {
@@ -60,6 +155,11 @@ public:
     reserve(id.id + 1);
     return values_[id.id];
   }
+  // Unlike `operator[]`, this does not grow the context, so the reference remains valid until the context is grown.
+  index_t& at(var id) {
+    assert(id.id < values_.size());
+    return values_[id.id];
+  }
   index_t operator[](var id) const { return values_[id.id]; }
 
   // This is always inlined to avoid msan false positives if the value hasn't been set already yet.
@@ -91,6 +191,37 @@ index_t evaluate(const stmt& s, eval_context& context);
 index_t evaluate(const expr& e);
 index_t evaluate(const stmt& s);
 
+// Evaluate `s` assuming that `context` is already big enough to hold every symbol used by `s` (see
+// `find_context_size`), so the context is never grown during evaluation. This also applies to any accesses to the
+// context by callbacks.
+index_t evaluate_unchecked(const stmt& s, eval_context& context);
+
+// The target of the `call_stmt`s that implement copies in pipelines built by `build_pipeline` (see `implement_copy`).
+// The outputs of the call are the src, dst, and (optional) pad buffers of the copy, which are passed to `impl`. If
+// `impl` is empty, this calls `copy_with_pool` with the thread pool of the `eval_config`.
+struct copy_call {
+  copy_stmt::callable impl;
+
+  index_t operator()(const call_stmt* op, const eval_context& ctx) const;
+};
+
+// The arena used for heap allocations made by the calling thread when `eval_config::use_arena` is true.
+arena& thread_arena();
+
+// Make sure the arena of the calling thread can satisfy `allocations` heap allocations (made by `heap_allocate`)
+// totalling `size` bytes, without calling the system allocator.
+void reserve_thread_arena(const eval_config& config, std::size_t size, std::size_t allocations);
+
+// Allocate or free the memory for a buffer with storage on the heap, as specified by `config`.
+void* heap_allocate(const eval_config& config, var sym, raw_buffer* buf);
+void heap_free(const eval_config& config, var sym, raw_buffer* buf, void* allocation);
+
+// Implementations of calls and heap allocations that record statistics of them in `eval_config::profile`, which must
+// not be null.
+index_t invoke_profiled(const call_stmt* op, eval_context& context);
+void* heap_allocate_profiled(const eval_config& config, const allocate* op, var sym, raw_buffer* buf);
+void heap_free_profiled(const eval_config& config, const allocate* op, var sym, raw_buffer* buf, void* allocation);
+
 }  // namespace slinky
 
 #endif  // SLINKY_RUNTIME_EVALUATE_H
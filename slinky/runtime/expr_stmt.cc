@@ -518,13 +518,14 @@ stmt block::make(std::vector<stmt> stmts, stmt tail_stmt) {
   return make(std::move(stmts));
 }
 
-stmt loop::make(var sym, expr max_workers, interval_expr bounds, expr step, stmt body) {
+stmt loop::make(var sym, expr max_workers, interval_expr bounds, expr step, stmt body, expr grain) {
   auto l = new loop();
   l->sym = sym;
   l->max_workers = std::move(max_workers);
   l->bounds = std::move(bounds);
   l->step = std::move(step);
   l->body = std::move(body);
+  l->grain = std::move(grain);
   return stmt(l);
 }
 
@@ -893,6 +894,7 @@ void recursive_node_visitor::visit(const loop* op) {
   op->bounds.max.accept(this);
   if (op->step.defined()) op->step.accept(this);
   if (op->max_workers.defined()) op->max_workers.accept(this);
+  if (op->grain.defined()) op->grain.accept(this);
   if (op->body.defined()) op->body.accept(this);
 }
 void recursive_node_visitor::visit(const call_stmt* op) {}
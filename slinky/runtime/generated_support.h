@@ -0,0 +1,329 @@
+#ifndef SLINKY_RUNTIME_GENERATED_SUPPORT_H
+#define SLINKY_RUNTIME_GENERATED_SUPPORT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <initializer_list>
+#include <iostream>
+#include <memory>
+
+#include "slinky/base/arena.h"
+#include "slinky/base/thread_pool.h"
+#include "slinky/base/util.h"
+#include "slinky/runtime/buffer.h"
+#include "slinky/runtime/evaluate.h"
+#include "slinky/runtime/expr.h"
+#include "slinky/runtime/print.h"
+#include "slinky/runtime/stmt.h"
+
+// Helpers used by the source code produced by `generate_pipeline_source`. These implement the same semantics as the
+// corresponding parts of `evaluate`.
+namespace slinky {
+namespace generated {
+
+// Symbols are stored as `index_t` in the generated code, as in `eval_context`.
+SLINKY_INLINE raw_buffer* buf(index_t x) { return reinterpret_cast<raw_buffer*>(x); }
+template <typename T>
+SLINKY_INLINE index_t value(T* x) {
+  return reinterpret_cast<index_t>(x);
+}
+
+// Buffer fields, as in `variable` expressions.
+SLINKY_INLINE index_t buffer_rank(index_t x) { return buf(x)->rank; }
+SLINKY_INLINE index_t buffer_elem_size(index_t x) { return buf(x)->elem_size; }
+SLINKY_INLINE index_t buffer_size_bytes(index_t x) { return buf(x)->size_bytes(); }
+SLINKY_INLINE index_t buffer_min(index_t x, int d) { return buf(x)->dim(d).min(); }
+SLINKY_INLINE index_t buffer_max(index_t x, int d) { return buf(x)->dim(d).max(); }
+SLINKY_INLINE index_t buffer_stride(index_t x, int d) { return buf(x)->dim(d).stride(); }
+SLINKY_INLINE index_t buffer_fold_factor(index_t x, int d) { return buf(x)->dim(d).fold_factor(); }
+
+// Makes a buffer for the constant data of `constant_buffer` nodes.
+inline raw_buffer make_raw_buffer(void* base, std::size_t elem_size, std::size_t rank, slinky::dim* dims) {
+  raw_buffer result;
+  result.base = base;
+  result.elem_size = elem_size;
+  result.rank = rank;
+  result.dims = dims;
+  return result;
+}
+
+// A buffer with storage for its dims. Buffers are referred to by address, so these can't be copied or moved.
+class local_buffer : public raw_buffer {
+  static constexpr std::size_t small_rank = 8;
+  slinky::dim small_dims_[small_rank];
+  std::unique_ptr<slinky::dim[]> large_dims_;
+
+public:
+  explicit local_buffer(std::size_t rank) {
+    base = nullptr;
+    elem_size = 0;
+    this->rank = rank;
+    if (rank <= small_rank) {
+      dims = small_dims_;
+    } else {
+      large_dims_.reset(new slinky::dim[rank]);
+      dims = large_dims_.get();
+    }
+  }
+  local_buffer(const local_buffer&) = delete;
+  local_buffer& operator=(const local_buffer&) = delete;
+
+  // Make a copy of `src`, including its dims.
+  explicit local_buffer(const raw_buffer& src) : local_buffer(src.rank) {
+    base = src.base;
+    elem_size = src.elem_size;
+    internal::copy_small_n(src.dims, src.rank, dims);
+  }
+
+  void remove_trailing_broadcasts() {
+    while (rank > 0 && dims[rank - 1].is_broadcast()) {
+      --rank;
+    }
+  }
+};
+
+// A buffer with memory allocated by `allocate` nodes, which is freed when the buffer is destroyed.
+class allocated_buffer : public local_buffer {
+  const eval_config* config_ = nullptr;
+  var sym_;
+  void* allocation_ = nullptr;
+
+public:
+  using local_buffer::local_buffer;
+
+  ~allocated_buffer() { free(); }
+
+  void allocate_heap(const eval_config& config, var sym) {
+    config_ = &config;
+    sym_ = sym;
+    allocation_ = heap_allocate(config, sym, this);
+  }
+
+  // Returns the number of bytes of stack memory to allocate for this buffer, or 0 if it was allocated on the heap
+  // instead.
+  std::size_t init_stack(const eval_config& config, var sym, memory_type storage) {
+    std::size_t size = init_strides(config.stride_alignment);
+    if (storage == memory_type::stack || size <= config.auto_stack_threshold) {
+      return size + config.base_alignment;
+    } else {
+      allocate_heap(config, sym);
+      return 0;
+    }
+  }
+  void set_stack(const eval_config& config, void* memory) { base = align_up(memory, config.base_alignment); }
+
+  // Implements the `free` intrinsic.
+  void free() {
+    if (allocation_) {
+      heap_free(*config_, sym_, this, allocation_);
+      allocation_ = nullptr;
+    }
+  }
+  void free_early() {
+    // Allocations from the arena must be freed in order, this allocation will be freed when it is destroyed.
+    if (!config_ || !config_->use_arena) free();
+  }
+};
+
+// Restores the base and the bounds of the first `N` dims of a buffer cropped in place when destroyed.
+template <std::size_t N>
+class crop_guard {
+  raw_buffer* buf_;
+  void* base_;
+  slinky::dim dims_[N];
+
+public:
+  explicit crop_guard(raw_buffer* buf) : buf_(buf), base_(buf->base) {
+    for (std::size_t d = 0; d < N && d < buf->rank; ++d) {
+      dims_[d] = buf->dims[d];
+    }
+  }
+  crop_guard(const crop_guard&) = delete;
+  crop_guard& operator=(const crop_guard&) = delete;
+  ~crop_guard() {
+    buf_->base = base_;
+    for (std::size_t d = 0; d < N && d < buf_->rank; ++d) {
+      buf_->dims[d].set_bounds(dims_[d].min(), dims_[d].max());
+    }
+  }
+};
+
+// Restores the base and the bounds of dimension `d` of a buffer cropped in place when destroyed.
+class crop_dim_guard {
+  raw_buffer* buf_;
+  void* base_;
+  std::size_t d_;
+  index_t min_, max_;
+
+public:
+  crop_dim_guard(raw_buffer* buf, std::size_t d)
+      : buf_(buf), base_(buf->base), d_(d), min_(buf->dim(d).min()), max_(buf->dim(d).max()) {}
+  crop_dim_guard(const crop_dim_guard&) = delete;
+  crop_dim_guard& operator=(const crop_dim_guard&) = delete;
+  ~crop_dim_guard() {
+    buf_->base = base_;
+    if (d_ < buf_->rank) buf_->dims[d_].set_bounds(min_, max_);
+  }
+};
+
+// Crops dimension `d` of `buf`, which is a no-op for broadcast dimensions.
+SLINKY_INLINE void crop(raw_buffer* buf, std::size_t d, index_t min, index_t max) {
+  if (d < buf->rank) buf->crop(d, min, max);
+}
+
+// Restores the rank of a buffer truncated in place when destroyed.
+class rank_guard {
+  raw_buffer* buf_;
+  std::size_t rank_;
+
+public:
+  rank_guard(raw_buffer* buf, std::size_t rank) : buf_(buf), rank_(buf->rank) { buf->rank = rank; }
+  rank_guard(const rank_guard&) = delete;
+  rank_guard& operator=(const rank_guard&) = delete;
+  ~rank_guard() { buf_->rank = rank_; }
+};
+
+SLINKY_INLINE void* at(void* base, const raw_buffer* buf, std::size_t d, index_t x) {
+  return base && buf->dim(d).contains(x) ? offset_bytes_non_null(base, buf->dim(d).flat_offset_bytes(x)) : nullptr;
+}
+
+// Implements `slice_dim`. `result` must have a rank of at least the rank of `src`.
+inline void slice_dim(local_buffer& result, const raw_buffer& src, std::size_t d, index_t x) {
+  result.elem_size = src.elem_size;
+  if (d >= src.rank) {
+    // Slicing a broadcast dimension is a no-op.
+    result.base = src.base;
+    result.rank = src.rank;
+    internal::copy_small_n(src.dims, src.rank, result.dims);
+    return;
+  }
+  result.base = at(src.base, &src, d, x);
+  result.rank = src.rank - 1;
+  for (std::size_t i = 0; i < d; ++i) {
+    result.dims[i] = src.dims[i];
+  }
+  for (std::size_t i = d; i < result.rank; ++i) {
+    result.dims[i] = src.dims[i + 1];
+  }
+}
+
+// Implements `slice_buffer`, after the base of `result` has been offset to the sliced coordinates. Bit `d` of `sliced`
+// indicates dimension `d` is sliced. `result` must have a rank of at least the rank of `src`.
+inline void slice_dims(local_buffer& result, const raw_buffer& src, std::uint64_t sliced) {
+  result.elem_size = src.elem_size;
+  result.rank = 0;
+  for (std::size_t d = 0; d < src.rank; ++d) {
+    if (d >= 64 || !(sliced & (std::uint64_t{1} << d))) {
+      result.dims[result.rank++] = src.dims[d];
+    }
+  }
+}
+
+inline index_t semaphore_init(const eval_context& ctx, index_t sem, index_t count) {
+  index_t* s = reinterpret_cast<index_t*>(sem);
+  ctx.config->thread_pool->atomic_call([=]() { *s = count; });
+  return 1;
+}
+
+// `sems` is a list of (semaphore, count) pairs.
+inline index_t semaphore_signal(const eval_context& ctx, std::initializer_list<index_t> sems) {
+  ctx.config->thread_pool->atomic_call([=]() {
+    for (const index_t* i = sems.begin(); i != sems.end(); i += 2) {
+      *reinterpret_cast<index_t*>(i[0]) += i[1];
+    }
+  });
+  return 1;
+}
+
+inline index_t semaphore_wait(const eval_context& ctx, std::initializer_list<index_t> sems) {
+  ctx.config->thread_pool->wait_for([=]() {
+    // Check we can acquire all of the semaphores before acquiring any of them.
+    for (const index_t* i = sems.begin(); i != sems.end(); i += 2) {
+      if (*reinterpret_cast<index_t*>(i[0]) < i[1]) return false;
+    }
+    for (const index_t* i = sems.begin(); i != sems.end(); i += 2) {
+      *reinterpret_cast<index_t*>(i[0]) -= i[1];
+    }
+    return true;
+  });
+  return 1;
+}
+
+inline index_t wait_for(const eval_context& ctx, std::initializer_list<index_t> tasks) {
+  for (index_t i : tasks) {
+    thread_pool::task* t = reinterpret_cast<thread_pool::task*>(i);
+    if (t) ctx.config->thread_pool->wait_for(t);
+  }
+  return tasks.size();
+}
+
+inline index_t trace_begin(const eval_context& ctx, index_t name) {
+  return ctx.config->trace_begin ? ctx.config->trace_begin(reinterpret_cast<const char*>(name)) : 0;
+}
+
+inline index_t trace_end(const eval_context& ctx, index_t token) {
+  if (ctx.config->trace_end) ctx.config->trace_end(token);
+  return 1;
+}
+
+inline index_t free(index_t buffer) {
+  reinterpret_cast<allocated_buffer*>(buffer)->free_early();
+  return 1;
+}
+
+// Make a context for evaluating a parallel loop body or an async task, which is needed to call callbacks.
+inline void init_context(eval_context& ctx, const eval_context& parent, std::size_t size) {
+  if (ctx.size() == 0) {
+    ctx.config = parent.config;
+    ctx.reserve(size);
+  }
+}
+
+SLINKY_NO_INLINE inline index_t check_failed(const eval_context& ctx, const expr& condition) {
+  if (ctx.config->check_failed) {
+    ctx.config->check_failed(condition);
+  } else {
+    std::cerr << "Check failed: " << condition << std::endl;
+    std::abort();
+  }
+  return 1;
+}
+
+SLINKY_NO_INLINE inline index_t call_failed(const eval_context& ctx, const call_stmt* op, index_t result) {
+  if (ctx.config->call_failed) {
+    ctx.config->call_failed(op);
+  } else {
+    std::cerr << "call_stmt failed: " << stmt(op) << "->" << result << std::endl;
+    std::abort();
+  }
+  return result;
+}
+
+// Returns true if all of the outputs of `op` are empty, for calls with `call_stmt::attributes::skip_if_empty`.
+inline bool outputs_empty(const eval_context& ctx, const call_stmt* op) {
+  for (var i : op->outputs) {
+    const raw_buffer* buf = ctx.lookup_buffer(i);
+    if (buf && !buf->empty()) return false;
+  }
+  return true;
+}
+
+// Implements the copies of pipelines built by `build_pipeline`, as `copy_call` does with the default implementation.
+inline void copy(const eval_context& ctx, const raw_buffer* src, const raw_buffer* dst, const raw_buffer* pad) {
+  copy_with_pool(ctx.config->thread_pool, *src, *dst, *pad);
+}
+
+// Record the first non-zero result of the iterations of a parallel loop.
+inline void set_result(std::atomic<index_t>& result, index_t value) {
+  if (value != 0) {
+    index_t zero = 0;
+    result.compare_exchange_strong(zero, value);
+  }
+}
+
+}  // namespace generated
+}  // namespace slinky
+
+#endif  // SLINKY_RUNTIME_GENERATED_SUPPORT_H
@@ -12,6 +12,8 @@ void pipeline::setup(scalars args, buffers inputs, buffers outputs, eval_context
   assert(inputs.size() == this->inputs.size());
   assert(outputs.size() == this->outputs.size());
 
+  ctx.reserve(context_size);
+
   for (std::size_t i = 0; i < args.size(); ++i) {
     ctx[this->args[i]] = args[i];
   }
@@ -25,16 +27,26 @@ void pipeline::setup(scalars args, buffers inputs, buffers outputs, eval_context
 
 void pipeline::setup(buffers inputs, buffers outputs, eval_context& ctx) const { setup({}, inputs, outputs, ctx); }
 
-index_t pipeline::evaluate(eval_context& ctx) const { return slinky::evaluate(body, ctx); }
+index_t pipeline::evaluate(eval_context& ctx) const {
+  if (ctx.config->use_arena && heap_high_water.defined()) {
+    reserve_thread_arena(*ctx.config, slinky::evaluate(heap_high_water, ctx), heap_high_water_allocations);
+  }
+  if (context_size > 0) {
+    ctx.reserve(context_size);
+    return slinky::evaluate_unchecked(body, ctx);
+  } else {
+    return slinky::evaluate(body, ctx);
+  }
+}
 
 index_t pipeline::evaluate(scalars args, buffers inputs, buffers outputs, eval_context& ctx) const {
   setup(args, inputs, outputs, ctx);
-  return slinky::evaluate(body, ctx);
+  return evaluate(ctx);
 }
 
 index_t pipeline::evaluate(buffers inputs, buffers outputs, eval_context& ctx) const {
   setup(inputs, outputs, ctx);
-  return slinky::evaluate(body, ctx);
+  return evaluate(ctx);
 }
 
 index_t pipeline::evaluate(scalars args, buffers inputs, buffers outputs) const {
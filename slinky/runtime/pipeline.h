@@ -1,6 +1,7 @@
 #ifndef SLINKY_RUNTIME_PIPELINE_H
 #define SLINKY_RUNTIME_PIPELINE_H
 
+#include <cstddef>
 #include <vector>
 
 #include "slinky/runtime/expr.h"
@@ -19,6 +20,19 @@ public:
 
   stmt body;
 
+  // One more than the largest symbol id used by the pipeline, if known (otherwise 0). If this is known, `setup` sizes
+  // the context once, and `evaluate` evaluates the body without checking the context size (see `evaluate_unchecked`).
+  std::size_t context_size = 0;
+
+  // An upper bound on the number of bytes of heap memory needed at once by one thread evaluating the pipeline, in
+  // terms of the arguments, inputs, and outputs, if known. When evaluating with `eval_config::use_arena`, the arena of
+  // the calling thread is reserved to this size before evaluating the body (see `reserve_thread_arena`). This is only
+  // found if the pipeline is built with `build_options::heap_high_water`.
+  expr heap_high_water;
+  // An upper bound on the number of heap allocations live at once, used to account for the alignment padding of each
+  // allocation when reserving the arena.
+  std::size_t heap_high_water_allocations = 0;
+
   using scalars = span<const index_t>;
   using buffers = span<const raw_buffer*>;
 
@@ -1,10 +1,12 @@
 #include "slinky/runtime/print.h"
 
 #include <cassert>
+#include <chrono>
 #include <sstream>
 #include <string>
 #include <iomanip>
 
+#include "slinky/runtime/evaluate.h"
 #include "slinky/runtime/expr.h"
 #include "slinky/runtime/stmt.h"
 
@@ -132,6 +134,7 @@ public:
   int depth = -1;
   std::ostream& os;
   const node_context* context;
+  const eval_profile* profile = nullptr;
 
   printer(std::ostream& os, const node_context* context) : os(os), context(context) {}
 
@@ -317,6 +320,9 @@ public:
     if (l->step.defined()) {
       *this << ", " << l->step;
     }
+    if (l->grain.defined()) {
+      *this << ", grain=" << l->grain;
+    }
     *this << ") {";
     *this << l->body;
     *this << indent() << "}";
@@ -344,6 +350,12 @@ public:
       *this << "<null target>";
     }
     *this << ", {" << n->inputs << "}, {" << n->outputs << "}, {" << n->scalars << "})";
+    if (profile) {
+      call_profile p = profile->calls(n);
+      if (p.calls > 0) {
+        *this << "  // " << p;
+      }
+    }
   }
 
   void visit(const copy_stmt* n) override {
@@ -362,6 +374,12 @@ public:
       *this << "" << indent();
     }
     *this << "}) {";
+    if (profile) {
+      allocation_profile p = profile->allocations(n);
+      if (p.allocations > 0) {
+        *this << "  // " << p;
+      }
+    }
     *this << n->body;
     *this << indent() << "}";
   }
@@ -481,6 +499,12 @@ void print(std::ostream& os, const stmt& s, const node_context* ctx) {
   p << s;
 }
 
+void print(std::ostream& os, const stmt& s, const eval_profile& profile, const node_context* ctx) {
+  printer p(os, ctx ? ctx : default_context);
+  p.profile = &profile;
+  p << s;
+}
+
 std::string to_string(var x) {
   std::stringstream ss;
   printer p(ss, default_context);
@@ -537,4 +561,26 @@ std::ostream& operator<<(std::ostream& os, const dim& d) {
   return os;
 }
 
+namespace {
+
+double to_us(std::chrono::nanoseconds t) { return std::chrono::duration<double, std::micro>(t).count(); }
+
+}  // namespace
+
+std::ostream& operator<<(std::ostream& os, const call_profile& p) {
+  os << "calls=" << p.calls << ", time=" << to_us(p.total_time) << "us, max_time=" << to_us(p.max_time)
+     << "us, elements=" << p.elements << ", bytes_read=" << p.bytes_read << ", bytes_written=" << p.bytes_written;
+  for (std::size_t i = 0; i < p.events.size(); ++i) {
+    if (p.events_counted & (1u << i)) {
+      os << ", " << to_string(static_cast<perf_event>(i)) << "=" << p.events[i];
+    }
+  }
+  return os;
+}
+
+std::ostream& operator<<(std::ostream& os, const allocation_profile& p) {
+  os << "allocations=" << p.allocations << ", bytes=" << p.bytes << ", time=" << to_us(p.time) << "us";
+  return os;
+}
+
 }  // namespace slinky
@@ -10,9 +10,15 @@
 
 namespace slinky {
 
+class eval_profile;
+struct call_profile;
+struct allocation_profile;
+
 void print(std::ostream& os, var x, const node_context* ctx = nullptr);
 void print(std::ostream& os, const expr& e, const node_context* ctx = nullptr);
 void print(std::ostream& os, const stmt& s, const node_context* ctx = nullptr);
+// Print `s`, with the statistics in `profile` of each `call_stmt` and `allocate` in a comment next to it.
+void print(std::ostream& os, const stmt& s, const eval_profile& profile, const node_context* ctx = nullptr);
 
 std::ostream& operator<<(std::ostream& os, const expr& e);
 std::ostream& operator<<(std::ostream& os, const stmt& s);
@@ -37,6 +43,8 @@ std::ostream& operator<<(std::ostream& os, const modulus_remainder<T>& i) {
 
 std::ostream& operator<<(std::ostream& os, const raw_buffer& buf);
 std::ostream& operator<<(std::ostream& os, const dim& d);
+std::ostream& operator<<(std::ostream& os, const call_profile& p);
+std::ostream& operator<<(std::ostream& os, const allocation_profile& p);
 
 // It's not legal to overload std::to_string(), or anything else in std;
 // intended usage here is to do `using std::to_string;` followed by naked
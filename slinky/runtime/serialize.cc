@@ -0,0 +1,686 @@
+#include "slinky/runtime/serialize.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "slinky/base/span.h"
+#include "slinky/runtime/buffer.h"
+#include "slinky/runtime/evaluate.h"
+#include "slinky/runtime/expr.h"
+#include "slinky/runtime/pipeline.h"
+#include "slinky/runtime/stmt.h"
+
+namespace slinky {
+
+namespace {
+
+const char magic[4] = {'S', 'L', 'N', 'K'};
+
+// The data is a stream that must be decoded in order, rather than a zero-copy layout: deserializing needs to make
+// ref-counted expr and stmt nodes anyways, so the data can't be used in place. Most of the values (node types, symbols,
+// small constants) fit in one byte as a varint, which makes the data several times smaller than fixed size fields, and
+// independent of the byte order of the machine.
+//
+// Integers are stored as LEB128 varints, signed integers are zigzag encoded first. Symbols are stored as their id
+// plus one, so undefined symbols are 0. Exprs and stmts are stored as their node type, followed by their fields in
+// declaration order. Undefined exprs and stmts are stored as the node type `none`.
+class serializer : public expr_visitor, public stmt_visitor {
+  std::vector<char>& out;
+
+public:
+  // Set to false if we find something we can't serialize.
+  bool ok = true;
+
+  serializer(std::vector<char>& out) : out(out) {}
+
+  void write(std::uint64_t x) {
+    while (x >= 0x80) {
+      out.push_back(static_cast<char>((x & 0x7f) | 0x80));
+      x >>= 7;
+    }
+    out.push_back(static_cast<char>(x));
+  }
+  void write_signed(std::int64_t x) {
+    write((static_cast<std::uint64_t>(x) << 1) ^ static_cast<std::uint64_t>(x >> 63));
+  }
+  void write(const void* data, std::size_t size) {
+    const char* begin = reinterpret_cast<const char*>(data);
+    out.insert(out.end(), begin, begin + size);
+  }
+  void write(const std::string& s) {
+    write(s.size());
+    write(s.data(), s.size());
+  }
+  void write(var v) { write(static_cast<std::uint64_t>(v.id + 1)); }
+  void write(const expr& e) {
+    if (e.defined()) {
+      e.accept(this);
+    } else {
+      write(static_cast<std::uint64_t>(expr_node_type::none));
+    }
+  }
+  void write(const interval_expr& i) {
+    write(i.min);
+    write(i.max);
+  }
+  void write(const dim_expr& d) {
+    write(d.bounds);
+    write(d.stride);
+    write(d.fold_factor);
+  }
+  void write(const stmt& s) {
+    if (s.defined()) {
+      s.accept(this);
+    } else {
+      write(static_cast<std::uint64_t>(stmt_node_type::none));
+    }
+  }
+  template <typename T>
+  void write(const std::vector<T>& v) {
+    write(v.size());
+    for (const T& i : v) {
+      write(i);
+    }
+  }
+  void write(const std::vector<int>& v) {
+    write(v.size());
+    for (int i : v) {
+      write_signed(i);
+    }
+  }
+  template <typename T>
+  void write(const std::vector<std::pair<var, T>>& lets) {
+    write(lets.size());
+    for (const auto& i : lets) {
+      write(i.first);
+      write(i.second);
+    }
+  }
+  void write(const raw_buffer& buf) {
+    write(buf.elem_size);
+    write(buf.rank);
+    for (std::size_t d = 0; d < buf.rank; ++d) {
+      write_signed(buf.dim(d).min());
+      write_signed(buf.dim(d).max());
+      write_signed(buf.dim(d).stride());
+      write_signed(buf.dim(d).fold_factor());
+    }
+    // Store the contents densely, so the data doesn't depend on the strides or padding of the buffer.
+    std::vector<dim> dense_dims(buf.dims, buf.dims + buf.rank);
+    for (dim& d : dense_dims) {
+      d.set_stride(dim::auto_stride);
+      d.set_fold_factor(dim::unfolded);
+    }
+    raw_buffer dense = buf;
+    dense.dims = dense_dims.data();
+    dense.init_strides();
+    raw_buffer_ptr data = raw_buffer::make(dense.rank, dense.elem_size, dense.dims);
+    copy(buf, *data);
+    write(data->size_bytes());
+    write(data->base, data->size_bytes());
+  }
+
+  template <typename T>
+  void write_type(const T*) {
+    write(static_cast<std::uint64_t>(T::static_type));
+  }
+
+  void visit(const variable* op) override {
+    write_type(op);
+    write(op->sym);
+    write(static_cast<std::uint64_t>(op->field));
+    write_signed(op->dim);
+  }
+  void visit(const constant* op) override {
+    write_type(op);
+    write_signed(op->value);
+  }
+  void visit(const let* op) override {
+    write_type(op);
+    write(op->lets);
+    write(op->body);
+  }
+  template <typename T>
+  void visit_binary(const T* op) {
+    write_type(op);
+    write(op->a);
+    write(op->b);
+  }
+  void visit(const add* op) override { visit_binary(op); }
+  void visit(const sub* op) override { visit_binary(op); }
+  void visit(const mul* op) override { visit_binary(op); }
+  void visit(const div* op) override { visit_binary(op); }
+  void visit(const mod* op) override { visit_binary(op); }
+  void visit(const class min* op) override { visit_binary(op); }
+  void visit(const class max* op) override { visit_binary(op); }
+  void visit(const equal* op) override { visit_binary(op); }
+  void visit(const not_equal* op) override { visit_binary(op); }
+  void visit(const less* op) override { visit_binary(op); }
+  void visit(const less_equal* op) override { visit_binary(op); }
+  void visit(const logical_and* op) override { visit_binary(op); }
+  void visit(const logical_or* op) override { visit_binary(op); }
+  void visit(const logical_not* op) override {
+    write_type(op);
+    write(op->a);
+  }
+  void visit(const class select* op) override {
+    write_type(op);
+    write(op->condition);
+    write(op->true_value);
+    write(op->false_value);
+  }
+  void visit(const call* op) override {
+    // We can't serialize user defined callables.
+    if (op->target) ok = false;
+    write_type(op);
+    write(static_cast<std::uint64_t>(op->intrinsic));
+    write(op->args);
+  }
+
+  void visit(const let_stmt* op) override {
+    write_type(op);
+    write(op->lets);
+    write(op->body);
+    write(op->is_closure);
+  }
+  void visit(const block* op) override {
+    write_type(op);
+    write(op->stmts);
+  }
+  void visit(const loop* op) override {
+    write_type(op);
+    write(op->sym);
+    write(op->max_workers);
+    write(op->bounds);
+    write(op->step);
+    write(op->grain);
+    write(op->body);
+  }
+  void visit(const call_stmt* op) override {
+    // Copies implemented by `build_pipeline` are restored with `callback_registry::copy`, other calls are resolved by
+    // name when deserializing.
+    const bool is_copy = op->target.target<copy_call>() != nullptr;
+    if (!is_copy && op->attrs.name.empty()) ok = false;
+    write_type(op);
+    write(static_cast<std::uint64_t>(is_copy));
+    write(op->inputs);
+    write(op->outputs);
+    write(op->scalars);
+    write_signed(op->attrs.allow_in_place);
+    write_signed(op->attrs.min_rank);
+    write(op->attrs.name);
+    write(static_cast<std::uint64_t>(op->attrs.skip_if_empty));
+    write(static_cast<std::uint64_t>(op->attrs.full_tile));
+  }
+  void visit(const copy_stmt* op) override {
+    write_type(op);
+    write(op->src);
+    write(op->src_x);
+    write(op->dst);
+    write(op->dst_x);
+    write(op->pad);
+  }
+  void visit(const allocate* op) override {
+    write_type(op);
+    write(op->sym);
+    write(static_cast<std::uint64_t>(op->storage));
+    write(op->elem_size);
+    write(op->dims);
+    write(op->body);
+  }
+  void visit(const make_buffer* op) override {
+    write_type(op);
+    write(op->sym);
+    write(op->base);
+    write(op->elem_size);
+    write(op->dims);
+    write(op->body);
+  }
+  void visit(const constant_buffer* op) override {
+    write_type(op);
+    write(op->sym);
+    write(*op->value);
+    write(op->body);
+  }
+  void visit(const clone_buffer* op) override {
+    write_type(op);
+    write(op->sym);
+    write(op->src);
+    write(op->body);
+  }
+  void visit(const crop_buffer* op) override {
+    write_type(op);
+    write(op->sym);
+    write(op->src);
+    write(op->bounds);
+    write(op->body);
+  }
+  void visit(const crop_dim* op) override {
+    write_type(op);
+    write(op->sym);
+    write(op->src);
+    write_signed(op->dim);
+    write(op->bounds);
+    write(op->body);
+  }
+  void visit(const slice_buffer* op) override {
+    write_type(op);
+    write(op->sym);
+    write(op->src);
+    write(op->at);
+    write(op->body);
+  }
+  void visit(const slice_dim* op) override {
+    write_type(op);
+    write(op->sym);
+    write(op->src);
+    write_signed(op->dim);
+    write(op->at);
+    write(op->body);
+  }
+  void visit(const transpose* op) override {
+    write_type(op);
+    write(op->sym);
+    write(op->src);
+    write(op->dims);
+    write(op->body);
+  }
+  void visit(const async* op) override {
+    write_type(op);
+    write(op->sym);
+    write(op->task);
+    write(op->body);
+  }
+  void visit(const check* op) override {
+    write_type(op);
+    write(op->condition);
+  }
+};
+
+// Reads the format written by `serializer`. If the data is invalid, `ok` is set to false, and the rest of the reads
+// return default values.
+class deserializer {
+  const char* at;
+  const char* end;
+  const callback_registry& callbacks;
+
+public:
+  bool ok = true;
+
+  deserializer(span<const char> data, const callback_registry& callbacks)
+      : at(data.data()), end(data.data() + data.size()), callbacks(callbacks) {}
+
+  bool done() const { return at == end; }
+
+  std::uint64_t read_uint() {
+    std::uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (at == end) break;
+      std::uint8_t byte = static_cast<std::uint8_t>(*at++);
+      result |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) return result;
+    }
+    ok = false;
+    return 0;
+  }
+  std::int64_t read_int() {
+    std::uint64_t x = read_uint();
+    return static_cast<std::int64_t>((x >> 1) ^ (~(x & 1) + 1));
+  }
+  // Reads the size of a list, which can't be larger than the remaining data.
+  std::size_t read_size() {
+    std::uint64_t n = read_uint();
+    if (n > static_cast<std::uint64_t>(end - at)) {
+      ok = false;
+      return 0;
+    }
+    return n;
+  }
+  const char* read_bytes(std::size_t size) {
+    if (size > static_cast<std::size_t>(end - at)) {
+      ok = false;
+      return nullptr;
+    }
+    const char* result = at;
+    at += size;
+    return result;
+  }
+  // Reads an enum, which must not be greater than `max`.
+  template <typename T>
+  T read_enum(T max) {
+    std::uint64_t x = read_uint();
+    if (x > static_cast<std::uint64_t>(max)) {
+      ok = false;
+      return T();
+    }
+    return static_cast<T>(x);
+  }
+  std::string read_string() {
+    std::size_t size = read_size();
+    const char* data = read_bytes(size);
+    return data ? std::string(data, size) : std::string();
+  }
+  var read_var() { return var(static_cast<var::type>(read_uint() - 1)); }
+  interval_expr read_interval() {
+    expr min = read_expr();
+    expr max = read_expr();
+    return {std::move(min), std::move(max)};
+  }
+  dim_expr read_dim() {
+    interval_expr bounds = read_interval();
+    expr stride = read_expr();
+    expr fold_factor = read_expr();
+    return {std::move(bounds), std::move(stride), std::move(fold_factor)};
+  }
+  std::vector<var> read_vars() {
+    std::vector<var> result(read_size());
+    for (var& i : result) {
+      i = read_var();
+    }
+    return result;
+  }
+  std::vector<expr> read_exprs() {
+    std::vector<expr> result(read_size());
+    for (expr& i : result) {
+      i = read_expr();
+    }
+    return result;
+  }
+  std::vector<interval_expr> read_intervals() {
+    std::vector<interval_expr> result(read_size());
+    for (interval_expr& i : result) {
+      i = read_interval();
+    }
+    return result;
+  }
+  std::vector<dim_expr> read_dims() {
+    std::vector<dim_expr> result(read_size());
+    for (dim_expr& i : result) {
+      i = read_dim();
+    }
+    return result;
+  }
+  std::vector<int> read_ints() {
+    std::vector<int> result(read_size());
+    for (int& i : result) {
+      i = read_int();
+    }
+    return result;
+  }
+  std::vector<std::pair<var, expr>> read_lets() {
+    std::vector<std::pair<var, expr>> result(read_size());
+    for (auto& i : result) {
+      i.first = read_var();
+      i.second = read_expr();
+    }
+    return result;
+  }
+  const_raw_buffer_ptr read_buffer() {
+    std::size_t elem_size = read_uint();
+    std::size_t rank = read_size();
+    std::vector<dim> dims(rank);
+    for (dim& d : dims) {
+      index_t min = read_int();
+      index_t max = read_int();
+      d.set_bounds(min, max);
+      d.set_stride(read_int());
+      d.set_fold_factor(read_int());
+    }
+    std::vector<dim> dense_dims = dims;
+    for (dim& d : dense_dims) {
+      d.set_stride(dim::auto_stride);
+      d.set_fold_factor(dim::unfolded);
+    }
+    raw_buffer dense;
+    dense.elem_size = elem_size;
+    dense.rank = rank;
+    dense.dims = dense_dims.data();
+    dense.init_strides();
+    std::size_t size = read_size();
+    dense.base = const_cast<char*>(read_bytes(size));
+    if (!ok || size != dense.size_bytes()) {
+      ok = false;
+      return nullptr;
+    }
+    raw_buffer_ptr result = raw_buffer::make(rank, elem_size, dims.data());
+    copy(dense, *result);
+    return result;
+  }
+
+  expr read_expr() {
+    if (!ok) return expr();
+    switch (static_cast<expr_node_type>(read_uint())) {
+    case expr_node_type::none: return expr();
+    case expr_node_type::variable: {
+      var sym = read_var();
+      buffer_field field = read_enum(buffer_field::fold_factor);
+      int dim = read_int();
+      return variable::make(sym, field, dim);
+    }
+    case expr_node_type::constant: return constant::make(read_int());
+    case expr_node_type::let: {
+      std::vector<std::pair<var, expr>> lets = read_lets();
+      expr body = read_expr();
+      return let::make(std::move(lets), std::move(body));
+    }
+    case expr_node_type::add: return read_binary<add>();
+    case expr_node_type::sub: return read_binary<sub>();
+    case expr_node_type::mul: return read_binary<mul>();
+    case expr_node_type::div: return read_binary<div>();
+    case expr_node_type::mod: return read_binary<mod>();
+    case expr_node_type::min: return read_binary<class min>();
+    case expr_node_type::max: return read_binary<class max>();
+    case expr_node_type::equal: return read_binary<equal>();
+    case expr_node_type::not_equal: return read_binary<not_equal>();
+    case expr_node_type::less: return read_binary<less>();
+    case expr_node_type::less_equal: return read_binary<less_equal>();
+    case expr_node_type::logical_and: return read_binary<logical_and>();
+    case expr_node_type::logical_or: return read_binary<logical_or>();
+    case expr_node_type::logical_not: return logical_not::make(read_expr());
+    case expr_node_type::select: {
+      expr c = read_expr();
+      expr t = read_expr();
+      expr f = read_expr();
+      return select::make(std::move(c), std::move(t), std::move(f));
+    }
+    case expr_node_type::call: {
+      intrinsic fn = read_enum(intrinsic::free);
+      std::vector<expr> args = read_exprs();
+      return call::make(fn, std::move(args));
+    }
+    }
+    ok = false;
+    return expr();
+  }
+
+  template <typename T>
+  expr read_binary() {
+    expr a = read_expr();
+    expr b = read_expr();
+    return T::make(std::move(a), std::move(b));
+  }
+
+  stmt read_stmt() {
+    if (!ok) return stmt();
+    switch (static_cast<stmt_node_type>(read_uint())) {
+    case stmt_node_type::none: return stmt();
+    case stmt_node_type::call_stmt: {
+      bool is_copy = read_uint() != 0;
+      call_stmt::symbol_list inputs = read_vars();
+      call_stmt::symbol_list outputs = read_vars();
+      std::vector<expr> scalars = read_exprs();
+      call_stmt::attributes attrs;
+      attrs.allow_in_place = read_int();
+      attrs.min_rank = read_int();
+      attrs.name = read_string();
+      attrs.skip_if_empty = read_uint() != 0;
+      attrs.full_tile = read_uint() != 0;
+      if (!ok) return stmt();
+      if (is_copy) {
+        return call_stmt::make(
+            copy_call{callbacks.copy}, std::move(inputs), std::move(outputs), std::move(scalars), std::move(attrs));
+      }
+      auto target = callbacks.calls.find(attrs.name);
+      if (target == callbacks.calls.end()) {
+        ok = false;
+        return stmt();
+      }
+      return call_stmt::make(
+          target->second, std::move(inputs), std::move(outputs), std::move(scalars), std::move(attrs));
+    }
+    case stmt_node_type::copy_stmt: {
+      var src = read_var();
+      std::vector<expr> src_x = read_exprs();
+      var dst = read_var();
+      std::vector<var> dst_x = read_vars();
+      var pad = read_var();
+      return copy_stmt::make(callbacks.copy, src, std::move(src_x), dst, std::move(dst_x), pad);
+    }
+    case stmt_node_type::let_stmt: {
+      std::vector<std::pair<var, expr>> lets = read_lets();
+      stmt body = read_stmt();
+      bool is_closure = read_uint() != 0;
+      return let_stmt::make(std::move(lets), std::move(body), is_closure);
+    }
+    case stmt_node_type::block: {
+      std::vector<stmt> stmts(read_size());
+      for (stmt& i : stmts) {
+        i = read_stmt();
+      }
+      return block::make(std::move(stmts));
+    }
+    case stmt_node_type::loop: {
+      var sym = read_var();
+      expr max_workers = read_expr();
+      interval_expr bounds = read_interval();
+      expr step = read_expr();
+      expr grain = read_expr();
+      stmt body = read_stmt();
+      return loop::make(
+          sym, std::move(max_workers), std::move(bounds), std::move(step), std::move(body), std::move(grain));
+    }
+    case stmt_node_type::allocate: {
+      var sym = read_var();
+      memory_type storage = read_enum(memory_type::heap);
+      expr elem_size = read_expr();
+      std::vector<dim_expr> dims = read_dims();
+      stmt body = read_stmt();
+      return allocate::make(sym, storage, std::move(elem_size), std::move(dims), std::move(body));
+    }
+    case stmt_node_type::make_buffer: {
+      var sym = read_var();
+      expr base = read_expr();
+      expr elem_size = read_expr();
+      std::vector<dim_expr> dims = read_dims();
+      stmt body = read_stmt();
+      return make_buffer::make(sym, std::move(base), std::move(elem_size), std::move(dims), std::move(body));
+    }
+    case stmt_node_type::constant_buffer: {
+      var sym = read_var();
+      const_raw_buffer_ptr value = read_buffer();
+      stmt body = read_stmt();
+      if (!ok) return stmt();
+      return constant_buffer::make(sym, std::move(value), std::move(body));
+    }
+    case stmt_node_type::clone_buffer: {
+      var sym = read_var();
+      var src = read_var();
+      stmt body = read_stmt();
+      return clone_buffer::make(sym, src, std::move(body));
+    }
+    case stmt_node_type::crop_buffer: {
+      var sym = read_var();
+      var src = read_var();
+      std::vector<interval_expr> bounds = read_intervals();
+      stmt body = read_stmt();
+      return crop_buffer::make(sym, src, std::move(bounds), std::move(body));
+    }
+    case stmt_node_type::crop_dim: {
+      var sym = read_var();
+      var src = read_var();
+      int dim = read_int();
+      interval_expr bounds = read_interval();
+      stmt body = read_stmt();
+      return crop_dim::make(sym, src, dim, std::move(bounds), std::move(body));
+    }
+    case stmt_node_type::slice_buffer: {
+      var sym = read_var();
+      var src = read_var();
+      std::vector<expr> at = read_exprs();
+      stmt body = read_stmt();
+      return slice_buffer::make(sym, src, std::move(at), std::move(body));
+    }
+    case stmt_node_type::slice_dim: {
+      var sym = read_var();
+      var src = read_var();
+      int dim = read_int();
+      expr at = read_expr();
+      stmt body = read_stmt();
+      return slice_dim::make(sym, src, dim, std::move(at), std::move(body));
+    }
+    case stmt_node_type::transpose: {
+      var sym = read_var();
+      var src = read_var();
+      std::vector<int> dims = read_ints();
+      stmt body = read_stmt();
+      return transpose::make(sym, src, std::move(dims), std::move(body));
+    }
+    case stmt_node_type::async: {
+      var sym = read_var();
+      stmt task = read_stmt();
+      stmt body = read_stmt();
+      return async::make(sym, std::move(task), std::move(body));
+    }
+    case stmt_node_type::check: return check::make(read_expr());
+    }
+    ok = false;
+    return stmt();
+  }
+};
+
+}  // namespace
+
+std::vector<char> serialize_pipeline(const pipeline& p) {
+  std::vector<char> result(std::begin(magic), std::end(magic));
+  serializer s(result);
+  s.write(serialize_version);
+  s.write(p.args);
+  s.write(p.inputs);
+  s.write(p.outputs);
+  s.write(p.context_size);
+  s.write(p.heap_high_water);
+  s.write(p.heap_high_water_allocations);
+  s.write(p.body);
+  if (!s.ok) return {};
+  return result;
+}
+
+std::optional<pipeline> deserialize_pipeline(span<const char> data, const callback_registry& callbacks) {
+  if (data.size() < sizeof(magic) || memcmp(data.data(), magic, sizeof(magic)) != 0) {
+    return std::nullopt;
+  }
+  deserializer d(data.subspan(sizeof(magic)), callbacks);
+  if (d.read_uint() != serialize_version) {
+    return std::nullopt;
+  }
+
+  pipeline result;
+  result.args = d.read_vars();
+  result.inputs = d.read_vars();
+  result.outputs = d.read_vars();
+  result.context_size = d.read_uint();
+  result.heap_high_water = d.read_expr();
+  result.heap_high_water_allocations = d.read_uint();
+  result.body = d.read_stmt();
+  if (!d.ok || !d.done()) {
+    return std::nullopt;
+  }
+  return result;
+}
+
+}  // namespace slinky
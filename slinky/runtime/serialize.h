@@ -0,0 +1,41 @@
+#ifndef SLINKY_RUNTIME_SERIALIZE_H
+#define SLINKY_RUNTIME_SERIALIZE_H
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "slinky/base/span.h"
+#include "slinky/runtime/pipeline.h"
+#include "slinky/runtime/stmt.h"
+
+namespace slinky {
+
+// The version of the format produced by `serialize_pipeline`. Data with a different version can't be deserialized.
+constexpr std::uint32_t serialize_version = 6;
+
+// Callbacks that serialized pipelines refer to by name.
+struct callback_registry {
+  // The targets of `call_stmt`s, by `call_stmt::attributes::name`.
+  std::map<std::string, call_stmt::callable> calls;
+
+  // The implementation of `copy_stmt`s, and of the `copy_call`s that `build_pipeline` implements copies with. If this
+  // is not set, the copies use the default implementation (see `copy_stmt::impl`).
+  copy_stmt::callable copy;
+};
+
+// Serializes the symbols, body, and metadata of `p` to a binary representation. Callbacks are stored by name, and the
+// contents of constant buffers are stored in the data. Returns an empty vector if `p` can't be serialized, because it
+// contains a `call_stmt` without a name, or a `call` to a user defined callable.
+std::vector<char> serialize_pipeline(const pipeline& p);
+
+// Reconstructs a pipeline from the result of `serialize_pipeline`, resolving callbacks with `callbacks`. Returns
+// `std::nullopt` if the data is invalid, was serialized with a different version of the format, or refers to a
+// callback that is not in `callbacks`.
+std::optional<pipeline> deserialize_pipeline(span<const char> data, const callback_registry& callbacks);
+
+}  // namespace slinky
+
+#endif  // SLINKY_RUNTIME_SERIALIZE_H
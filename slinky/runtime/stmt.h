@@ -147,6 +147,14 @@ public:
     // assert(inputs[0]->size_bytes() == outputs[0]->size_bytes());
     // memcpy(outputs[0]->base(), inputs[0]->base(), outputs[0]->size_bytes());
     std::string name;
+
+    // If true, the call is skipped when all of its outputs are empty buffers. Otherwise, the callable must handle empty
+    // buffers, which are common when cropping to the bounds of a buffer, e.g. in the warmup of a sliding window.
+    bool skip_if_empty = false;
+
+    // If true, every dimension of the outputs of this call that is cropped to a tile of one of the call's
+    // `func::loops` has an extent equal to the step of that loop. This is set by `build_options::split_loop_tails`.
+    bool full_tile = false;
   };
 
   callable target;
@@ -176,7 +184,8 @@ public:
   var pad;
 
   // This function implements the copy operation. `slinky::copy` is always a suitable implementation of this.
-  // The implementation must only perform a copy and no other operations.
+  // The implementation must only perform a copy and no other operations. If this is empty, the copy uses
+  // `slinky::copy`, or `parallel_copy` if the `eval_config` has a thread pool.
   callable impl;
 
   void accept(stmt_visitor* v) const override;
@@ -235,13 +244,16 @@ public:
   interval_expr bounds;
   expr step;
   stmt body;
+  // A hint of the minimum number of consecutive iterations a worker of a parallel loop should run at a time (see
+  // `thread_pool::parallel_for`). If undefined, this is 1.
+  expr grain;
 
   static constexpr int serial = 1;
   static constexpr int parallel = std::numeric_limits<int>::max();
 
   void accept(stmt_visitor* v) const override;
 
-  static stmt make(var sym, expr max_workers, interval_expr bounds, expr step, stmt body);
+  static stmt make(var sym, expr max_workers, interval_expr bounds, expr step, stmt body, expr grain = expr());
 
   static constexpr stmt_node_type static_type = stmt_node_type::loop;
 };
@@ -10,6 +10,7 @@
 #include <random>
 
 #include "slinky/base/test/seeded_test.h"
+#include "slinky/base/thread_pool_impl.h"
 #include "slinky/runtime/buffer.h"
 
 namespace slinky {
@@ -990,6 +991,110 @@ TEST(buffer, copy) {
   }
 }
 
+TEST(buffer, parallel_copy) {
+  gtest_seeded_mt19937 rng;
+  thread_pool_impl t(3);
+
+  constexpr int max_rank = 4;
+  for (auto _ : fuzz_test(std::chrono::seconds(1))) {
+    int rank = random(rng, 0, max_rank);
+    int elem_size = random(rng, 1, 12);
+    // Use small chunks, so we split even these small buffers.
+    index_t min_chunk_bytes = random(rng, 1, 64);
+
+    buffer<void, max_rank> dst(rank, elem_size);
+    for (int d = 0; d < rank; ++d) {
+      dst.mutable_dim(d).set_min_extent(0, random(rng, 1, 9));
+    }
+    buffer<void, max_rank> src = dst;
+    randomize_strides_and_padding(rng, src, {-1, 1, true});
+    init_random(rng, src);
+
+    // The padding can't be out of bounds, add one extra padding.
+    buffer<void, max_rank> padding1 = dst;
+    buffer<void, max_rank> padding2 = dst;
+    randomize_strides_and_padding(rng, padding1, {1, 3, true});
+    randomize_strides_and_padding(rng, padding2, {1, 3, true});
+    init_random(rng, padding1);
+    init_random(rng, padding2);
+
+    randomize_strides_and_padding(rng, dst, {-1, 1, false});
+    dst.allocate();
+
+    parallel_copy(t, src, dst, padding1, min_chunk_bytes);
+    for_each_index(dst, [&](auto i) {
+      if (src.contains(i)) {
+        ASSERT_EQ(memcmp(dst.address_at(i), src.address_at(i), elem_size), 0);
+      } else {
+        ASSERT_EQ(memcmp(dst.address_at(i), padding1.address_at(i), elem_size), 0);
+      }
+    });
+
+    parallel_pad(t, src.dims, dst, padding2, min_chunk_bytes);
+    for_each_index(dst, [&](auto i) {
+      if (src.contains(i)) {
+        ASSERT_EQ(memcmp(dst.address_at(i), src.address_at(i), elem_size), 0);
+      } else {
+        ASSERT_EQ(memcmp(dst.address_at(i), padding2.address_at(i), elem_size), 0);
+      }
+    });
+  }
+}
+
+TEST(buffer, parallel_pad_large) {
+  gtest_seeded_mt19937 rng;
+  thread_pool_impl t(3);
+
+  // This buffer is big enough to be split into several chunks of `parallel_copy_min_chunk_bytes`.
+  const index_t W = 1000;
+  const index_t H = 1000;
+  buffer<int, 2> serial_dst({W, H});
+  init_random(rng, serial_dst);
+  buffer<int, 2> parallel_dst({W, H});
+  parallel_dst.allocate();
+  memcpy(parallel_dst.base(), serial_dst.base(), serial_dst.size_bytes());
+
+  buffer<int, 2> padding({W, H});
+  init_random(rng, padding);
+  dim src[] = {{100, 899}, {200, 799}};
+
+  pad(src, serial_dst, padding);
+  parallel_pad(t, src, parallel_dst, padding);
+  ASSERT_EQ(memcmp(parallel_dst.base(), serial_dst.base(), serial_dst.size_bytes()), 0);
+}
+
+TEST(buffer, copy_transpose) {
+  gtest_seeded_mt19937 rng;
+
+  constexpr int max_rank = 3;
+  for (auto _ : fuzz_test(std::chrono::seconds(1))) {
+    int rank = random(rng, 2, max_rank);
+    int elem_size = 1 << random(rng, 0, 3);
+
+    // Make a src buffer that is contiguous in a dimension other than the innermost dimension of the dst.
+    buffer<void, max_rank> dst(rank, elem_size);
+    for (int d = 0; d < rank; ++d) {
+      dst.mutable_dim(d).set_min_extent(random(rng, -3, 3), random(rng, 1, 40));
+    }
+    buffer<void, max_rank> src = dst;
+    std::vector<int> permutation(rank);
+    std::iota(permutation.begin(), permutation.end(), 0);
+    std::swap(permutation[0], permutation[random(rng, 1, rank - 1)]);
+    index_t stride = elem_size;
+    for (int d : permutation) {
+      slinky::dim& dim = src.mutable_dim(d);
+      dim.set_bounds(dim.min() - random(rng, 0, 2), dim.max() + random(rng, 0, 2));
+      dim.set_stride(stride);
+      stride *= dim.extent() + random(rng, 0, 3);
+    }
+    init_random(rng, src);
+    dst.allocate();
+
+    slinky::copy(src, dst);
+    for_each_index(dst, [&](auto i) { ASSERT_EQ(memcmp(dst.address_at(i), src.address_at(i), elem_size), 0); });
+  }
+}
+
 TEST(buffer, copy_empty_src) {
   gtest_seeded_mt19937 rng;
 
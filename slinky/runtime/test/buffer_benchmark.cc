@@ -2,6 +2,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <utility>
 
 #include "slinky/runtime/buffer.h"
 
@@ -160,6 +161,27 @@ void BM_copy_padded(benchmark::State& state) {
 BENCHMARK(BM_copy_padded)->Args({256, 4, -1});
 BENCHMARK(BM_copy_padded)->Args({64, 4, 4});
 
+// Copy an `n` x `n` matrix to its transpose.
+template <typename T>
+void BM_copy_transpose(benchmark::State& state) {
+  const index_t n = state.range(0);
+  buffer<T, 2> src;
+  buffer<T, 2> dst;
+  allocate_buffer(src, {n, n});
+  allocate_buffer(dst, {n, n});
+  std::swap(src.mutable_dim(0), src.mutable_dim(1));
+
+  for (auto _ : state) {
+    copy(src, dst);
+  }
+  state.SetBytesProcessed(state.iterations() * n * n * sizeof(T));
+}
+
+BENCHMARK(BM_copy_transpose<uint8_t>)->Arg(64)->Arg(1024);
+BENCHMARK(BM_copy_transpose<uint16_t>)->Arg(64)->Arg(1024);
+BENCHMARK(BM_copy_transpose<uint32_t>)->Arg(64)->Arg(1024);
+BENCHMARK(BM_copy_transpose<uint64_t>)->Arg(64)->Arg(1024);
+
 void BM_for_each_element_1x(benchmark::State& state) {
   std::vector<index_t> extents = state_to_vector(3, state);
   buffer<char, 3> buf;
@@ -0,0 +1,414 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cassert>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "slinky/base/thread_pool_impl.h"
+#include "slinky/runtime/compile.h"
+#include "slinky/runtime/evaluate.h"
+#include "slinky/runtime/expr.h"
+#include "slinky/runtime/print.h"
+#include "slinky/runtime/stmt.h"
+
+namespace slinky {
+
+namespace {
+
+node_context ctx;
+var x(ctx, "x");
+var y(ctx, "y");
+var z(ctx, "z");
+var result(ctx, "result");
+
+// Evaluate `e` by compiling a stmt that passes the value of `e` to a call.
+index_t evaluate_compiled(const expr& e, eval_context& context) {
+  index_t value = 0;
+  stmt s = let_stmt::make({{result, e}}, call_stmt::make(
+                                              [&](const call_stmt*, eval_context& ctx) -> index_t {
+                                                value = ctx[result];
+                                                return 0;
+                                              },
+                                              {}, {}, {}, {}));
+  index_t status = evaluate(compile(s), context);
+  assert(status == 0);
+  return value;
+}
+
+// Check that the compiled and reference evaluation of `e` agree.
+void test_expr(const expr& e, eval_context& context) {
+  index_t expected = evaluate(e, context);
+  ASSERT_EQ(evaluate_compiled(e, context), expected) << e;
+}
+
+void assert_buffer_extents_are(const raw_buffer& buf, const std::vector<int>& extents) {
+  ASSERT_EQ(buf.rank, extents.size());
+  for (std::size_t d = 0; d < extents.size(); ++d) {
+    ASSERT_EQ(extents[d], buf.dim(d).extent());
+  }
+}
+
+// Make a call that checks the extents and base of `buffer`, and counts how many times it was called.
+stmt make_check(var buffer, std::vector<int> extents, const void* base, int& calls) {
+  return call_stmt::make(
+      [=, &calls](const call_stmt*, eval_context& ctx) -> index_t {
+        const raw_buffer& buf = *ctx.lookup_buffer(buffer);
+        assert_buffer_extents_are(buf, extents);
+        EXPECT_EQ(buf.base, base);
+        ++calls;
+        return 0;
+      },
+      {}, {buffer}, {}, {});
+}
+
+}  // namespace
+
+TEST(compile, arithmetic) {
+  eval_context context;
+  context[x] = 4;
+  context[y] = -3;
+
+  for (const expr& e : std::vector<expr>{
+           x + 5,
+           x - 3,
+           x * y,
+           x / y,
+           y / x,
+           x % y,
+           y % x,
+           x / 0,
+           x % 0,
+           min(x, y),
+           max(x, y),
+           expr(x) < y,
+           x <= y,
+           expr(x) == y,
+           expr(x) != y,
+           x && y,
+           x || 0,
+           !x,
+           abs(y),
+           (x + 2) / 3,
+           select(expr(x) < y, x * 2, y - 1),
+           select(expr(y) < x, x * 2, y - 1),
+           let::make(z, x * 2, z + y),
+           let::make({{z, x * 2}, {result, z + 1}}, z * result),
+           and_then(expr(true), expr(x) < y),
+           and_then(expr(false), indeterminate()),
+           or_else(expr(x) > y, indeterminate()),
+           or_else(expr(false), expr(false)),
+       }) {
+    test_expr(e, context);
+  }
+}
+
+TEST(compile, buffer_fields) {
+  eval_context context;
+  buffer<int, 2> buf({10, 20});
+  buf.allocate();
+  context[x] = reinterpret_cast<index_t>(&buf);
+  context[y] = 3;
+
+  for (const expr& e : std::vector<expr>{
+           buffer_rank(x),
+           buffer_elem_size(x),
+           variable::make(x, buffer_field::size_bytes),
+           buffer_min(x, 0),
+           buffer_max(x, 1),
+           buffer_stride(x, 1),
+           buffer_fold_factor(x, 0),
+           // Broadcast dimensions
+           buffer_stride(x, 2),
+           buffer_fold_factor(x, 3),
+           buffer_at(x),
+           buffer_at(x, y),
+           buffer_at(x, y, 4),
+           buffer_at(x, expr(), 4),
+           // Out of bounds
+           buffer_at(x, 10, 4),
+       }) {
+    test_expr(e, context);
+  }
+}
+
+TEST(compile, constant_buffer) {
+  slinky::dim dims[] = {{0, 9, 4}, {0, 19, 40}};
+  auto buf = raw_buffer::make(2, 4, dims);
+
+  index_t values[3] = {0, 0, 0};
+  stmt body = call_stmt::make(
+      [&](const call_stmt*, eval_context& ctx) -> index_t {
+        values[0] = ctx[y];
+        values[1] = ctx[z];
+        values[2] = ctx[result];
+        return 0;
+      },
+      {}, {}, {}, {});
+  body = let_stmt::make(
+      {{y, buffer_max(x, 1)}, {z, buffer_stride(x, 1)}, {result, variable::make(x, buffer_field::size_bytes)}}, body);
+  compiled_stmt s = compile(constant_buffer::make(x, buf, body));
+
+  // The metadata of the constant buffer should have been folded.
+  std::stringstream program;
+  program << s;
+  ASSERT_EQ(program.str().find("load_"), std::string::npos) << program.str();
+
+  ASSERT_EQ(evaluate(s), 0);
+  ASSERT_EQ(values[0], 19);
+  ASSERT_EQ(values[1], 40);
+  ASSERT_EQ(values[2], 800);
+}
+
+TEST(compile, loop) {
+  eval_context context;
+  thread_pool_impl t;
+  eval_config cfg;
+  cfg.thread_pool = &t;
+  context.config = &cfg;
+
+  for (int max_workers : {loop::serial, 2, 3, loop::parallel}) {
+    for (bool closure : {false, true}) {
+      std::atomic<index_t> sum_x = 0;
+      stmt body = call_stmt::make(
+          [&](const call_stmt*, eval_context& ctx) -> index_t {
+            sum_x += ctx[x] * ctx[y];
+            return 0;
+          },
+          {}, {}, {}, {});
+      if (closure) {
+        body = let_stmt::make({{x, x}, {y, y}}, body, /*is_closure=*/true);
+      }
+
+      compiled_stmt l = compile(let_stmt::make({{y, 2}}, loop::make(x, max_workers, range(2, 12), 3, body)));
+
+      ASSERT_EQ(evaluate(l, context), 0);
+      ASSERT_EQ(sum_x, 2 * (2 + 5 + 8 + 11));
+    }
+  }
+}
+
+TEST(compile, loop_grain) {
+  eval_context context;
+  thread_pool_impl t;
+  eval_config cfg;
+  cfg.thread_pool = &t;
+  context.config = &cfg;
+
+  // A loop with no more iterations than the grain runs on the calling thread.
+  std::atomic<int> other_threads = 0;
+  std::atomic<index_t> sum_x = 0;
+  const std::thread::id caller = std::this_thread::get_id();
+  stmt body = call_stmt::make(
+      [&](const call_stmt*, eval_context& ctx) -> index_t {
+        if (std::this_thread::get_id() != caller) ++other_threads;
+        sum_x += ctx[x];
+        return 0;
+      },
+      {}, {}, {}, {});
+  compiled_stmt l = compile(let_stmt::make({{y, 4}}, loop::make(x, loop::parallel, range(2, 12), 3, body, y)));
+  ASSERT_EQ(evaluate(l, context), 0);
+  ASSERT_EQ(sum_x, 2 + 5 + 8 + 11);
+  ASSERT_EQ(other_threads, 0);
+}
+
+TEST(compile, call_failed) {
+  eval_context context;
+  eval_config cfg;
+  int failed = 0;
+  cfg.call_failed = [&](const call_stmt*) { ++failed; };
+  context.config = &cfg;
+
+  int calls = 0;
+  stmt fail = call_stmt::make(
+      [&](const call_stmt*, eval_context& ctx) -> index_t {
+        ++calls;
+        return ctx[x] == 5 ? 7 : 0;
+      },
+      {}, {}, {}, {});
+
+  compiled_stmt l = compile(loop::make(x, loop::serial, range(0, 10), 1, fail));
+  ASSERT_EQ(evaluate(l, context), 7);
+  ASSERT_EQ(calls, 6);
+  ASSERT_EQ(failed, 1);
+}
+
+TEST(compile, skip_if_empty) {
+  buffer<int, 1> buf({10});
+  buf.allocate();
+
+  for (bool skip_if_empty : {false, true}) {
+    int calls = 0;
+    call_stmt::attributes attrs;
+    attrs.skip_if_empty = skip_if_empty;
+    stmt c = call_stmt::make(
+        [&](const call_stmt*, eval_context&) -> index_t {
+          ++calls;
+          return 0;
+        },
+        {}, {y}, {}, attrs);
+    // Only the crops for x in [0, 9] are not empty.
+    stmt s = loop::make(x, loop::serial, range(-5, 15), 1, crop_dim::make(y, y, 0, {x, x}, c));
+
+    eval_context context;
+    context[y] = reinterpret_cast<index_t>(&buf);
+    ASSERT_EQ(evaluate(s, context), 0);
+    const int expected = calls;
+    ASSERT_EQ(expected, skip_if_empty ? 10 : 20);
+
+    calls = 0;
+    ASSERT_EQ(evaluate(compile(s), context), 0);
+    ASSERT_EQ(calls, expected);
+  }
+}
+
+TEST(compile, check_failed) {
+  eval_context context;
+  eval_config cfg;
+  int failed = 0;
+  cfg.check_failed = [&](const expr&) { ++failed; };
+  context.config = &cfg;
+  context[x] = 3;
+
+  ASSERT_EQ(evaluate(compile(check::make(expr(x) < 4)), context), 0);
+  ASSERT_EQ(failed, 0);
+  ASSERT_NE(evaluate(compile(check::make(expr(x) > 4)), context), 0);
+  ASSERT_EQ(failed, 1);
+}
+
+TEST(compile, allocate) {
+  for (memory_type storage : {memory_type::stack, memory_type::heap, memory_type::automatic}) {
+    int calls = 0;
+    stmt check_x = call_stmt::make(
+        [&](const call_stmt*, eval_context& ctx) -> index_t {
+          const raw_buffer& buf = *ctx.lookup_buffer(x);
+          assert_buffer_extents_are(buf, {4, 5});
+          EXPECT_NE(buf.base, nullptr);
+          EXPECT_EQ(buf.dim(1).stride(), 16);
+          ++calls;
+          return 0;
+        },
+        {}, {x}, {}, {});
+    std::vector<dim_expr> dims = {{{0, 3}, expr()}, {{2, 6}, expr()}, dim::broadcast()};
+    ASSERT_EQ(evaluate(compile(allocate::make(x, storage, 4, dims, check_x))), 0);
+    ASSERT_EQ(calls, 1);
+  }
+}
+
+TEST(compile, profile) {
+  call_stmt::attributes attrs;
+  attrs.name = "f";
+  stmt f = call_stmt::make([](const call_stmt*, eval_context&) -> index_t { return 0; }, {}, {y}, {}, attrs);
+  stmt s = allocate::make(x, memory_type::heap, sizeof(int), {{{0, 9}, sizeof(int)}},
+      loop::make(z, loop::serial, range(0, 5), 1, crop_dim::make(y, x, 0, {2 * z, 2 * z + 1}, f)));
+
+  // The compiled program should record the same statistics as the reference evaluator.
+  std::vector<std::map<std::string, call_profile>> calls;
+  std::vector<allocation_profile> allocations;
+  for (bool compiled : {false, true}) {
+    eval_profile profile;
+    eval_config cfg;
+    cfg.profile = &profile;
+    eval_context context;
+    context.config = &cfg;
+    ASSERT_EQ(compiled ? evaluate(compile(s), context) : evaluate(s, context), 0);
+    calls.push_back(profile.calls());
+    allocations.push_back(profile.allocations());
+  }
+  for (const auto& i : calls) {
+    ASSERT_EQ(i.size(), 1);
+    ASSERT_EQ(i.at("f").calls, 5);
+    ASSERT_EQ(i.at("f").elements, 10);
+    ASSERT_EQ(i.at("f").bytes_written, 10 * sizeof(int));
+  }
+  for (const allocation_profile& i : allocations) {
+    ASSERT_EQ(i.allocations, 1);
+    ASSERT_EQ(i.bytes, 10 * sizeof(int));
+  }
+}
+
+TEST(compile, make_buffer) {
+  int calls = 0;
+  char data[4];
+  compiled_stmt s = compile(make_buffer::make(
+      x, reinterpret_cast<index_t>(&data[0]), 1, {{{0, 3}, 1}, dim::broadcast()}, make_check(x, {4}, data, calls)));
+  ASSERT_EQ(evaluate(s), 0);
+  ASSERT_EQ(calls, 1);
+}
+
+TEST(compile, crop_slice_transpose) {
+  eval_context context;
+  buffer<int, 4> buf({10, 20, 30, 40});
+  buf.allocate();
+  context[x] = reinterpret_cast<index_t>(&buf);
+  buffer<int, 1> y_buf({3});
+  context[y] = reinterpret_cast<index_t>(&y_buf);
+
+  auto buf_before = buf;
+
+  int calls = 0;
+  std::vector<stmt> tests = {
+      crop_dim::make(x, x, 0, {1, 3}, make_check(x, {3, 20, 30, 40}, buf.address_at(1), calls)),
+      crop_dim::make(y, x, 1, buffer_bounds(y, 0), make_check(y, {10, 3, 30, 40}, buf.base(), calls)),
+      crop_dim::make(y, x, 5, {5, 15}, make_check(y, {10, 20, 30, 40}, buf.base(), calls)),
+      crop_buffer::make(
+          x, x, {{1, 3}, {}, {2, 5}}, make_check(x, {3, 20, 4, 40}, buf.address_at(1, slinky::slice, 2), calls)),
+      crop_buffer::make(y, x, {{1, 3}, {}, {2, 5}, {}, {10, 30}},
+          block::make({
+              make_check(x, {10, 20, 30, 40}, buf.base(), calls),
+              make_check(y, {3, 20, 4, 40}, buf.address_at(1, slinky::slice, 2), calls),
+          })),
+      slice_dim::make(x, x, 1, 2, make_check(x, {10, 30, 40}, buf.address_at(slinky::slice, 2), calls)),
+      slice_dim::make(y, x, 5, 2, make_check(y, {10, 20, 30, 40}, buf.base(), calls)),
+      slice_buffer::make(
+          y, x, {{}, 4, {}, 2}, make_check(y, {10, 30}, buf.address_at(slinky::slice, 4, slinky::slice, 2), calls)),
+      slice_buffer::make(x, x, {50}, make_check(x, {20, 30, 40}, nullptr, calls)),
+      transpose::make(y, x, {2, 0}, make_check(y, {30, 10}, buf.base(), calls)),
+      transpose::make(x, x, {0, 1}, make_check(x, {10, 20}, buf.base(), calls)),
+      clone_buffer::make(z, x, make_check(z, {10, 20, 30, 40}, buf.base(), calls)),
+  };
+  for (const stmt& s : tests) {
+    calls = 0;
+    ASSERT_EQ(evaluate(s, context), 0);
+    int expected_calls = calls;
+    ASSERT_GT(expected_calls, 0);
+    calls = 0;
+    ASSERT_EQ(evaluate(compile(s), context), 0);
+    ASSERT_EQ(calls, expected_calls);
+    ASSERT_EQ(buf_before.base(), buf.base());
+    for (std::size_t d = 0; d < buf.rank; ++d) {
+      ASSERT_EQ(buf_before.dim(d), buf.dim(d));
+    }
+  }
+}
+
+TEST(compile, async) {
+  eval_context context;
+  thread_pool_impl t;
+  eval_config cfg;
+  cfg.thread_pool = &t;
+  context.config = &cfg;
+
+  std::atomic<int> state = 0;
+  stmt increment_state = call_stmt::make(
+      [&](const call_stmt* op, eval_context& ctx) -> index_t {
+        ++state;
+        return 0;
+      },
+      {}, {}, {}, {});
+  stmt check_state = call_stmt::make(
+      [&](const call_stmt* op, eval_context& ctx) -> index_t {
+        EXPECT_EQ(state, 1);
+        return 0;
+      },
+      {}, {}, {}, {});
+
+  stmt test = async::make(x, increment_state, block::make({check::make(wait_for(x)), check_state}));
+  ASSERT_EQ(evaluate(compile(test), context), 0);
+  ASSERT_EQ(state, 1);
+}
+
+}  // namespace slinky
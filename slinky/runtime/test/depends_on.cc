@@ -153,4 +153,13 @@ TEST(find_dependencies, basic) {
   ASSERT_THAT(find_dependencies(copy_stmt::make(nullptr, x, {w + u}, y, {w}, var())), testing::ElementsAre(x, y, u));
 }
 
+TEST(find_context_size, basic) {
+  ASSERT_EQ(find_context_size(stmt()), 0);
+  ASSERT_EQ(find_context_size(check::make(x)), x.id + 1);
+  ASSERT_EQ(find_context_size(check::make(let::make(v, x, v + y))), v.id + 1);
+  ASSERT_EQ(find_context_size(crop_dim::make(v, x, 0, {y, y}, dummy_call({w}, {u}))), v.id + 1);
+  ASSERT_EQ(find_context_size(crop_dim::make(x, y, 0, {z, z}, dummy_call({w}, {u}))), u.id + 1);
+  ASSERT_EQ(find_context_size(loop::make(yc, loop::serial, {x, y}, 1, check::make(z))), yc.id + 1);
+}
+
 }  // namespace slinky
@@ -1,9 +1,17 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "slinky/base/span.h"
 #include "slinky/base/thread_pool_impl.h"
+#include "slinky/runtime/depends_on.h"
 #include "slinky/runtime/evaluate.h"
 #include "slinky/runtime/expr.h"
 #include "slinky/runtime/print.h"
@@ -107,6 +115,48 @@ TEST(evaluate, call) {
   ASSERT_EQ(calls[0], 2);
 }
 
+TEST(evaluate, skip_if_empty) {
+  var a(ctx, "a");
+  var i(ctx, "i");
+
+  buffer<int, 1> a_buf({10});
+  a_buf.allocate();
+
+  for (bool skip_if_empty : {false, true}) {
+    int calls = 0;
+    call_stmt::attributes attrs;
+    attrs.skip_if_empty = skip_if_empty;
+    stmt c = call_stmt::make(
+        [&](const call_stmt*, eval_context&) -> index_t {
+          ++calls;
+          return 0;
+        },
+        {}, {a}, {}, attrs);
+    // The fast path for crop_dim + call_stmt loops and the general case should both skip the calls.
+    for (stmt body : {c, block::make({c, check::make(1)})}) {
+      calls = 0;
+      eval_context eval_ctx;
+      eval_ctx[a] = reinterpret_cast<index_t>(&a_buf);
+      ASSERT_EQ(evaluate(loop::make(i, loop::serial, {-5, 14}, 1, crop_dim::make(a, a, 0, {i, i}, body)), eval_ctx), 0);
+      ASSERT_EQ(calls, skip_if_empty ? 10 : 20);
+    }
+  }
+
+  // Calls without outputs are never skipped.
+  int calls = 0;
+  call_stmt::attributes attrs;
+  attrs.skip_if_empty = true;
+  stmt c = call_stmt::make(
+      [&](const call_stmt*, eval_context&) -> index_t {
+        ++calls;
+        return 0;
+      },
+      {}, {}, {}, attrs);
+  eval_context eval_ctx;
+  ASSERT_EQ(evaluate(c, eval_ctx), 0);
+  ASSERT_EQ(calls, 1);
+}
+
 TEST(evaluate, loop) {
   eval_context ctx;
   thread_pool_impl t;
@@ -131,6 +181,45 @@ TEST(evaluate, loop) {
   }
 }
 
+TEST(evaluate, loop_grain) {
+  eval_context ctx;
+  thread_pool_impl t;
+  eval_config cfg;
+  cfg.thread_pool = &t;
+  ctx.config = &cfg;
+
+  // A loop with no more iterations than the grain runs on the calling thread.
+  std::atomic<int> other_threads = 0;
+  std::atomic<index_t> sum_x = 0;
+  const std::thread::id caller = std::this_thread::get_id();
+  stmt c = call_stmt::make(
+      [&](const call_stmt*, eval_context& ctx) -> index_t {
+        if (std::this_thread::get_id() != caller) ++other_threads;
+        sum_x += ctx[x];
+        return 0;
+      },
+      {}, {}, {}, {});
+  ASSERT_EQ(evaluate(let_stmt::make({{y, 4}}, loop::make(x, loop::parallel, range(2, 12), 3, c, y)), ctx), 0);
+  ASSERT_EQ(sum_x, 2 + 5 + 8 + 11);
+  ASSERT_EQ(other_threads, 0);
+}
+
+TEST(evaluate, unchecked) {
+  std::vector<index_t> xs;
+  stmt c = call_stmt::make(
+      [&](const call_stmt*, eval_context& ctx) -> index_t {
+        xs.push_back(ctx[x] * ctx[y]);
+        return 0;
+      },
+      {}, {}, {}, {});
+  stmt l = let_stmt::make({{y, 3}}, loop::make(x, loop::serial, range(0, 3), 1, c));
+
+  eval_context ctx;
+  ctx.reserve(find_context_size(l));
+  ASSERT_EQ(evaluate_unchecked(l, ctx), 0);
+  ASSERT_EQ(xs, std::vector<index_t>({0, 3, 6}));
+}
+
 void assert_buffer_extents_are(const raw_buffer& buf, const std::vector<int>& extents) {
   ASSERT_EQ(buf.rank, extents.size());
   for (std::size_t d = 0; d < extents.size(); ++d) {
@@ -213,6 +302,210 @@ TEST(evaluate, crop_dim) {
   evaluate(crop_dim::make(y, x, 2, {5, 15}, make_check(y, {10, 20}, buf.base())), ctx);
 }
 
+TEST(evaluate, loop_crop_calls) {
+  var a(ctx, "a");
+  var b(ctx, "b");
+  var c(ctx, "c");
+  var i(ctx, "i");
+
+  buffer<int, 2> a_buf({10, 20});
+  buffer<int, 2> b_buf({10, 20});
+  buffer<int, 2> c_buf({10, 8});
+  a_buf.allocate();
+  c_buf.allocate();
+  c_buf.dims[1].set_fold_factor(4);
+  auto a_before = a_buf;
+
+  // Records the buffers seen by each call, and fails at iteration `fail_at`.
+  struct record {
+    var sym;
+    const void* base;
+    index_t min0, max0, min1, max1;
+    index_t i;
+
+    bool operator==(const record& r) const {
+      return sym == r.sym && base == r.base && min0 == r.min0 && max0 == r.max0 && min1 == r.min1 &&
+             max1 == r.max1 && i == r.i;
+    }
+  };
+  std::vector<record> records;
+  index_t fail_at = -1;
+  auto make_call = [&](var in, var out) {
+    return call_stmt::make(
+        [&records, &fail_at, i, out](const call_stmt*, eval_context& ctx) -> index_t {
+          const raw_buffer& buf = *ctx.lookup_buffer(out);
+          records.push_back({out, buf.base, buf.dim(0).min(), buf.dim(0).max(), buf.dim(1).min(), buf.dim(1).max(),
+              ctx[i]});
+          return ctx[i] == fail_at ? 7 : 0;
+        },
+        {in}, {out}, {}, {});
+  };
+
+  // The fast path handles loops of crop_dim + call_stmt. To compare to the general case, we hide the calls in a block
+  // with a no-op check.
+  auto make_loop = [&](bool fast) {
+    auto maybe_hide = [=](stmt s) { return fast ? s : block::make({s, check::make(1)}); };
+    std::vector<stmt> body = {
+        // Shadowed crop.
+        crop_dim::make(a, a, 1, {i, i + 1}, maybe_hide(make_call(c, a))),
+        // Not shadowed, with clamping at both ends, and a call that uses the uncropped `a`.
+        crop_dim::make(b, a, 1, {i + -2, i + 3}, maybe_hide(make_call(a, b))),
+        // Empty crops, beyond the end of the loop.
+        crop_dim::make(b, b, 1, {i + 30, i + 31}, maybe_hide(make_call(a, b))),
+        // Broadcast dimension.
+        crop_dim::make(b, a, 3, {i, i}, maybe_hide(make_call(a, b))),
+        // Folded dimension.
+        crop_dim::make(c, c, 1, {i, i + 1}, maybe_hide(make_call(a, c))),
+    };
+    return loop::make(i, loop::serial, {buffer_min(a, 1), buffer_max(a, 1)}, 2, block::make(std::move(body)));
+  };
+
+  eval_config cfg;
+  int failed = 0;
+  cfg.call_failed = [&](const call_stmt*) { ++failed; };
+
+  for (index_t fail : {-1, 6}) {
+    fail_at = fail;
+    std::vector<std::vector<record>> results;
+    for (bool fast : {false, true}) {
+      eval_context eval_ctx;
+      eval_ctx.config = &cfg;
+      eval_ctx[a] = reinterpret_cast<index_t>(&a_buf);
+      eval_ctx[b] = reinterpret_cast<index_t>(&b_buf);
+      eval_ctx[c] = reinterpret_cast<index_t>(&c_buf);
+      records.clear();
+      ASSERT_EQ(evaluate(make_loop(fast), eval_ctx), fail < 0 ? 0 : 7);
+      ASSERT_EQ(a_buf, a_before);
+      results.push_back(records);
+    }
+    ASSERT_EQ(results[0].size(), fail < 0 ? 50 : 16);
+    ASSERT_EQ(results[0], results[1]);
+  }
+  ASSERT_EQ(failed, 2);
+}
+
+TEST(evaluate, profile) {
+  var in(ctx, "in");
+  var out(ctx, "out");
+  var i(ctx, "i");
+
+  call_stmt::attributes producer_attrs;
+  producer_attrs.name = "producer";
+  stmt producer = call_stmt::make([](const call_stmt*, eval_context&) -> index_t { return 0; }, {}, {out},
+      {}, std::move(producer_attrs));
+  call_stmt::attributes consumer_attrs;
+  consumer_attrs.name = "consumer";
+  stmt consumer = call_stmt::make([](const call_stmt*, eval_context&) -> index_t { return 0; }, {in}, {}, {},
+      std::move(consumer_attrs));
+
+  // Produce one element of the buffer in each iteration of a parallel loop, and consume two elements in each iteration
+  // of a serial loop.
+  stmt s = allocate::make(x, memory_type::heap, sizeof(int), {{{0, 9}, sizeof(int)}},
+      block::make({
+          loop::make(i, loop::parallel, range(0, 8), 1, crop_dim::make(out, x, 0, {i, i}, producer)),
+          loop::make(i, loop::serial, range(0, 8), 1, crop_dim::make(in, x, 0, {i, i + 1}, consumer)),
+      }));
+
+  thread_pool_impl t;
+  eval_profile profile;
+  eval_config cfg;
+  cfg.thread_pool = &t;
+  cfg.profile = &profile;
+  eval_context eval_ctx;
+  eval_ctx.config = &cfg;
+  for (int repeat = 0; repeat < 2; ++repeat) {
+    ASSERT_EQ(evaluate(s, eval_ctx), 0);
+  }
+
+  std::map<std::string, call_profile> calls = profile.calls();
+  ASSERT_EQ(calls.size(), 2);
+  ASSERT_EQ(calls["producer"].calls, 16);
+  ASSERT_EQ(calls["producer"].elements, 16);
+  ASSERT_EQ(calls["producer"].bytes_read, 0);
+  ASSERT_EQ(calls["producer"].bytes_written, 16 * sizeof(int));
+  ASSERT_EQ(calls["consumer"].calls, 16);
+  ASSERT_EQ(calls["consumer"].elements, 0);
+  ASSERT_EQ(calls["consumer"].bytes_read, 32 * sizeof(int));
+  ASSERT_EQ(calls["consumer"].bytes_written, 0);
+  ASSERT_GE(calls["consumer"].total_time, calls["consumer"].max_time);
+
+  allocation_profile allocations = profile.allocations();
+  ASSERT_EQ(allocations.allocations, 2);
+  ASSERT_EQ(allocations.bytes, 20 * sizeof(int));
+
+  std::stringstream printed;
+  print(printed, s, profile, &ctx);
+  ASSERT_NE(printed.str().find("call(producer, {}, {out}, {})  // calls=16,"), std::string::npos) << printed.str();
+  ASSERT_NE(printed.str().find("call(consumer, {in}, {}, {})  // calls=16,"), std::string::npos) << printed.str();
+  ASSERT_NE(printed.str().find("}) {  // allocations=2,"), std::string::npos) << printed.str();
+
+  profile.clear();
+  ASSERT_TRUE(profile.calls().empty());
+}
+
+TEST(evaluate, profile_events) {
+  call_stmt::attributes attrs;
+  attrs.name = "touch";
+  stmt touch = call_stmt::make(
+      [](const call_stmt*, eval_context& ctx) -> index_t {
+        const raw_buffer& buf = *ctx.lookup_buffer(x);
+        memset(buf.base, 0, buf.size_bytes());
+        return 0;
+      },
+      {}, {x}, {}, std::move(attrs));
+  stmt s = allocate::make(x, memory_type::heap, 1, {{{0, (1 << 20) - 1}, 1}}, touch);
+
+  eval_profile profile(/*count_events=*/true);
+  eval_config cfg;
+  cfg.profile = &profile;
+  eval_context eval_ctx;
+  eval_ctx.config = &cfg;
+  ASSERT_EQ(evaluate(s, eval_ctx), 0);
+
+  // Which events are counted depends on the machine we run on.
+  const std::uint32_t counted = perf_counters().counted();
+  call_profile calls = profile.calls()["touch"];
+  ASSERT_EQ(calls.calls, 1);
+  ASSERT_EQ(calls.events_counted, counted);
+  for (std::size_t i = 0; i < perf_counters::event_count; ++i) {
+    if (!(counted & (1u << i))) {
+      ASSERT_EQ(calls.events[i], 0);
+    }
+  }
+
+  std::stringstream printed;
+  print(printed, s, profile, &ctx);
+  for (std::size_t i = 0; i < perf_counters::event_count; ++i) {
+    const std::string name = std::string(", ") + to_string(static_cast<perf_event>(i)) + "=";
+    ASSERT_EQ(printed.str().find(name) != std::string::npos, (counted & (1u << i)) != 0) << printed.str();
+  }
+}
+
+TEST(evaluate, first_touch) {
+  // A buffer with a negative stride, so the memory of the buffer is before its base.
+  const index_t size = 100000;
+  stmt s = allocate::make(x, memory_type::heap, 1, {{{0, size - 1}, -1}},
+      call_stmt::make([](const call_stmt*, eval_context&) -> index_t { return 0; }, {}, {x}, {}, {}));
+
+  std::vector<char> memory;
+  eval_config cfg;
+  cfg.first_touch = true;
+  cfg.allocate = [&](var, raw_buffer* buf) -> void* {
+    memory.assign(buf->size_bytes(), 1);
+    buf->base = memory.data() + memory.size() - 1;
+    return memory.data();
+  };
+  cfg.free = [](var, raw_buffer*, void*) {};
+  eval_context eval_ctx;
+  eval_ctx.config = &cfg;
+  ASSERT_EQ(evaluate(s, eval_ctx), 0);
+
+  // The allocation should have been touched from its beginning, one byte in each page (which are at most 64KB).
+  ASSERT_EQ(memory.size(), size);
+  ASSERT_EQ(memory.front(), 0);
+  ASSERT_GE(std::count(memory.begin(), memory.end(), 0), size / (64 * 1024));
+}
+
 TEST(evaluate, crop_buffer) {
   eval_context ctx;
   buffer<int, 4> buf({10, 20, 30, 40});
@@ -6,6 +6,7 @@
 #include <cstdint>
 
 #include "slinky/base/thread_pool_impl.h"
+#include "slinky/runtime/compile.h"
 #include "slinky/runtime/evaluate.h"
 #include "slinky/runtime/expr.h"
 
@@ -61,143 +62,152 @@ std::vector<dim_expr> make_dims(int rank) {
 
 stmt make_buf(var buf, int rank, stmt body) { return make_buffer::make(buf, 0, 1, make_dims(rank), body); }
 
-void BM_call(benchmark::State& state) {
+// Run the benchmark loop evaluating `body`, either with the reference evaluator, or by compiling it first.
+void run(benchmark::State& state, const stmt& body, bool compiled, eval_context& eval_ctx) {
+  if (compiled) {
+    compiled_stmt program = compile(body);
+    for (auto _ : state) {
+      evaluate(program, eval_ctx);
+    }
+  } else {
+    for (auto _ : state) {
+      evaluate(body, eval_ctx);
+    }
+  }
+}
+void run(benchmark::State& state, const stmt& body, bool compiled) {
+  eval_context eval_ctx;
+  run(state, body, compiled, eval_ctx);
+}
+
+void BM_call(benchmark::State& state, bool compiled) {
   std::atomic<int> calls = 0;
   stmt body = make_loop(make_call_counter(calls));
 
-  for (auto _ : state) {
-    evaluate(body);
-  }
+  run(state, body, compiled);
 
   state.SetItemsProcessed(calls);
 }
 
-BENCHMARK(BM_call);
+BENCHMARK_CAPTURE(BM_call, interpreted, false);
+BENCHMARK_CAPTURE(BM_call, compiled, true);
 
-void BM_let(benchmark::State& state) {
+void BM_let(benchmark::State& state, bool compiled) {
   std::atomic<int> calls = 0;
   std::vector<std::pair<var, expr>> values = {{y, x}, {z, y}, {w, z}};
   values.resize(state.range(0));
   stmt body = make_loop(let_stmt::make(values, make_call_counter(calls)));
 
-  for (auto _ : state) {
-    evaluate(body);
-  }
+  run(state, body, compiled);
 
   state.SetItemsProcessed(calls);
 }
 
-BENCHMARK(BM_let)->DenseRange(1, 3);
+BENCHMARK_CAPTURE(BM_let, interpreted, false)->DenseRange(1, 3);
+BENCHMARK_CAPTURE(BM_let, compiled, true)->DenseRange(1, 3);
 
-void BM_block(benchmark::State& state) {
+void BM_block(benchmark::State& state, bool compiled) {
   std::atomic<int> calls = 0;
   std::vector<stmt> call_counters(state.range(0), make_call_counter(calls));
   stmt body = make_loop(block::make(call_counters));
 
-  for (auto _ : state) {
-    evaluate(body);
-  }
+  run(state, body, compiled);
 
   state.SetItemsProcessed(calls);
 }
 
-BENCHMARK(BM_block)->RangeMultiplier(2)->Range(2, 16);
+BENCHMARK_CAPTURE(BM_block, interpreted, false)->RangeMultiplier(2)->Range(2, 16);
+BENCHMARK_CAPTURE(BM_block, compiled, true)->RangeMultiplier(2)->Range(2, 16);
 
-void BM_crop_dim(benchmark::State& state) {
+void BM_crop_dim(benchmark::State& state, bool compiled) {
   std::atomic<int> calls = 0;
   stmt c = crop_dim::make(dst, state.range(0) ? src : dst, 0, {1, 10}, make_call_counter(calls));
   stmt l = make_loop(c);
   stmt body = make_buf(src, 3, make_buf(dst, 3, l));
 
-  for (auto _ : state) {
-    evaluate(body);
-  }
+  run(state, body, compiled);
 
   state.SetItemsProcessed(calls);
 }
 
-BENCHMARK(BM_crop_dim)->DenseRange(0, 1);
+BENCHMARK_CAPTURE(BM_crop_dim, interpreted, false)->DenseRange(0, 1);
+BENCHMARK_CAPTURE(BM_crop_dim, compiled, true)->DenseRange(0, 1);
 
-void BM_crop_buffer(benchmark::State& state) {
+void BM_crop_buffer(benchmark::State& state, bool compiled) {
   std::atomic<int> calls = 0;
   stmt c = crop_buffer::make(dst, state.range(0) ? src : dst, {{1, 10}, {}, {2, 20}}, make_call_counter(calls));
   stmt l = make_loop(c);
   stmt body = make_buf(src, 3, make_buf(dst, 3, l));
 
-  for (auto _ : state) {
-    evaluate(body);
-  }
+  run(state, body, compiled);
 
   state.SetItemsProcessed(calls);
 }
 
-BENCHMARK(BM_crop_buffer)->DenseRange(0, 1);
+BENCHMARK_CAPTURE(BM_crop_buffer, interpreted, false)->DenseRange(0, 1);
+BENCHMARK_CAPTURE(BM_crop_buffer, compiled, true)->DenseRange(0, 1);
 
-void BM_slice_dim(benchmark::State& state) {
+void BM_slice_dim(benchmark::State& state, bool compiled) {
   std::atomic<int> calls = 0;
   stmt c = slice_dim::make(dst, state.range(0) ? src : dst, 1, 10, make_call_counter(calls));
   stmt l = make_loop(c);
   stmt body = make_buf(src, 3, make_buf(dst, 3, l));
 
-  for (auto _ : state) {
-    evaluate(body);
-  }
+  run(state, body, compiled);
 
   state.SetItemsProcessed(calls);
 }
 
-BENCHMARK(BM_slice_dim)->DenseRange(0, 1);
+BENCHMARK_CAPTURE(BM_slice_dim, interpreted, false)->DenseRange(0, 1);
+BENCHMARK_CAPTURE(BM_slice_dim, compiled, true)->DenseRange(0, 1);
 
-void BM_slice_buffer(benchmark::State& state) {
+void BM_slice_buffer(benchmark::State& state, bool compiled) {
   std::atomic<int> calls = 0;
   stmt c = slice_buffer::make(dst, state.range(0) ? src : dst, {10, {}, 20}, make_call_counter(calls));
   stmt l = make_loop(c);
   stmt body = make_buf(src, 3, make_buf(dst, 3, l));
 
-  for (auto _ : state) {
-    evaluate(body);
-  }
+  run(state, body, compiled);
 
   state.SetItemsProcessed(calls);
 }
 
-BENCHMARK(BM_slice_buffer)->DenseRange(0, 1);
+BENCHMARK_CAPTURE(BM_slice_buffer, interpreted, false)->DenseRange(0, 1);
+BENCHMARK_CAPTURE(BM_slice_buffer, compiled, true)->DenseRange(0, 1);
 
-void BM_transpose(benchmark::State& state) {
+void BM_transpose(benchmark::State& state, bool compiled) {
   std::atomic<int> calls = 0;
   stmt c = transpose::make(dst, state.range(0) ? src : dst, {2, 1, 0}, make_call_counter(calls));
   stmt l = make_loop(c);
   stmt body = make_buf(src, 3, make_buf(dst, 3, l));
 
-  for (auto _ : state) {
-    evaluate(body);
-  }
+  run(state, body, compiled);
 
   state.SetItemsProcessed(calls);
 }
 
-BENCHMARK(BM_transpose)->DenseRange(0, 1);
+BENCHMARK_CAPTURE(BM_transpose, interpreted, false)->DenseRange(0, 1);
+BENCHMARK_CAPTURE(BM_transpose, compiled, true)->DenseRange(0, 1);
 
-void BM_allocate(benchmark::State& state) {
+void BM_allocate(benchmark::State& state, bool compiled) {
   std::atomic<int> calls = 0;
   stmt op = allocate::make(buf, memory_type::stack, 1, make_dims(state.range(0)), make_call_counter(calls));
   stmt body = make_loop(op);
 
-  for (auto _ : state) {
-    evaluate(body);
-  }
+  run(state, body, compiled);
 
   state.SetItemsProcessed(calls);
 }
 
-BENCHMARK(BM_allocate)->DenseRange(1, 4);
+BENCHMARK_CAPTURE(BM_allocate, interpreted, false)->DenseRange(1, 4);
+BENCHMARK_CAPTURE(BM_allocate, compiled, true)->DenseRange(1, 4);
 
 enum class dim_type {
   constant,
   expr,
 };
 
-void BM_make_buffer(benchmark::State& state, dim_type kind) {
+void BM_make_buffer(benchmark::State& state, dim_type kind, bool compiled) {
   const int rank = state.range(0);
   std::atomic<int> calls = 0;
   stmt op;
@@ -211,20 +221,23 @@ void BM_make_buffer(benchmark::State& state, dim_type kind) {
   stmt l = make_loop(op);
   stmt body = make_buf(src, rank, l);
 
-  for (auto _ : state) {
-    evaluate(body);
-  }
+  run(state, body, compiled);
 
   state.SetItemsProcessed(calls);
 }
 
-void BM_make_buffer_constant(benchmark::State& state) { BM_make_buffer(state, dim_type::constant); }
-void BM_make_buffer_expr(benchmark::State& state) { BM_make_buffer(state, dim_type::expr); }
+void BM_make_buffer_constant(benchmark::State& state, bool compiled) {
+  BM_make_buffer(state, dim_type::constant, compiled);
+}
+void BM_make_buffer_expr(benchmark::State& state, bool compiled) { BM_make_buffer(state, dim_type::expr, compiled); }
 
-BENCHMARK(BM_make_buffer_constant)->DenseRange(1, 4);
-BENCHMARK(BM_make_buffer_expr)->DenseRange(1, 4);
+BENCHMARK_CAPTURE(BM_make_buffer_constant, interpreted, false)->DenseRange(1, 4);
+BENCHMARK_CAPTURE(BM_make_buffer_constant, compiled, true)->DenseRange(1, 4);
+BENCHMARK_CAPTURE(BM_make_buffer_expr, interpreted, false)->DenseRange(1, 4);
+BENCHMARK_CAPTURE(BM_make_buffer_expr, compiled, true)->DenseRange(1, 4);
 
-void benchmark_parallel_loop(benchmark::State& state, bool synchronize, nanoseconds task_size = nanoseconds{1000}) {
+void benchmark_parallel_loop(
+    benchmark::State& state, bool compiled, bool synchronize, nanoseconds task_size = nanoseconds{1000}) {
   const int workers = state.range(0);
 
   std::atomic<int> calls = 0;
@@ -244,31 +257,36 @@ void benchmark_parallel_loop(benchmark::State& state, bool synchronize, nanoseco
   config.thread_pool = &t;
   eval_ctx.config = &config;
 
-  for (auto _ : state) {
-    evaluate(body, eval_ctx);
-  }
+  run(state, body, compiled, eval_ctx);
 
   state.SetItemsProcessed(calls);
 }
 
-void BM_parallel_loop_10ns(benchmark::State& state) {
-  benchmark_parallel_loop(state, /*synchronize=*/false, nanoseconds{10});
+void BM_parallel_loop_10ns(benchmark::State& state, bool compiled) {
+  benchmark_parallel_loop(state, compiled, /*synchronize=*/false, nanoseconds{10});
+}
+void BM_parallel_loop_100ns(benchmark::State& state, bool compiled) {
+  benchmark_parallel_loop(state, compiled, /*synchronize=*/false, nanoseconds{100});
 }
-void BM_parallel_loop_100ns(benchmark::State& state) {
-  benchmark_parallel_loop(state, /*synchronize=*/false, nanoseconds{100});
+void BM_parallel_loop_1us(benchmark::State& state, bool compiled) {
+  benchmark_parallel_loop(state, compiled, /*synchronize=*/false, nanoseconds{1000});
 }
-void BM_parallel_loop_1us(benchmark::State& state) {
-  benchmark_parallel_loop(state, /*synchronize=*/false, nanoseconds{1000});
+void BM_parallel_loop_10us(benchmark::State& state, bool compiled) {
+  benchmark_parallel_loop(state, compiled, /*synchronize=*/false, nanoseconds{10000});
 }
-void BM_parallel_loop_10us(benchmark::State& state) {
-  benchmark_parallel_loop(state, /*synchronize=*/false, nanoseconds{10000});
+void BM_semaphores(benchmark::State& state, bool compiled) {
+  benchmark_parallel_loop(state, compiled, /*synchronize=*/true);
 }
-void BM_semaphores(benchmark::State& state) { benchmark_parallel_loop(state, /*synchronize=*/true); }
 
-BENCHMARK(BM_parallel_loop_10ns)->RangeMultiplier(2)->Range(1, 16);
-BENCHMARK(BM_parallel_loop_100ns)->RangeMultiplier(2)->Range(1, 16);
-BENCHMARK(BM_parallel_loop_1us)->RangeMultiplier(2)->Range(1, 16);
-BENCHMARK(BM_parallel_loop_10us)->RangeMultiplier(2)->Range(1, 16);
-BENCHMARK(BM_semaphores)->RangeMultiplier(2)->Range(1, 16);
+BENCHMARK_CAPTURE(BM_parallel_loop_10ns, interpreted, false)->RangeMultiplier(2)->Range(1, 16);
+BENCHMARK_CAPTURE(BM_parallel_loop_10ns, compiled, true)->RangeMultiplier(2)->Range(1, 16);
+BENCHMARK_CAPTURE(BM_parallel_loop_100ns, interpreted, false)->RangeMultiplier(2)->Range(1, 16);
+BENCHMARK_CAPTURE(BM_parallel_loop_100ns, compiled, true)->RangeMultiplier(2)->Range(1, 16);
+BENCHMARK_CAPTURE(BM_parallel_loop_1us, interpreted, false)->RangeMultiplier(2)->Range(1, 16);
+BENCHMARK_CAPTURE(BM_parallel_loop_1us, compiled, true)->RangeMultiplier(2)->Range(1, 16);
+BENCHMARK_CAPTURE(BM_parallel_loop_10us, interpreted, false)->RangeMultiplier(2)->Range(1, 16);
+BENCHMARK_CAPTURE(BM_parallel_loop_10us, compiled, true)->RangeMultiplier(2)->Range(1, 16);
+BENCHMARK_CAPTURE(BM_semaphores, interpreted, false)->RangeMultiplier(2)->Range(1, 16);
+BENCHMARK_CAPTURE(BM_semaphores, compiled, true)->RangeMultiplier(2)->Range(1, 16);
 
 }  // namespace slinky
@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "slinky/base/span.h"
+#include "slinky/runtime/buffer.h"
+#include "slinky/runtime/evaluate.h"
+#include "slinky/runtime/expr.h"
+#include "slinky/runtime/pipeline.h"
+#include "slinky/runtime/serialize.h"
+#include "slinky/runtime/stmt.h"
+
+namespace slinky {
+
+namespace {
+
+node_context ctx;
+var x(ctx, "x");
+var y(ctx, "y");
+var in(ctx, "in");
+var out(ctx, "out");
+var c(ctx, "c");
+var intm(ctx, "intm");
+var sliced(ctx, "sliced");
+var task(ctx, "task");
+
+raw_buffer_ptr make_constant() {
+  buffer<int, 1> buf({10});
+  buf.allocate();
+  for_each_element([](int* x) { *x = 3; }, buf);
+  return raw_buffer::make_copy(buf);
+}
+
+// out(x) = in(x) * c(x) + y, computed in a loop over x.
+pipeline make_pipeline() {
+  call_stmt::attributes attrs;
+  attrs.name = "mul_add";
+  stmt body = call_stmt::make(nullptr, {in, c}, {intm}, {y}, attrs);
+  body = crop_dim::make(intm, intm, 0, point(x), body);
+  body = block::make({check::make(buffer_min(in, 0) <= buffer_min(out, 0)), body});
+  body = loop::make(x, loop::serial, buffer_bounds(out, 0), 1, body);
+  body = let_stmt::make(y, buffer_extent(out, 0) / 2, body);
+  body = make_buffer::make(intm, buffer_at(out), buffer_elem_size(out), {buffer_dim(out, 0)}, body);
+  body = constant_buffer::make(c, make_constant(), body);
+
+  pipeline p;
+  p.inputs = {in};
+  p.outputs = {out};
+  p.body = body;
+  p.context_size = task.id + 1;
+  p.heap_high_water = max(buffer_extent(out, 0), 0) * 4;
+  p.heap_high_water_allocations = 1;
+  return p;
+}
+
+index_t mul_add(const call_stmt* op, eval_context& ctx) {
+  const buffer<const int>& a = *ctx.lookup_buffer<const int>(op->inputs[0]);
+  const buffer<const int>& b = *ctx.lookup_buffer<const int>(op->inputs[1]);
+  const buffer<int>& r = *ctx.lookup_buffer<int>(op->outputs[0]);
+  index_t k = evaluate(op->scalars[0], ctx);
+  for_each_element([k](int* r, const int* a, const int* b) { *r = *a * *b + k; }, r, a, b);
+  return 0;
+}
+
+}  // namespace
+
+TEST(serialize, round_trip) {
+  pipeline p = make_pipeline();
+  std::vector<char> data = serialize_pipeline(p);
+  ASSERT_FALSE(data.empty());
+
+  callback_registry callbacks;
+  callbacks.calls["mul_add"] = mul_add;
+  std::optional<pipeline> loaded = deserialize_pipeline(data, callbacks);
+  ASSERT_TRUE(loaded);
+  ASSERT_EQ(loaded->inputs, p.inputs);
+  ASSERT_EQ(loaded->outputs, p.outputs);
+  ASSERT_EQ(loaded->context_size, p.context_size);
+  ASSERT_EQ(loaded->heap_high_water_allocations, p.heap_high_water_allocations);
+  ASSERT_EQ(serialize_pipeline(*loaded), data);
+
+  buffer<int, 1> in_buf({10});
+  buffer<int, 1> out_buf({10});
+  in_buf.allocate();
+  out_buf.allocate();
+  for (int i = 0; i < 10; ++i) {
+    in_buf(i) = i;
+  }
+
+  const raw_buffer* inputs[] = {&in_buf};
+  const raw_buffer* outputs[] = {&out_buf};
+  ASSERT_EQ(loaded->evaluate(inputs, outputs), 0);
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_EQ(out_buf(i), i * 3 + 5);
+  }
+}
+
+TEST(serialize, all_nodes) {
+  // This stmt doesn't make sense to evaluate, it just covers every kind of node.
+  stmt body = copy_stmt::make(nullptr, in, {x, y + 1}, out, {x, y}, var());
+  body = block::make({body, call_stmt::make(nullptr, {}, {out}, {}, {0, 1, "f"})});
+  body = transpose::make(sliced, sliced, {1, 0}, body);
+  body = slice_buffer::make(sliced, sliced, {expr(), x}, body);
+  body = slice_dim::make(sliced, out, 0, select(x < y, x, -y), body);
+  body = crop_buffer::make(intm, intm, {{x, y}, interval_expr()}, body);
+  body = clone_buffer::make(intm, out, body);
+  body = async::make(task, check::make(and_then(x != y, !(x == 0))), body);
+  body = allocate::make(intm, memory_type::heap, 4, {{{0, x % 7}, 4, expr()}}, body);
+  body = let_stmt::make({{x, let::make(y, 3, y - 1)}}, body, true);
+  body = loop::make(y, loop::parallel, {min(x, 0), abs(x) / 2}, 2, body, x + 1);
+
+  pipeline p;
+  p.args = {x};
+  p.outputs = {out};
+  p.body = body;
+
+  std::vector<char> data = serialize_pipeline(p);
+  ASSERT_FALSE(data.empty());
+
+  callback_registry callbacks;
+  callbacks.calls["f"] = mul_add;
+  std::optional<pipeline> loaded = deserialize_pipeline(data, callbacks);
+  ASSERT_TRUE(loaded);
+  ASSERT_EQ(loaded->args, p.args);
+  ASSERT_FALSE(loaded->heap_high_water.defined());
+  ASSERT_EQ(serialize_pipeline(*loaded), data);
+}
+
+TEST(serialize, errors) {
+  pipeline p = make_pipeline();
+  std::vector<char> data = serialize_pipeline(p);
+  ASSERT_FALSE(data.empty());
+
+  // The callback can't be found.
+  ASSERT_FALSE(deserialize_pipeline(data, callback_registry()));
+
+  callback_registry callbacks;
+  callbacks.calls["mul_add"] = mul_add;
+  ASSERT_TRUE(deserialize_pipeline(data, callbacks));
+
+  // Truncated or corrupted data.
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    ASSERT_FALSE(deserialize_pipeline(span<const char>(data.data(), i), callbacks));
+  }
+  std::vector<char> wrong_version = data;
+  wrong_version[4] = serialize_version + 1;
+  ASSERT_FALSE(deserialize_pipeline(wrong_version, callbacks));
+
+  // Enums out of range.
+  p.body = check::make(variable::make(x, static_cast<buffer_field>(100), 0) == 0);
+  data = serialize_pipeline(p);
+  ASSERT_FALSE(data.empty());
+  ASSERT_FALSE(deserialize_pipeline(data, callbacks));
+  p.body = allocate::make(intm, static_cast<memory_type>(3), 4, {}, stmt());
+  data = serialize_pipeline(p);
+  ASSERT_FALSE(data.empty());
+  ASSERT_FALSE(deserialize_pipeline(data, callbacks));
+  p.body = check::make(call::make(static_cast<intrinsic>(100), {}));
+  data = serialize_pipeline(p);
+  ASSERT_FALSE(data.empty());
+  ASSERT_FALSE(deserialize_pipeline(data, callbacks));
+
+  // Calls without names and user defined call exprs can't be serialized.
+  p.body = call_stmt::make(mul_add, {}, {}, {}, {});
+  ASSERT_TRUE(serialize_pipeline(p).empty());
+  p.body = check::make(call::make([](const call*, eval_context&) -> index_t { return 1; }, {}));
+  ASSERT_TRUE(serialize_pipeline(p).empty());
+}
+
+}  // namespace slinky